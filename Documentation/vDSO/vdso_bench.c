@@ -0,0 +1,135 @@
+/*
+ * vdso_bench.c: time vDSO clock_gettime/gettimeofday against the
+ * system calls they replace.
+ *
+ * Subject to the GNU General Public License, version 2
+ *
+ * Build together with parse_vdso.c, e.g. for ARM:
+ * arm-linux-gnueabi-gcc -std=gnu99 -O2 -static
+ *      vdso_bench.c parse_vdso.c -o vdso_bench
+ *
+ * Usage: vdso_bench [iterations]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+
+extern void *vdso_sym(const char *version, const char *name);
+extern void vdso_init_from_auxv(void *auxv);
+
+#ifndef CLOCK_REALTIME_COARSE
+# define CLOCK_REALTIME_COARSE	5
+#endif
+#ifndef CLOCK_MONOTONIC_COARSE
+# define CLOCK_MONOTONIC_COARSE	6
+#endif
+
+typedef int (*cgt_t)(clockid_t clk, struct timespec *ts);
+typedef int (*gtod_t)(struct timeval *tv, struct timezone *tz);
+
+static cgt_t vdso_cgt;
+static gtod_t vdso_gtod;
+
+static const struct {
+	clockid_t id;
+	const char *name;
+} clocks[] = {
+	{ CLOCK_REALTIME,		"CLOCK_REALTIME" },
+	{ CLOCK_MONOTONIC,		"CLOCK_MONOTONIC" },
+	{ CLOCK_REALTIME_COARSE,	"CLOCK_REALTIME_COARSE" },
+	{ CLOCK_MONOTONIC_COARSE,	"CLOCK_MONOTONIC_COARSE" },
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	syscall(__NR_clock_gettime, CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void report(const char *what, const char *path, uint64_t ns,
+		   unsigned long iters)
+{
+	printf("%-24s %-8s %8.1f ns/call\n", what, path, (double)ns / iters);
+}
+
+static void bench_clock(clockid_t id, const char *name, unsigned long iters)
+{
+	struct timespec ts, vts;
+	unsigned long i;
+	uint64_t t0;
+
+	t0 = now_ns();
+	for (i = 0; i < iters; i++)
+		syscall(__NR_clock_gettime, id, &ts);
+	report(name, "syscall", now_ns() - t0, iters);
+
+	if (!vdso_cgt)
+		return;
+
+	t0 = now_ns();
+	for (i = 0; i < iters; i++)
+		vdso_cgt(id, &vts);
+	report(name, "vdso", now_ns() - t0, iters);
+
+	/* the two paths must agree to within the clock's granularity */
+	syscall(__NR_clock_gettime, id, &ts);
+	vdso_cgt(id, &vts);
+	if (vts.tv_sec < ts.tv_sec - 1 || vts.tv_sec > ts.tv_sec + 1)
+		printf("%s: vdso %ld.%09ld syscall %ld.%09ld disagree\n", name,
+		       (long)vts.tv_sec, vts.tv_nsec,
+		       (long)ts.tv_sec, ts.tv_nsec);
+}
+
+static void bench_gtod(unsigned long iters)
+{
+	struct timeval tv;
+	unsigned long i;
+	uint64_t t0;
+
+	t0 = now_ns();
+	for (i = 0; i < iters; i++)
+		syscall(__NR_gettimeofday, &tv, NULL);
+	report("gettimeofday", "syscall", now_ns() - t0, iters);
+
+	if (!vdso_gtod)
+		return;
+
+	t0 = now_ns();
+	for (i = 0; i < iters; i++)
+		vdso_gtod(&tv, NULL);
+	report("gettimeofday", "vdso", now_ns() - t0, iters);
+}
+
+int main(int argc, char **argv, char **envp)
+{
+	unsigned long iters = 1000000;
+	unsigned int i;
+
+	if (argc > 1)
+		iters = strtoul(argv[1], NULL, 0);
+	if (!iters)
+		iters = 1;
+
+	/* auxv follows the environment */
+	while (*envp)
+		envp++;
+	vdso_init_from_auxv(envp + 1);
+
+	vdso_cgt = (cgt_t)vdso_sym("LINUX_2.6", "__vdso_clock_gettime");
+	vdso_gtod = (gtod_t)vdso_sym("LINUX_2.6", "__vdso_gettimeofday");
+	if (!vdso_cgt || !vdso_gtod)
+		printf("no vDSO, timing the system calls only\n");
+
+	for (i = 0; i < sizeof(clocks) / sizeof(clocks[0]); i++)
+		bench_clock(clocks[i].id, clocks[i].name, iters);
+	bench_gtod(iters);
+
+	return 0;
+}
@@ -0,0 +1,55 @@
+/*
+ * NEON bulk copy and clear routines, see arch/arm/lib/neon-copy.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ASM_ARM_NEON_COPY_H
+#define __ASM_ARM_NEON_COPY_H
+
+/*
+ * memcpy and copy_{to,from}_user branch to the NEON dispatch for
+ * copies of at least NEON_COPY_MIN bytes (an ARM immediate); the NEON
+ * loops move NEON_COPY_BLOCK bytes per iteration.
+ */
+#define NEON_COPY_MIN		1024
+#define NEON_COPY_BLOCK		64
+
+#ifdef __ASSEMBLY__
+
+/*
+ * Start of a scalar copy routine taking the length in r2: large copies
+ * go to the NEON dispatch \large, the rest fall through to \scalar.
+ */
+	.macro	neon_copy_dispatch, large, scalar
+	cmp	r2, #NEON_COPY_MIN
+	blo	\scalar
+	b	\large
+	.endm
+
+#else
+
+#include <linux/types.h>
+#include <linux/compiler.h>
+
+/* the scalar routines, entered past the NEON size check */
+extern void *__memcpy_arm(void *dst, const void *src, size_t n);
+extern void __copy_page_arm(void *to, const void *from);
+extern unsigned long __copy_from_user_arm(void *to,
+		const void __user *from, unsigned long n);
+extern unsigned long __copy_to_user_arm(void __user *to,
+		const void *from, unsigned long n);
+
+/* NEON loops, n a multiple of NEON_COPY_BLOCK; call with NEON claimed */
+extern void __memcpy_neon(void *dst, const void *src, size_t n);
+extern void __copy_page_neon(void *to, const void *from);
+extern void __clear_page_neon(void *page);
+extern unsigned long __copy_from_user_neon(void *to,
+		const void __user *from, unsigned long n);
+extern unsigned long __copy_to_user_neon(void __user *to,
+		const void *from, unsigned long n);
+
+#endif /* __ASSEMBLY__ */
+
+#endif /* __ASM_ARM_NEON_COPY_H */
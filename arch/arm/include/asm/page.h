@@ -131,7 +131,11 @@ extern void __cpu_copy_user_highpage(struct page *to, struct page *from,
 #define copy_user_highpage(to,from,vaddr,vma)	\
 	__cpu_copy_user_highpage(to, from, vaddr, vma)
 
+#ifdef CONFIG_ARM_NEON_COPY
+extern void clear_page(void *page);
+#else
 #define clear_page(page)	memset((void *)(page), 0, PAGE_SIZE)
+#endif
 extern void copy_page(void *to, const void *from);
 
 #define __HAVE_ARCH_GATE_AREA 1
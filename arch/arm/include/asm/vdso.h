@@ -0,0 +1,17 @@
+#ifndef __ASM_VDSO_H
+#define __ASM_VDSO_H
+
+#ifdef __KERNEL__
+
+/* the data page sits right below the text, see arch/arm/vdso/datapage.S */
+#define VDSO_DATA_SIZE		PAGE_SIZE
+
+#ifndef __ASSEMBLY__
+
+extern char vdso_start, vdso_end;
+
+#endif /* !__ASSEMBLY__ */
+
+#endif /* __KERNEL__ */
+
+#endif /* __ASM_VDSO_H */
@@ -0,0 +1,40 @@
+/*
+ * ARM vDSO data page
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ASM_VDSO_DATAPAGE_H
+#define __ASM_VDSO_DATAPAGE_H
+
+#ifdef __KERNEL__
+
+#ifndef __ASSEMBLY__
+
+#include <asm/page.h>
+
+/*
+ * Timekeeping state shared with the vDSO, one page mapped read-only
+ * just below the vDSO text.  seq_count is odd while the kernel is
+ * updating it; readers retry until they see the same even count on
+ * both sides of their read.
+ */
+struct vdso_data {
+	u32 seq_count;
+	u32 xtime_coarse_sec;	/* CLOCK_REALTIME at the last tick */
+	u32 xtime_coarse_nsec;
+	u32 wtm_clock_sec;	/* wall to monotonic offset */
+	u32 wtm_clock_nsec;
+};
+
+union vdso_data_store {
+	struct vdso_data data;
+	u8 page[PAGE_SIZE];
+};
+
+#endif /* !__ASSEMBLY__ */
+
+#endif /* __KERNEL__ */
+
+#endif /* __ASM_VDSO_DATAPAGE_H */
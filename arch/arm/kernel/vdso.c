@@ -0,0 +1,127 @@
+/*
+ * ARM vDSO: maps the vDSO image and its data page into each process
+ * and keeps the data page in step with the timekeeping core.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/clocksource.h>
+#include <linux/elf.h>
+#include <linux/err.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/time.h>
+
+#include <asm/barrier.h>
+#include <asm/cacheflush.h>
+#include <asm/page.h>
+#include <asm/vdso.h>
+#include <asm/vdso_datapage.h>
+
+static union vdso_data_store vdso_data_store __page_aligned_data;
+static struct vdso_data *vdso_data = &vdso_data_store.data;
+
+/* data page followed by the text pages */
+static struct page **vdso_pagelist;
+static unsigned int vdso_pages;
+
+static int __init vdso_init(void)
+{
+	unsigned int text_pages;
+	int i;
+
+	if (memcmp(&vdso_start, ELFMAG, SELFMAG)) {
+		pr_err("vDSO is not a valid ELF object!\n");
+		return -ENOEXEC;
+	}
+
+	text_pages = (&vdso_end - &vdso_start) >> PAGE_SHIFT;
+	vdso_pages = text_pages + 1;
+
+	vdso_pagelist = kcalloc(vdso_pages, sizeof(struct page *), GFP_KERNEL);
+	if (!vdso_pagelist)
+		return -ENOMEM;
+
+	vdso_pagelist[0] = virt_to_page(vdso_data);
+	for (i = 0; i < text_pages; i++)
+		vdso_pagelist[i + 1] = virt_to_page(&vdso_start + i * PAGE_SIZE);
+
+	pr_info("vdso: %u text pages at %p, data page at %p\n",
+		text_pages, &vdso_start, vdso_data);
+
+	return 0;
+}
+arch_initcall(vdso_init);
+
+int arch_setup_additional_pages(struct linux_binprm *bprm, int uses_interp)
+{
+	struct mm_struct *mm = current->mm;
+	unsigned long len = vdso_pages << PAGE_SHIFT;
+	unsigned long addr;
+	int ret;
+
+	if (!vdso_pagelist)
+		return 0;
+
+	down_write(&mm->mmap_sem);
+
+	addr = get_unmapped_area(NULL, 0, len, 0, 0);
+	if (IS_ERR_VALUE(addr)) {
+		ret = addr;
+		goto up_fail;
+	}
+
+	/*
+	 * VM_MAYWRITE lets debuggers place breakpoints in the text, the
+	 * pages are COWed; the data page itself is never writable.
+	 */
+	ret = install_special_mapping(mm, addr, len,
+				      VM_READ | VM_EXEC |
+				      VM_MAYREAD | VM_MAYWRITE | VM_MAYEXEC,
+				      vdso_pagelist);
+	if (ret)
+		goto up_fail;
+
+	mm->context.vdso = addr;
+
+up_fail:
+	up_write(&mm->mmap_sem);
+	return ret;
+}
+
+static inline void vdso_write_begin(struct vdso_data *vdata)
+{
+	++vdata->seq_count;
+	smp_wmb();
+}
+
+static inline void vdso_write_end(struct vdso_data *vdata)
+{
+	smp_wmb();
+	++vdata->seq_count;
+}
+
+/* called from timekeeping with the timekeeper lock held for write */
+void update_vsyscall(struct timespec *ts, struct timespec *wtm,
+		     struct clocksource *c, u32 mult)
+{
+	vdso_write_begin(vdso_data);
+
+	vdso_data->xtime_coarse_sec	= ts->tv_sec;
+	vdso_data->xtime_coarse_nsec	= ts->tv_nsec;
+	vdso_data->wtm_clock_sec	= wtm->tv_sec;
+	vdso_data->wtm_clock_nsec	= wtm->tv_nsec;
+
+	vdso_write_end(vdso_data);
+
+	flush_dcache_page(virt_to_page(vdso_data));
+}
+
+void update_vsyscall_tz(void)
+{
+	/* gettimeofday() always takes the system call */
+}
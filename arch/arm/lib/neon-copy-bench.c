@@ -0,0 +1,198 @@
+/*
+ * NEON memory copy benchmark
+ *
+ * Times the scalar and NEON routines behind memcpy, copy_page,
+ * clear_page and the user copies, NEON including the cost of claiming
+ * it per call.  Results go to the kernel log on module load.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/gfp.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+
+#include <asm/neon.h>
+#include <asm/neon-copy.h>
+#include <asm/page.h>
+
+#define BENCH_ORDER	4
+#define BENCH_MAX	(PAGE_SIZE << BENCH_ORDER)
+
+static unsigned int total_kb = 65536;
+module_param(total_kb, uint, 0444);
+MODULE_PARM_DESC(total_kb, "KB moved per measurement");
+
+static const unsigned int sizes[] = { 256, 1024, 4096, 16384, BENCH_MAX };
+
+enum bench_op {
+	BENCH_MEMCPY,
+	BENCH_FROM_USER,
+	BENCH_TO_USER,
+	BENCH_COPY_PAGE,
+	BENCH_CLEAR_PAGE,
+};
+
+static const char *bench_names[] = {
+	[BENCH_MEMCPY]		= "memcpy",
+	[BENCH_FROM_USER]	= "copy_from_user",
+	[BENCH_TO_USER]		= "copy_to_user",
+	[BENCH_COPY_PAGE]	= "copy_page",
+	[BENCH_CLEAR_PAGE]	= "clear_page",
+};
+
+static void bench_scalar(enum bench_op op, void *dst, void *src, size_t n)
+{
+	switch (op) {
+	case BENCH_MEMCPY:
+		__memcpy_arm(dst, src, n);
+		break;
+	case BENCH_FROM_USER:
+		if (__copy_from_user_arm(dst, (void __user *)src, n))
+			pr_warn("neon_copy_bench: short scalar copy\n");
+		break;
+	case BENCH_TO_USER:
+		if (__copy_to_user_arm((void __user *)dst, src, n))
+			pr_warn("neon_copy_bench: short scalar copy\n");
+		break;
+	case BENCH_COPY_PAGE:
+#ifdef CONFIG_HAS_MACH_MEMUTILS
+		__memcpy_arm(dst, src, PAGE_SIZE);
+#else
+		__copy_page_arm(dst, src);
+#endif
+		break;
+	case BENCH_CLEAR_PAGE:
+		memset(dst, 0, PAGE_SIZE);
+		break;
+	}
+}
+
+static void bench_neon(enum bench_op op, void *dst, void *src, size_t n)
+{
+	unsigned long left = 0;
+
+	if (op == BENCH_FROM_USER || op == BENCH_TO_USER)
+		pagefault_disable();
+	kernel_neon_begin();
+
+	switch (op) {
+	case BENCH_MEMCPY:
+		__memcpy_neon(dst, src, n);
+		break;
+	case BENCH_FROM_USER:
+		left = __copy_from_user_neon(dst, (void __user *)src, n);
+		break;
+	case BENCH_TO_USER:
+		left = __copy_to_user_neon((void __user *)dst, src, n);
+		break;
+	case BENCH_COPY_PAGE:
+		__copy_page_neon(dst, src);
+		break;
+	case BENCH_CLEAR_PAGE:
+		__clear_page_neon(dst);
+		break;
+	}
+
+	kernel_neon_end();
+	if (op == BENCH_FROM_USER || op == BENCH_TO_USER)
+		pagefault_enable();
+
+	if (left)
+		pr_warn("neon_copy_bench: short NEON copy\n");
+}
+
+/* MB/s for n bytes moved iters times */
+static unsigned long bench_run(enum bench_op op, bool neon, void *dst,
+			       void *src, size_t n, unsigned int iters)
+{
+	ktime_t start;
+	s64 ns;
+	unsigned int i;
+
+	start = ktime_get();
+	for (i = 0; i < iters; i++) {
+		if (neon)
+			bench_neon(op, dst, src, n);
+		else
+			bench_scalar(op, dst, src, n);
+	}
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	return div64_u64((u64)n * iters * 1000, ns ? ns : 1);
+}
+
+static void bench_op(enum bench_op op, void *dst, void *src, size_t n)
+{
+	unsigned int iters = max_t(unsigned int,
+				   div_u64((u64)total_kb << 10, n), 1);
+	unsigned long scalar, neon;
+
+	/* warm the caches and TLBs for both */
+	bench_scalar(op, dst, src, n);
+	bench_neon(op, dst, src, n);
+
+	scalar = bench_run(op, false, dst, src, n, iters);
+	neon = bench_run(op, true, dst, src, n, iters);
+
+	pr_info("neon_copy_bench: %-14s %6zu bytes: arm %5lu MB/s, neon %5lu MB/s\n",
+		bench_names[op], n, scalar, neon);
+}
+
+static int __init neon_copy_bench_init(void)
+{
+	unsigned long src, dst;
+	mm_segment_t fs;
+	int i;
+
+	if (!cpu_has_neon())
+		return -ENODEV;
+
+	src = __get_free_pages(GFP_KERNEL, BENCH_ORDER);
+	dst = __get_free_pages(GFP_KERNEL, BENCH_ORDER);
+	if (!src || !dst) {
+		free_pages(src, BENCH_ORDER);
+		free_pages(dst, BENCH_ORDER);
+		return -ENOMEM;
+	}
+	memset((void *)src, 0x5a, BENCH_MAX);
+
+	for (i = 0; i < ARRAY_SIZE(sizes); i++)
+		bench_op(BENCH_MEMCPY, (void *)dst, (void *)src, sizes[i]);
+	if (memcmp((void *)dst, (void *)src, BENCH_MAX))
+		pr_err("neon_copy_bench: memcpy mismatch\n");
+
+	/* the user copies run on kernel buffers */
+	fs = get_fs();
+	set_fs(KERNEL_DS);
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		bench_op(BENCH_FROM_USER, (void *)dst, (void *)src, sizes[i]);
+		bench_op(BENCH_TO_USER, (void *)dst, (void *)src, sizes[i]);
+	}
+	set_fs(fs);
+
+	bench_op(BENCH_COPY_PAGE, (void *)dst, (void *)src, PAGE_SIZE);
+	bench_op(BENCH_CLEAR_PAGE, (void *)dst, NULL, PAGE_SIZE);
+
+	if (memchr_inv((void *)dst, 0, PAGE_SIZE))
+		pr_err("neon_copy_bench: clear_page left data behind\n");
+
+	free_pages(src, BENCH_ORDER);
+	free_pages(dst, BENCH_ORDER);
+	return 0;
+}
+
+static void __exit neon_copy_bench_exit(void)
+{
+}
+
+module_init(neon_copy_bench_init);
+module_exit(neon_copy_bench_exit);
+
+MODULE_DESCRIPTION("NEON memory copy benchmark");
+MODULE_LICENSE("GPL v2");
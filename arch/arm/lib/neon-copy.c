@@ -0,0 +1,192 @@
+/*
+ *  linux/arch/arm/lib/neon-copy.c
+ *
+ *  NEON dispatch for the bulk paths of memcpy, copy_{to,from}_user,
+ *  copy_page and clear_page.  The scalar entry points branch here for
+ *  copies of NEON_COPY_MIN bytes or more; below the threshold, from
+ *  interrupt context or inside another kernel mode NEON section the
+ *  scalar routine does the work.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/init.h>
+#include <linux/jump_label.h>
+#include <linux/module.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+
+#include <asm/neon.h>
+#include <asm/neon-copy.h>
+#include <asm/page.h>
+
+/* enabled once NEON has been probed, see neon_copy_init() */
+static struct static_key neon_copy_key = STATIC_KEY_INIT_FALSE;
+
+/*
+ * Smallest copy worth claiming NEON for.  Values below NEON_COPY_MIN
+ * act as NEON_COPY_MIN, 0 turns the NEON paths off.
+ */
+static unsigned int threshold = NEON_COPY_MIN;
+module_param(threshold, uint, 0644);
+MODULE_PARM_DESC(threshold, "smallest copy done with NEON, 0 disables");
+
+static inline bool neon_copy_ok(unsigned long n)
+{
+	unsigned int min = ACCESS_ONCE(threshold);
+
+	return static_key_false(&neon_copy_key) && min && n >= min &&
+	       kernel_neon_usable();
+}
+
+/*
+ * NEON is claimed for at most NEON_COPY_CHUNK bytes at a time, so a
+ * large copy does not hold preemption off for its whole length: the
+ * kernel_neon_end() between chunks is a preemption point.
+ */
+#define NEON_COPY_CHUNK		PAGE_SIZE
+
+void *__memcpy_large(void *dst, const void *src, size_t n)
+{
+	size_t bulk = n & ~(NEON_COPY_BLOCK - 1);
+	size_t done, len;
+
+	if (!neon_copy_ok(n))
+		return __memcpy_arm(dst, src, n);
+
+	for (done = 0; done < bulk; done += len) {
+		len = min_t(size_t, bulk - done, NEON_COPY_CHUNK);
+		kernel_neon_begin();
+		__memcpy_neon(dst + done, src + done, len);
+		kernel_neon_end();
+	}
+
+	if (bulk != n)
+		__memcpy_arm(dst + bulk, src + bulk, n - bulk);
+	return dst;
+}
+
+/*
+ * The NEON user copies run with page faults disabled.  A chunk that
+ * faults is finished on the scalar path, where the fault is serviced,
+ * and the next chunk goes back to NEON.  Like the scalar routines,
+ * copy_from_user leaves every byte it could not copy zeroed.
+ */
+unsigned long __copy_from_user_large(void *to, const void __user *from,
+				     unsigned long n)
+{
+	unsigned long bulk = n & ~(NEON_COPY_BLOCK - 1);
+	unsigned long done, len, left;
+
+	if (!neon_copy_ok(n))
+		return __copy_from_user_arm(to, from, n);
+
+	for (done = 0; done < bulk; done += len) {
+		len = min_t(unsigned long, bulk - done, NEON_COPY_CHUNK);
+
+		pagefault_disable();
+		kernel_neon_begin();
+		left = __copy_from_user_neon(to + done, from + done, len);
+		kernel_neon_end();
+		pagefault_enable();
+
+		if (left) {
+			left = __copy_from_user_arm(to + done + len - left,
+						    from + done + len - left,
+						    left);
+			if (left) {
+				memset(to + done + len, 0, n - done - len);
+				return n - done - len + left;
+			}
+		}
+	}
+
+	if (bulk != n)
+		return __copy_from_user_arm(to + bulk, from + bulk, n - bulk);
+	return 0;
+}
+
+unsigned long __copy_to_user_large(void __user *to, const void *from,
+				   unsigned long n)
+{
+	unsigned long bulk = n & ~(NEON_COPY_BLOCK - 1);
+	unsigned long done, len, left;
+
+	if (!neon_copy_ok(n))
+		return __copy_to_user_arm(to, from, n);
+
+	for (done = 0; done < bulk; done += len) {
+		len = min_t(unsigned long, bulk - done, NEON_COPY_CHUNK);
+
+		pagefault_disable();
+		kernel_neon_begin();
+		left = __copy_to_user_neon(to + done, from + done, len);
+		kernel_neon_end();
+		pagefault_enable();
+
+		if (left) {
+			left = __copy_to_user_arm(to + done + len - left,
+						  from + done + len - left,
+						  left);
+			if (left)
+				return n - done - len + left;
+		}
+	}
+
+	if (bulk != n)
+		return __copy_to_user_arm(to + bulk, from + bulk, n - bulk);
+	return 0;
+}
+
+#ifndef CONFIG_HAS_MACH_MEMUTILS
+/* the mach memutils copy_page is a memcpy and dispatches through it */
+void copy_page(void *to, const void *from)
+{
+	if (!neon_copy_ok(PAGE_SIZE)) {
+		__copy_page_arm(to, from);
+		return;
+	}
+
+	kernel_neon_begin();
+	__copy_page_neon(to, from);
+	kernel_neon_end();
+}
+#endif
+
+void clear_page(void *page)
+{
+	if (!neon_copy_ok(PAGE_SIZE)) {
+		memset(page, 0, PAGE_SIZE);
+		return;
+	}
+
+	kernel_neon_begin();
+	__clear_page_neon(page);
+	kernel_neon_end();
+}
+EXPORT_SYMBOL(clear_page);
+
+/* for the benchmark module */
+EXPORT_SYMBOL_GPL(__memcpy_arm);
+EXPORT_SYMBOL_GPL(__memcpy_neon);
+EXPORT_SYMBOL_GPL(__copy_page_neon);
+EXPORT_SYMBOL_GPL(__clear_page_neon);
+EXPORT_SYMBOL_GPL(__copy_from_user_arm);
+EXPORT_SYMBOL_GPL(__copy_from_user_neon);
+EXPORT_SYMBOL_GPL(__copy_to_user_arm);
+EXPORT_SYMBOL_GPL(__copy_to_user_neon);
+#ifndef CONFIG_HAS_MACH_MEMUTILS
+EXPORT_SYMBOL_GPL(__copy_page_arm);
+#endif
+
+static int __init neon_copy_init(void)
+{
+	if (!cpu_has_neon())
+		return 0;
+
+	static_key_slow_inc(&neon_copy_key);
+	pr_info("NEON memory copy enabled for %u bytes and up\n", threshold);
+	return 0;
+}
+late_initcall(neon_copy_init);
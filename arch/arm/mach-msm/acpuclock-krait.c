@@ -22,6 +22,7 @@
 #include <linux/cpufreq.h>
 #include <linux/cpu.h>
 #include <linux/regulator/consumer.h>
+#include <linux/input_boost.h>
 
 #include <asm/mach-types.h>
 #include <asm/cpu.h>
@@ -197,12 +198,16 @@ static unsigned int compute_l2_level(struct scalable *sc, unsigned int vote_l)
 	return new_l;
 }
 
+/* bandwidth vote of the L2 level and the floor held by an input boost */
+static unsigned int bus_bw_cur, bus_bw_boost;
+
 static void set_bus_bw(unsigned int bw)
 {
 	int ret;
 
-	
-	ret = msm_bus_scale_client_update_request(drv.bus_perf_client, bw);
+	bus_bw_cur = bw;
+	ret = msm_bus_scale_client_update_request(drv.bus_perf_client,
+						  max(bw, bus_bw_boost));
 	if (ret)
 		dev_err(drv.dev, "bandwidth request failed (%d)\n", ret);
 }
@@ -884,12 +889,39 @@ static void __init bus_init(const struct l2_level *l2_level)
 		BUG();
 	}
 
+	bus_bw_cur = l2_level->bw_level;
 	ret = msm_bus_scale_client_update_request(drv.bus_perf_client,
 			l2_level->bw_level);
 	if (ret)
 		dev_err(drv.dev, "initial bandwidth req failed (%d)\n", ret);
 }
 
+/* Vote the highest L2 bandwidth level while an input boost asks for it */
+static int acpuclk_input_boost(struct notifier_block *nb, unsigned long val,
+			       void *data)
+{
+	struct input_boost_event *ev = data;
+	const struct l2_level *l;
+	unsigned int bw = 0;
+
+	if (ev->bus)
+		for (l = drv.l2_freq_tbl; l->speed.khz != 0; l++)
+			bw = max(bw, l->bw_level);
+
+	mutex_lock(&driver_lock);
+	if (bw != bus_bw_boost) {
+		bus_bw_boost = bw;
+		set_bus_bw(bus_bw_cur);
+	}
+	mutex_unlock(&driver_lock);
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block acpuclk_input_boost_nb = {
+	.notifier_call = acpuclk_input_boost,
+};
+
 #ifdef CONFIG_CPU_VOLTAGE_TABLE
 
 #define HFPLL_MIN_VDD		 800000
@@ -1202,6 +1234,7 @@ int __init acpuclk_krait_init(struct device *dev,
 	dcvs_freq_init();
 	acpuclk_register(&acpuclk_krait_data);
 	register_hotcpu_notifier(&acpuclk_cpu_notifier);
+	input_boost_register_notifier(&acpuclk_input_boost_nb);
 
 	acpuclk_krait_debug_init(&drv);
 
@@ -15,6 +15,7 @@
 #define DEBUG
 
 #include <linux/delay.h>
+#include <linux/hrtimer.h>
 #include <linux/module.h>
 #include <linux/netdevice.h>
 #include <linux/platform_device.h>
@@ -178,6 +179,20 @@ struct rx_pkt_info {
 #define A2_PHYS_SIZE		0x2000
 #define BUFFER_SIZE		2048
 #define NUM_BUFFERS		32
+#define MAX_NUM_BUFFERS		128
+#define RX_COPYBREAK		256
+#define BAM_NAPI_WEIGHT		64
+
+/*
+ * rx_ring_depth: buffers kept posted to the A2 rx pipe, bounded by the
+ * descriptor FIFO.  rx_copybreak: data packets up to this size are copied
+ * into a right-sized skb and their mapped buffer is handed straight back
+ * to the hardware; larger packets are passed up without a copy.
+ */
+static int rx_ring_depth = NUM_BUFFERS;
+module_param(rx_ring_depth, int, S_IRUGO | S_IWUSR | S_IWGRP);
+static int rx_copybreak = RX_COPYBREAK;
+module_param(rx_copybreak, int, S_IRUGO | S_IWUSR | S_IWGRP);
 
 #ifndef A2_BAM_IRQ
 #define A2_BAM_IRQ -1
@@ -202,10 +217,18 @@ static int bam_mux_initialized;
 
 static int polling_mode;
 static unsigned long rx_timer_interval;
+static int rx_inactive_polls;
+static atomic_t rx_cmd_pending = ATOMIC_INIT(0);
+static struct net_device bam_napi_dev;
+static struct napi_struct bam_napi;
+static DEFINE_MUTEX(bam_napi_lock);
+static int bam_napi_enabled;
+static struct hrtimer rx_poll_timer;
 
 static LIST_HEAD(bam_rx_pool);
-static DEFINE_MUTEX(bam_rx_pool_mutexlock);
+static DEFINE_SPINLOCK(bam_rx_pool_spinlock);
 static int bam_rx_pool_len;
+static uint32_t bam_rx_recycle_cnt;
 static LIST_HEAD(bam_tx_pool);
 static DEFINE_SPINLOCK(bam_tx_pool_spinlock);
 static DEFINE_MUTEX(bam_pdev_mutexlock);
@@ -222,10 +245,10 @@ struct bam_mux_hdr {
 static void notify_all(int event, unsigned long data);
 static void bam_mux_write_done(struct work_struct *work);
 static void handle_bam_mux_cmd(struct work_struct *work);
-static void rx_timer_work_func(struct work_struct *work);
+static void rx_irq_mode_work_func(struct work_struct *work);
 static void queue_rx_work_func(struct work_struct *work);
 
-static DECLARE_WORK(rx_timer_work, rx_timer_work_func);
+static DECLARE_WORK(rx_irq_mode_work, rx_irq_mode_work_func);
 static DECLARE_WORK(queue_rx_work, queue_rx_work_func);
 
 static struct workqueue_struct *bam_mux_rx_workqueue;
@@ -402,6 +425,24 @@ static inline void verify_tx_queue_is_empty(const char *func)
 	spin_unlock_irqrestore(&bam_tx_pool_spinlock, flags);
 }
 
+static int bam_rx_ring_depth(void)
+{
+	int depth = rx_ring_depth;
+
+	if (depth < 1)
+		return 1;
+	if (depth > MAX_NUM_BUFFERS)
+		return MAX_NUM_BUFFERS;
+	return depth;
+}
+
+static void bam_rx_free(struct rx_pkt_info *info)
+{
+	dma_unmap_single(NULL, info->dma_address, BUFFER_SIZE, DMA_FROM_DEVICE);
+	dev_kfree_skb_any(info->skb);
+	kfree(info);
+}
+
 static void __queue_rx(gfp_t alloc_flags)
 {
 	void *ptr;
@@ -409,11 +450,12 @@ static void __queue_rx(gfp_t alloc_flags)
 	int ret;
 	int rx_len_cached;
 
-	mutex_lock(&bam_rx_pool_mutexlock);
+	spin_lock_bh(&bam_rx_pool_spinlock);
 	rx_len_cached = bam_rx_pool_len;
-	mutex_unlock(&bam_rx_pool_mutexlock);
+	spin_unlock_bh(&bam_rx_pool_spinlock);
 
-	while (bam_connection_is_active && rx_len_cached < NUM_BUFFERS) {
+	while (bam_connection_is_active &&
+			rx_len_cached < bam_rx_ring_depth()) {
 		if (in_global_reset) {
 			DBG("%s: in_global_reset\n", __func__);
 			goto fail;
@@ -448,7 +490,7 @@ static void __queue_rx(gfp_t alloc_flags)
 			goto fail_skb;
 		}
 
-		mutex_lock(&bam_rx_pool_mutexlock);
+		spin_lock_bh(&bam_rx_pool_spinlock);
 		list_add_tail(&info->list_node, &bam_rx_pool);
 		rx_len_cached = ++bam_rx_pool_len;
 		ret = sps_transfer_one(bam_rx_pipe, info->dma_address,
@@ -457,7 +499,7 @@ static void __queue_rx(gfp_t alloc_flags)
 		if (ret) {
 			list_del(&info->list_node);
 			rx_len_cached = --bam_rx_pool_len;
-			mutex_unlock(&bam_rx_pool_mutexlock);
+			spin_unlock_bh(&bam_rx_pool_spinlock);
 			DMUX_LOG_KERR("%s: sps_transfer_one failed %d\n",
 				__func__, ret);
 
@@ -466,7 +508,7 @@ static void __queue_rx(gfp_t alloc_flags)
 
 			goto fail_skb;
 		}
-		mutex_unlock(&bam_rx_pool_mutexlock);
+		spin_unlock_bh(&bam_rx_pool_spinlock);
 
 	}
 	return;
@@ -504,32 +546,86 @@ static void queue_rx_work_func(struct work_struct *work)
 	__queue_rx(GFP_KERNEL);
 }
 
-static void bam_mux_process_data(struct sk_buff *rx_skb)
+/*
+ * Give a consumed buffer back to the hardware without unmapping it.  The
+ * skb still spans the whole buffer since only its contents were read.
+ */
+static void bam_rx_recycle(struct rx_pkt_info *info)
+{
+	int ret;
+
+	spin_lock_bh(&bam_rx_pool_spinlock);
+	if (!bam_connection_is_active || in_global_reset ||
+			bam_rx_pool_len >= bam_rx_ring_depth()) {
+		spin_unlock_bh(&bam_rx_pool_spinlock);
+		bam_rx_free(info);
+		return;
+	}
+
+	dma_sync_single_for_device(NULL, info->dma_address, BUFFER_SIZE,
+					DMA_FROM_DEVICE);
+	list_add_tail(&info->list_node, &bam_rx_pool);
+	++bam_rx_pool_len;
+	ret = sps_transfer_one(bam_rx_pipe, info->dma_address, BUFFER_SIZE,
+			info, SPS_IOVEC_FLAG_INT | SPS_IOVEC_FLAG_EOT);
+	if (ret) {
+		list_del(&info->list_node);
+		--bam_rx_pool_len;
+		spin_unlock_bh(&bam_rx_pool_spinlock);
+		DMUX_LOG_KERR("%s: sps_transfer_one failed %d\n",
+			__func__, ret);
+		bam_rx_free(info);
+		queue_rx();
+		return;
+	}
+	++bam_rx_recycle_cnt;
+	spin_unlock_bh(&bam_rx_pool_spinlock);
+}
+
+static void bam_mux_process_data(struct rx_pkt_info *info)
 {
 	unsigned long flags;
 	struct bam_mux_hdr *rx_hdr;
+	struct sk_buff *rx_skb;
 	unsigned long event_data;
+	uint8_t ch_id;
+	uint16_t pkt_len;
 	DBG("%s: entry\n", __func__);
 
-	rx_hdr = (struct bam_mux_hdr *)rx_skb->data;
+	rx_hdr = (struct bam_mux_hdr *)info->skb->data;
+	ch_id = rx_hdr->ch_id;
+	pkt_len = rx_hdr->pkt_len;
+
+	rx_skb = NULL;
+	if (pkt_len <= rx_copybreak)
+		rx_skb = __dev_alloc_skb(pkt_len, GFP_ATOMIC | __GFP_NOWARN);
 
-	rx_skb->data = (unsigned char *)(rx_hdr + 1);
-	rx_skb->tail = rx_skb->data + rx_hdr->pkt_len;
-	rx_skb->len = rx_hdr->pkt_len;
-	rx_skb->truesize = rx_hdr->pkt_len + sizeof(struct sk_buff);
+	if (rx_skb) {
+		memcpy(skb_put(rx_skb, pkt_len), rx_hdr + 1, pkt_len);
+		bam_rx_recycle(info);
+	} else {
+		rx_skb = info->skb;
+		dma_unmap_single(NULL, info->dma_address, BUFFER_SIZE,
+					DMA_FROM_DEVICE);
+		kfree(info);
+
+		rx_skb->data = (unsigned char *)(rx_hdr + 1);
+		rx_skb->tail = rx_skb->data + pkt_len;
+		rx_skb->len = pkt_len;
+		rx_skb->truesize = pkt_len + sizeof(struct sk_buff);
+		queue_rx();
+	}
 
 	event_data = (unsigned long)(rx_skb);
 
-	spin_lock_irqsave(&bam_ch[rx_hdr->ch_id].lock, flags);
-	if (bam_ch[rx_hdr->ch_id].notify)
-		bam_ch[rx_hdr->ch_id].notify(
-			bam_ch[rx_hdr->ch_id].priv, BAM_DMUX_RECEIVE,
+	spin_lock_irqsave(&bam_ch[ch_id].lock, flags);
+	if (bam_ch[ch_id].notify)
+		bam_ch[ch_id].notify(bam_ch[ch_id].priv, BAM_DMUX_RECEIVE,
 							event_data);
 	else
 		dev_kfree_skb_any(rx_skb);
-	spin_unlock_irqrestore(&bam_ch[rx_hdr->ch_id].lock, flags);
+	spin_unlock_irqrestore(&bam_ch[ch_id].lock, flags);
 
-	queue_rx();
 	DBG("%s: exit\n", __func__);
 }
 
@@ -543,7 +639,6 @@ static inline void handle_bam_mux_cmd_open(struct bam_mux_hdr *rx_hdr)
 		bam_dmux_log("%s: open cid %d aborted due to ssr\n",
 				__func__, rx_hdr->ch_id);
 		mutex_unlock(&bam_pdev_mutexlock);
-		queue_rx();
 		return;
 	}
 	spin_lock_irqsave(&bam_ch[rx_hdr->ch_id].lock, flags);
@@ -555,54 +650,35 @@ static inline void handle_bam_mux_cmd_open(struct bam_mux_hdr *rx_hdr)
 		pr_err(MODULE_NAME "%s: platform_device_add() error: %d\n",
 				__func__, ret);
 	mutex_unlock(&bam_pdev_mutexlock);
-	queue_rx();
 }
 
+/*
+ * napi_schedule() only raises NET_RX_SOFTIRQ; from process context that
+ * needs a bh section around it or the softirq may not run until the next
+ * interrupt.
+ */
+static void bam_rx_napi_kick(void)
+{
+	local_bh_disable();
+	napi_schedule(&bam_napi);
+	local_bh_enable();
+}
+
+/*
+ * Control commands need process context, so they are run from the rx
+ * workqueue and the poll loop is parked until they complete to keep the
+ * command and data streams in order.
+ */
 static void handle_bam_mux_cmd(struct work_struct *work)
 {
 	unsigned long flags;
 	struct bam_mux_hdr *rx_hdr;
 	struct rx_pkt_info *info;
-	struct sk_buff *rx_skb;
 
 	info = container_of(work, struct rx_pkt_info, work);
-	rx_skb = info->skb;
-	dma_unmap_single(NULL, info->dma_address, BUFFER_SIZE, DMA_FROM_DEVICE);
-	kfree(info);
-
-	rx_hdr = (struct bam_mux_hdr *)rx_skb->data;
-
-	
-	DBG("%s: magic %x reserved %d cmd %d pad %d ch %d len %d\n", __func__,
-			rx_hdr->magic_num, rx_hdr->reserved, rx_hdr->cmd,
-			rx_hdr->pad_len, rx_hdr->ch_id, rx_hdr->pkt_len);
-	if (rx_hdr->magic_num != BAM_MUX_HDR_MAGIC_NO) {
-		DMUX_LOG_KERR("%s: dropping invalid hdr. magic %x"
-			" reserved %d cmd %d"
-			" pad %d ch %d len %d\n", __func__,
-			rx_hdr->magic_num, rx_hdr->reserved, rx_hdr->cmd,
-			rx_hdr->pad_len, rx_hdr->ch_id, rx_hdr->pkt_len);
-		dev_kfree_skb_any(rx_skb);
-		queue_rx();
-		return;
-	}
-
-	if (rx_hdr->ch_id >= BAM_DMUX_NUM_CHANNELS) {
-		pr_warning(MODULE_NAME "%s: dropping invalid LCID %d"
-			" reserved %d cmd %d"
-			" pad %d ch %d len %d\n", __func__,
-			rx_hdr->ch_id, rx_hdr->reserved, rx_hdr->cmd,
-			rx_hdr->pad_len, rx_hdr->ch_id, rx_hdr->pkt_len);
-		dev_kfree_skb_any(rx_skb);
-		queue_rx();
-		return;
-	}
+	rx_hdr = (struct bam_mux_hdr *)info->skb->data;
 
 	switch (rx_hdr->cmd) {
-	case BAM_MUX_HDR_CMD_DATA:
-		DBG_INC_READ_CNT(rx_hdr->pkt_len);
-		bam_mux_process_data(rx_skb);
-		break;
 	case BAM_MUX_HDR_CMD_OPEN:
 		bam_dmux_log("%s: opening cid %d PC enabled\n", __func__,
 				rx_hdr->ch_id);
@@ -612,7 +688,6 @@ static void handle_bam_mux_cmd(struct work_struct *work)
 								__func__);
 			disconnect_ack = 0;
 		}
-		dev_kfree_skb_any(rx_skb);
 		break;
 	case BAM_MUX_HDR_CMD_OPEN_NO_A2_PC:
 		bam_dmux_log("%s: opening cid %d PC disabled\n", __func__,
@@ -624,7 +699,6 @@ static void handle_bam_mux_cmd(struct work_struct *work)
 		}
 
 		handle_bam_mux_cmd_open(rx_hdr);
-		dev_kfree_skb_any(rx_skb);
 		break;
 	case BAM_MUX_HDR_CMD_CLOSE:
 		
@@ -646,8 +720,64 @@ static void handle_bam_mux_cmd(struct work_struct *work)
 		if (!bam_ch[rx_hdr->ch_id].pdev)
 			pr_err(MODULE_NAME "%s: platform_device_alloc failed\n", __func__);
 		mutex_unlock(&bam_pdev_mutexlock);
-		dev_kfree_skb_any(rx_skb);
-		queue_rx();
+		break;
+	default:
+		break;
+	}
+
+	bam_rx_recycle(info);
+	atomic_set(&rx_cmd_pending, 0);
+	bam_rx_napi_kick();
+}
+
+static void bam_mux_rx_one(struct rx_pkt_info *info)
+{
+	struct bam_mux_hdr *rx_hdr;
+
+	dma_sync_single_for_cpu(NULL, info->dma_address, BUFFER_SIZE,
+					DMA_FROM_DEVICE);
+	rx_hdr = (struct bam_mux_hdr *)info->skb->data;
+
+	
+	DBG("%s: magic %x reserved %d cmd %d pad %d ch %d len %d\n", __func__,
+			rx_hdr->magic_num, rx_hdr->reserved, rx_hdr->cmd,
+			rx_hdr->pad_len, rx_hdr->ch_id, rx_hdr->pkt_len);
+	if (rx_hdr->magic_num != BAM_MUX_HDR_MAGIC_NO) {
+		DMUX_LOG_KERR("%s: dropping invalid hdr. magic %x"
+			" reserved %d cmd %d"
+			" pad %d ch %d len %d\n", __func__,
+			rx_hdr->magic_num, rx_hdr->reserved, rx_hdr->cmd,
+			rx_hdr->pad_len, rx_hdr->ch_id, rx_hdr->pkt_len);
+		bam_rx_recycle(info);
+		return;
+	}
+
+	if (rx_hdr->ch_id >= BAM_DMUX_NUM_CHANNELS) {
+		pr_warning(MODULE_NAME "%s: dropping invalid LCID %d"
+			" reserved %d cmd %d"
+			" pad %d ch %d len %d\n", __func__,
+			rx_hdr->ch_id, rx_hdr->reserved, rx_hdr->cmd,
+			rx_hdr->pad_len, rx_hdr->ch_id, rx_hdr->pkt_len);
+		bam_rx_recycle(info);
+		return;
+	}
+
+	switch (rx_hdr->cmd) {
+	case BAM_MUX_HDR_CMD_DATA:
+		if (rx_hdr->pkt_len > BUFFER_SIZE - sizeof(*rx_hdr)) {
+			DMUX_LOG_KERR("%s: dropping oversized pkt ch %d len %d\n",
+				__func__, rx_hdr->ch_id, rx_hdr->pkt_len);
+			bam_rx_recycle(info);
+			break;
+		}
+		DBG_INC_READ_CNT(rx_hdr->pkt_len);
+		bam_mux_process_data(info);
+		break;
+	case BAM_MUX_HDR_CMD_OPEN:
+	case BAM_MUX_HDR_CMD_OPEN_NO_A2_PC:
+	case BAM_MUX_HDR_CMD_CLOSE:
+		atomic_set(&rx_cmd_pending, 1);
+		queue_work(bam_mux_rx_workqueue, &info->work);
 		break;
 	default:
 		DMUX_LOG_KERR("%s: dropping invalid hdr. magic %x"
@@ -655,9 +785,8 @@ static void handle_bam_mux_cmd(struct work_struct *work)
 			__func__, rx_hdr->magic_num, rx_hdr->reserved,
 			rx_hdr->cmd, rx_hdr->pad_len, rx_hdr->ch_id,
 			rx_hdr->pkt_len);
-		dev_kfree_skb_any(rx_skb);
-		queue_rx();
-		return;
+		bam_rx_recycle(info);
+		break;
 	}
 }
 
@@ -1073,8 +1202,6 @@ int msm_bam_dmux_is_ch_low(uint32_t id)
 static void rx_switch_to_interrupt_mode(void)
 {
 	struct sps_connect cur_rx_conn;
-	struct sps_iovec iov;
-	struct rx_pkt_info *info;
 	int ret;
 
 	DBG("%s: entry\n", __func__);
@@ -1101,22 +1228,45 @@ static void rx_switch_to_interrupt_mode(void)
 	polling_mode = 0;
 	release_wakelock();
 
-	
-	while (bam_connection_is_active && !polling_mode) {
+	/* pick up anything that completed before the interrupt was enabled */
+	bam_rx_napi_kick();
+	DBG("%s: exit\n", __func__);
+	return;
+
+fail:
+	pr_err(MODULE_NAME "%s: reverting to polling\n", __func__);
+	rx_inactive_polls = 0;
+	bam_rx_napi_kick();
+}
+
+static void rx_irq_mode_work_func(struct work_struct *work)
+{
+	if (bam_connection_is_active && polling_mode && !in_global_reset)
+		rx_switch_to_interrupt_mode();
+}
+
+/* Pops the next completed rx buffer, NULL once the pipe is drained */
+static struct rx_pkt_info *bam_rx_next_completed(void)
+{
+	struct sps_iovec iov;
+	struct rx_pkt_info *info;
+	int ret;
+
+	for (;;) {
 		ret = sps_get_iovec(bam_rx_pipe, &iov);
 		if (ret) {
 			pr_err(MODULE_NAME "%s: sps_get_iovec failed %d\n",
 					__func__, ret);
-			break;
+			return NULL;
 		}
 		if (iov.addr == 0)
-			break;
+			return NULL;
 
-		mutex_lock(&bam_rx_pool_mutexlock);
+		spin_lock_bh(&bam_rx_pool_spinlock);
 		if (unlikely(list_empty(&bam_rx_pool))) {
 			DMUX_LOG_KERR("%s: have iovec %p but rx pool empty\n",
 				__func__, (void *)iov.addr);
-			mutex_unlock(&bam_rx_pool_mutexlock);
+			spin_unlock_bh(&bam_rx_pool_spinlock);
 			continue;
 		}
 		info = list_first_entry(&bam_rx_pool, struct rx_pkt_info,
@@ -1136,115 +1286,112 @@ static void rx_switch_to_interrupt_mode(void)
 		BUG_ON(info->dma_address != iov.addr);
 		list_del(&info->list_node);
 		--bam_rx_pool_len;
-		mutex_unlock(&bam_rx_pool_mutexlock);
-		handle_bam_mux_cmd(&info->work);
+		spin_unlock_bh(&bam_rx_pool_spinlock);
+		return info;
 	}
-	DBG("%s: exit\n", __func__);
-	return;
-
-fail:
-	pr_err(MODULE_NAME "%s: reverting to polling\n", __func__);
-	queue_work_on(0, bam_mux_rx_workqueue, &rx_timer_work);
 }
 
-static void rx_timer_work_func(struct work_struct *work)
+static void rx_adapt_timer_interval(void)
 {
-	struct sps_iovec iov;
-	struct rx_pkt_info *info;
-	int inactive_cycles = 0;
-	int ret;
 	u32 buffs_unused, buffs_used;
+	int depth = bam_rx_ring_depth();
+	int ret;
 
-	DBG("%s: entry\n", __func__);
-	while (bam_connection_is_active) { 
-		++inactive_cycles;
-		while (bam_connection_is_active) { 
-			if (in_global_reset) {
-				DBG("%s: in_global_reset\n", __func__);
-				return;
-			}
-			ret = sps_get_iovec(bam_rx_pipe, &iov);
-			if (ret) {
-				pr_err(MODULE_NAME "%s: sps_get_iovec failed %d\n",
-						__func__, ret);
-				break;
-			}
-			if (iov.addr == 0)
-				break;
-			inactive_cycles = 0;
-			mutex_lock(&bam_rx_pool_mutexlock);
-			if (unlikely(list_empty(&bam_rx_pool))) {
-				DMUX_LOG_KERR(
-					"%s: have iovec %p but rx pool empty\n",
-					__func__, (void *)iov.addr);
-				mutex_unlock(&bam_rx_pool_mutexlock);
-				continue;
-			}
-			info = list_first_entry(&bam_rx_pool,
-					struct rx_pkt_info,	list_node);
-			if (info->dma_address != iov.addr) {
-				DMUX_LOG_KERR("%s: iovec %p != dma %p\n",
-					__func__,
-					(void *)iov.addr,
-					(void *)info->dma_address);
-				list_for_each_entry(info, &bam_rx_pool,
-						list_node) {
-					DMUX_LOG_KERR("%s: dma %p\n", __func__,
-						(void *)info->dma_address);
-					if (iov.addr == info->dma_address)
-						break;
-				}
-			}
-			BUG_ON(info->dma_address != iov.addr);
-			list_del(&info->list_node);
-			--bam_rx_pool_len;
-			mutex_unlock(&bam_rx_pool_mutexlock);
-			handle_bam_mux_cmd(&info->work);
-		}
+	ret = sps_get_unused_desc_num(bam_rx_pipe, &buffs_unused);
+	if (ret) {
+		pr_err("%s: error getting num buffers unused after sleep\n",
+			__func__);
+		return;
+	}
 
-		if (inactive_cycles >= POLLING_INACTIVITY) {
-			rx_switch_to_interrupt_mode();
-			break;
+	buffs_used = depth - buffs_unused;
+
+	if (buffs_unused == 0) {
+		rx_timer_interval = MIN_POLLING_SLEEP;
+	} else {
+		if (buffs_used > 0) {
+			rx_timer_interval =
+				(2 * depth * rx_timer_interval) /
+				(3 * buffs_used);
+		} else {
+			rx_timer_interval = MAX_POLLING_SLEEP;
 		}
+	}
 
-		if (bam_adaptive_timer_enabled) {
-			usleep_range(rx_timer_interval, rx_timer_interval + 50);
+	if (rx_timer_interval > MAX_POLLING_SLEEP)
+		rx_timer_interval = MAX_POLLING_SLEEP;
+	else if (rx_timer_interval < MIN_POLLING_SLEEP)
+		rx_timer_interval = MIN_POLLING_SLEEP;
+}
 
-			ret = sps_get_unused_desc_num(bam_rx_pipe,
-						&buffs_unused);
+static enum hrtimer_restart rx_poll_timer_func(struct hrtimer *timer)
+{
+	napi_schedule(&bam_napi);
+	return HRTIMER_NORESTART;
+}
 
-			if (ret) {
-				pr_err("%s: error getting num buffers unused after sleep\n",
-					__func__);
+static void rx_arm_poll_timer(void)
+{
+	unsigned long min_us, max_us;
 
-				break;
-			}
+	if (bam_adaptive_timer_enabled) {
+		min_us = rx_timer_interval;
+		max_us = rx_timer_interval + 50;
+	} else {
+		min_us = POLLING_MIN_SLEEP;
+		max_us = max(POLLING_MAX_SLEEP, POLLING_MIN_SLEEP);
+	}
+	hrtimer_start_range_ns(&rx_poll_timer,
+			ns_to_ktime(min_us * NSEC_PER_USEC),
+			(max_us - min_us) * NSEC_PER_USEC, HRTIMER_MODE_REL);
+}
 
-			buffs_used = NUM_BUFFERS - buffs_unused;
-
-			if (buffs_unused == 0) {
-				rx_timer_interval = MIN_POLLING_SLEEP;
-			} else {
-				if (buffs_used > 0) {
-					rx_timer_interval =
-						(2 * NUM_BUFFERS *
-							rx_timer_interval)/
-						(3 * buffs_used);
-				} else {
-					rx_timer_interval =
-						MAX_POLLING_SLEEP;
-				}
-			}
+/*
+ * Rx is drained in softirq context, budget packets at a time.  In polling
+ * mode an idle pass re-arms the poll timer instead of sleeping in a work
+ * item, and after POLLING_INACTIVITY idle passes the pipe is switched back
+ * to interrupt mode from the rx workqueue.
+ */
+static int bam_rx_poll(struct napi_struct *napi, int budget)
+{
+	struct rx_pkt_info *info;
+	int done = 0;
 
-			if (rx_timer_interval > MAX_POLLING_SLEEP)
-				rx_timer_interval = MAX_POLLING_SLEEP;
-			else if (rx_timer_interval < MIN_POLLING_SLEEP)
-				rx_timer_interval = MIN_POLLING_SLEEP;
-		} else {
-			usleep_range(POLLING_MIN_SLEEP, POLLING_MAX_SLEEP);
+	if (polling_mode && bam_adaptive_timer_enabled &&
+			bam_connection_is_active)
+		rx_adapt_timer_interval();
+
+	while (done < budget && bam_connection_is_active &&
+			!atomic_read(&rx_cmd_pending)) {
+		if (in_global_reset) {
+			DBG("%s: in_global_reset\n", __func__);
+			break;
 		}
+		info = bam_rx_next_completed();
+		if (!info)
+			break;
+		bam_mux_rx_one(info);
+		++done;
 	}
-	DBG("%s: exit\n", __func__);
+
+	if (done == budget)
+		return budget;
+
+	napi_complete(napi);
+
+	if (!polling_mode || !bam_connection_is_active ||
+			atomic_read(&rx_cmd_pending) || in_global_reset)
+		return done;
+
+	if (done) {
+		rx_inactive_polls = 0;
+	} else if (++rx_inactive_polls >= POLLING_INACTIVITY) {
+		queue_work_on(0, bam_mux_rx_workqueue, &rx_irq_mode_work);
+		return done;
+	}
+
+	rx_arm_poll_timer();
+	return done;
 }
 
 static void bam_mux_tx_notify(struct sps_event_notify *notify)
@@ -1306,7 +1453,8 @@ static void bam_mux_rx_notify(struct sps_event_notify *notify)
 			}
 			grab_wakelock();
 			polling_mode = 1;
-			queue_work_on(0, bam_mux_rx_workqueue, &rx_timer_work);
+			rx_inactive_polls = 0;
+			napi_schedule(&bam_napi);
 		}
 		break;
 	default:
@@ -1359,6 +1507,7 @@ static int debug_stats(char *buf, int max)
 			"sps tx failures: %u\n"
 			"sps tx stalls:   %u\n"
 			"rx queue len:    %d\n"
+			"rx recycled:     %u\n"
 			"a2 ack out cnt:  %d\n"
 			"a2 ack in cnt:   %d\n"
 			"a2 pwr cntl in:  %d\n",
@@ -1369,6 +1518,7 @@ static int debug_stats(char *buf, int max)
 			bam_dmux_tx_sps_failure_cnt,
 			bam_dmux_tx_stall_cnt,
 			bam_rx_pool_len,
+			bam_rx_recycle_cnt,
 			atomic_read(&bam_dmux_ack_out_cnt),
 			atomic_read(&bam_dmux_ack_in_cnt),
 			atomic_read(&bam_dmux_a2_pwr_cntl_in_cnt)
@@ -1800,6 +1950,31 @@ static void ul_wakeup(void)
 	mutex_unlock(&wakeup_lock);
 }
 
+/*
+ * The poll loop must not run while the rx pool is torn down on
+ * disconnect or SSR; napi_disable() waits for a running poll to finish
+ * and turns later napi_schedule() calls into no-ops.
+ */
+static void bam_rx_napi_stop(void)
+{
+	mutex_lock(&bam_napi_lock);
+	if (bam_napi_enabled) {
+		napi_disable(&bam_napi);
+		bam_napi_enabled = 0;
+	}
+	mutex_unlock(&bam_napi_lock);
+}
+
+static void bam_rx_napi_start(void)
+{
+	mutex_lock(&bam_napi_lock);
+	if (!bam_napi_enabled) {
+		napi_enable(&bam_napi);
+		bam_napi_enabled = 1;
+	}
+	mutex_unlock(&bam_napi_lock);
+}
+
 static void reconnect_to_bam(void)
 {
 	int i;
@@ -1835,6 +2010,7 @@ static void reconnect_to_bam(void)
 	}
 
 	bam_connection_is_active = 1;
+	bam_rx_napi_start();
 
 	if (polling_mode)
 		rx_switch_to_interrupt_mode();
@@ -1868,18 +2044,17 @@ static void disconnect_to_bam(void)
 	INIT_COMPLETION(bam_connection_completion);
 	unvote_dfab();
 
-	mutex_lock(&bam_rx_pool_mutexlock);
+	bam_rx_napi_stop();
+	hrtimer_cancel(&rx_poll_timer);
+	spin_lock_bh(&bam_rx_pool_spinlock);
 	while (!list_empty(&bam_rx_pool)) {
 		node = bam_rx_pool.next;
 		list_del(node);
 		info = container_of(node, struct rx_pkt_info, list_node);
-		dma_unmap_single(NULL, info->dma_address, BUFFER_SIZE,
-							DMA_FROM_DEVICE);
-		dev_kfree_skb_any(info->skb);
-		kfree(info);
+		bam_rx_free(info);
 	}
 	bam_rx_pool_len = 0;
-	mutex_unlock(&bam_rx_pool_mutexlock);
+	spin_unlock_bh(&bam_rx_pool_spinlock);
 
 	if (disconnect_ack)
 		toggle_apps_ack();
@@ -1987,6 +2162,8 @@ static int restart_notifier_cb(struct notifier_block *this,
 	bam_dmux_log("%s: begin\n", __func__);
 	pr_info(MODULE_NAME "%s: begin\n", __func__);
 	in_global_reset = 1;
+	bam_rx_napi_stop();
+	hrtimer_cancel(&rx_poll_timer);
 
 	
 	write_lock_irqsave(&ul_wakeup_lock, flags);
@@ -2407,6 +2584,12 @@ static int bam_dmux_probe(struct platform_device *pdev)
 	if (!bam_mux_rx_workqueue)
 		return -ENOMEM;
 
+	init_dummy_netdev(&bam_napi_dev);
+	netif_napi_add(&bam_napi_dev, &bam_napi, bam_rx_poll, BAM_NAPI_WEIGHT);
+	bam_rx_napi_start();
+	hrtimer_init(&rx_poll_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	rx_poll_timer.function = rx_poll_timer_func;
+
 	bam_mux_tx_workqueue = create_singlethread_workqueue("bam_dmux_tx");
 	if (!bam_mux_tx_workqueue) {
 		destroy_workqueue(bam_mux_rx_workqueue);
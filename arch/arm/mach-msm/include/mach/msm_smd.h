@@ -190,6 +190,41 @@ int smd_write_segment(smd_channel_t *ch, void *data, int len, int user_buf);
  */
 int smd_write_end(smd_channel_t *ch);
 
+/* Reserves space to build a message directly in the channel fifo.
+ *
+ * @ch: channel to write to
+ * @data: set to the start of the reserved, contiguous fifo space
+ * @len: number of bytes to reserve (the packet length for packet channels)
+ *
+ * Nothing is visible to the remote side until smd_write_commit() is called.
+ * Only one reservation may be outstanding, and smd_write() and
+ * smd_write_start() fail with -EBUSY until it is committed.
+ *
+ * Returns:
+ *      len - success
+ *      -ENODEV - invalid smd channel
+ *      -EINVAL - invalid length
+ *      -EBUSY - a packet transaction or reservation is in progress
+ *      -EPIPE - channel is not open
+ *      -EAGAIN - not enough contiguous space, fall back to smd_write()
+ */
+int smd_write_reserve(smd_channel_t *ch, void **data, int len);
+
+/* Publishes the first @len bytes of the reservation and signals the
+ * remote side.  A @len of 0 drops the reservation.
+ *
+ * Returns @len on success, -ENODEV, -ENOEXEC if nothing is reserved or
+ * -EINVAL if @len exceeds the reservation.
+ */
+int smd_write_commit(smd_channel_t *ch, int len);
+
+/* Returns the number of contiguous bytes that can be read in place at
+ * *@data, limited to the current packet on packet channels.  Release them
+ * with smd_read_consume().
+ */
+int smd_read_peek(smd_channel_t *ch, void **data);
+int smd_read_consume(smd_channel_t *ch, int len);
+
 const char *smd_edge_to_subsystem(uint32_t type);
 
 const char *smd_pid_to_subsystem(uint32_t pid);
@@ -300,6 +335,26 @@ static inline int smd_write_end(smd_channel_t *ch)
 	return -ENODEV;
 }
 
+static inline int smd_write_reserve(smd_channel_t *ch, void **data, int len)
+{
+	return -ENODEV;
+}
+
+static inline int smd_write_commit(smd_channel_t *ch, int len)
+{
+	return -ENODEV;
+}
+
+static inline int smd_read_peek(smd_channel_t *ch, void **data)
+{
+	return -ENODEV;
+}
+
+static inline int smd_read_consume(smd_channel_t *ch, int len)
+{
+	return -ENODEV;
+}
+
 static inline const char *smd_edge_to_subsystem(uint32_t type)
 {
 	return NULL;
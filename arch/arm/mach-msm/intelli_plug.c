@@ -20,8 +20,7 @@
 #include <linux/mutex.h>
 #include <linux/module.h>
 #include <linux/rq_stats.h>
-#include <linux/slab.h>
-#include <linux/input.h>
+#include <linux/input_boost.h>
 
 //#define DEBUG_INTELLI_PLUG
 #undef DEBUG_INTELLI_PLUG
@@ -44,6 +43,7 @@ static DEFINE_MUTEX(intelli_plug_mutex);
 
 static struct delayed_work intelli_plug_work;
 static struct delayed_work intelli_plug_boost;
+static unsigned int boost_min_cpus = 2;
 
 static struct workqueue_struct *intelliplug_wq;
 static struct workqueue_struct *intelliplug_boost_wq;
@@ -173,11 +173,12 @@ static unsigned int calculate_thread_stats(void)
 
 static void __cpuinit intelli_plug_boost_fn(struct work_struct *work)
 {
+	unsigned int cpu;
 
-	int nr_cpus = num_online_cpus();
-
-	if (nr_cpus < 2)
-		cpu_up(1);
+	for (cpu = 1; cpu < boost_min_cpus && cpu < nr_cpu_ids; cpu++) {
+		if (!cpu_online(cpu))
+			cpu_up(cpu);
+	}
 }
 
 static void __cpuinit intelli_plug_work_fn(struct work_struct *work)
@@ -349,79 +350,27 @@ static struct early_suspend intelli_plug_early_suspend_struct_driver = {
 };
 #endif	/* CONFIG_HAS_EARLYSUSPEND */
 
-static void intelli_plug_input_event(struct input_handle *handle,
-		unsigned int type, unsigned int code, int value)
+static int intelli_plug_input_boost(struct notifier_block *nb,
+		unsigned long val, void *data)
 {
+	struct input_boost_event *ev = data;
+
+	if (val != INPUT_BOOST_START || ev->min_cpus < 2)
+		return NOTIFY_DONE;
+
 #ifdef DEBUG_INTELLI_PLUG
 	pr_info("intelli_plug touched!\n");
 #endif
 
+	boost_min_cpus = ev->min_cpus;
 	queue_delayed_work_on(0, intelliplug_wq, &intelli_plug_boost,
 		msecs_to_jiffies(10));
-}
-
-static int intelli_plug_input_connect(struct input_handler *handler,
-		struct input_dev *dev, const struct input_device_id *id)
-{
-	struct input_handle *handle;
-	int error;
-
-	handle = kzalloc(sizeof(struct input_handle), GFP_KERNEL);
-	if (!handle)
-		return -ENOMEM;
 
-	handle->dev = dev;
-	handle->handler = handler;
-	handle->name = "intelliplug";
-
-	error = input_register_handle(handle);
-	if (error)
-		goto err2;
-
-	error = input_open_device(handle);
-	if (error)
-		goto err1;
-	pr_info("%s found and connected!\n", dev->name);
-	return 0;
-err1:
-	input_unregister_handle(handle);
-err2:
-	kfree(handle);
-	return error;
-}
-
-static void intelli_plug_input_disconnect(struct input_handle *handle)
-{
-	input_close_device(handle);
-	input_unregister_handle(handle);
-	kfree(handle);
+	return NOTIFY_OK;
 }
 
-static const struct input_device_id intelli_plug_ids[] = {
-	{
-		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
-			 INPUT_DEVICE_ID_MATCH_ABSBIT,
-		.evbit = { BIT_MASK(EV_ABS) },
-		.absbit = { [BIT_WORD(ABS_MT_POSITION_X)] =
-			    BIT_MASK(ABS_MT_POSITION_X) |
-			    BIT_MASK(ABS_MT_POSITION_Y) },
-	}, /* multi-touch touchscreen */
-	{
-		.flags = INPUT_DEVICE_ID_MATCH_KEYBIT |
-			 INPUT_DEVICE_ID_MATCH_ABSBIT,
-		.keybit = { [BIT_WORD(BTN_TOUCH)] = BIT_MASK(BTN_TOUCH) },
-		.absbit = { [BIT_WORD(ABS_X)] =
-			    BIT_MASK(ABS_X) | BIT_MASK(ABS_Y) },
-	}, /* touchpad */
-	{ },
-};
-
-static struct input_handler intelli_plug_input_handler = {
-	.event          = intelli_plug_input_event,
-	.connect        = intelli_plug_input_connect,
-	.disconnect     = intelli_plug_input_disconnect,
-	.name           = "intelliplug_handler",
-	.id_table       = intelli_plug_ids,
+static struct notifier_block intelli_plug_input_boost_nb = {
+	.notifier_call = intelli_plug_input_boost,
 };
 
 int __init intelli_plug_init(void)
@@ -433,7 +382,7 @@ int __init intelli_plug_init(void)
 		 INTELLI_PLUG_MAJOR_VERSION,
 		 INTELLI_PLUG_MINOR_VERSION);
 
-	rc = input_register_handler(&intelli_plug_input_handler);
+	rc = input_boost_register_notifier(&intelli_plug_input_boost_nb);
 	intelliplug_wq = alloc_workqueue("intelliplug",
 				WQ_HIGHPRI | WQ_UNBOUND, 1);
 	intelliplug_boost_wq = alloc_workqueue("iplug_boost",
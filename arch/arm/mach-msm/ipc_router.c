@@ -27,6 +27,10 @@
 #include <linux/platform_device.h>
 #include <linux/uaccess.h>
 #include <linux/debugfs.h>
+#include <linux/rculist.h>
+#include <linux/srcu.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
 
 #include <asm/uaccess.h>
 #include <asm/byteorder.h>
@@ -96,6 +100,14 @@ static DEFINE_MUTEX(control_ports_lock);
 static struct list_head local_ports[LP_HASH_SIZE];
 static DEFINE_MUTEX(local_ports_lock);
 
+/*
+ * The rx path looks local ports up under this SRCU domain instead of
+ * local_ports_lock.  A reader holds it only until it owns the port's
+ * port_rx_q_lock, so a port may be freed once it is unhashed, a grace
+ * period has elapsed and its rx queue lock has been cycled.
+ */
+static struct srcu_struct local_ports_srcu;
+
 #define SRV_HASH_SIZE 32
 static struct list_head server_list[SRV_HASH_SIZE];
 static DEFINE_MUTEX(server_list_lock);
@@ -105,12 +117,14 @@ struct msm_ipc_server {
 	struct list_head list;
 	struct msm_ipc_port_name name;
 	struct list_head server_port_list;
+	struct rcu_head rcu;
 };
 
 struct msm_ipc_server_port {
 	struct list_head list;
 	struct msm_ipc_port_addr server_addr;
 	struct msm_ipc_router_xprt_info *xprt_info;
+	struct rcu_head rcu;
 };
 
 #define RP_HASH_SIZE 32
@@ -122,6 +136,8 @@ struct msm_ipc_router_remote_port {
 	wait_queue_head_t quota_wait;
 	uint32_t tx_quota_cnt;
 	struct mutex quota_lock;
+	atomic_t ref_cnt;
+	struct rcu_head rcu;
 };
 
 struct msm_ipc_router_xprt_info {
@@ -234,17 +250,21 @@ static int add_routing_table_entry(
 		return -EINVAL;
 
 	key = (rt_entry->node_id % RT_HASH_SIZE);
-	list_add_tail(&rt_entry->list, &routing_table[key]);
+	list_add_tail_rcu(&rt_entry->list, &routing_table[key]);
 	return 0;
 }
 
+/*
+ * Routing table entries are never freed, so the data path may look them
+ * up without routing_table_lock; rt_entry->lock still guards xprt_info.
+ */
 static struct msm_ipc_routing_table_entry *lookup_routing_table(
 	uint32_t node_id)
 {
 	uint32_t key = (node_id % RT_HASH_SIZE);
 	struct msm_ipc_routing_table_entry *rt_entry;
 
-	list_for_each_entry(rt_entry, &routing_table[key], list) {
+	list_for_each_entry_rcu(rt_entry, &routing_table[key], list) {
 		if (rt_entry->node_id == node_id)
 			return rt_entry;
 	}
@@ -292,6 +312,7 @@ struct rr_packet *clone_pkt(struct rr_packet *pkt)
 		pr_err("%s: failure\n", __func__);
 		return NULL;
 	}
+	kref_init(&cloned_pkt->ref);
 
 	pkt_fragment_q = kmalloc(sizeof(struct sk_buff_head), GFP_KERNEL);
 	if (!pkt_fragment_q) {
@@ -331,6 +352,7 @@ struct rr_packet *create_pkt(struct sk_buff_head *data)
 		pr_err("%s: failure\n", __func__);
 		return NULL;
 	}
+	kref_init(&pkt->ref);
 
 	pkt->pkt_fragment_q = data;
 	skb_queue_walk(pkt->pkt_fragment_q, temp_skb)
@@ -338,13 +360,11 @@ struct rr_packet *create_pkt(struct sk_buff_head *data)
 	return pkt;
 }
 
-void release_pkt(struct rr_packet *pkt)
+static void pkt_release(struct kref *ref)
 {
+	struct rr_packet *pkt = container_of(ref, struct rr_packet, ref);
 	struct sk_buff *temp_skb;
 
-	if (!pkt)
-		return;
-
 	if (!pkt->pkt_fragment_q) {
 		kfree(pkt);
 		return;
@@ -356,7 +376,14 @@ void release_pkt(struct rr_packet *pkt)
 	}
 	kfree(pkt->pkt_fragment_q);
 	kfree(pkt);
-	return;
+}
+
+void release_pkt(struct rr_packet *pkt)
+{
+	if (!pkt)
+		return;
+
+	kref_put(&pkt->ref, pkt_release);
 }
 
 static int post_control_ports(struct rr_packet *pkt)
@@ -425,7 +452,7 @@ void msm_ipc_router_add_local_port(struct msm_ipc_port *port_ptr)
 
 	key = (port_ptr->this_port.port_id & (LP_HASH_SIZE - 1));
 	mutex_lock(&local_ports_lock);
-	list_add_tail(&port_ptr->list, &local_ports[key]);
+	list_add_tail_rcu(&port_ptr->list, &local_ports[key]);
 	mutex_unlock(&local_ports_lock);
 }
 
@@ -469,12 +496,13 @@ struct msm_ipc_port *msm_ipc_router_create_raw_port(void *endpoint,
 	return port_ptr;
 }
 
+/* Caller holds local_ports_srcu or local_ports_lock */
 static struct msm_ipc_port *msm_ipc_router_lookup_local_port(uint32_t port_id)
 {
 	int key = (port_id & (LP_HASH_SIZE - 1));
 	struct msm_ipc_port *port_ptr;
 
-	list_for_each_entry(port_ptr, &local_ports[key], list) {
+	list_for_each_entry_rcu(port_ptr, &local_ports[key], list) {
 		if (port_ptr->this_port.port_id == port_id) {
 			return port_ptr;
 		}
@@ -482,6 +510,17 @@ static struct msm_ipc_port *msm_ipc_router_lookup_local_port(uint32_t port_id)
 	return NULL;
 }
 
+static void msm_ipc_router_put_remote_port(
+	struct msm_ipc_router_remote_port *rport_ptr)
+{
+	if (rport_ptr && atomic_dec_and_test(&rport_ptr->ref_cnt))
+		kfree_rcu(rport_ptr, rcu);
+}
+
+/*
+ * Lockless lookup.  The remote port is returned with a reference held,
+ * which the caller drops with msm_ipc_router_put_remote_port().
+ */
 static struct msm_ipc_router_remote_port *msm_ipc_router_lookup_remote_port(
 						uint32_t node_id,
 						uint32_t port_id)
@@ -490,27 +529,24 @@ static struct msm_ipc_router_remote_port *msm_ipc_router_lookup_remote_port(
 	struct msm_ipc_routing_table_entry *rt_entry;
 	int key = (port_id & (RP_HASH_SIZE - 1));
 
-	mutex_lock(&routing_table_lock);
 	rt_entry = lookup_routing_table(node_id);
 	if (!rt_entry) {
-		mutex_unlock(&routing_table_lock);
 		pr_err("%s: Node is not up\n", __func__);
 		return NULL;
 	}
 
-	mutex_lock(&rt_entry->lock);
-	list_for_each_entry(rport_ptr,
-			    &rt_entry->remote_port_list[key], list) {
+	rcu_read_lock();
+	list_for_each_entry_rcu(rport_ptr,
+				&rt_entry->remote_port_list[key], list) {
 		if (rport_ptr->port_id == port_id) {
-			if (rport_ptr->restart_state != RESTART_NORMAL)
+			if (rport_ptr->restart_state != RESTART_NORMAL ||
+			    !atomic_inc_not_zero(&rport_ptr->ref_cnt))
 				rport_ptr = NULL;
-			mutex_unlock(&rt_entry->lock);
-			mutex_unlock(&routing_table_lock);
+			rcu_read_unlock();
 			return rport_ptr;
 		}
 	}
-	mutex_unlock(&rt_entry->lock);
-	mutex_unlock(&routing_table_lock);
+	rcu_read_unlock();
 	return NULL;
 }
 
@@ -545,23 +581,38 @@ static struct msm_ipc_router_remote_port *msm_ipc_router_create_remote_port(
 	rport_ptr->tx_quota_cnt = 0;
 	init_waitqueue_head(&rport_ptr->quota_wait);
 	mutex_init(&rport_ptr->quota_lock);
-	list_add_tail(&rport_ptr->list,
-		      &rt_entry->remote_port_list[key]);
+	atomic_set(&rport_ptr->ref_cnt, 1);
+	list_add_tail_rcu(&rport_ptr->list,
+			  &rt_entry->remote_port_list[key]);
 	mutex_unlock(&rt_entry->lock);
 	mutex_unlock(&routing_table_lock);
 	return rport_ptr;
 }
 
-static void msm_ipc_router_destroy_remote_port(
+/*
+ * Unhash a remote port and drop the routing table's reference.  Writers
+ * still waiting for tx quota are kicked out with -ENETRESET; the port is
+ * freed once they and any lockless lookups are done with it.
+ * Caller holds rt_entry->lock.
+ */
+static void msm_ipc_router_unhash_remote_port(
 	struct msm_ipc_router_remote_port *rport_ptr)
 {
-	uint32_t node_id;
-	struct msm_ipc_routing_table_entry *rt_entry;
+	list_del_rcu(&rport_ptr->list);
+	mutex_lock(&rport_ptr->quota_lock);
+	rport_ptr->restart_state = RESTART_PEND;
+	wake_up(&rport_ptr->quota_wait);
+	mutex_unlock(&rport_ptr->quota_lock);
+	msm_ipc_router_put_remote_port(rport_ptr);
+}
 
-	if (!rport_ptr)
-		return;
+static void msm_ipc_router_destroy_remote_port(uint32_t node_id,
+					       uint32_t port_id)
+{
+	struct msm_ipc_router_remote_port *rport_ptr;
+	struct msm_ipc_routing_table_entry *rt_entry;
+	int key = (port_id & (RP_HASH_SIZE - 1));
 
-	node_id = rport_ptr->node_id;
 	mutex_lock(&routing_table_lock);
 	rt_entry = lookup_routing_table(node_id);
 	if (!rt_entry) {
@@ -571,8 +622,13 @@ static void msm_ipc_router_destroy_remote_port(
 	}
 
 	mutex_lock(&rt_entry->lock);
-	list_del(&rport_ptr->list);
-	kfree(rport_ptr);
+	list_for_each_entry(rport_ptr,
+			    &rt_entry->remote_port_list[key], list) {
+		if (rport_ptr->port_id == port_id) {
+			msm_ipc_router_unhash_remote_port(rport_ptr);
+			break;
+		}
+	}
 	mutex_unlock(&rt_entry->lock);
 	mutex_unlock(&routing_table_lock);
 	return;
@@ -588,25 +644,25 @@ static struct msm_ipc_server *msm_ipc_router_lookup_server(
 	struct msm_ipc_server_port *server_port;
 	int key = (instance & (SRV_HASH_SIZE - 1));
 
-	mutex_lock(&server_list_lock);
-	list_for_each_entry(server, &server_list[key], list) {
+	rcu_read_lock();
+	list_for_each_entry_rcu(server, &server_list[key], list) {
 		if ((server->name.service != service) ||
 		    (server->name.instance != instance))
 			continue;
 		if ((node_id == 0) && (port_id == 0)) {
-			mutex_unlock(&server_list_lock);
+			rcu_read_unlock();
 			return server;
 		}
-		list_for_each_entry(server_port, &server->server_port_list,
-				    list) {
+		list_for_each_entry_rcu(server_port,
+					&server->server_port_list, list) {
 			if ((server_port->server_addr.node_id == node_id) &&
 			    (server_port->server_addr.port_id == port_id)) {
-				mutex_unlock(&server_list_lock);
+				rcu_read_unlock();
 				return server;
 			}
 		}
 	}
-	mutex_unlock(&server_list_lock);
+	rcu_read_unlock();
 	return NULL;
 }
 
@@ -637,14 +693,14 @@ static struct msm_ipc_server *msm_ipc_router_create_server(
 	server->name.service = service;
 	server->name.instance = instance;
 	INIT_LIST_HEAD(&server->server_port_list);
-	list_add_tail(&server->list, &server_list[key]);
+	list_add_tail_rcu(&server->list, &server_list[key]);
 
 create_srv_port:
 	server_port = kmalloc(sizeof(struct msm_ipc_server_port), GFP_KERNEL);
 	if (!server_port) {
 		if (list_empty(&server->server_port_list)) {
-			list_del(&server->list);
-			kfree(server);
+			list_del_rcu(&server->list);
+			kfree_rcu(server, rcu);
 		}
 		mutex_unlock(&server_list_lock);
 		pr_err("%s: Server Port allocation failed\n", __func__);
@@ -653,7 +709,7 @@ create_srv_port:
 	server_port->server_addr.node_id = node_id;
 	server_port->server_addr.port_id = port_id;
 	server_port->xprt_info = xprt_info;
-	list_add_tail(&server_port->list, &server->server_port_list);
+	list_add_tail_rcu(&server_port->list, &server->server_port_list);
 	mutex_unlock(&server_list_lock);
 
 	return server;
@@ -674,12 +730,12 @@ static void msm_ipc_router_destroy_server(struct msm_ipc_server *server,
 			break;
 	}
 	if (server_port) {
-		list_del(&server_port->list);
-		kfree(server_port);
+		list_del_rcu(&server_port->list);
+		kfree_rcu(server_port, rcu);
 	}
 	if (list_empty(&server->server_port_list)) {
-		list_del(&server->list);
-		kfree(server);
+		list_del_rcu(&server->list);
+		kfree_rcu(server, rcu);
 	}
 	mutex_unlock(&server_list_lock);
 	return;
@@ -711,6 +767,7 @@ static int msm_ipc_router_send_control_msg(
 		pr_err("%s: pkt alloc failed\n", __func__);
 		return -ENOMEM;
 	}
+	kref_init(&pkt->ref);
 
 	pkt_fragment_q = kmalloc(sizeof(struct sk_buff_head), GFP_KERNEL);
 	if (!pkt_fragment_q) {
@@ -842,6 +899,7 @@ static int broadcast_ctl_msg_locally(union rr_control_msg *msg)
 		pr_err("%s: pkt alloc failed\n", __func__);
 		return -ENOMEM;
 	}
+	kref_init(&pkt->ref);
 
 	pkt_fragment_q = kmalloc(sizeof(struct sk_buff_head), GFP_KERNEL);
 	if (!pkt_fragment_q) {
@@ -957,21 +1015,23 @@ static int forward_msg(struct msm_ipc_router_xprt_info *xprt_info,
 
 	hdr = (struct rr_header *)head_pkt->data;
 	dst_node_id = hdr->dst_node_id;
-	mutex_lock(&routing_table_lock);
 	rt_entry = lookup_routing_table(dst_node_id);
-	if (!(rt_entry) || !(rt_entry->xprt_info)) {
-		mutex_unlock(&routing_table_lock);
+	if (!rt_entry) {
 		pr_err("%s: Routing table not initialized\n", __func__);
 		return -ENODEV;
 	}
 
 	mutex_lock(&rt_entry->lock);
 	fwd_xprt_info = rt_entry->xprt_info;
+	if (!fwd_xprt_info) {
+		mutex_unlock(&rt_entry->lock);
+		pr_err("%s: Routing table not initialized\n", __func__);
+		return -ENODEV;
+	}
 	mutex_lock(&fwd_xprt_info->tx_lock);
 	if (xprt_info->remote_node_id == fwd_xprt_info->remote_node_id) {
 		mutex_unlock(&fwd_xprt_info->tx_lock);
 		mutex_unlock(&rt_entry->lock);
-		mutex_unlock(&routing_table_lock);
 		pr_err("%s: Discarding Command to route back\n", __func__);
 		return -EINVAL;
 	}
@@ -979,14 +1039,12 @@ static int forward_msg(struct msm_ipc_router_xprt_info *xprt_info,
 	if (xprt_info->xprt->link_id == fwd_xprt_info->xprt->link_id) {
 		mutex_unlock(&fwd_xprt_info->tx_lock);
 		mutex_unlock(&rt_entry->lock);
-		mutex_unlock(&routing_table_lock);
 		pr_err("%s: DST in the same cluster\n", __func__);
 		return 0;
 	}
 	fwd_xprt_info->xprt->write(pkt, pkt->length, fwd_xprt_info->xprt);
 	mutex_unlock(&fwd_xprt_info->tx_lock);
 	mutex_unlock(&rt_entry->lock);
-	mutex_unlock(&routing_table_lock);
 
 	return 0;
 }
@@ -1005,6 +1063,7 @@ static void reset_remote_port_info(uint32_t node_id, uint32_t port_id)
 	rport_ptr->restart_state = RESTART_PEND;
 	wake_up(&rport_ptr->quota_wait);
 	mutex_unlock(&rport_ptr->quota_lock);
+	msm_ipc_router_put_remote_port(rport_ptr);
 	return;
 }
 
@@ -1042,12 +1101,12 @@ static void msm_ipc_cleanup_remote_server_info(
 				ctl.srv.port_id = svr_port->server_addr.port_id;
 				relay_ctl_msg(xprt_info, &ctl);
 				broadcast_ctl_msg_locally(&ctl);
-				list_del(&svr_port->list);
-				kfree(svr_port);
+				list_del_rcu(&svr_port->list);
+				kfree_rcu(svr_port, rcu);
 			}
 			if (list_empty(&svr->server_port_list)) {
-				list_del(&svr->list);
-				kfree(svr);
+				list_del_rcu(&svr->list);
+				kfree_rcu(svr, rcu);
 			}
 		}
 	}
@@ -1115,10 +1174,9 @@ static void msm_ipc_cleanup_remote_port_info(uint32_t node_id)
 			for (j = 0; j < RP_HASH_SIZE; j++) {
 				list_for_each_entry_safe(rport_ptr,
 					tmp_rport_ptr,
-					&rt_entry->remote_port_list[j], list) {
-					list_del(&rport_ptr->list);
-					kfree(rport_ptr);
-				}
+					&rt_entry->remote_port_list[j], list)
+					msm_ipc_router_unhash_remote_port(
+								rport_ptr);
 			}
 			mutex_unlock(&rt_entry->lock);
 		}
@@ -1246,6 +1304,7 @@ static int process_control_msg(struct msm_ipc_router_xprt_info *xprt_info,
 		rport_ptr->tx_quota_cnt = 0;
 		mutex_unlock(&rport_ptr->quota_lock);
 		wake_up(&rport_ptr->quota_wait);
+		msm_ipc_router_put_remote_port(rport_ptr);
 		break;
 
 	case IPC_ROUTER_CTRL_CMD_NEW_SERVER:
@@ -1291,8 +1350,11 @@ static int process_control_msg(struct msm_ipc_router_xprt_info *xprt_info,
 				return -ENOMEM;
 			}
 
-			if (!msm_ipc_router_lookup_remote_port(
-					msg->srv.node_id, msg->srv.port_id)) {
+			rport_ptr = msm_ipc_router_lookup_remote_port(
+					msg->srv.node_id, msg->srv.port_id);
+			if (rport_ptr) {
+				msm_ipc_router_put_remote_port(rport_ptr);
+			} else {
 				rport_ptr = msm_ipc_router_create_remote_port(
 					msg->srv.node_id, msg->srv.port_id);
 				if (!rport_ptr)
@@ -1323,10 +1385,8 @@ static int process_control_msg(struct msm_ipc_router_xprt_info *xprt_info,
 	case IPC_ROUTER_CTRL_CMD_REMOVE_CLIENT:
 		RR("o REMOVE_CLIENT id=%d:%08x\n",
 		    msg->cli.node_id, msg->cli.port_id);
-		rport_ptr = msm_ipc_router_lookup_remote_port(msg->cli.node_id,
-							msg->cli.port_id);
-		if (rport_ptr)
-			msm_ipc_router_destroy_remote_port(rport_ptr);
+		msm_ipc_router_destroy_remote_port(msg->cli.node_id,
+						   msg->cli.port_id);
 
 		relay_msg(xprt_info, pkt);
 		post_control_ports(pkt);
@@ -1352,6 +1412,7 @@ static void do_read_data(struct work_struct *work)
 	struct msm_ipc_port_addr *src_addr;
 	struct msm_ipc_router_remote_port *rport_ptr;
 	uint32_t resume_tx, resume_tx_node_id, resume_tx_port_id;
+	int srcu_idx;
 
 	struct msm_ipc_router_xprt_info *xprt_info =
 		container_of(work,
@@ -1429,37 +1490,40 @@ static void do_read_data(struct work_struct *work)
 	rport_ptr = msm_ipc_router_lookup_remote_port(hdr->src_node_id,
 						      hdr->src_port_id);
 
-	mutex_lock(&local_ports_lock);
+	srcu_idx = srcu_read_lock(&local_ports_srcu);
 	port_ptr = msm_ipc_router_lookup_local_port(hdr->dst_port_id);
 	if (!port_ptr) {
 		pr_err("%s: No local port id %08x\n", __func__,
 			hdr->dst_port_id);
-		mutex_unlock(&local_ports_lock);
+		srcu_read_unlock(&local_ports_srcu, srcu_idx);
+		msm_ipc_router_put_remote_port(rport_ptr);
 		release_pkt(pkt);
 		goto process_done;
 	}
+	mutex_lock(&port_ptr->port_rx_q_lock);
+	srcu_read_unlock(&local_ports_srcu, srcu_idx);
 
-	if (!rport_ptr) {
+	if (rport_ptr) {
+		msm_ipc_router_put_remote_port(rport_ptr);
+	} else {
 		rport_ptr = msm_ipc_router_create_remote_port(
 							hdr->src_node_id,
 							hdr->src_port_id);
 		if (!rport_ptr) {
 			pr_err("%s: Remote port %08x:%08x creation failed\n",
 				__func__, hdr->src_node_id, hdr->src_port_id);
-			mutex_unlock(&local_ports_lock);
+			mutex_unlock(&port_ptr->port_rx_q_lock);
+			release_pkt(pkt);
 			goto process_done;
 		}
 	}
 
 	if (!port_ptr->notify) {
-		mutex_lock(&port_ptr->port_rx_q_lock);
 		wake_lock(&port_ptr->port_rx_wake_lock);
 		list_add_tail(&pkt->list, &port_ptr->port_rx_q);
 		wake_up(&port_ptr->port_rx_wait_q);
 		mutex_unlock(&port_ptr->port_rx_q_lock);
-		mutex_unlock(&local_ports_lock);
 	} else {
-		mutex_lock(&port_ptr->port_rx_q_lock);
 		src_addr = kmalloc(sizeof(struct msm_ipc_port_addr),
 				   GFP_KERNEL);
 		if (src_addr) {
@@ -1467,7 +1531,6 @@ static void do_read_data(struct work_struct *work)
 			src_addr->port_id = hdr->src_port_id;
 		}
 		skb_pull(head_skb, IPC_ROUTER_HDR_SIZE);
-		mutex_unlock(&local_ports_lock);
 		port_ptr->notify(MSM_IPC_ROUTER_READ_CB, pkt->pkt_fragment_q,
 				 src_addr, port_ptr->priv);
 		mutex_unlock(&port_ptr->port_rx_q_lock);
@@ -1597,6 +1660,7 @@ static int loopback_data(struct msm_ipc_port *src,
 	struct rr_header *hdr;
 	struct msm_ipc_port *port_ptr;
 	struct rr_packet *pkt;
+	int srcu_idx, ret;
 
 	if (!data) {
 		pr_err("%s: Invalid pkt pointer\n", __func__);
@@ -1630,23 +1694,24 @@ static int loopback_data(struct msm_ipc_port *src,
 	hdr->dst_port_id = port_id;
 	pkt->length += IPC_ROUTER_HDR_SIZE;
 
-	mutex_lock(&local_ports_lock);
+	srcu_idx = srcu_read_lock(&local_ports_srcu);
 	port_ptr = msm_ipc_router_lookup_local_port(port_id);
 	if (!port_ptr) {
 		pr_err("%s: Local port %d not present\n", __func__, port_id);
-		mutex_unlock(&local_ports_lock);
+		srcu_read_unlock(&local_ports_srcu, srcu_idx);
 		release_pkt(pkt);
 		return -ENODEV;
 	}
 
 	mutex_lock(&port_ptr->port_rx_q_lock);
+	srcu_read_unlock(&local_ports_srcu, srcu_idx);
+	ret = pkt->length;
 	wake_lock(&port_ptr->port_rx_wake_lock);
 	list_add_tail(&pkt->list, &port_ptr->port_rx_q);
 	wake_up(&port_ptr->port_rx_wait_q);
 	mutex_unlock(&port_ptr->port_rx_q_lock);
-	mutex_unlock(&local_ports_lock);
 
-	return pkt->length;
+	return ret;
 }
 
 static int msm_ipc_router_write_pkt(struct msm_ipc_port *src,
@@ -1712,21 +1777,24 @@ static int msm_ipc_router_write_pkt(struct msm_ipc_port *src,
 		hdr->confirm_rx = 1;
 	mutex_unlock(&rport_ptr->quota_lock);
 
-	mutex_lock(&routing_table_lock);
 	rt_entry = lookup_routing_table(hdr->dst_node_id);
-	if (!rt_entry || !rt_entry->xprt_info) {
-		mutex_unlock(&routing_table_lock);
+	if (!rt_entry) {
 		pr_err("%s: Remote node %d not up\n",
 			__func__, hdr->dst_node_id);
 		return -ENODEV;
 	}
 	mutex_lock(&rt_entry->lock);
 	xprt_info = rt_entry->xprt_info;
+	if (!xprt_info) {
+		mutex_unlock(&rt_entry->lock);
+		pr_err("%s: Remote node %d not up\n",
+			__func__, hdr->dst_node_id);
+		return -ENODEV;
+	}
 	mutex_lock(&xprt_info->tx_lock);
 	ret = xprt_info->xprt->write(pkt, pkt->length, xprt_info->xprt);
 	mutex_unlock(&xprt_info->tx_lock);
 	mutex_unlock(&rt_entry->lock);
-	mutex_unlock(&routing_table_lock);
 
 	if (ret < 0) {
 		pr_err("%s: Write on XPRT failed\n", __func__);
@@ -1781,21 +1849,23 @@ int msm_ipc_router_send_to(struct msm_ipc_port *src,
 		dst_node_id = dest->addr.port_addr.node_id;
 		dst_port_id = dest->addr.port_addr.port_id;
 	} else if (dest->addrtype == MSM_IPC_ADDR_NAME) {
+		rcu_read_lock();
 		server = msm_ipc_router_lookup_server(
 					dest->addr.port_name.service,
 					dest->addr.port_name.instance,
 					0, 0);
-		if (!server) {
+		server_port = server ? list_first_or_null_rcu(
+					&server->server_port_list,
+					struct msm_ipc_server_port,
+					list) : NULL;
+		if (!server_port) {
+			rcu_read_unlock();
 			pr_err("%s: Destination not reachable\n", __func__);
 			return -ENODEV;
 		}
-		mutex_lock(&server_list_lock);
-		server_port = list_first_entry(&server->server_port_list,
-					       struct msm_ipc_server_port,
-					       list);
 		dst_node_id = server_port->server_addr.node_id;
 		dst_port_id = server_port->server_addr.port_id;
-		mutex_unlock(&server_list_lock);
+		rcu_read_unlock();
 	}
 	if (dst_node_id == IPC_ROUTER_NID_LOCAL) {
 		ret = loopback_data(src, dst_port_id, data);
@@ -1812,11 +1882,13 @@ int msm_ipc_router_send_to(struct msm_ipc_port *src,
 
 	pkt = create_pkt(data);
 	if (!pkt) {
+		msm_ipc_router_put_remote_port(rport_ptr);
 		pr_err("%s: Pkt creation failed\n", __func__);
 		return -ENOMEM;
 	}
 
 	ret = msm_ipc_router_write_pkt(src, rport_ptr, pkt);
+	msm_ipc_router_put_remote_port(rport_ptr);
 	release_pkt(pkt);
 
 	return ret;
@@ -1848,7 +1920,8 @@ int msm_ipc_router_read(struct msm_ipc_port *port_ptr,
 		wake_unlock(&port_ptr->port_rx_wake_lock);
 	*data = pkt->pkt_fragment_q;
 	ret = pkt->length;
-	kfree(pkt);
+	pkt->pkt_fragment_q = NULL;
+	release_pkt(pkt);
 	mutex_unlock(&port_ptr->port_rx_q_lock);
 
 	return ret;
@@ -1938,8 +2011,9 @@ int msm_ipc_router_close_port(struct msm_ipc_port *port_ptr)
 
 	if (port_ptr->type == SERVER_PORT || port_ptr->type == CLIENT_PORT) {
 		mutex_lock(&local_ports_lock);
-		list_del(&port_ptr->list);
+		list_del_rcu(&port_ptr->list);
 		mutex_unlock(&local_ports_lock);
+		synchronize_srcu(&local_ports_srcu);
 
 		if (port_ptr->type == SERVER_PORT) {
 			msg.cmd = IPC_ROUTER_CTRL_CMD_REMOVE_SERVER;
@@ -2014,8 +2088,9 @@ int msm_ipc_router_bind_control_port(struct msm_ipc_port *port_ptr)
 		return -EINVAL;
 
 	mutex_lock(&local_ports_lock);
-	list_del(&port_ptr->list);
+	list_del_rcu(&port_ptr->list);
 	mutex_unlock(&local_ports_lock);
+	synchronize_srcu(&local_ports_srcu);
 	port_ptr->type = CONTROL_PORT;
 	mutex_lock(&control_ports_lock);
 	list_add_tail(&port_ptr->list, &control_ports);
@@ -2044,17 +2119,17 @@ int msm_ipc_router_lookup_server_name(struct msm_ipc_port_name *srv_name,
 		return -EINVAL;
 	}
 
-	mutex_lock(&server_list_lock);
+	rcu_read_lock();
 	if (!lookup_mask)
 		lookup_mask = 0xFFFFFFFF;
 	for (key = 0; key < SRV_HASH_SIZE; key++) {
-		list_for_each_entry(server, &server_list[key], list) {
+		list_for_each_entry_rcu(server, &server_list[key], list) {
 			if ((server->name.service != srv_name->service) ||
 			    ((server->name.instance & lookup_mask) !=
 				srv_name->instance))
 				continue;
 
-			list_for_each_entry(server_port,
+			list_for_each_entry_rcu(server_port,
 				&server->server_port_list, list) {
 				if (i < num_entries_in_array) {
 					srv_addr[i].node_id =
@@ -2066,7 +2141,7 @@ int msm_ipc_router_lookup_server_name(struct msm_ipc_port_name *srv_name,
 			}
 		}
 	}
-	mutex_unlock(&server_list_lock);
+	rcu_read_unlock();
 
 	return i;
 }
@@ -2092,17 +2167,17 @@ int msm_ipc_router_lookup_server_name(struct msm_ipc_port_name *srv_name,
 		return -EINVAL;
 	}
 
-	mutex_lock(&server_list_lock);
+	rcu_read_lock();
 	if (!lookup_mask)
 		lookup_mask = 0xFFFFFFFF;
 	for (key = 0; key < SRV_HASH_SIZE; key++) {
-		list_for_each_entry(server, &server_list[key], list) {
+		list_for_each_entry_rcu(server, &server_list[key], list) {
 			if ((server->name.service != srv_name->service) ||
 			    ((server->name.instance & lookup_mask) !=
 				srv_name->instance))
 				continue;
 
-			list_for_each_entry(server_port,
+			list_for_each_entry_rcu(server_port,
 				&server->server_port_list, list) {
 				if (i < num_entries_in_array) {
 					srv_info[i].node_id =
@@ -2118,7 +2193,7 @@ int msm_ipc_router_lookup_server_name(struct msm_ipc_port_name *srv_name,
 			}
 		}
 	}
-	mutex_unlock(&server_list_lock);
+	rcu_read_unlock();
 
 	return i;
 }
@@ -2309,26 +2384,215 @@ static int dump_local_ports(char *buf, int max)
 	return i;
 }
 
+/*
+ * Local loopback latency: LB_BENCH_CLIENTS threads exchange small
+ * messages with an echo port through loopback_data(), the same lookup
+ * and queueing path QMI clients of local services take.
+ */
+#define LB_BENCH_CLIENTS	4
+#define LB_BENCH_ITERS		500
+#define LB_BENCH_MSG_SZ		64
+
+struct lb_bench_client {
+	struct msm_ipc_port *port;
+	struct msm_ipc_addr server;
+	struct completion done;
+	s64 total_ns;
+	s64 max_ns;
+	int count;
+	int ret;
+};
+
+static struct sk_buff_head *lb_bench_alloc_msg(void)
+{
+	struct sk_buff_head *msg;
+	struct sk_buff *skb;
+
+	msg = kmalloc(sizeof(struct sk_buff_head), GFP_KERNEL);
+	if (!msg)
+		return NULL;
+
+	skb = alloc_skb(IPC_ROUTER_HDR_SIZE + LB_BENCH_MSG_SZ, GFP_KERNEL);
+	if (!skb) {
+		kfree(msg);
+		return NULL;
+	}
+	skb_reserve(skb, IPC_ROUTER_HDR_SIZE);
+	memset(skb_put(skb, LB_BENCH_MSG_SZ), 0x5a, LB_BENCH_MSG_SZ);
+	skb_queue_head_init(msg);
+	skb_queue_tail(msg, skb);
+	return msg;
+}
+
+static void lb_bench_free_msg(struct sk_buff_head *msg)
+{
+	skb_queue_purge(msg);
+	kfree(msg);
+}
+
+static int lb_bench_echo(void *data)
+{
+	struct msm_ipc_port *port_ptr = data;
+	struct sk_buff_head *msg;
+	struct msm_ipc_addr src;
+
+	while (!kthread_should_stop()) {
+		if (msm_ipc_router_recv_from(port_ptr, &msg, &src,
+					     HZ / 10) <= 0)
+			continue;
+		msm_ipc_router_send_to(port_ptr, msg, &src);
+	}
+	return 0;
+}
+
+static int lb_bench_client(void *data)
+{
+	struct lb_bench_client *c = data;
+	struct sk_buff_head *msg;
+	ktime_t start;
+	s64 ns;
+	int i;
+
+	for (i = 0; i < LB_BENCH_ITERS; i++) {
+		msg = lb_bench_alloc_msg();
+		if (!msg) {
+			c->ret = -ENOMEM;
+			break;
+		}
+		start = ktime_get();
+		c->ret = msm_ipc_router_send_to(c->port, msg, &c->server);
+		if (c->ret < 0)
+			break;
+		c->ret = msm_ipc_router_recv_from(c->port, &msg, NULL, HZ);
+		if (c->ret < 0)
+			break;
+		ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+		lb_bench_free_msg(msg);
+		c->total_ns += ns;
+		if (ns > c->max_ns)
+			c->max_ns = ns;
+		c->count++;
+	}
+	complete(&c->done);
+	return 0;
+}
+
+static int loopback_bench(char *buf, int max)
+{
+	struct lb_bench_client *clients;
+	struct msm_ipc_port *echo_port;
+	struct task_struct *echo_task, *task;
+	s64 total_ns = 0, max_ns = 0;
+	int i = 0, j, count = 0;
+
+	clients = kzalloc(LB_BENCH_CLIENTS * sizeof(*clients), GFP_KERNEL);
+	if (!clients)
+		return scnprintf(buf, max, "out of memory\n");
+
+	echo_port = msm_ipc_router_create_port(NULL, NULL);
+	if (!echo_port) {
+		kfree(clients);
+		return scnprintf(buf, max, "echo port create failed\n");
+	}
+	echo_task = kthread_run(lb_bench_echo, echo_port, "ipc_rtr_echo");
+	if (IS_ERR(echo_task)) {
+		msm_ipc_router_close_port(echo_port);
+		kfree(clients);
+		return scnprintf(buf, max, "echo thread start failed\n");
+	}
+
+	for (j = 0; j < LB_BENCH_CLIENTS; j++) {
+		init_completion(&clients[j].done);
+		clients[j].server.addrtype = MSM_IPC_ADDR_ID;
+		clients[j].server.addr.port_addr = echo_port->this_port;
+		clients[j].port = msm_ipc_router_create_port(NULL, NULL);
+		if (!clients[j].port) {
+			clients[j].ret = -ENOMEM;
+			complete(&clients[j].done);
+			continue;
+		}
+		task = kthread_run(lb_bench_client, &clients[j],
+				   "ipc_rtr_bench/%d", j);
+		if (IS_ERR(task)) {
+			clients[j].ret = PTR_ERR(task);
+			complete(&clients[j].done);
+		}
+	}
+
+	for (j = 0; j < LB_BENCH_CLIENTS; j++) {
+		wait_for_completion(&clients[j].done);
+		if (clients[j].port)
+			msm_ipc_router_close_port(clients[j].port);
+		if (clients[j].ret < 0)
+			i += scnprintf(buf + i, max - i,
+				       "client %d failed: %d\n",
+				       j, clients[j].ret);
+		total_ns += clients[j].total_ns;
+		count += clients[j].count;
+		if (clients[j].max_ns > max_ns)
+			max_ns = clients[j].max_ns;
+	}
+	kthread_stop(echo_task);
+	msm_ipc_router_close_port(echo_port);
+
+	i += scnprintf(buf + i, max - i, "clients: %d\n", LB_BENCH_CLIENTS);
+	i += scnprintf(buf + i, max - i, "msg size: %d\n", LB_BENCH_MSG_SZ);
+	i += scnprintf(buf + i, max - i, "round trips: %d\n", count);
+	if (count)
+		i += scnprintf(buf + i, max - i, "avg latency: %lld ns\n",
+			       div_s64(total_ns, count));
+	i += scnprintf(buf + i, max - i, "max latency: %lld ns\n", max_ns);
+
+	kfree(clients);
+	return i;
+}
+
 #define DEBUG_BUFMAX 4096
-static char debug_buffer[DEBUG_BUFMAX];
 
+struct debug_file {
+	int (*fill)(char *buf, int max);
+	int size;
+	char buf[DEBUG_BUFMAX];
+};
+
+/*
+ * Some dumps (the loopback benchmark) are expensive, so the buffer is
+ * filled once per open at offset 0 and later chunks are served from it.
+ */
 static ssize_t debug_read(struct file *file, char __user *buf,
 			  size_t count, loff_t *ppos)
 {
-	int (*fill)(char *buf, int max) = file->private_data;
-	int bsize = fill(debug_buffer, DEBUG_BUFMAX);
-	return simple_read_from_buffer(buf, count, ppos, debug_buffer, bsize);
+	struct debug_file *df = file->private_data;
+
+	if (*ppos == 0)
+		df->size = df->fill(df->buf, DEBUG_BUFMAX);
+
+	return simple_read_from_buffer(buf, count, ppos, df->buf, df->size);
 }
 
 static int debug_open(struct inode *inode, struct file *file)
 {
-	file->private_data = inode->i_private;
+	struct debug_file *df;
+
+	df = kzalloc(sizeof(*df), GFP_KERNEL);
+	if (!df)
+		return -ENOMEM;
+
+	df->fill = inode->i_private;
+	file->private_data = df;
+	return 0;
+}
+
+static int debug_release(struct inode *inode, struct file *file)
+{
+	kfree(file->private_data);
 	return 0;
 }
 
 static const struct file_operations debug_ops = {
 	.read = debug_read,
 	.open = debug_open,
+	.release = debug_release,
 };
 
 static void debug_create(const char *name, mode_t mode,
@@ -2358,6 +2622,8 @@ static void debugfs_init(void)
 		      dump_xprt_info);
 	debug_create("dump_routing_table", 0444, dent,
 		      dump_routing_table);
+	debug_create("loopback_bench", 0444, dent,
+		      loopback_bench);
 }
 
 #else
@@ -2518,9 +2784,9 @@ void msm_ipc_router_xprt_notify(struct msm_ipc_router_xprt *xprt,
 		xprt_info = xprt->priv;
 	}
 
-	pkt = clone_pkt((struct rr_packet *)data);
-	if (!pkt)
-		return;
+	/* share the transport's packet rather than cloning every skb */
+	pkt = (struct rr_packet *)data;
+	kref_get(&pkt->ref);
 
 	mutex_lock(&xprt_info->rx_lock);
 	list_add_tail(&pkt->list, &xprt_info->pkt_list);
@@ -2586,6 +2852,9 @@ static int __init msm_ipc_router_init(void)
 
 	for (i = 0; i < LP_HASH_SIZE; i++)
 		INIT_LIST_HEAD(&local_ports[i]);
+	ret = init_srcu_struct(&local_ports_srcu);
+	if (ret < 0)
+		return ret;
 
 	mutex_lock(&routing_table_lock);
 	if (!routing_table_inited) {
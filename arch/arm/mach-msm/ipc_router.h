@@ -18,6 +18,7 @@
 #include <linux/errno.h>
 #include <linux/mm.h>
 #include <linux/list.h>
+#include <linux/kref.h>
 #include <linux/cdev.h>
 #include <linux/platform_device.h>
 #include <linux/wakelock.h>
@@ -99,6 +100,7 @@ struct rr_packet {
 	struct list_head list;
 	struct sk_buff_head *pkt_fragment_q;
 	uint32_t length;
+	struct kref ref;
 };
 
 struct msm_ipc_port {
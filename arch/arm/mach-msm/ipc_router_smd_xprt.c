@@ -109,6 +109,7 @@ static int msm_ipc_router_smd_remote_write(void *data,
 	int offset, sz_written = 0;
 	int ret, num_retries = 0;
 	unsigned long flags;
+	void *fifo_buf;
 	struct msm_ipc_router_smd_xprt *smd_xprtp =
 		container_of(xprt, struct msm_ipc_router_smd_xprt, xprt);
 
@@ -119,6 +120,22 @@ static int msm_ipc_router_smd_remote_write(void *data,
 		return -EINVAL;
 
 	align_sz = ALIGN_SIZE(pkt->length);
+
+	/* gather the fragments straight into the fifo when there is room */
+	if (smd_write_reserve(smd_xprtp->channel, &fifo_buf,
+			      len + align_sz) == len + align_sz) {
+		offset = 0;
+		skb_queue_walk(pkt->pkt_fragment_q, ipc_rtr_pkt) {
+			memcpy(fifo_buf + offset, ipc_rtr_pkt->data,
+			       ipc_rtr_pkt->len);
+			offset += ipc_rtr_pkt->len;
+		}
+		memset(fifo_buf + offset, 0, align_sz);
+		smd_write_commit(smd_xprtp->channel, len + align_sz);
+		D("%s: Wrote %d bytes in place over %s\n",
+		  __func__, len, xprt->name);
+		return len;
+	}
 	while ((ret = smd_write_start(smd_xprtp->channel,
 				      (len + align_sz))) < 0) {
 		spin_lock_irqsave(&smd_xprtp->ss_reset_lock, flags);
@@ -259,6 +276,7 @@ static void smd_xprt_read_data(struct work_struct *work)
 				return;
 			}
 			skb_queue_head_init(smd_xprtp->in_pkt->pkt_fragment_q);
+			kref_init(&smd_xprtp->in_pkt->ref);
 			smd_xprtp->is_partial_in_pkt = 1;
 			D("%s: Allocated rr_packet\n", __func__);
 		}
@@ -35,8 +35,7 @@
 #include <linux/delay.h>
 #include <linux/export.h>
 #ifdef CONFIG_MSM_MPDEC_INPUTBOOST_CPUMIN
-#include <linux/input.h>
-#include <linux/slab.h>
+#include <linux/input_boost.h>
 #endif
 #include "acpuclock.h"
 
@@ -471,79 +470,37 @@ static void mpdec_input_callback(struct work_struct *unused) {
     return;
 }
 
-static void mpdec_input_event(struct input_handle *handle, unsigned int type,
-        unsigned int code, int value) {
+static int mpdec_input_boost_notify(struct notifier_block *nb,
+        unsigned long val, void *data) {
+    struct input_boost_event *ev = data;
     int i = 0;
 
+    if (val != INPUT_BOOST_START)
+        return NOTIFY_DONE;
+
     if (!msm_mpdec_tuners_ins.boost_enabled)
-        return;
+        return NOTIFY_DONE;
 
     if (!is_screen_on)
-        return;
+        return NOTIFY_DONE;
 
-    for_each_online_cpu(i) {
-        queue_work_on(i, mpdec_input_wq, &per_cpu(mpdec_input_work, i));
+    /* bring up the cores the boost policy asks for */
+    if (state != MSM_MPDEC_DISABLED) {
+        for (i = 1; i < ev->min_cpus && i < msm_mpdec_tuners_ins.max_cpus; i++) {
+            if (!cpu_online(i))
+                mpdec_cpu_up(i);
+        }
     }
-}
 
-static int input_dev_filter(const char *input_dev_name) {
-    if (strstr(input_dev_name, "touch") ||
-        strstr(input_dev_name, "keypad")) {
-        return 0;
-    } else {
-        return 1;
+    for_each_online_cpu(i) {
+        queue_work_on(i, mpdec_input_wq, &per_cpu(mpdec_input_work, i));
     }
-}
 
-static int mpdec_input_connect(struct input_handler *handler,
-        struct input_dev *dev, const struct input_device_id *id) {
-    struct input_handle *handle;
-    int error;
-
-    if (input_dev_filter(dev->name))
-        return -ENODEV;
-
-    handle = kzalloc(sizeof(struct input_handle), GFP_KERNEL);
-    if (!handle)
-        return -ENOMEM;
-
-    handle->dev = dev;
-    handle->handler = handler;
-    handle->name = "mpdec";
-
-    error = input_register_handle(handle);
-    if (error)
-        goto err2;
-
-    error = input_open_device(handle);
-    if (error)
-        goto err1;
-
-    return 0;
-err1:
-    input_unregister_handle(handle);
-err2:
-    kfree(handle);
-    return error;
-}
-
-static void mpdec_input_disconnect(struct input_handle *handle) {
-    input_close_device(handle);
-    input_unregister_handle(handle);
-    kfree(handle);
+    return NOTIFY_OK;
 }
 
-static const struct input_device_id mpdec_ids[] = {
-    { .driver_info = 1 },
-    { },
-};
-
-static struct input_handler mpdec_input_handler = {
-    .event        = mpdec_input_event,
-    .connect      = mpdec_input_connect,
-    .disconnect   = mpdec_input_disconnect,
-    .name         = "mpdec_inputreq",
-    .id_table     = mpdec_ids,
+static struct notifier_block mpdec_input_boost_nb = {
+    .notifier_call = mpdec_input_boost_notify,
 };
 #endif
 
@@ -1143,7 +1100,7 @@ static int __init msm_mpdec_init(void) {
         INIT_WORK(&per_cpu(mpdec_input_work, i), mpdec_input_callback);
         INIT_DELAYED_WORK(&per_cpu(msm_mpdec_revib_work, i), msm_mpdec_revib_work_thread);
     }
-    rc = input_register_handler(&mpdec_input_handler);
+    rc = input_boost_register_notifier(&mpdec_input_boost_nb);
 #endif
 
     if (state != MSM_MPDEC_DISABLED)
@@ -1175,7 +1132,7 @@ late_initcall(msm_mpdec_init);
 
 void msm_mpdec_exit(void) {
 #ifdef CONFIG_MSM_MPDEC_INPUTBOOST_CPUMIN
-    input_unregister_handler(&mpdec_input_handler);
+    input_boost_unregister_notifier(&mpdec_input_boost_nb);
     destroy_workqueue(msm_mpdec_revib_workq);
     destroy_workqueue(mpdec_input_wq);
 #endif
@@ -26,6 +26,7 @@
 #include <linux/list.h>
 #include <linux/slab.h>
 #include <linux/delay.h>
+#include <linux/hrtimer.h>
 #include <linux/io.h>
 #include <linux/termios.h>
 #include <linux/ctype.h>
@@ -191,6 +192,16 @@ static int msm_smd_debug_mask;
 module_param_named(debug_mask, msm_smd_debug_mask,
 		   int, S_IRUGO | S_IWUSR | S_IWGRP);
 
+/*
+ * When non-zero, write signals to the remote side are held back for up to
+ * this long so that a burst of writes costs a single interrupt.  A signal
+ * still goes out immediately once the send fifo is half full.  Reads
+ * always signal at once, the remote writer may be waiting for the space.
+ */
+static int smd_signal_delay_us;
+module_param_named(signal_delay_us, smd_signal_delay_us,
+		   int, S_IRUGO | S_IWUSR | S_IWGRP);
+
 #if defined(CONFIG_MSM_SMD_DEBUG)
 #define SMD_DBG(x...) do {				\
 		if (msm_smd_debug_mask & MSM_SMD_DEBUG) \
@@ -738,10 +749,13 @@ struct smd_channel {
 	unsigned type;
 
 	int pending_pkt_sz;
+	int reserved_sz;
 
 	char is_pkt_ch;
 
 	struct smd_half_channel_access *half_ch;
+
+	struct hrtimer signal_timer;
 };
 
 struct edge_to_pid {
@@ -1158,6 +1172,44 @@ static void ch_write_done(struct smd_channel *ch, unsigned count)
 	ch->half_ch->set_fHEAD(ch->send, 1);
 }
 
+static enum hrtimer_restart smd_signal_timer_fn(struct hrtimer *timer)
+{
+	struct smd_channel *ch = container_of(timer, struct smd_channel,
+						signal_timer);
+
+	ch->notify_other_cpu();
+	return HRTIMER_NORESTART;
+}
+
+static void smd_signal_init(struct smd_channel *ch)
+{
+	hrtimer_init(&ch->signal_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	ch->signal_timer.function = smd_signal_timer_fn;
+}
+
+static void smd_signal_remote_now(struct smd_channel *ch)
+{
+	hrtimer_try_to_cancel(&ch->signal_timer);
+	ch->notify_other_cpu();
+}
+
+/* signal new data in the send fifo, see smd_signal_delay_us */
+static void smd_signal_remote(struct smd_channel *ch)
+{
+	int delay = smd_signal_delay_us;
+
+	if (delay <= 0 ||
+	    smd_stream_write_avail(ch) < (ch->fifo_size >> 1)) {
+		smd_signal_remote_now(ch);
+		return;
+	}
+
+	if (!hrtimer_active(&ch->signal_timer))
+		hrtimer_start(&ch->signal_timer,
+			ns_to_ktime((u64)delay * NSEC_PER_USEC),
+			HRTIMER_MODE_REL);
+}
+
 static void ch_set_state(struct smd_channel *ch, unsigned n)
 {
 	if (n == SMD_SS_OPENED) {
@@ -1430,7 +1482,7 @@ static int smd_is_packet(struct smd_alloc_elm *alloc_elm)
 		return 0;
 }
 
-static int smd_stream_write(smd_channel_t *ch, const void *_data, int len,
+static int __smd_stream_write(smd_channel_t *ch, const void *_data, int len,
 				int user_buf)
 {
 	void *ptr;
@@ -1470,12 +1522,21 @@ static int smd_stream_write(smd_channel_t *ch, const void *_data, int len,
 			break;
 	}
 
-	if (orig_len - len)
-		ch->notify_other_cpu();
-
 	return orig_len - len;
 }
 
+static int smd_stream_write(smd_channel_t *ch, const void *_data, int len,
+				int user_buf)
+{
+	int r;
+
+	r = __smd_stream_write(ch, _data, len, user_buf);
+	if (r > 0)
+		smd_signal_remote(ch);
+
+	return r;
+}
+
 static int smd_packet_write(smd_channel_t *ch, const void *_data, int len,
 				int user_buf)
 {
@@ -1495,7 +1556,7 @@ static int smd_packet_write(smd_channel_t *ch, const void *_data, int len,
 	hdr[1] = hdr[2] = hdr[3] = hdr[4] = 0;
 
 
-	ret = smd_stream_write(ch, hdr, sizeof(hdr), 0);
+	ret = __smd_stream_write(ch, hdr, sizeof(hdr), 0);
 	if (ret < 0 || ret != sizeof(hdr)) {
 		SMD_DBG("%s failed to write pkt header: "
 			"%d returned\n", __func__, ret);
@@ -1503,7 +1564,8 @@ static int smd_packet_write(smd_channel_t *ch, const void *_data, int len,
 	}
 
 
-	ret = smd_stream_write(ch, _data, len, user_buf);
+	ret = __smd_stream_write(ch, _data, len, user_buf);
+	smd_signal_remote(ch);
 	if (ret < 0 || ret != len) {
 		SMD_DBG("%s failed to write pkt data: "
 			"%d returned\n", __func__, ret);
@@ -1523,7 +1585,7 @@ static int smd_stream_read(smd_channel_t *ch, void *data, int len, int user_buf)
 	r = ch_read(ch, data, len, user_buf);
 	if (r > 0)
 		if (!read_intr_blocked(ch))
-			ch->notify_other_cpu();
+			smd_signal_remote_now(ch);
 
 	return r;
 }
@@ -1542,7 +1604,7 @@ static int smd_packet_read(smd_channel_t *ch, void *data, int len, int user_buf)
 	r = ch_read(ch, data, len, user_buf);
 	if (r > 0)
 		if (!read_intr_blocked(ch))
-			ch->notify_other_cpu();
+			smd_signal_remote_now(ch);
 
 	spin_lock_irqsave(&smd_lock, flags);
 	ch->current_packet -= r;
@@ -1566,7 +1628,7 @@ static int smd_packet_read_from_cb(smd_channel_t *ch, void *data, int len,
 	r = ch_read(ch, data, len, user_buf);
 	if (r > 0)
 		if (!read_intr_blocked(ch))
-			ch->notify_other_cpu();
+			smd_signal_remote_now(ch);
 
 	ch->current_packet -= r;
 	update_packet_state(ch);
@@ -1670,6 +1732,7 @@ static int smd_alloc_channel(struct smd_alloc_elm *alloc_elm)
 	}
 
 	ch->fifo_mask = ch->fifo_size - 1;
+	smd_signal_init(ch);
 
 	
 	if (ch->type == SMD_APPS_MODEM)
@@ -1755,6 +1818,8 @@ static int smd_alloc_loopback_channel(void)
 	ch->fifo_mask = ch->fifo_size - 1;
 	ch->type = SMD_LOOPBACK_TYPE;
 	ch->notify_other_cpu = notify_loopback_smd;
+	ch->half_ch = get_half_ch_funcs(ch->type);
+	smd_signal_init(ch);
 
 	ch->read = smd_stream_read;
 	ch->write = smd_stream_write;
@@ -1926,6 +1991,10 @@ int smd_close(smd_channel_t *ch)
 
 	SMD_INFO("smd_close(%s)\n", ch->name);
 
+	if (hrtimer_cancel(&ch->signal_timer))
+		ch->notify_other_cpu();
+	ch->reserved_sz = 0;
+
 	spin_lock_irqsave(&smd_lock, flags);
 	list_del(&ch->ch_list);
 	if (ch->n == SMD_LOOPBACK_CID) {
@@ -1974,6 +2043,8 @@ int smd_write_start(smd_channel_t *ch, int len)
 			ch->pending_pkt_sz);
 		return -EBUSY;
 	}
+	if (ch->reserved_sz)
+		return -EBUSY;
 	ch->pending_pkt_sz = len;
 
 	if (smd_stream_write_avail(ch) < (SMD_HEADER_SIZE)) {
@@ -1986,7 +2057,7 @@ int smd_write_start(smd_channel_t *ch, int len)
 	hdr[1] = hdr[2] = hdr[3] = hdr[4] = 0;
 
 
-	ret = smd_stream_write(ch, hdr, sizeof(hdr), 0);
+	ret = __smd_stream_write(ch, hdr, sizeof(hdr), 0);
 	if (ret < 0 || ret != sizeof(hdr)) {
 		ch->pending_pkt_sz = 0;
 		pr_err("%s: packet header failed to write\n", __func__);
@@ -2019,10 +2090,14 @@ int smd_write_segment(smd_channel_t *ch, void *data, int len, int user_buf)
 		return -EINVAL;
 	}
 
-	bytes_written = smd_stream_write(ch, data, len, user_buf);
+	bytes_written = __smd_stream_write(ch, data, len, user_buf);
 
 	ch->pending_pkt_sz -= bytes_written;
 
+	/* signal at the end of the packet, or now if the fifo filled up */
+	if (bytes_written < len || !ch->pending_pkt_sz)
+		smd_signal_remote(ch);
+
 	return bytes_written;
 }
 EXPORT_SYMBOL(smd_write_segment);
@@ -2043,6 +2118,111 @@ int smd_write_end(smd_channel_t *ch)
 }
 EXPORT_SYMBOL(smd_write_end);
 
+static void ch_write_at_head(struct smd_channel *ch, const void *data,
+			     unsigned len)
+{
+	unsigned head = ch->half_ch->get_head(ch->send);
+	unsigned n = min(len, ch->fifo_size - head);
+
+	memcpy(ch->send_data + head, data, n);
+	if (len > n)
+		memcpy(ch->send_data, data + n, len - n);
+}
+
+int smd_write_reserve(smd_channel_t *ch, void **data, int len)
+{
+	unsigned hdr_sz;
+	unsigned offset;
+
+	if (!ch) {
+		pr_err("%s: Invalid channel specified\n", __func__);
+		return -ENODEV;
+	}
+	if (len < 1) {
+		pr_err("%s: invalid length: %d\n", __func__, len);
+		return -EINVAL;
+	}
+	if (ch->pending_pkt_sz || ch->reserved_sz)
+		return -EBUSY;
+	if (!ch_is_open(ch))
+		return -EPIPE;
+
+	hdr_sz = ch->is_pkt_ch ? SMD_HEADER_SIZE : 0;
+	if (smd_stream_write_avail(ch) < hdr_sz + len)
+		return -EAGAIN;
+
+	offset = (ch->half_ch->get_head(ch->send) + hdr_sz) & ch->fifo_mask;
+	if (offset + len > ch->fifo_size)
+		return -EAGAIN;
+
+	*data = ch->send_data + offset;
+	ch->reserved_sz = len;
+	return len;
+}
+EXPORT_SYMBOL(smd_write_reserve);
+
+int smd_write_commit(smd_channel_t *ch, int len)
+{
+	unsigned hdr[5];
+	unsigned count = len;
+
+	if (!ch) {
+		pr_err("%s: Invalid channel specified\n", __func__);
+		return -ENODEV;
+	}
+	if (!ch->reserved_sz) {
+		pr_err("%s: no reservation in progress\n", __func__);
+		return -ENOEXEC;
+	}
+	if (len < 0 || len > ch->reserved_sz) {
+		pr_err("%s: invalid length: %d\n", __func__, len);
+		return -EINVAL;
+	}
+
+	ch->reserved_sz = 0;
+	if (!len)
+		return 0;
+
+	if (ch->is_pkt_ch) {
+		hdr[0] = len;
+		hdr[1] = hdr[2] = hdr[3] = hdr[4] = 0;
+		ch_write_at_head(ch, hdr, sizeof(hdr));
+		count += sizeof(hdr);
+	}
+
+	ch_write_done(ch, count);
+	smd_signal_remote(ch);
+	return len;
+}
+EXPORT_SYMBOL(smd_write_commit);
+
+int smd_read_peek(smd_channel_t *ch, void **data)
+{
+	int n;
+
+	if (!ch) {
+		pr_err("%s: Invalid channel specified\n", __func__);
+		return -ENODEV;
+	}
+
+	n = ch_read_buffer(ch, data);
+	if (ch->is_pkt_ch && n > ch->current_packet)
+		n = ch->current_packet;
+	return n;
+}
+EXPORT_SYMBOL(smd_read_peek);
+
+int smd_read_consume(smd_channel_t *ch, int len)
+{
+	if (!ch) {
+		pr_err("%s: Invalid channel specified\n", __func__);
+		return -ENODEV;
+	}
+
+	return ch->read(ch, NULL, len, 0);
+}
+EXPORT_SYMBOL(smd_read_consume);
+
 int smd_read(smd_channel_t *ch, void *data, int len)
 {
 	if (!ch) {
@@ -2083,7 +2263,8 @@ int smd_write(smd_channel_t *ch, const void *data, int len)
 		return -ENODEV;
 	}
 
-	return ch->pending_pkt_sz ? -EBUSY : ch->write(ch, data, len, 0);
+	return (ch->pending_pkt_sz || ch->reserved_sz) ? -EBUSY :
+						ch->write(ch, data, len, 0);
 }
 EXPORT_SYMBOL(smd_write);
 
@@ -2094,7 +2275,8 @@ int smd_write_user_buffer(smd_channel_t *ch, const void *data, int len)
 		return -ENODEV;
 	}
 
-	return ch->pending_pkt_sz ? -EBUSY : ch->write(ch, data, len, 1);
+	return (ch->pending_pkt_sz || ch->reserved_sz) ? -EBUSY :
+						ch->write(ch, data, len, 1);
 }
 EXPORT_SYMBOL(smd_write_user_buffer);
 
@@ -19,8 +19,12 @@
 #include <linux/list.h>
 #include <linux/ctype.h>
 #include <linux/jiffies.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/completion.h>
 
 #include <mach/msm_iomap.h>
+#include <mach/msm_smd.h>
 
 #include "smd_private.h"
 
@@ -515,6 +519,118 @@ static int debug_test_smsm(char *buf, int max)
 	return i;
 }
 
+/*
+ * Round trip through the local loopback channel: every write lands in
+ * the same fifo and the data notification comes back synchronously, so
+ * this measures the per-packet cost of the smd core itself, once with
+ * smd_write/smd_read and once with the reserve/commit and peek/consume
+ * calls.
+ */
+#define LB_BENCH_ITERS		1000
+
+static struct completion lb_bench_done;
+
+static void lb_bench_notify(void *priv, unsigned event)
+{
+	if (event == SMD_EVENT_DATA)
+		complete(&lb_bench_done);
+}
+
+static int lb_bench_run(smd_channel_t *ch, char *pkt, int size,
+			bool inplace, s64 *max_ns)
+{
+	void *ptr;
+	int n, done;
+	int iter;
+	ktime_t t;
+	s64 ns;
+
+	for (iter = 0; iter < LB_BENCH_ITERS; iter++) {
+		INIT_COMPLETION(lb_bench_done);
+		t = ktime_get();
+		if (inplace && smd_write_reserve(ch, &ptr, size) == size) {
+			memcpy(ptr, pkt, size);
+			n = smd_write_commit(ch, size);
+		} else {
+			n = smd_write(ch, pkt, size);
+		}
+		if (n != size)
+			return -EIO;
+		if (!wait_for_completion_timeout(&lb_bench_done, HZ))
+			return -ETIMEDOUT;
+
+		for (done = 0; done < size; done += n) {
+			if (inplace) {
+				n = smd_read_peek(ch, &ptr);
+				if (n > size - done)
+					n = size - done;
+				if (n > 0)
+					n = smd_read_consume(ch, n);
+			} else {
+				n = smd_read(ch, pkt, size - done);
+			}
+			if (n <= 0)
+				return -EIO;
+		}
+		ns = ktime_to_ns(ktime_sub(ktime_get(), t));
+		if (ns > *max_ns)
+			*max_ns = ns;
+	}
+	return 0;
+}
+
+static int debug_loopback_bench(char *buf, int max)
+{
+	static const int sizes[] = { 16, 64, 256, 1024, 4096 };
+	smd_channel_t *ch;
+	char *pkt;
+	int i = 0;
+	int k, mode, ret;
+	ktime_t start;
+	s64 total_ns, max_ns;
+
+	pkt = kzalloc(sizes[ARRAY_SIZE(sizes) - 1], GFP_KERNEL);
+	if (!pkt)
+		return scnprintf(buf, max, "out of memory\n");
+
+	init_completion(&lb_bench_done);
+	ret = smd_named_open_on_edge("local_loopback", SMD_LOOPBACK_TYPE,
+				     &ch, NULL, lb_bench_notify);
+	if (ret) {
+		kfree(pkt);
+		return scnprintf(buf, max, "open local_loopback failed %d\n",
+				 ret);
+	}
+
+	i += scnprintf(buf + i, max - i, "%-8s %6s %10s %10s %10s\n",
+		       "mode", "size", "avg_ns", "max_ns", "KB/s");
+	for (mode = 0; mode < 2; mode++) {
+		for (k = 0; k < ARRAY_SIZE(sizes); k++) {
+			max_ns = 0;
+			start = ktime_get();
+			ret = lb_bench_run(ch, pkt, sizes[k], mode, &max_ns);
+			total_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+			if (ret) {
+				i += scnprintf(buf + i, max - i,
+					       "%-8s %6d failed %d\n",
+					       mode ? "inplace" : "copy",
+					       sizes[k], ret);
+				continue;
+			}
+			i += scnprintf(buf + i, max - i,
+				       "%-8s %6d %10lld %10lld %10lld\n",
+				       mode ? "inplace" : "copy", sizes[k],
+				       div_s64(total_ns, LB_BENCH_ITERS), max_ns,
+				       div64_s64((s64)sizes[k] * LB_BENCH_ITERS *
+						 1000000, total_ns ? : 1));
+		}
+	}
+
+	smd_close(ch);
+	kfree(pkt);
+	return i;
+}
+
 static int debug_read_mem(char *buf, int max)
 {
 	unsigned n;
@@ -774,6 +890,7 @@ static int __init smd_debugfs_init(void)
 	debug_create("print_f3", 0444, dent, debug_f3);
 	debug_create("int_stats", 0444, dent, debug_int_stats);
 	debug_create("int_stats_reset", 0444, dent, debug_int_stats_reset);
+	debug_create("loopback_bench", 0444, dent, debug_loopback_bench);
 
 	
 	debug_create("build", 0444, dent, debug_read_build_id);
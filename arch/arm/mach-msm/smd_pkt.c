@@ -456,6 +456,7 @@ ssize_t smd_pkt_write(struct file *file,
 {
 	int r = 0, bytes_written;
 	struct smd_pkt_dev *smd_pkt_devp;
+	void *fifo_buf;
 	DEFINE_WAIT(write_wait);
 
 	smd_pkt_devp = file->private_data;
@@ -490,6 +491,18 @@ ssize_t smd_pkt_write(struct file *file,
 		}
 	}
 
+	/* build the packet in place when it fits without wrapping */
+	if (smd_write_reserve(smd_pkt_devp->ch, &fifo_buf, count) == count) {
+		if (copy_from_user(fifo_buf, buf, count)) {
+			smd_write_commit(smd_pkt_devp->ch, 0);
+			mutex_unlock(&smd_pkt_devp->tx_lock);
+			return -EFAULT;
+		}
+		smd_write_commit(smd_pkt_devp->ch, count);
+		bytes_written = count;
+		goto write_done;
+	}
+
 	r = smd_write_start(smd_pkt_devp->ch, count);
 	if (r < 0) {
 		mutex_unlock(&smd_pkt_devp->tx_lock);
@@ -535,6 +548,7 @@ ssize_t smd_pkt_write(struct file *file,
 		}
 	} while (bytes_written != count);
 	smd_write_end(smd_pkt_devp->ch);
+write_done:
 	mutex_unlock(&smd_pkt_devp->tx_lock);
 	D_WRITE_DUMP_BUFFER("Write: ",
 			    (bytes_written > 16 ? 16 : bytes_written), buf);
@@ -0,0 +1,133 @@
+/*
+ * Userspace implementations of gettimeofday() and clock_gettime().
+ * The coarse clocks are read from the vDSO data page, the rest use
+ * the system call.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/compiler.h>
+#include <linux/time.h>
+#include <asm/barrier.h>
+#include <asm/page.h>
+#include <asm/processor.h>
+#include <asm/unistd.h>
+#include <asm/vdso_datapage.h>
+
+extern struct vdso_data *__get_datapage(void);
+
+static notrace u32 vdso_read_begin(const struct vdso_data *vdata)
+{
+	u32 seq;
+repeat:
+	seq = ACCESS_ONCE(vdata->seq_count);
+	if (seq & 1) {
+		cpu_relax();
+		goto repeat;
+	}
+	smp_rmb();
+	return seq;
+}
+
+static notrace int vdso_read_retry(const struct vdso_data *vdata, u32 start)
+{
+	smp_rmb();
+	return vdata->seq_count != start;
+}
+
+static notrace long clock_gettime_fallback(clockid_t _clkid,
+					   struct timespec *_ts)
+{
+	register struct timespec *ts asm("r1") = _ts;
+	register clockid_t clkid asm("r0") = _clkid;
+	register long ret asm ("r0");
+	register long nr asm("r7") = __NR_clock_gettime;
+
+	asm volatile(
+	"	swi #0\n"
+	: "=r" (ret)
+	: "r" (clkid), "r" (ts), "r" (nr)
+	: "memory");
+
+	return ret;
+}
+
+static notrace long gettimeofday_fallback(struct timeval *_tv,
+					  struct timezone *_tz)
+{
+	register struct timezone *tz asm("r1") = _tz;
+	register struct timeval *tv asm("r0") = _tv;
+	register long ret asm ("r0");
+	register long nr asm("r7") = __NR_gettimeofday;
+
+	asm volatile(
+	"	swi #0\n"
+	: "=r" (ret)
+	: "r" (tv), "r" (tz), "r" (nr)
+	: "memory");
+
+	return ret;
+}
+
+static notrace void add_wtm(const struct vdso_data *vdata, struct timespec *ts,
+			    u32 sec, u32 nsec)
+{
+	ts->tv_sec = sec + vdata->wtm_clock_sec;
+	ts->tv_nsec = nsec + vdata->wtm_clock_nsec;
+	if (ts->tv_nsec >= NSEC_PER_SEC) {
+		ts->tv_nsec -= NSEC_PER_SEC;
+		ts->tv_sec++;
+	}
+}
+
+static notrace void do_realtime_coarse(const struct vdso_data *vdata,
+				       struct timespec *ts)
+{
+	u32 seq;
+
+	do {
+		seq = vdso_read_begin(vdata);
+		ts->tv_sec = vdata->xtime_coarse_sec;
+		ts->tv_nsec = vdata->xtime_coarse_nsec;
+	} while (vdso_read_retry(vdata, seq));
+}
+
+static notrace void do_monotonic_coarse(const struct vdso_data *vdata,
+					struct timespec *ts)
+{
+	u32 seq;
+
+	do {
+		seq = vdso_read_begin(vdata);
+		add_wtm(vdata, ts, vdata->xtime_coarse_sec,
+			vdata->xtime_coarse_nsec);
+	} while (vdso_read_retry(vdata, seq));
+}
+
+/*
+ * No clocksource on these targets can be read from user mode (the MSM
+ * GPT/DGT timers are memory mapped), so only the _COARSE clocks are
+ * answered from the data page.  Everything else goes straight to the
+ * system call.
+ */
+notrace int __vdso_clock_gettime(clockid_t clkid, struct timespec *ts)
+{
+	struct vdso_data *vdata = __get_datapage();
+
+	switch (clkid) {
+	case CLOCK_REALTIME_COARSE:
+		do_realtime_coarse(vdata, ts);
+		return 0;
+	case CLOCK_MONOTONIC_COARSE:
+		do_monotonic_coarse(vdata, ts);
+		return 0;
+	}
+
+	return clock_gettime_fallback(clkid, ts);
+}
+
+notrace int __vdso_gettimeofday(struct timeval *tv, struct timezone *tz)
+{
+	return gettimeofday_fallback(tv, tz);
+}
@@ -498,6 +498,19 @@ static int proc_read_status(char *page, char **start, off_t off, int count,
 /*
  * Kernel-side NEON support functions
  */
+static DEFINE_PER_CPU(bool, kernel_neon_busy);
+
+/*
+ * True if kernel_neon_begin() may be called here: not from interrupt
+ * context and not from inside another kernel_neon_begin() section.
+ * A task inside a section cannot migrate, so the per-cpu read is safe.
+ */
+bool kernel_neon_usable(void)
+{
+	return !in_interrupt() && !__this_cpu_read(kernel_neon_busy);
+}
+EXPORT_SYMBOL(kernel_neon_usable);
+
 void kernel_neon_begin(void)
 {
 	struct thread_info *thread = current_thread_info();
@@ -526,11 +539,13 @@ void kernel_neon_begin(void)
 		vfp_save_state(vfp_current_hw_state[cpu], fpexc);
 #endif
 	vfp_current_hw_state[cpu] = NULL;
+	__this_cpu_write(kernel_neon_busy, true);
 }
 EXPORT_SYMBOL(kernel_neon_begin);
 
 void kernel_neon_end(void)
 {
+	__this_cpu_write(kernel_neon_busy, false);
 	/* Disable the NEON/VFP unit. */
 	fmxr(FPEXC, fmrx(FPEXC) & ~FPEXC_EN);
 	put_cpu();
@@ -29,6 +29,10 @@
 #include <linux/async.h>
 #include <linux/suspend.h>
 #include <linux/timer.h>
+#include <linux/slab.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/math64.h>
 
 #include "../base.h"
 #include "power.h"
@@ -310,21 +314,35 @@ static void dpm_show_time(ktime_t starttime, pm_message_t state, char *info)
 		usecs / USEC_PER_MSEC, usecs % USEC_PER_MSEC);
 }
 
+static void dpm_account_time(struct device *dev, pm_message_t state,
+			     ktime_t starttime)
+{
+	s64 delta = ktime_to_ns(ktime_sub(ktime_get(), starttime));
+
+	if (state.event & (PM_EVENT_RESUME | PM_EVENT_THAW |
+			   PM_EVENT_RESTORE | PM_EVENT_RECOVER))
+		dev->power.resume_ns += delta;
+	else
+		dev->power.suspend_ns += delta;
+}
+
 static int dpm_run_callback(pm_callback_t cb, struct device *dev,
 			    pm_message_t state, char *info)
 {
-	ktime_t calltime;
+	ktime_t calltime, starttime;
 	int error;
 
 	if (!cb)
 		return 0;
 
 	calltime = initcall_debug_start(dev);
+	starttime = ktime_get();
 
 	pm_dev_dbg(dev, state, info);
 	error = cb(dev);
 	suspend_report_result(cb, error);
 
+	dpm_account_time(dev, state, starttime);
 	initcall_debug_report(dev, calltime, error);
 
 	return error;
@@ -844,13 +862,15 @@ static int legacy_suspend(struct device *dev, pm_message_t state,
 			  int (*cb)(struct device *dev, pm_message_t state))
 {
 	int error;
-	ktime_t calltime;
+	ktime_t calltime, starttime;
 
 	calltime = initcall_debug_start(dev);
+	starttime = ktime_get();
 
 	error = cb(dev, state);
 	suspend_report_result(cb, error);
 
+	dpm_account_time(dev, state, starttime);
 	initcall_debug_report(dev, calltime, error);
 
 	return error;
@@ -1047,6 +1067,8 @@ static int device_prepare(struct device *dev, pm_message_t state)
 	device_lock(dev);
 
 	dev->power.wakeup_path = device_may_wakeup(dev);
+	dev->power.suspend_ns = 0;
+	dev->power.resume_ns = 0;
 
 	if (dev->pm_domain) {
 		info = "preparing power domain ";
@@ -1141,3 +1163,98 @@ int device_pm_wait_for_dev(struct device *subordinate, struct device *dev)
 	return async_error;
 }
 EXPORT_SYMBOL_GPL(device_pm_wait_for_dev);
+
+#ifdef CONFIG_DEBUG_FS
+static u32 dpm_slowest_count = 10;
+
+struct dpm_slow_entry {
+	struct device	*dev;
+	s64		ns;
+};
+
+static void dpm_slowest_insert(struct dpm_slow_entry *tbl, int n,
+			       struct device *dev, s64 ns)
+{
+	int i;
+
+	if (!ns || ns <= tbl[n - 1].ns)
+		return;
+
+	for (i = n - 1; i > 0 && tbl[i - 1].ns < ns; i--)
+		tbl[i] = tbl[i - 1];
+	tbl[i].dev = dev;
+	tbl[i].ns = ns;
+}
+
+static void dpm_slowest_print(struct seq_file *m, const char *verb,
+			      struct dpm_slow_entry *tbl, int n)
+{
+	int i;
+
+	seq_printf(m, "slowest %s:\n", verb);
+	for (i = 0; i < n && tbl[i].dev; i++)
+		seq_printf(m, "%10lld us  %s %s\n",
+			   div_s64(tbl[i].ns, NSEC_PER_USEC),
+			   dev_driver_string(tbl[i].dev),
+			   dev_name(tbl[i].dev));
+}
+
+static int dpm_slowest_show(struct seq_file *m, void *unused)
+{
+	struct list_head *lists[] = {
+		&dpm_list, &dpm_prepared_list, &dpm_suspended_list,
+		&dpm_late_early_list, &dpm_noirq_list,
+	};
+	struct dpm_slow_entry *suspend, *resume;
+	struct device *dev;
+	int i, n = min_t(u32, dpm_slowest_count, 256);
+
+	if (!n)
+		return 0;
+
+	suspend = kcalloc(2 * n, sizeof(*suspend), GFP_KERNEL);
+	if (!suspend)
+		return -ENOMEM;
+	resume = suspend + n;
+
+	mutex_lock(&dpm_list_mtx);
+	for (i = 0; i < ARRAY_SIZE(lists); i++)
+		list_for_each_entry(dev, lists[i], power.entry) {
+			dpm_slowest_insert(suspend, n, dev,
+					   dev->power.suspend_ns);
+			dpm_slowest_insert(resume, n, dev,
+					   dev->power.resume_ns);
+		}
+
+	dpm_slowest_print(m, "suspend", suspend, n);
+	dpm_slowest_print(m, "resume", resume, n);
+	mutex_unlock(&dpm_list_mtx);
+
+	kfree(suspend);
+	return 0;
+}
+
+static int dpm_slowest_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, dpm_slowest_show, NULL);
+}
+
+static const struct file_operations dpm_slowest_fops = {
+	.owner = THIS_MODULE,
+	.open = dpm_slowest_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init dpm_debugfs_init(void)
+{
+	debugfs_create_file("pm_slowest_devices", S_IRUGO, NULL, NULL,
+			    &dpm_slowest_fops);
+	debugfs_create_u32("pm_slowest_count", S_IRUGO | S_IWUSR, NULL,
+			   &dpm_slowest_count);
+	return 0;
+}
+
+late_initcall(dpm_debugfs_init);
+#endif
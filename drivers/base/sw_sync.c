@@ -38,6 +38,8 @@ struct sync_pt *sw_sync_pt_create(struct sw_sync_timeline *obj, u32 value)
 
 	pt = (struct sw_sync_pt *)
 		sync_pt_create(&obj->obj, sizeof(struct sw_sync_pt));
+	if (pt == NULL)
+		return NULL;
 
 	pt->value = value;
 
@@ -0,0 +1,121 @@
+/*
+ * sync framework benchmark
+ *
+ * Times fence create, merge, wait and timeline signal on a private
+ * sw_sync timeline.  Results go to the kernel log on module load.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ */
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/sw_sync.h>
+#include <linux/sync.h>
+
+static int nr_fences = 4096;
+module_param(nr_fences, int, 0444);
+MODULE_PARM_DESC(nr_fences, "fences created per run");
+
+static void bench_report(const char *what, ktime_t start, int n)
+{
+	s64 ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	pr_info("sw_sync_benchmark: %-16s %8lld ns/op\n", what,
+		div_s64(ns, n ? n : 1));
+}
+
+static void bench_put(struct sync_fence **fences, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		if (fences[i])
+			sync_fence_put(fences[i]);
+}
+
+static int __init sw_sync_benchmark_init(void)
+{
+	struct sw_sync_timeline *obj;
+	struct sync_fence **fences, **merged, **merged_sig;
+	struct sync_pt *pt;
+	ktime_t start;
+	int i, n = nr_fences;
+	int ret = -ENOMEM;
+
+	if (n < 2)
+		return -EINVAL;
+
+	fences = kcalloc(n, sizeof(*fences), GFP_KERNEL);
+	merged = kcalloc(n, sizeof(*merged), GFP_KERNEL);
+	merged_sig = kcalloc(n, sizeof(*merged_sig), GFP_KERNEL);
+	obj = sw_sync_timeline_create("sync_bench");
+	if (!fences || !merged || !merged_sig || !obj)
+		goto out;
+
+	start = ktime_get();
+	for (i = 0; i < n; i++) {
+		pt = sw_sync_pt_create(obj, i + 1);
+		if (pt == NULL)
+			goto out_put;
+		fences[i] = sync_fence_create("bench", pt);
+		if (fences[i] == NULL) {
+			sync_pt_free(pt);
+			goto out_put;
+		}
+	}
+	bench_report("create", start, n);
+
+	start = ktime_get();
+	for (i = 0; i < n - 1; i++) {
+		merged[i] = sync_fence_merge("bench_merge", fences[i],
+					     fences[i + 1]);
+		if (merged[i] == NULL)
+			goto out_put;
+	}
+	bench_report("merge", start, n - 1);
+
+	start = ktime_get();
+	for (i = 0; i < n; i++)
+		sw_sync_timeline_inc(obj, 1);
+	bench_report("signal", start, n);
+
+	start = ktime_get();
+	for (i = 0; i < n; i++)
+		sync_fence_wait(fences[i], 0);
+	bench_report("wait (signaled)", start, n);
+
+	start = ktime_get();
+	for (i = 0; i < n - 1; i++) {
+		merged_sig[i] = sync_fence_merge("bench_merge", fences[i],
+						 fences[i + 1]);
+		if (merged_sig[i] == NULL)
+			goto out_put;
+	}
+	bench_report("merge (signaled)", start, n - 1);
+
+	ret = 0;
+out_put:
+	bench_put(merged_sig, n);
+	bench_put(merged, n);
+	bench_put(fences, n);
+out:
+	if (obj)
+		sync_timeline_destroy(&obj->obj);
+	kfree(merged_sig);
+	kfree(merged);
+	kfree(fences);
+	return ret;
+}
+
+static void __exit sw_sync_benchmark_exit(void)
+{
+}
+
+module_init(sw_sync_benchmark_init);
+module_exit(sw_sync_benchmark_exit);
+
+MODULE_DESCRIPTION("sync framework benchmark");
+MODULE_LICENSE("GPL v2");
@@ -42,6 +42,12 @@ static DEFINE_SPINLOCK(sync_timeline_list_lock);
 static LIST_HEAD(sync_fence_list_head);
 static DEFINE_SPINLOCK(sync_fence_list_lock);
 
+/* room for the implementation data of sw_sync and kgsl pts */
+#define SYNC_PT_CACHE_SIZE	(sizeof(struct sync_pt) + 2 * sizeof(u64))
+
+static struct kmem_cache *sync_fence_cachep;
+static struct kmem_cache *sync_pt_cachep;
+
 struct sync_timeline *sync_timeline_create(const struct sync_timeline_ops *ops,
 					   int size, const char *name)
 {
@@ -145,11 +151,13 @@ void sync_timeline_signal(struct sync_timeline *obj)
 		struct sync_pt *pt =
 			container_of(pos, struct sync_pt, active_list);
 
-		if (_sync_pt_has_signaled(pt)) {
-			list_del_init(pos);
-			list_add(&pt->signaled_list, &signaled_pts);
-			kref_get(&pt->fence->kref);
-		}
+		/* the list is in signal order, the rest is still active */
+		if (!_sync_pt_has_signaled(pt))
+			break;
+
+		list_del_init(pos);
+		list_add(&pt->signaled_list, &signaled_pts);
+		kref_get(&pt->fence->kref);
 	}
 
 	spin_unlock_irqrestore(&obj->active_list_lock, flags);
@@ -172,7 +180,13 @@ struct sync_pt *sync_pt_create(struct sync_timeline *parent, int size)
 	if (size < sizeof(struct sync_pt))
 		return NULL;
 
-	pt = kzalloc(size, GFP_KERNEL);
+	if (size <= SYNC_PT_CACHE_SIZE) {
+		pt = kmem_cache_zalloc(sync_pt_cachep, GFP_KERNEL);
+		if (pt)
+			pt->cached = true;
+	} else {
+		pt = kzalloc(size, GFP_KERNEL);
+	}
 	if (pt == NULL)
 		return NULL;
 
@@ -193,7 +207,10 @@ void sync_pt_free(struct sync_pt *pt)
 
 	kref_put(&pt->parent->kref, sync_timeline_free);
 
-	kfree(pt);
+	if (pt->cached)
+		kmem_cache_free(sync_pt_cachep, pt);
+	else
+		kfree(pt);
 }
 EXPORT_SYMBOL(sync_pt_free);
 
@@ -219,10 +236,16 @@ static struct sync_pt *sync_pt_dup(struct sync_pt *pt)
 	return pt->parent->ops->dup(pt);
 }
 
-/* Adds a sync pt to the active queue.  Called when added to a fence */
+/*
+ * Adds a sync pt to the active queue.  Called when added to a fence.
+ * The queue is kept in signal order (ops->compare) so that
+ * sync_timeline_signal() can stop at the first active pt.  pts are
+ * normally created in order, so the walk ends at the tail.
+ */
 static void sync_pt_activate(struct sync_pt *pt)
 {
 	struct sync_timeline *obj = pt->parent;
+	struct sync_pt *pos;
 	unsigned long flags;
 	int err;
 
@@ -232,7 +255,11 @@ static void sync_pt_activate(struct sync_pt *pt)
 	if (err != 0)
 		goto out;
 
-	list_add_tail(&pt->active_list, &obj->active_list_head);
+	list_for_each_entry_reverse(pos, &obj->active_list_head, active_list)
+		if (obj->ops->compare(pos, pt) <= 0)
+			break;
+
+	list_add(&pt->active_list, &pos->active_list);
 
 out:
 	spin_unlock_irqrestore(&obj->active_list_lock, flags);
@@ -255,13 +282,13 @@ static struct sync_fence *sync_fence_alloc(const char *name)
 	struct sync_fence *fence;
 	unsigned long flags;
 
-	fence = kzalloc(sizeof(struct sync_fence), GFP_KERNEL);
+	fence = kmem_cache_zalloc(sync_fence_cachep, GFP_KERNEL);
 	if (fence == NULL)
 		return NULL;
 
 	fence->file = anon_inode_getfile("sync_fence", &sync_fence_fops,
 					 fence, 0);
-	if (fence->file == NULL)
+	if (IS_ERR(fence->file))
 		goto err;
 
 	kref_init(&fence->kref);
@@ -280,7 +307,7 @@ static struct sync_fence *sync_fence_alloc(const char *name)
 	return fence;
 
 err:
-	kfree(fence);
+	kmem_cache_free(sync_fence_cachep, fence);
 	return NULL;
 }
 
@@ -310,69 +337,70 @@ struct sync_fence *sync_fence_create(const char *name, struct sync_pt *pt)
 }
 EXPORT_SYMBOL(sync_fence_create);
 
-static int sync_fence_copy_pts(struct sync_fence *dst, struct sync_fence *src)
+static int sync_fence_add_pt(struct sync_fence *dst, struct sync_pt *pt)
 {
-	struct list_head *pos;
+	struct sync_pt *new_pt = sync_pt_dup(pt);
 
-	list_for_each(pos, &src->pt_list_head) {
-		struct sync_pt *orig_pt =
-			container_of(pos, struct sync_pt, pt_list);
-		struct sync_pt *new_pt = sync_pt_dup(orig_pt);
+	if (new_pt == NULL)
+		return -ENOMEM;
 
-		if (new_pt == NULL)
-			return -ENOMEM;
+	new_pt->fence = dst;
+	list_add(&new_pt->pt_list, &dst->pt_list_head);
+	return 0;
+}
 
-		new_pt->fence = dst;
-		list_add(&new_pt->pt_list, &dst->pt_list_head);
-	}
+static struct sync_pt *sync_fence_find_pt(struct sync_fence *fence,
+					  struct sync_timeline *obj)
+{
+	struct sync_pt *pt;
 
-	return 0;
+	list_for_each_entry(pt, &fence->pt_list_head, pt_list)
+		if (pt->parent == obj)
+			return pt;
+
+	return NULL;
 }
 
-static int sync_fence_merge_pts(struct sync_fence *dst, struct sync_fence *src)
-{
-	struct list_head *src_pos, *dst_pos, *n;
-
-	list_for_each(src_pos, &src->pt_list_head) {
-		struct sync_pt *src_pt =
-			container_of(src_pos, struct sync_pt, pt_list);
-		bool collapsed = false;
-
-		list_for_each_safe(dst_pos, n, &dst->pt_list_head) {
-			struct sync_pt *dst_pt =
-				container_of(dst_pos, struct sync_pt, pt_list);
-			/* collapse two sync_pts on the same timeline
-			 * to a single sync_pt that will signal at
-			 * the later of the two
-			 */
-			if (dst_pt->parent == src_pt->parent) {
-				if (dst_pt->parent->ops->compare(dst_pt, src_pt) == -1) {
-					struct sync_pt *new_pt =
-						sync_pt_dup(src_pt);
-					if (new_pt == NULL)
-						return -ENOMEM;
-
-					new_pt->fence = dst;
-					list_replace(&dst_pt->pt_list,
-						     &new_pt->pt_list);
-					sync_pt_free(dst_pt);
-				}
-				collapsed = true;
-				break;
-			}
-		}
+/*
+ * Fill dst with one sync_pt per timeline of a and b, the later of the
+ * two where both have one.  Only the winner is duplicated, and pts that
+ * already signaled are left out as there is nothing left to wait for.
+ */
+static int sync_fence_merge_pts(struct sync_fence *dst,
+				struct sync_fence *a, struct sync_fence *b)
+{
+	struct sync_pt *pt, *other, *keep;
+	int err;
 
-		if (!collapsed) {
-			struct sync_pt *new_pt = sync_pt_dup(src_pt);
+	list_for_each_entry(pt, &a->pt_list_head, pt_list) {
+		keep = pt;
+		other = sync_fence_find_pt(b, pt->parent);
+		if (other && pt->parent->ops->compare(pt, other) == -1)
+			keep = other;
 
-			if (new_pt == NULL)
-				return -ENOMEM;
+		if (keep->status == 1)
+			continue;
 
-			new_pt->fence = dst;
-			list_add(&new_pt->pt_list, &dst->pt_list_head);
-		}
+		err = sync_fence_add_pt(dst, keep);
+		if (err < 0)
+			return err;
+	}
+
+	list_for_each_entry(pt, &b->pt_list_head, pt_list) {
+		if (pt->status == 1 || sync_fence_find_pt(a, pt->parent))
+			continue;
+
+		err = sync_fence_add_pt(dst, pt);
+		if (err < 0)
+			return err;
 	}
 
+	/* everything signaled while we looked, a fence needs one pt */
+	if (list_empty(&dst->pt_list_head))
+		return sync_fence_add_pt(dst,
+			list_first_entry(&a->pt_list_head, struct sync_pt,
+					 pt_list));
+
 	return 0;
 }
 
@@ -446,6 +474,12 @@ static int sync_fence_get_status(struct sync_fence *fence)
 	return status;
 }
 
+static bool sync_fence_signaled(struct sync_fence *fence)
+{
+	smp_rmb();
+	return fence->status == 1;
+}
+
 struct sync_fence *sync_fence_merge(const char *name,
 				    struct sync_fence *a, struct sync_fence *b)
 {
@@ -453,15 +487,24 @@ struct sync_fence *sync_fence_merge(const char *name,
 	struct list_head *pos;
 	int err;
 
+	/*
+	 * Nothing to merge when one side already signaled: hand out
+	 * another reference to the other side instead of a new fence.
+	 */
+	if (a == b || sync_fence_signaled(b)) {
+		get_file(a->file);
+		return a;
+	}
+	if (sync_fence_signaled(a)) {
+		get_file(b->file);
+		return b;
+	}
+
 	fence = sync_fence_alloc(name);
 	if (fence == NULL)
 		return NULL;
 
-	err = sync_fence_copy_pts(fence, a);
-	if (err < 0)
-		goto err;
-
-	err = sync_fence_merge_pts(fence, b);
+	err = sync_fence_merge_pts(fence, a, b);
 	if (err < 0)
 		goto err;
 
@@ -481,8 +524,8 @@ struct sync_fence *sync_fence_merge(const char *name,
 
 	return fence;
 err:
-	sync_fence_free_pts(fence);
-	kfree(fence);
+	/* release detaches and frees the pts added so far */
+	fput(fence->file);
 	return NULL;
 }
 EXPORT_SYMBOL(sync_fence_merge);
@@ -634,7 +677,7 @@ static void sync_fence_free(struct kref *kref)
 
 	sync_fence_free_pts(fence);
 
-	kfree(fence);
+	kmem_cache_free(sync_fence_cachep, fence);
 }
 
 static int sync_fence_release(struct inode *inode, struct file *file)
@@ -840,6 +883,15 @@ static long sync_fence_ioctl(struct file *file, unsigned int cmd,
 	}
 }
 
+static int __init sync_init(void)
+{
+	sync_fence_cachep = KMEM_CACHE(sync_fence, SLAB_PANIC);
+	sync_pt_cachep = kmem_cache_create("sync_pt", SYNC_PT_CACHE_SIZE, 0,
+					   SLAB_PANIC, NULL);
+	return 0;
+}
+core_initcall(sync_init);
+
 #ifdef CONFIG_DEBUG_FS
 static const char *sync_status_str(int status)
 {
@@ -14,7 +14,11 @@
 
 #include <linux/slab.h>
 #include <linux/debugfs.h>
+#include <linux/ktime.h>
+#include <linux/random.h>
+#include <linux/crc-ccitt.h>
 #include "diagchar.h"
+#include "diagchar_hdlc.h"
 #include "diagfwd.h"
 #include "diagfwd_bridge.h"
 
@@ -268,6 +272,115 @@ const struct file_operations diag_dbgfs_bridge_ops = {
 };
 #endif
 
+#define HDLC_BENCH_LEN		4096
+#define HDLC_BENCH_ITERS	1000
+#define HDLC_GOOD_CRC		0xF0B8
+
+/* Encode one frame and decode it again; returns 0 if it survives */
+static int diag_hdlc_bench_verify(const uint8_t *src, uint8_t *enc,
+				  uint8_t *dec, unsigned int len)
+{
+	struct diag_send_desc_type send = { src, src + len - 1,
+					    DIAG_STATE_START, 1 };
+	struct diag_hdlc_dest_type dest = { enc, enc + 2 * len + 6, 0 };
+	struct diag_hdlc_decode_type hdlc = { 0 };
+
+	diag_hdlc_encode(&send, &dest);
+	if (send.state != DIAG_STATE_COMPLETE)
+		return -EIO;
+
+	hdlc.src_ptr = enc;
+	hdlc.src_size = (uint8_t *)dest.dest - enc;
+	hdlc.dest_ptr = dec;
+	hdlc.dest_size = len + 3;
+	if (!diag_hdlc_decode(&hdlc) || hdlc.dest_idx != len + 3)
+		return -EIO;
+	if (memcmp(src, dec, len) ||
+	    crc_ccitt(CRC_16_L_SEED, dec, len + 2) != HDLC_GOOD_CRC)
+		return -EIO;
+	return 0;
+}
+
+static ssize_t diag_dbgfs_read_hdlc_bench(struct file *file,
+					  char __user *ubuf, size_t count,
+					  loff_t *ppos)
+{
+	/* one in N bytes is forced to need escaping, 0 for none */
+	static const unsigned int density[] = { 0, 256, 32, 4 };
+	struct diag_send_desc_type send;
+	struct diag_hdlc_dest_type dest;
+	uint8_t *src, *enc, *dec;
+	char *buf;
+	unsigned int d, i, n;
+	ktime_t start;
+	s64 ns, us, rate;
+	int ret = 0;
+
+	if (*ppos)
+		return 0;
+
+	buf = kzalloc(DEBUG_BUF_SIZE, GFP_KERNEL);
+	src = kmalloc(HDLC_BENCH_LEN, GFP_KERNEL);
+	enc = kmalloc(2 * HDLC_BENCH_LEN + 8, GFP_KERNEL);
+	dec = kmalloc(HDLC_BENCH_LEN + 3, GFP_KERNEL);
+	if (!buf || !src || !enc || !dec) {
+		pr_err("diag: %s, Error allocating memory\n", __func__);
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (d = 0; d < ARRAY_SIZE(density); d++) {
+		get_random_bytes(src, HDLC_BENCH_LEN);
+		for (i = 0; i < HDLC_BENCH_LEN; i++) {
+			if (src[i] == CONTROL_CHAR || src[i] == ESC_CHAR)
+				src[i] = 0;
+			if (density[d] && !(src[i] % density[d]))
+				src[i] = (i & 1) ? CONTROL_CHAR : ESC_CHAR;
+		}
+
+		if (diag_hdlc_bench_verify(src, enc, dec, HDLC_BENCH_LEN)) {
+			ret += scnprintf(buf + ret, DEBUG_BUF_SIZE - ret,
+				"escape 1/%u: round trip FAILED\n",
+				density[d]);
+			continue;
+		}
+
+		start = ktime_get();
+		for (n = 0; n < HDLC_BENCH_ITERS; n++) {
+			send.pkt = src;
+			send.last = src + HDLC_BENCH_LEN - 1;
+			send.state = DIAG_STATE_START;
+			send.terminate = 1;
+			dest.dest = enc;
+			dest.dest_last = enc + 2 * HDLC_BENCH_LEN + 6;
+			diag_hdlc_encode(&send, &dest);
+		}
+		ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		/* no native 64-bit division on 32-bit ARM */
+		us = div_s64(ns, NSEC_PER_USEC);
+		rate = us ? div_s64((s64)HDLC_BENCH_LEN * HDLC_BENCH_ITERS,
+				    (s32)min_t(s64, us, INT_MAX)) : 0;
+
+		ret += scnprintf(buf + ret, DEBUG_BUF_SIZE - ret,
+			"escape 1/%u: %u x %u bytes in %lld us, %lld MB/s\n",
+			density[d], HDLC_BENCH_ITERS, HDLC_BENCH_LEN,
+			us, rate);
+	}
+
+	ret = simple_read_from_buffer(ubuf, count, ppos, buf, ret);
+out:
+	kfree(dec);
+	kfree(enc);
+	kfree(src);
+	kfree(buf);
+	return ret;
+}
+
+const struct file_operations diag_dbgfs_hdlc_bench_ops = {
+	.read = diag_dbgfs_read_hdlc_bench,
+};
+
 const struct file_operations diag_dbgfs_status_ops = {
 	.read = diag_dbgfs_read_status,
 };
@@ -295,6 +408,9 @@ void diag_debugfs_init(void)
 	debugfs_create_file("work_pending", 0444, diag_dbgfs_dent, 0,
 		&diag_dbgfs_workpending_ops);
 
+	debugfs_create_file("hdlc_bench", 0444, diag_dbgfs_dent, 0,
+		&diag_dbgfs_hdlc_bench_ops);
+
 #ifdef CONFIG_DIAGFWD_BRIDGE_CODE
 	debugfs_create_file("bridge", 0444, diag_dbgfs_dent, 0,
 		&diag_dbgfs_bridge_ops);
@@ -281,6 +281,12 @@ struct diagchar_dev {
 	int logging_mode;
 	int mask_check;
 	int logging_process_id;
+	/* memory device mode mmap ring, see diag_mmap_write() */
+	struct diag_mmap_ring_hdr *mmap_hdr;
+	unsigned char *mmap_data;
+	unsigned int mmap_size;
+	unsigned int mmap_head;
+	spinlock_t mmap_lock;
 	struct task_struct *socket_process;
 	struct task_struct *callback_process;
 #if DIAG_XPST
@@ -19,6 +19,8 @@
 #include <linux/uaccess.h>
 #include <linux/diagchar.h>
 #include <linux/sched.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
 #ifdef CONFIG_DIAG_OVER_USB
 #include <mach/usbdiag.h>
 #endif
@@ -60,6 +62,7 @@ static unsigned int itemsize_write_struct = 20;
 static unsigned int poolsize_write_struct = 8; 
 static unsigned int max_clients = 15;
 static unsigned int threshold_client_limit = 30;
+static unsigned int mmap_ring_size = 512 * 1024;
 unsigned int diag_max_reg = 600;
 unsigned int diag_threshold_reg = 750;
 
@@ -69,6 +72,7 @@ void *buf_hdlc;
 module_param(itemsize, uint, 0);
 module_param(poolsize, uint, 0);
 module_param(max_clients, uint, 0);
+module_param(mmap_ring_size, uint, 0);
 
 static unsigned s, entries_once = 50;
 static ssize_t show_diag_registration(struct device *dev,
@@ -944,6 +948,14 @@ static int diagchar_read(struct file *file, char __user *buf, size_t count,
 				current->comm, current->parent->comm, current->tgid);
 	mutex_lock(&driver->diagchar_mutex);
 
+	if (driver->data_ready[index] & DIAG_MMAP_DATA_TYPE) {
+		/* the records themselves are already in the mmap ring */
+		data_type = DIAG_MMAP_DATA_TYPE;
+		COPY_USER_SPACE_OR_EXIT(buf, data_type, 4);
+		driver->data_ready[index] ^= DIAG_MMAP_DATA_TYPE;
+		goto exit;
+	}
+
 	if ((driver->data_ready[index] & USER_SPACE_DATA_TYPE) && (driver->
 					logging_mode == MEMORY_DEVICE_MODE)) {
 #if defined(CONFIG_DIAGFWD_BRIDGE_CODE) && defined(CONFIG_DIAG_HSIC_ON_LEGACY)
@@ -1717,11 +1729,151 @@ int mask_request_validate(unsigned char mask_buf[])
 	return 0;
 }
 
+/*
+ * Copy one record into the logger's mmap ring. Returns -ENODEV when no
+ * ring is mapped, so the caller can fall back to buf_tbl and read(), and
+ * -ENOSPC when the logger has fallen behind; the record is dropped and
+ * counted in the ring header in that case.
+ */
+int diag_mmap_write(const void *buf, int len)
+{
+	struct diag_mmap_ring_hdr *hdr;
+	unsigned int size, head, tail, used, need, total;
+	unsigned long flags;
+	int i, ret = 0;
+
+	if (len <= 0)
+		return -EINVAL;
+
+	spin_lock_irqsave(&driver->mmap_lock, flags);
+	hdr = driver->mmap_hdr;
+	if (!hdr) {
+		ret = -ENODEV;
+		goto out;
+	}
+
+	size = driver->mmap_size;
+	head = driver->mmap_head;
+	tail = ACCESS_ONCE(hdr->tail);
+	if (tail >= size || (tail & 3)) {
+		pr_err_ratelimited("diag: invalid mmap ring tail %u\n", tail);
+		hdr->dropped++;
+		ret = -EINVAL;
+		goto out;
+	}
+
+	/* one word stays free so that head == tail means empty */
+	used = head >= tail ? head - tail : size - (tail - head);
+	need = sizeof(u32) + ALIGN(len, 4);
+	total = need;
+	if (head + need > size)
+		total += size - head;
+	if (total > size - used - sizeof(u32)) {
+		hdr->dropped++;
+		ret = -ENOSPC;
+		goto out;
+	}
+
+	/* head is word aligned and below size, so a marker always fits */
+	if (head + need > size) {
+		*(u32 *)(driver->mmap_data + head) = DIAG_MMAP_WRAP;
+		head = 0;
+	}
+	*(u32 *)(driver->mmap_data + head) = len;
+	memcpy(driver->mmap_data + head + sizeof(u32), buf, len);
+	head += need;
+	if (head == size)
+		head = 0;
+
+	/* publish the record before the new head */
+	smp_wmb();
+	hdr->head = head;
+	driver->mmap_head = head;
+out:
+	spin_unlock_irqrestore(&driver->mmap_lock, flags);
+
+	if (ret)
+		return ret;
+
+	for (i = 0; i < driver->num_clients; i++)
+		if (driver->client_map[i].pid == driver->logging_process_id) {
+			driver->data_ready[i] |= DIAG_MMAP_DATA_TYPE;
+			wake_up_interruptible(&driver->wait_q);
+			break;
+		}
+	return 0;
+}
+
+static void diagchar_vma_close(struct vm_area_struct *vma)
+{
+	unsigned long flags;
+	void *ring = NULL;
+
+	spin_lock_irqsave(&driver->mmap_lock, flags);
+	if (driver->mmap_hdr == vma->vm_private_data) {
+		ring = driver->mmap_hdr;
+		driver->mmap_hdr = NULL;
+		driver->mmap_data = NULL;
+	}
+	spin_unlock_irqrestore(&driver->mmap_lock, flags);
+
+	/* the mapped pages hold their own references until unmapped */
+	vfree(ring);
+}
+
+static const struct vm_operations_struct diagchar_vm_ops = {
+	.close = diagchar_vma_close,
+};
+
+static int diagchar_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	unsigned long len = vma->vm_end - vma->vm_start;
+	unsigned int size = PAGE_ALIGN(mmap_ring_size);
+	struct diag_mmap_ring_hdr *hdr;
+	unsigned long flags;
+	int err;
+
+	if (driver->logging_mode != MEMORY_DEVICE_MODE ||
+	    driver->logging_process_id != current->tgid)
+		return -EPERM;
+	if (!size || vma->vm_pgoff || len != PAGE_SIZE + size)
+		return -EINVAL;
+
+	hdr = vmalloc_user(len);
+	if (!hdr)
+		return -ENOMEM;
+	hdr->size = size;
+
+	err = remap_vmalloc_range(vma, hdr, 0);
+	if (err) {
+		vfree(hdr);
+		return err;
+	}
+	vma->vm_flags |= VM_DONTCOPY | VM_DONTEXPAND;
+	vma->vm_private_data = hdr;
+	vma->vm_ops = &diagchar_vm_ops;
+
+	spin_lock_irqsave(&driver->mmap_lock, flags);
+	if (driver->mmap_hdr) {
+		spin_unlock_irqrestore(&driver->mmap_lock, flags);
+		vfree(hdr);
+		return -EBUSY;
+	}
+	driver->mmap_data = (unsigned char *)hdr + PAGE_SIZE;
+	driver->mmap_size = size;
+	driver->mmap_head = 0;
+	driver->mmap_hdr = hdr;
+	spin_unlock_irqrestore(&driver->mmap_lock, flags);
+
+	return 0;
+}
+
 static const struct file_operations diagcharfops = {
 	.owner = THIS_MODULE,
 	.read = diagchar_read,
 	.write = diagchar_write,
 	.unlocked_ioctl = diagchar_ioctl,
+	.mmap = diagchar_mmap,
 	.open = diagchar_open,
 	.release = diagchar_close
 };
@@ -1873,6 +2025,7 @@ static int __init diagchar_init(void)
 		driver->callback_process = NULL;
 		driver->mask_check = 0;
 		mutex_init(&driver->diagchar_mutex);
+		spin_lock_init(&driver->mmap_lock);
 		init_waitqueue_head(&driver->wait_q);
 		init_waitqueue_head(&driver->smd_wait_q);
 		INIT_WORK(&(driver->diag_drain_work), diag_drain_work_fn);
@@ -1897,6 +2050,7 @@ static int __init diagchar_init(void)
 						 diag_clean_lpass_reg_fn);
 		INIT_WORK(&(driver->diag_clean_wcnss_reg_work),
 						 diag_clean_wcnss_reg_fn);
+		diag_hdlc_init();
 		diag_debugfs_init();
 		diag_masks_init();
 		diagfwd_init();
@@ -24,11 +24,89 @@
 
 MODULE_LICENSE("GPL v2");
 
-#define CRC_16_L_SEED           0xFFFF
-
 #define CRC_16_L_STEP(xx_crc, xx_c) \
 	crc_ccitt_byte(xx_crc, xx_c)
 
+/*
+ * Slice-by-4 tables for the reflected CCITT CRC. diag_crc_tbl[k][i] is the
+ * CRC contribution of byte i followed by k + 1 zero bytes; crc_ccitt_table
+ * is the slice for byte i alone and is not copied.
+ */
+static uint16_t diag_crc_tbl[3][256];
+
+#define REPEAT_BYTE_UL(x)	((~0UL / 0xff) * (x))
+
+/* Non-zero if any byte of w equals c */
+static inline unsigned long diag_word_has_byte(unsigned long w,
+					       unsigned char c)
+{
+	w ^= REPEAT_BYTE_UL(c);
+	return (w - REPEAT_BYTE_UL(0x01)) & ~w & REPEAT_BYTE_UL(0x80);
+}
+
+/*
+ * Return the number of leading bytes of src (at most len) which go out
+ * unescaped. Aligned words are checked for CONTROL_CHAR and ESC_CHAR in
+ * one go; the byte loops only cover the unaligned head, the tail and
+ * the word holding the first special character.
+ */
+static unsigned int diag_hdlc_clean_run(const uint8_t *src, unsigned int len)
+{
+	const uint8_t *p = src, *end = src + len;
+	unsigned long w;
+
+	while (p < end && ((unsigned long)p & (sizeof(long) - 1))) {
+		if (*p == CONTROL_CHAR || *p == ESC_CHAR)
+			return p - src;
+		p++;
+	}
+
+	while (end - p >= sizeof(long)) {
+		w = *(const unsigned long *)p;
+		if (diag_word_has_byte(w, CONTROL_CHAR) ||
+		    diag_word_has_byte(w, ESC_CHAR))
+			break;
+		p += sizeof(long);
+	}
+
+	while (p < end && *p != CONTROL_CHAR && *p != ESC_CHAR)
+		p++;
+
+	return p - src;
+}
+
+static uint16_t diag_crc16_bulk(uint16_t crc, const uint8_t *p,
+				unsigned int len)
+{
+	while (len >= 4) {
+		crc ^= p[0] | (p[1] << 8);
+		crc = diag_crc_tbl[2][crc & 0xFF] ^
+		      diag_crc_tbl[1][crc >> 8] ^
+		      diag_crc_tbl[0][p[2]] ^
+		      crc_ccitt_table[p[3]];
+		p += 4;
+		len -= 4;
+	}
+	while (len--)
+		crc = CRC_16_L_STEP(crc, *p++);
+
+	return crc;
+}
+
+void diag_hdlc_init(void)
+{
+	uint16_t c;
+	int i, k;
+
+	for (i = 0; i < 256; i++) {
+		c = crc_ccitt_table[i];
+		for (k = 0; k < 3; k++) {
+			c = (c >> 8) ^ crc_ccitt_table[c & 0xFF];
+			diag_crc_tbl[k][i] = c;
+		}
+	}
+}
+
 void diag_hdlc_encode(struct diag_send_desc_type *src_desc,
 		      struct diag_hdlc_dest_type *enc)
 {
@@ -40,6 +118,7 @@ void diag_hdlc_encode(struct diag_send_desc_type *src_desc,
 	unsigned char src_byte = 0;
 	enum diag_send_state_enum_type state;
 	unsigned int used = 0;
+	unsigned int run;
 
 	if (src_desc && enc) {
 
@@ -61,6 +140,18 @@ void diag_hdlc_encode(struct diag_send_desc_type *src_desc,
 		if (dest && dest_last) {
 			while (src <= src_last && dest <= dest_last) {
 
+				run = diag_hdlc_clean_run(src,
+					min(src_last - src, dest_last - dest)
+					+ 1);
+				if (run) {
+					memcpy(dest, src, run);
+					crc = diag_crc16_bulk(crc, src, run);
+					src += run;
+					dest += run;
+					used += run;
+					continue;
+				}
+
 				src_byte = *src++;
 
 				if ((src_byte == CONTROL_CHAR) ||
@@ -162,7 +253,7 @@ int diag_hdlc_decode(struct diag_hdlc_decode_type *hdlc)
 	unsigned int src_length = 0, dest_length = 0;
 
 	unsigned int len = 0;
-	unsigned int i;
+	unsigned int i, run;
 	uint8_t src_byte;
 
 	int pkt_bnd = 0;
@@ -181,6 +272,18 @@ int diag_hdlc_decode(struct diag_hdlc_decode_type *hdlc)
 
 		for (i = 0; i < src_length; i++) {
 
+			if (!hdlc->escaping) {
+				run = diag_hdlc_clean_run(&src_ptr[i],
+					min(src_length - i, dest_length - len));
+				if (run) {
+					memcpy(&dest_ptr[len], &src_ptr[i], run);
+					len += run;
+					i += run;
+					if (len >= dest_length || i >= src_length)
+						break;
+				}
+			}
+
 			src_byte = src_ptr[i];
 
 			if (hdlc->escaping) {
@@ -47,11 +47,15 @@ struct diag_hdlc_decode_type {
 
 };
 
+void diag_hdlc_init(void);
+
 void diag_hdlc_encode(struct diag_send_desc_type *src_desc,
 		      struct diag_hdlc_dest_type *enc);
 
 int diag_hdlc_decode(struct diag_hdlc_decode_type *hdlc);
 
+#define CRC_16_L_SEED	0xFFFF
+
 #define ESC_CHAR     0x7D
 #define ESC_MASK     0x20
 
@@ -329,6 +329,55 @@ drop:
 	}
 }
 
+/*
+ * With the logger's ring mapped, memory device mode data is copied once
+ * into the ring and the buffer goes straight back to its owner instead
+ * of waiting in buf_tbl/in_busy for the next read().
+ */
+static int diag_mmap_deliver(void *buf, int proc_num,
+			     struct diag_request *write_ptr)
+{
+	int len, err;
+
+	if (proc_num == APPS_DATA)
+		len = driver->used;
+	else if ((proc_num == MODEM_DATA || proc_num == LPASS_DATA ||
+		  proc_num == WCNSS_DATA) && write_ptr)
+		len = write_ptr->length;
+	else
+		return -EINVAL;
+
+	err = diag_mmap_write(buf, len);
+	if (err == -ENODEV || err == -EINVAL)
+		return err;
+
+	/* delivered, or dropped and counted by the ring */
+	if (proc_num == APPS_DATA) {
+		diagmem_free(driver, buf, POOL_TYPE_HDLC);
+	} else if (proc_num == MODEM_DATA) {
+		if (buf == driver->buf_in_1)
+			driver->in_busy_1 = 0;
+		else if (buf == driver->buf_in_2)
+			driver->in_busy_2 = 0;
+		queue_work(driver->diag_wq, &(driver->diag_read_smd_work));
+	} else if (proc_num == LPASS_DATA) {
+		if (buf == driver->buf_in_lpass_1)
+			driver->in_busy_lpass_1 = 0;
+		else if (buf == driver->buf_in_lpass_2)
+			driver->in_busy_lpass_2 = 0;
+		queue_work(driver->diag_wq,
+			   &(driver->diag_read_smd_lpass_work));
+	} else {
+		if (buf == driver->buf_in_wcnss_1)
+			driver->in_busy_wcnss_1 = 0;
+		else if (buf == driver->buf_in_wcnss_2)
+			driver->in_busy_wcnss_2 = 0;
+		queue_work(driver->diag_wq,
+			   &(driver->diag_read_smd_wcnss_work));
+	}
+	return 0;
+}
+
 int diag_device_write(void *buf, int proc_num, struct diag_request *write_ptr)
 {
 	int i, err = 0;
@@ -337,6 +386,9 @@ int diag_device_write(void *buf, int proc_num, struct diag_request *write_ptr)
 	pr_debug("proc_num: %d, logging_mode: %d\n",
 		proc_num, driver->logging_mode);
 	if (driver->logging_mode == MEMORY_DEVICE_MODE) {
+		if (driver->mmap_hdr &&
+		    !diag_mmap_deliver(buf, proc_num, write_ptr))
+			return 0;
 		if (proc_num == APPS_DATA) {
 			for (i = 0; i < driver->poolsize_write_struct; i++)
 				if (driver->buf_tbl[i].length == 0) {
@@ -36,6 +36,7 @@ int chk_apps_master(void);
 int chk_polling_response(void);
 void diag_update_userspace_clients(unsigned int type);
 void diag_update_sleeping_process(int process_id, int data_type);
+int diag_mmap_write(const void *buf, int len);
 void encode_rsp_and_send(int buf_length);
 #ifdef CONFIG_DIAG_OVER_USB
 int diagfwd_connect(void);
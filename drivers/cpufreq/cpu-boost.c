@@ -24,7 +24,12 @@
 #include <linux/moduleparam.h>
 #include <linux/slab.h>
 #include <linux/input.h>
+#include <linux/input_boost.h>
 #include <linux/time.h>
+#include <linux/math64.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/input_boost.h>
 
 struct cpu_sync {
 	struct delayed_work boost_rem;
@@ -49,14 +54,81 @@ module_param(boost_ms, uint, 0644);
 static unsigned int sync_threshold;
 module_param(sync_threshold, uint, 0644);
 
-static unsigned int input_boost_freq;
-module_param(input_boost_freq, uint, 0644);
+/*
+ * Input boost policies.  A single input handler classifies events and
+ * every class boosts cpufreq here and, through the notifier chain,
+ * hotplug, GPU and bus bandwidth together.  A class with ms == 0 is off.
+ *
+ * The defaults stay close to the old per-driver input handlers: touches
+ * and keys reach the hotplug drivers, which apply their own boosts, and
+ * cpu-boost adds no cpufreq floor (input_boost_freq was 0 before too).
+ * The fling class, and with it the GPU boost, stays off until userspace
+ * sets fling_boost_ms.
+ */
+struct boost_policy {
+	unsigned int freq;
+	unsigned int ms;
+	unsigned int min_cpus;
+	bool gpu;
+	bool bus;
+};
 
-static unsigned int input_boost_ms = 40;
-module_param(input_boost_ms, uint, 0644);
+static struct boost_policy boost_policy[INPUT_BOOST_NR] = {
+	[INPUT_BOOST_TOUCH]	= { .ms = 40, .min_cpus = 2 },
+	[INPUT_BOOST_FLING]	= { .ms = 0, .min_cpus = 2, .gpu = true },
+	[INPUT_BOOST_KEY]	= { .ms = 40 },
+};
 
-static u64 last_input_time;
-#define MIN_INPUT_INTERVAL (150 * USEC_PER_MSEC)
+#define boost_policy_param(name, class)					\
+	module_param_named(name##_boost_cpus, boost_policy[class].min_cpus, \
+			   uint, 0644);					\
+	module_param_named(name##_boost_gpu, boost_policy[class].gpu,	\
+			   bool, 0644);					\
+	module_param_named(name##_boost_bus, boost_policy[class].bus,	\
+			   bool, 0644)
+
+/* the touch class keeps the historical parameter names */
+module_param_named(input_boost_freq, boost_policy[INPUT_BOOST_TOUCH].freq,
+		   uint, 0644);
+module_param_named(input_boost_ms, boost_policy[INPUT_BOOST_TOUCH].ms,
+		   uint, 0644);
+boost_policy_param(touch, INPUT_BOOST_TOUCH);
+module_param_named(fling_boost_freq, boost_policy[INPUT_BOOST_FLING].freq,
+		   uint, 0644);
+module_param_named(fling_boost_ms, boost_policy[INPUT_BOOST_FLING].ms,
+		   uint, 0644);
+boost_policy_param(fling, INPUT_BOOST_FLING);
+module_param_named(key_boost_freq, boost_policy[INPUT_BOOST_KEY].freq,
+		   uint, 0644);
+module_param_named(key_boost_ms, boost_policy[INPUT_BOOST_KEY].ms,
+		   uint, 0644);
+boost_policy_param(key, INPUT_BOOST_KEY);
+
+/* release speed, in device units per second, that counts as a fling */
+static unsigned int fling_velocity = 1500;
+module_param(fling_velocity, uint, 0644);
+
+#define FLING_WINDOW_MS		50
+#define TOUCH_IDLE_MS		100
+#define MIN_INPUT_INTERVAL	(150 * USEC_PER_MSEC)
+
+static DEFINE_MUTEX(boost_lock);
+static BLOCKING_NOTIFIER_HEAD(input_boost_notifier);
+static unsigned long boost_pending;
+static unsigned long boost_active;
+static unsigned long boost_expires[INPUT_BOOST_NR];
+static ktime_t boost_input_time[INPUT_BOOST_NR];
+static u64 last_input_time[INPUT_BOOST_NR];
+static struct delayed_work boost_end_work[INPUT_BOOST_NR];
+
+struct boost_handle {
+	struct input_handle handle;
+	bool down;
+	int x, y;
+	int ax, ay;		/* start of the velocity window */
+	ktime_t at;
+	ktime_t last;
+};
 
 /*
  * The CPUFREQ_ADJUST notifier is used to override the current policy min to
@@ -210,7 +282,40 @@ static struct notifier_block boost_migration_nb = {
 	.notifier_call = boost_migration_notify,
 };
 
-static void do_input_boost(struct work_struct *work)
+int input_boost_register_notifier(struct notifier_block *nb)
+{
+	return blocking_notifier_chain_register(&input_boost_notifier, nb);
+}
+EXPORT_SYMBOL(input_boost_register_notifier);
+
+int input_boost_unregister_notifier(struct notifier_block *nb)
+{
+	return blocking_notifier_chain_unregister(&input_boost_notifier, nb);
+}
+EXPORT_SYMBOL(input_boost_unregister_notifier);
+
+/* Aggregate of all active classes, called with boost_lock held */
+static void boost_fill_event(struct input_boost_event *ev, int class)
+{
+	struct boost_policy *p;
+	int i;
+
+	memset(ev, 0, sizeof(*ev));
+	ev->class = class;
+	ev->input_time = boost_input_time[class];
+
+	for (i = 0; i < INPUT_BOOST_NR; i++) {
+		if (!test_bit(i, &boost_active))
+			continue;
+		p = &boost_policy[i];
+		ev->cpu_freq = max(ev->cpu_freq, p->freq);
+		ev->min_cpus = max(ev->min_cpus, p->min_cpus);
+		ev->gpu |= p->gpu;
+		ev->bus |= p->bus;
+	}
+}
+
+static void boost_cpufreq(unsigned int freq, unsigned int ms)
 {
 	unsigned int i, ret;
 	struct cpu_sync *i_sync_info;
@@ -223,48 +328,186 @@ static void do_input_boost(struct work_struct *work)
 		ret = cpufreq_get_policy(&policy, i);
 		if (ret)
 			continue;
-		if (policy.cur >= input_boost_freq)
+		if (policy.cur >= freq)
+			continue;
+		/* a stronger boost from another class is still running */
+		if (delayed_work_pending(&i_sync_info->input_boost_rem) &&
+		    i_sync_info->input_boost_min > freq)
 			continue;
 
 		cancel_delayed_work_sync(&i_sync_info->input_boost_rem);
-		i_sync_info->input_boost_min = input_boost_freq;
+		i_sync_info->input_boost_min = freq;
 		cpufreq_update_policy(i);
 		queue_delayed_work_on(i_sync_info->cpu, cpu_boost_wq,
 			&i_sync_info->input_boost_rem,
-			msecs_to_jiffies(input_boost_ms));
+			msecs_to_jiffies(ms));
 	}
 	put_online_cpus();
 }
 
-static void cpuboost_input_event(struct input_handle *handle,
-		unsigned int type, unsigned int code, int value)
+static void input_boost_start(int class)
+{
+	struct boost_policy *p = &boost_policy[class];
+	struct input_boost_event ev;
+
+	mutex_lock(&boost_lock);
+	set_bit(class, &boost_active);
+	boost_expires[class] = jiffies + msecs_to_jiffies(p->ms);
+	cancel_delayed_work(&boost_end_work[class]);
+	queue_delayed_work(cpu_boost_wq, &boost_end_work[class],
+			   msecs_to_jiffies(p->ms));
+
+	if (p->freq)
+		boost_cpufreq(p->freq, p->ms);
+
+	boost_fill_event(&ev, class);
+	blocking_notifier_call_chain(&input_boost_notifier,
+				     INPUT_BOOST_START, &ev);
+	mutex_unlock(&boost_lock);
+
+	trace_input_boost(class, p->freq, p->min_cpus,
+			  ktime_us_delta(ktime_get(), ev.input_time));
+}
+
+static void do_input_boost_end(struct work_struct *work)
 {
-	u64 now;
+	struct delayed_work *dwork = to_delayed_work(work);
+	int class = dwork - boost_end_work;
+	struct input_boost_event ev;
+
+	mutex_lock(&boost_lock);
+	/* re-armed while we were waiting for the lock */
+	if (!test_bit(class, &boost_active) ||
+	    time_before(jiffies, boost_expires[class]))
+		goto out;
+
+	clear_bit(class, &boost_active);
+	boost_fill_event(&ev, class);
+	blocking_notifier_call_chain(&input_boost_notifier,
+				     INPUT_BOOST_END, &ev);
+	trace_input_boost_end(class);
+out:
+	mutex_unlock(&boost_lock);
+}
 
-	if (!input_boost_freq)
-		return;
+static void do_input_boost(struct work_struct *work)
+{
+	int class;
 
-	now = ktime_to_us(ktime_get());
-	if (now - last_input_time < MIN_INPUT_INTERVAL)
+	for (class = 0; class < INPUT_BOOST_NR; class++)
+		if (test_and_clear_bit(class, &boost_pending))
+			input_boost_start(class);
+}
+
+static void input_boost_kick(int class, ktime_t now)
+{
+	u64 now_us = ktime_to_us(now);
+
+	if (!boost_policy[class].ms)
 		return;
 
-	if (work_pending(&input_boost_work))
+	if (now_us - last_input_time[class] < MIN_INPUT_INTERVAL)
 		return;
 
+	last_input_time[class] = now_us;
+	boost_input_time[class] = now;
+	set_bit(class, &boost_pending);
 	queue_work(cpu_boost_wq, &input_boost_work);
-	last_input_time = ktime_to_us(ktime_get());
+}
+
+static void boost_touch_down(struct boost_handle *bh, ktime_t now)
+{
+	bh->down = true;
+	bh->ax = bh->x;
+	bh->ay = bh->y;
+	bh->at = now;
+	input_boost_kick(INPUT_BOOST_TOUCH, now);
+}
+
+/* Predict a fling from the speed of the finger over the last window */
+static void boost_touch_up(struct boost_handle *bh, ktime_t now)
+{
+	s64 dt_us = ktime_us_delta(now, bh->at);
+	s64 dx = bh->x - bh->ax;
+	s64 dy = bh->y - bh->ay;
+	s64 thr;
+
+	bh->down = false;
+	if (dt_us <= 0 || !fling_velocity)
+		return;
+
+	/* distance covered at fling_velocity over the same window */
+	thr = div_s64((s64)fling_velocity * dt_us, USEC_PER_SEC);
+	if (dx * dx + dy * dy >= thr * thr)
+		input_boost_kick(INPUT_BOOST_FLING, now);
+}
+
+static void cpuboost_input_event(struct input_handle *handle,
+		unsigned int type, unsigned int code, int value)
+{
+	struct boost_handle *bh = container_of(handle, struct boost_handle,
+					       handle);
+	ktime_t now = ktime_get();
+
+	/* a panel without release events: treat a pause as a new touch */
+	if (bh->down && ktime_to_ms(ktime_sub(now, bh->last)) > TOUCH_IDLE_MS)
+		bh->down = false;
+	bh->last = now;
+
+	switch (type) {
+	case EV_ABS:
+		switch (code) {
+		case ABS_X:
+		case ABS_MT_POSITION_X:
+			bh->x = value;
+			break;
+		case ABS_Y:
+		case ABS_MT_POSITION_Y:
+			bh->y = value;
+			break;
+		case ABS_MT_TRACKING_ID:
+			if (value < 0 && bh->down)
+				boost_touch_up(bh, now);
+			return;
+		default:
+			return;
+		}
+		if (!bh->down)
+			boost_touch_down(bh, now);
+		break;
+	case EV_KEY:
+		if (code == BTN_TOUCH) {
+			if (value && !bh->down)
+				boost_touch_down(bh, now);
+			else if (!value && bh->down)
+				boost_touch_up(bh, now);
+		} else if (code < BTN_MISC && value) {
+			input_boost_kick(INPUT_BOOST_KEY, now);
+		}
+		break;
+	case EV_SYN:
+		if (code == SYN_REPORT && bh->down &&
+		    ktime_to_ms(ktime_sub(now, bh->at)) > FLING_WINDOW_MS) {
+			bh->ax = bh->x;
+			bh->ay = bh->y;
+			bh->at = now;
+		}
+		break;
+	}
 }
 
 static int cpuboost_input_connect(struct input_handler *handler,
 		struct input_dev *dev, const struct input_device_id *id)
 {
+	struct boost_handle *bh;
 	struct input_handle *handle;
 	int error;
 
-	handle = kzalloc(sizeof(struct input_handle), GFP_KERNEL);
-	if (!handle)
+	bh = kzalloc(sizeof(struct boost_handle), GFP_KERNEL);
+	if (!bh)
 		return -ENOMEM;
 
+	handle = &bh->handle;
 	handle->dev = dev;
 	handle->handler = handler;
 	handle->name = "cpufreq";
@@ -281,7 +524,7 @@ static int cpuboost_input_connect(struct input_handler *handler,
 err1:
 	input_unregister_handle(handle);
 err2:
-	kfree(handle);
+	kfree(bh);
 	return error;
 }
 
@@ -289,7 +532,7 @@ static void cpuboost_input_disconnect(struct input_handle *handle)
 {
 	input_close_device(handle);
 	input_unregister_handle(handle);
-	kfree(handle);
+	kfree(container_of(handle, struct boost_handle, handle));
 }
 
 static const struct input_device_id cpuboost_ids[] = {
@@ -328,7 +571,7 @@ static struct input_handler cpuboost_input_handler = {
 
 static int cpu_boost_init(void)
 {
-	int cpu, ret;
+	int cpu, i, ret;
 	struct cpu_sync *s;
 
 	cpufreq_register_notifier(&boost_adjust_nb, CPUFREQ_POLICY_NOTIFIER);
@@ -338,6 +581,8 @@ static int cpu_boost_init(void)
 		return -EFAULT;
 
 	INIT_WORK(&input_boost_work, do_input_boost);
+	for (i = 0; i < INPUT_BOOST_NR; i++)
+		INIT_DELAYED_WORK(&boost_end_work[i], do_input_boost_end);
 
 	for_each_possible_cpu(cpu) {
 		s = &per_cpu(sync_info, cpu);
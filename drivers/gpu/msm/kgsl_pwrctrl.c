@@ -18,6 +18,7 @@
 #include <mach/msm_iomap.h>
 #include <mach/msm_bus.h>
 #include <linux/ktime.h>
+#include <linux/input_boost.h>
 
 #include "kgsl.h"
 #include "kgsl_pwrscale.h"
@@ -94,7 +95,8 @@ static void update_clk_statistics(struct kgsl_device *device,
 static inline int _adjust_pwrlevel(struct kgsl_pwrctrl *pwr, int level)
 {
 	int max_pwrlevel = max_t(int, pwr->thermal_pwrlevel, pwr->max_pwrlevel);
-	int min_pwrlevel = max_t(int, pwr->thermal_pwrlevel, pwr->min_pwrlevel);
+	int min_pwrlevel = max_t(int, pwr->thermal_pwrlevel,
+				 min(pwr->min_pwrlevel, pwr->boost_pwrlevel));
 
 	if (level < max_pwrlevel)
 		return max_pwrlevel;
@@ -874,6 +876,32 @@ void kgsl_pwrctrl_irq(struct kgsl_device *device, int state)
 }
 EXPORT_SYMBOL(kgsl_pwrctrl_irq);
 
+/*
+ * Hold the GPU at its default level or above while the input boost
+ * framework says an interaction is in progress.  Thermal limits still win.
+ */
+static int kgsl_pwrctrl_input_boost(struct notifier_block *nb,
+				    unsigned long val, void *data)
+{
+	struct kgsl_pwrctrl *pwr = container_of(nb, struct kgsl_pwrctrl,
+						boost_nb);
+	struct kgsl_device *device = container_of(pwr, struct kgsl_device,
+						  pwrctrl);
+	struct input_boost_event *ev = data;
+	unsigned int level;
+
+	level = ev->gpu ? pwr->default_pwrlevel : pwr->num_pwrlevels - 1;
+	if (level == pwr->boost_pwrlevel)
+		return NOTIFY_DONE;
+
+	mutex_lock(&device->mutex);
+	pwr->boost_pwrlevel = level;
+	kgsl_pwrctrl_pwrlevel_change(device, pwr->active_pwrlevel);
+	mutex_unlock(&device->mutex);
+
+	return NOTIFY_OK;
+}
+
 int kgsl_pwrctrl_init(struct kgsl_device *device)
 {
 	int i, result = 0;
@@ -971,6 +999,10 @@ int kgsl_pwrctrl_init(struct kgsl_device *device)
 	}
 
 
+	pwr->boost_pwrlevel = pwr->num_pwrlevels - 1;
+	pwr->boost_nb.notifier_call = kgsl_pwrctrl_input_boost;
+	input_boost_register_notifier(&pwr->boost_nb);
+
 	pm_runtime_enable(device->parentdev);
 	register_early_suspend(&device->display_off);
 	return result;
@@ -991,6 +1023,7 @@ void kgsl_pwrctrl_close(struct kgsl_device *device)
 
 	KGSL_PWR_INFO(device, "close device %d\n", device->id);
 
+	input_boost_unregister_notifier(&pwr->boost_nb);
 	pm_runtime_disable(device->parentdev);
 	unregister_early_suspend(&device->display_off);
 
@@ -60,6 +60,8 @@ struct kgsl_clk_stats {
  * @irq_name - resource name for the IRQ
  * @restore_slumber - Flag to indicate that we are in a suspend/restore sequence
  * @clk_stats - structure of clock statistics
+ * @boost_pwrlevel - minimum powerlevel while an input boost is active
+ * @boost_nb - input boost notifier
  */
 
 struct kgsl_pwrctrl {
@@ -85,6 +87,8 @@ struct kgsl_pwrctrl {
 	s64 time;
 	unsigned int restore_slumber;
 	struct kgsl_clk_stats clk_stats;
+	unsigned int boost_pwrlevel;
+	struct notifier_block boost_nb;
 };
 
 void kgsl_pwrctrl_irq(struct kgsl_device *device, int state);
@@ -17,6 +17,7 @@
 #include <linux/string.h>
 #include <linux/delay.h>
 #include <linux/errno.h>
+#include <linux/hrtimer.h>
 #include <linux/interrupt.h>
 #include <linux/init.h>
 #include <linux/netdevice.h>
@@ -67,6 +68,43 @@ module_param_named(debug_enable, msm_rmnet_bam_debug_mask,
 #define HEADROOM_FOR_QOS    8
 #define TAILROOM            8 
 
+#define RMNET_NAPI_WEIGHT	64
+
+/*
+ * Uplink aggregation packs several IP packets into one BAM transfer, each
+ * behind a MAP header and padded to a 4 byte boundary.  It is only used in
+ * IP mode and is off until a buffer size is written to the ul_aggr attribute.
+ */
+#define RMNET_ETH_P_MAP		0x00F9
+#define RMNET_UL_AGGR_MIN_SIZE	2048
+#define RMNET_UL_AGGR_MAX_SIZE	16384
+
+struct rmnet_map_header {
+#if defined(__LITTLE_ENDIAN_BITFIELD)
+	u8 pad_len:6;
+	u8 reserved:1;
+	u8 cd_bit:1;
+#else
+	u8 cd_bit:1;
+	u8 reserved:1;
+	u8 pad_len:6;
+#endif
+	u8 mux_id;
+	__be16 pkt_len;
+} __packed;
+
+struct rmnet_aggr_cb {
+	unsigned int pkts;
+	unsigned int bytes;
+};
+
+#define RMNET_AGGR_CB(skb) ((struct rmnet_aggr_cb *)(skb)->cb)
+
+static unsigned int ul_aggr_max_pkts = 16;
+module_param(ul_aggr_max_pkts, uint, S_IRUGO | S_IWUSR | S_IWGRP);
+static unsigned int ul_aggr_timeout_us = 500;
+module_param(ul_aggr_timeout_us, uint, S_IRUGO | S_IWUSR | S_IWGRP);
+
 struct rmnet_private {
 	struct net_device_stats stats;
 	uint32_t ch_id;
@@ -83,6 +121,13 @@ struct rmnet_private {
 	u32 operation_mode; 
 	uint8_t device_up;
 	uint8_t in_reset;
+	struct napi_struct napi;
+	struct sk_buff_head rx_queue;
+	spinlock_t aggr_lock;
+	struct sk_buff *aggr_skb;
+	unsigned int ul_aggr_size;
+	struct hrtimer aggr_timer;
+	unsigned long ul_aggr_frames;
 };
 
 #define TX_DT_TP_L0_INTERVAL 5000
@@ -343,6 +388,39 @@ static ssize_t rmnet_bam_store(struct device *dev, struct device_attribute *attr
 
 static DEVICE_ATTR(throttle, S_IRUSR | S_IWUSR, rmnet_bam_show, rmnet_bam_store);
 
+static ssize_t ul_aggr_show(struct device *dev, struct device_attribute *attr,
+			    char *buf)
+{
+	struct rmnet_private *p = netdev_priv(to_net_dev(dev));
+
+	return sprintf(buf, "size=%u frames=%lu\n", p->ul_aggr_size,
+			p->ul_aggr_frames);
+}
+
+static ssize_t ul_aggr_store(struct device *dev, struct device_attribute *attr,
+			     const char *buf, size_t count)
+{
+	struct rmnet_private *p = netdev_priv(to_net_dev(dev));
+	unsigned int size;
+
+	if (sscanf(buf, "%u", &size) != 1)
+		return -EINVAL;
+	if (size && (size < RMNET_UL_AGGR_MIN_SIZE ||
+		     size > RMNET_UL_AGGR_MAX_SIZE))
+		return -EINVAL;
+
+	DBG0("%s ul_aggr=%u\n", __func__, size);
+	spin_lock_bh(&p->aggr_lock);
+	p->ul_aggr_size = size;
+	spin_unlock_bh(&p->aggr_lock);
+	/* push out whatever is pending under the old setting */
+	tasklet_schedule(&p->tsklt);
+
+	return count;
+}
+
+static DEVICE_ATTR(ul_aggr, S_IRUSR | S_IWUSR, ul_aggr_show, ul_aggr_store);
+
 static int rmnet_ioctl(struct net_device *dev, struct ifreq *ifr, int cmd);
 
 static __be16 rmnet_ip_type_trans(struct sk_buff *skb, struct net_device *dev)
@@ -384,6 +462,16 @@ static void bam_recv_notify(void *dev, struct sk_buff *skb)
 	u32 opmode;
 
 	if (skb) {
+		/*
+		 * NAPI is disabled while the interface is down, and a
+		 * stalled poll must not let the queue grow without bound
+		 */
+		if (!netif_running(dev) ||
+		    skb_queue_len(&p->rx_queue) >= netdev_max_backlog) {
+			p->stats.rx_dropped++;
+			dev_kfree_skb_any(skb);
+			return;
+		}
 		skb->dev = dev;
 		
 		spin_lock_irqsave(&p->lock, flags);
@@ -393,6 +481,7 @@ static void bam_recv_notify(void *dev, struct sk_buff *skb)
 		if (RMNET_IS_MODE_IP(opmode)) {
 			
 			skb->protocol = rmnet_ip_type_trans(skb, dev);
+			skb_reset_mac_header(skb);
 		} else {
 			
 			skb->protocol = eth_type_trans(skb, dev);
@@ -409,13 +498,193 @@ static void bam_recv_notify(void *dev, struct sk_buff *skb)
 			((struct net_device *)dev)->name,
 			p->stats.rx_packets, skb->len);
 
-		
-		netif_rx(skb);
+		skb_queue_tail(&p->rx_queue, skb);
+		napi_schedule(&p->napi);
 	} else
 		pr_err(MODULE_NAME "[%s] %s: No skb received",
 			((struct net_device *)dev)->name, __func__);
 }
 
+static int rmnet_poll(struct napi_struct *napi, int budget)
+{
+	struct rmnet_private *p = container_of(napi, struct rmnet_private,
+						napi);
+	struct sk_buff *skb;
+	int work_done = 0;
+
+	while (work_done < budget) {
+		skb = skb_dequeue(&p->rx_queue);
+		if (!skb)
+			break;
+		napi_gro_receive(napi, skb);
+		work_done++;
+	}
+
+	if (work_done < budget) {
+		napi_complete(napi);
+		/* catch packets queued after the last dequeue */
+		if (!skb_queue_empty(&p->rx_queue))
+			napi_schedule(napi);
+	}
+	return work_done;
+}
+
+static enum hrtimer_restart rmnet_aggr_timer_func(struct hrtimer *timer)
+{
+	struct rmnet_private *p = container_of(timer, struct rmnet_private,
+						aggr_timer);
+
+	tasklet_schedule(&p->tsklt);
+	return HRTIMER_NORESTART;
+}
+
+static void rmnet_aggr_arm_timer(struct rmnet_private *p)
+{
+	hrtimer_start(&p->aggr_timer,
+		ns_to_ktime((u64)ul_aggr_timeout_us * NSEC_PER_USEC),
+		HRTIMER_MODE_REL);
+}
+
+/* Called with aggr_lock held and the UL power vote taken */
+static int rmnet_aggr_flush(struct net_device *dev)
+{
+	struct rmnet_private *p = netdev_priv(dev);
+	struct sk_buff *skb = p->aggr_skb;
+	int ret;
+
+	if (!skb)
+		return 0;
+
+	hrtimer_try_to_cancel(&p->aggr_timer);
+	dev->trans_start = jiffies;
+	ret = msm_bam_dmux_write(p->ch_id, skb);
+	if (ret == -EAGAIN) {
+		/* keep the aggregate and retry once the channel drains */
+		netif_stop_queue(dev);
+		rmnet_aggr_arm_timer(p);
+		return ret;
+	}
+
+	p->aggr_skb = NULL;
+	if (ret) {
+		pr_err(MODULE_NAME "[%s] %s: write returned error %d",
+			dev->name, __func__, ret);
+		p->stats.tx_dropped += RMNET_AGGR_CB(skb)->pkts;
+		dev_kfree_skb_any(skb);
+	} else {
+		p->ul_aggr_frames++;
+	}
+	return ret;
+}
+
+static void rmnet_aggr_tasklet(unsigned long data)
+{
+	struct net_device *dev = (struct net_device *)data;
+	struct rmnet_private *p = netdev_priv(dev);
+
+	/* not awake: UL_CONNECTED reschedules the flush */
+	if (msm_bam_dmux_ul_power_vote()) {
+		spin_lock_bh(&p->aggr_lock);
+		rmnet_aggr_flush(dev);
+		spin_unlock_bh(&p->aggr_lock);
+	}
+	msm_bam_dmux_ul_power_unvote();
+}
+
+static void rmnet_aggr_drop(struct rmnet_private *p)
+{
+	hrtimer_cancel(&p->aggr_timer);
+	tasklet_kill(&p->tsklt);
+	spin_lock_bh(&p->aggr_lock);
+	if (p->aggr_skb) {
+		p->stats.tx_dropped += RMNET_AGGR_CB(p->aggr_skb)->pkts;
+		dev_kfree_skb_any(p->aggr_skb);
+		p->aggr_skb = NULL;
+	}
+	spin_unlock_bh(&p->aggr_lock);
+}
+
+/*
+ * Appends skb to the pending aggregate, consuming it on success.  A full
+ * aggregate is written out first; if that write is refused skb is left
+ * untouched and the error is returned so the stack can requeue it.
+ */
+static int rmnet_aggr_xmit(struct sk_buff *skb, struct net_device *dev,
+			   u32 opmode)
+{
+	struct rmnet_private *p = netdev_priv(dev);
+	struct rmnet_map_header *maph;
+	struct QMI_QOS_HDR_S *qmih;
+	struct sk_buff *aggr;
+	unsigned int hdr_len, pad, len;
+	unsigned char *dst;
+	int ret = 0;
+
+	hdr_len = sizeof(struct rmnet_map_header);
+	if (RMNET_IS_MODE_QOS(opmode))
+		hdr_len += sizeof(struct QMI_QOS_HDR_S);
+	pad = ALIGN(skb->len, 4) - skb->len;
+	len = hdr_len + skb->len + pad;
+
+	spin_lock_bh(&p->aggr_lock);
+	aggr = p->aggr_skb;
+	if (aggr && skb_tailroom(aggr) < len) {
+		ret = rmnet_aggr_flush(dev);
+		if (ret == -EAGAIN || ret == -EFAULT)
+			goto out;
+		ret = 0;
+		aggr = NULL;
+	}
+
+	if (!aggr) {
+		aggr = alloc_skb(p->ul_aggr_size + HEADROOM_FOR_BAM,
+				 GFP_ATOMIC);
+		if (!aggr) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		skb_reserve(aggr, HEADROOM_FOR_BAM);
+		aggr->dev = dev;
+		aggr->protocol = htons(RMNET_ETH_P_MAP);
+		memset(aggr->cb, 0, sizeof(struct rmnet_aggr_cb));
+		p->aggr_skb = aggr;
+	}
+
+	dst = skb_put(aggr, len);
+	maph = (struct rmnet_map_header *)dst;
+	maph->cd_bit = 0;
+	maph->reserved = 0;
+	maph->pad_len = pad;
+	maph->mux_id = p->ch_id;
+	maph->pkt_len = htons(len - sizeof(struct rmnet_map_header));
+	dst += sizeof(struct rmnet_map_header);
+
+	if (RMNET_IS_MODE_QOS(opmode)) {
+		qmih = (struct QMI_QOS_HDR_S *)dst;
+		qmih->version = 1;
+		qmih->flags = 0;
+		qmih->flow_id = skb->mark;
+		dst += sizeof(struct QMI_QOS_HDR_S);
+	}
+
+	skb_copy_bits(skb, 0, dst, skb->len);
+	memset(dst + skb->len, 0, pad);
+
+	RMNET_AGGR_CB(aggr)->pkts++;
+	RMNET_AGGR_CB(aggr)->bytes += skb->len;
+	dev_kfree_skb_any(skb);
+
+	if (RMNET_AGGR_CB(aggr)->pkts >= ul_aggr_max_pkts ||
+	    skb_tailroom(aggr) < dev->mtu + hdr_len + 3)
+		rmnet_aggr_flush(dev);
+	else if (!hrtimer_active(&p->aggr_timer))
+		rmnet_aggr_arm_timer(p);
+out:
+	spin_unlock_bh(&p->aggr_lock);
+	return ret;
+}
+
+
 static int _rmnet_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct rmnet_private *p = netdev_priv(dev);
@@ -457,7 +726,10 @@ static void bam_write_done(void *dev, struct sk_buff *skb)
 	unsigned long flags;
 
 	DBG1("%s: write complete\n", __func__);
-	if (RMNET_IS_MODE_IP(opmode) ||
+	if (skb->protocol == htons(RMNET_ETH_P_MAP)) {
+		p->stats.tx_packets += RMNET_AGGR_CB(skb)->pkts;
+		p->stats.tx_bytes += RMNET_AGGR_CB(skb)->bytes;
+	} else if (RMNET_IS_MODE_IP(opmode) ||
 				count_this_packet(skb->data, skb->len)) {
 		p->stats.tx_packets++;
 		p->stats.tx_bytes += skb->len;
@@ -470,6 +742,9 @@ static void bam_write_done(void *dev, struct sk_buff *skb)
 	    skb->len, skb->mark);
 	dev_kfree_skb_any(skb);
 
+	if (p->aggr_skb)
+		tasklet_schedule(&p->tsklt);
+
 	spin_lock_irqsave(&p->tx_queue_lock, flags);
 	
 	if ( enable_trottle == false )
@@ -525,6 +800,8 @@ static void bam_notify(void *dev, int event, unsigned long data)
 		} else {
 			spin_unlock_irqrestore(&p->lock, flags);
 		}
+		if (p->aggr_skb)
+			tasklet_schedule(&p->tsklt);
 		break;
 	case BAM_DMUX_UL_DISCONNECTED:
 		break;
@@ -554,14 +831,17 @@ static int __rmnet_open(struct net_device *dev)
 
 static int rmnet_open(struct net_device *dev)
 {
+	struct rmnet_private *p = netdev_priv(dev);
 	int rc = 0;
 
 	DBG0("[%s] rmnet_open()\n", dev->name);
 
 	rc = __rmnet_open(dev);
 
-	if (rc == 0)
+	if (rc == 0) {
+		napi_enable(&p->napi);
 		netif_start_queue(dev);
+	}
 
 	return rc;
 }
@@ -584,10 +864,15 @@ static int __rmnet_close(struct net_device *dev)
 
 static int rmnet_stop(struct net_device *dev)
 {
+	struct rmnet_private *p = netdev_priv(dev);
+
 	DBG0("[%s] rmnet_stop()\n", dev->name);
 
 	__rmnet_close(dev);
 	netif_stop_queue(dev);
+	napi_disable(&p->napi);
+	skb_queue_purge(&p->rx_queue);
+	rmnet_aggr_drop(p);
 
 	return 0;
 }
@@ -608,6 +893,8 @@ static int rmnet_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct rmnet_private *p = netdev_priv(dev);
 	unsigned long flags;
+	u32 opmode;
+	unsigned int len = skb->len;
 	int awake;
 	int ret = 0;
 
@@ -628,9 +915,17 @@ static int rmnet_xmit(struct sk_buff *skb, struct net_device *dev)
 		ret = 0;
 		goto exit;
 	}
+	opmode = p->operation_mode;
 	spin_unlock_irqrestore(&p->lock, flags);
 
-	ret = _rmnet_xmit(skb, dev);
+	if (p->ul_aggr_size && RMNET_IS_MODE_IP(opmode))
+		ret = rmnet_aggr_xmit(skb, dev, opmode);
+	else
+		ret = _rmnet_xmit(skb, dev);
+	if (ret == -ENOMEM) {
+		ret = NETDEV_TX_BUSY;
+		goto exit;
+	}
 	if (ret == -EPERM) {
 		ret = NETDEV_TX_BUSY;
 		goto exit;
@@ -660,7 +955,7 @@ static int rmnet_xmit(struct sk_buff *skb, struct net_device *dev)
 	}
 	else
 	{
-		current_tx_bytes += skb->len;
+		current_tx_bytes += len;
 		if (msm_bam_dmux_is_ch_full(p->ch_id) || (current_tx_bytes > tx_throttle_limited_size)) {
 			netif_stop_queue(dev);
 			DBG0("%s: High WM hit, stopping queue=%p, current_tx_bytes=%lu\n",    __func__, skb, current_tx_bytes);
@@ -895,6 +1190,7 @@ static int bam_rmnet_remove(struct platform_device *pdev)
 	msm_bam_dmux_close(p->ch_id);
 	netif_carrier_off(netdevs[i]);
 	netif_stop_queue(netdevs[i]);
+	rmnet_aggr_drop(p);
 	return 0;
 }
 
@@ -938,6 +1234,14 @@ static int __init rmnet_init(void)
 		p->in_reset = 0;
 		spin_lock_init(&p->lock);
 		spin_lock_init(&p->tx_queue_lock);
+		skb_queue_head_init(&p->rx_queue);
+		netif_napi_add(dev, &p->napi, rmnet_poll, RMNET_NAPI_WEIGHT);
+		spin_lock_init(&p->aggr_lock);
+		p->aggr_skb = NULL;
+		p->ul_aggr_size = 0;
+		hrtimer_init(&p->aggr_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+		p->aggr_timer.function = rmnet_aggr_timer_func;
+		tasklet_init(&p->tsklt, rmnet_aggr_tasklet, (unsigned long)dev);
 #ifdef CONFIG_MSM_RMNET_DEBUG
 		p->timeout_us = timeout_us;
 		p->wakeups_xmit = p->wakeups_rcv = 0;
@@ -954,6 +1258,8 @@ static int __init rmnet_init(void)
 		
 		if (device_create_file(d, &dev_attr_throttle))
 			continue;
+		if (device_create_file(d, &dev_attr_ul_aggr))
+			continue;
 		
 
 #ifdef CONFIG_MSM_RMNET_DEBUG
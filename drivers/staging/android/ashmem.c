@@ -27,6 +27,10 @@
 #include <linux/personality.h>
 #include <linux/bitops.h>
 #include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/sched.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <linux/shmem_fs.h>
 #include <linux/ashmem.h>
 #include <asm/cacheflush.h>
@@ -42,6 +46,9 @@ struct ashmem_area {
 	size_t size;			 
 	unsigned long vm_start;		 
 	unsigned long prot_mask;	 
+	struct mutex mutex;		/* protects all of the above */
+	u64 locked_at;			/* sched_clock() at mutex_lock */
+	struct task_struct *owner;	/* holder of mutex, for the shrinker */
 };
 
 struct ashmem_range {
@@ -53,11 +60,66 @@ struct ashmem_range {
 	unsigned int purged;		
 };
 
+/*
+ * Locking: each area's mutex covers its own state and unpinned ranges;
+ * ashmem_lru_lock only covers the LRU list and lru_count and nests
+ * inside an area mutex. The shrinker goes the other way round, so it
+ * only ever trylocks areas while holding ashmem_lru_lock.
+ */
 static LIST_HEAD(ashmem_lru_list);
 
 static unsigned long lru_count;
 
-static DEFINE_MUTEX(ashmem_mutex);
+static DEFINE_SPINLOCK(ashmem_lru_lock);
+
+/* ranges purged per trip through ashmem_lru_lock */
+#define ASHMEM_PURGE_BATCH	32
+
+struct ashmem_lock_stat {
+	atomic_long_t count;
+	atomic64_t total_ns;
+	u64 max_ns;
+};
+
+static struct ashmem_lock_stat ashmem_area_stat;
+static struct ashmem_lock_stat ashmem_lru_stat;
+static struct ashmem_lock_stat ashmem_purge_stat;
+
+static atomic_long_t ashmem_purged_ranges;
+static atomic_long_t ashmem_purged_pages;
+static atomic_long_t ashmem_purge_contended;
+
+static void ashmem_stat_add(struct ashmem_lock_stat *st, u64 ns)
+{
+	atomic_long_inc(&st->count);
+	atomic64_add(ns, &st->total_ns);
+	/* racy, good enough for a high-water mark */
+	if (ns > st->max_ns)
+		st->max_ns = ns;
+}
+
+static inline void asma_lock(struct ashmem_area *asma)
+{
+	mutex_lock(&asma->mutex);
+	asma->owner = current;
+	asma->locked_at = sched_clock();
+}
+
+static inline int asma_trylock(struct ashmem_area *asma)
+{
+	if (!mutex_trylock(&asma->mutex))
+		return 0;
+	asma->owner = current;
+	asma->locked_at = sched_clock();
+	return 1;
+}
+
+static inline void asma_unlock(struct ashmem_area *asma)
+{
+	ashmem_stat_add(&ashmem_area_stat, sched_clock() - asma->locked_at);
+	asma->owner = NULL;
+	mutex_unlock(&asma->mutex);
+}
 
 static struct kmem_cache *ashmem_area_cachep __read_mostly;
 static struct kmem_cache *ashmem_range_cachep __read_mostly;
@@ -88,16 +150,25 @@ static struct kmem_cache *ashmem_range_cachep __read_mostly;
 
 static inline void lru_add(struct ashmem_range *range)
 {
+	spin_lock(&ashmem_lru_lock);
 	list_add_tail(&range->lru, &ashmem_lru_list);
 	lru_count += range_size(range);
+	spin_unlock(&ashmem_lru_lock);
 }
 
-static inline void lru_del(struct ashmem_range *range)
+static inline void __lru_del(struct ashmem_range *range)
 {
 	list_del(&range->lru);
 	lru_count -= range_size(range);
 }
 
+static inline void lru_del(struct ashmem_range *range)
+{
+	spin_lock(&ashmem_lru_lock);
+	__lru_del(range);
+	spin_unlock(&ashmem_lru_lock);
+}
+
 static int range_alloc(struct ashmem_area *asma,
 		       struct ashmem_range *prev_range, unsigned int purged,
 		       size_t start, size_t end)
@@ -141,8 +212,11 @@ static inline void range_shrink(struct ashmem_range *range,
 	range->pgstart = start;
 	range->pgend = end;
 
-	if (range_on_lru(range))
+	if (range_on_lru(range)) {
+		spin_lock(&ashmem_lru_lock);
 		lru_count -= pre - range_size(range);
+		spin_unlock(&ashmem_lru_lock);
+	}
 }
 
 static int ashmem_open(struct inode *inode, struct file *file)
@@ -163,6 +237,7 @@ static int ashmem_open(struct inode *inode, struct file *file)
 	}
 
 	INIT_LIST_HEAD(&asma->unpinned_list);
+	mutex_init(&asma->mutex);
 	memcpy(asma->name, ASHMEM_NAME_PREFIX, ASHMEM_NAME_PREFIX_LEN);
 	asma->prot_mask = PROT_MASK;
 	file->private_data = asma;
@@ -175,10 +250,10 @@ static int ashmem_release(struct inode *ignored, struct file *file)
 	struct ashmem_area *asma = file->private_data;
 	struct ashmem_range *range, *next;
 
-	mutex_lock(&ashmem_mutex);
+	asma_lock(asma);
 	list_for_each_entry_safe(range, next, &asma->unpinned_list, unpinned)
 		range_del(range);
-	mutex_unlock(&ashmem_mutex);
+	asma_unlock(asma);
 
 	if (asma->file)
 		fput(asma->file);
@@ -193,7 +268,7 @@ static ssize_t ashmem_read(struct file *file, char __user *buf,
 	struct ashmem_area *asma = file->private_data;
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	asma_lock(asma);
 
 	
 	if (asma->size == 0)
@@ -212,7 +287,7 @@ static ssize_t ashmem_read(struct file *file, char __user *buf,
 	asma->file->f_pos = *pos;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	asma_unlock(asma);
 	return ret;
 }
 
@@ -221,7 +296,7 @@ static loff_t ashmem_llseek(struct file *file, loff_t offset, int origin)
 	struct ashmem_area *asma = file->private_data;
 	int ret;
 
-	mutex_lock(&ashmem_mutex);
+	asma_lock(asma);
 
 	if (asma->size == 0) {
 		ret = -EINVAL;
@@ -241,7 +316,7 @@ static loff_t ashmem_llseek(struct file *file, loff_t offset, int origin)
 	file->f_pos = asma->file->f_pos;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	asma_unlock(asma);
 	return ret;
 }
 
@@ -257,7 +332,7 @@ static int ashmem_mmap(struct file *file, struct vm_area_struct *vma)
 	struct ashmem_area *asma = file->private_data;
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	asma_lock(asma);
 
 	
 	if (unlikely(!asma->size)) {
@@ -301,38 +376,113 @@ static int ashmem_mmap(struct file *file, struct vm_area_struct *vma)
 	asma->vm_start = vma->vm_start;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	asma_unlock(asma);
 	return ret;
 }
 
-static int ashmem_shrink(struct shrinker *s, struct shrink_control *sc)
+static bool ashmem_batch_has_area(struct list_head *batch,
+				  struct ashmem_area *asma)
+{
+	struct ashmem_range *range;
+
+	list_for_each_entry(range, batch, lru)
+		if (range->asma == asma)
+			return true;
+	return false;
+}
+
+/*
+ * Move up to ASHMEM_PURGE_BATCH ranges (and at most nr_to_scan pages) off
+ * the LRU onto @batch, marking them purged. The area of each range is
+ * left locked so nobody can pin it before ashmem_purge_batch() is done.
+ * Areas that are busy are skipped for this pass.
+ *
+ * An area we already hold is either one locked earlier in this batch,
+ * whose further ranges are taken as well, or the area of a caller that
+ * entered reclaim with it locked, which is skipped.  Neither counts as
+ * contention.
+ */
+static unsigned long ashmem_lru_isolate(struct list_head *batch,
+					unsigned long nr_to_scan)
 {
 	struct ashmem_range *range, *next;
+	unsigned long pages = 0;
+	unsigned int nr = 0;
+	u64 t0;
 
-	
-	if (sc->nr_to_scan && !(sc->gfp_mask & __GFP_FS))
-		return -1;
-	if (!sc->nr_to_scan)
-		return lru_count;
+	spin_lock(&ashmem_lru_lock);
+	t0 = sched_clock();
+	list_for_each_entry_safe(range, next, &ashmem_lru_list, lru) {
+		if (nr >= ASHMEM_PURGE_BATCH || pages >= nr_to_scan)
+			break;
 
-	
-	if (!mutex_trylock(&ashmem_mutex)) {
-                return -1;
+		if (ACCESS_ONCE(range->asma->owner) == current) {
+			if (!ashmem_batch_has_area(batch, range->asma))
+				continue;
+		} else if (!asma_trylock(range->asma)) {
+			atomic_long_inc(&ashmem_purge_contended);
+			continue;
+		}
+
+		range->purged = ASHMEM_WAS_PURGED;
+		__lru_del(range);
+		list_add_tail(&range->lru, batch);
+
+		pages += range_size(range);
+		nr++;
 	}
-	list_for_each_entry_safe(range, next, &ashmem_lru_list, lru) {
-		struct inode *inode = range->asma->file->f_dentry->d_inode;
+	ashmem_stat_add(&ashmem_lru_stat, sched_clock() - t0);
+	spin_unlock(&ashmem_lru_lock);
+
+	return pages;
+}
+
+static void ashmem_purge_batch(struct list_head *batch)
+{
+	struct ashmem_range *range, *next;
+	u64 t0 = sched_clock();
+
+	list_for_each_entry_safe(range, next, batch, lru) {
+		struct ashmem_area *asma = range->asma;
+		struct inode *inode = asma->file->f_dentry->d_inode;
 		loff_t start = range->pgstart * PAGE_SIZE;
 		loff_t end = (range->pgend + 1) * PAGE_SIZE - 1;
 
 		vmtruncate_range(inode, start, end);
-		range->purged = ASHMEM_WAS_PURGED;
-		lru_del(range);
 
-		sc->nr_to_scan -= range_size(range);
-		if (sc->nr_to_scan <= 0)
+		atomic_long_inc(&ashmem_purged_ranges);
+		atomic_long_add(range_size(range), &ashmem_purged_pages);
+
+		/*
+		 * The range may go away as soon as its area is unlocked, so
+		 * unlock with the last range of the area in the batch.
+		 */
+		list_del(&range->lru);
+		if (!ashmem_batch_has_area(batch, asma))
+			asma_unlock(asma);
+	}
+	ashmem_stat_add(&ashmem_purge_stat, sched_clock() - t0);
+}
+
+static int ashmem_shrink(struct shrinker *s, struct shrink_control *sc)
+{
+	
+	if (sc->nr_to_scan && !(sc->gfp_mask & __GFP_FS))
+		return -1;
+	if (!sc->nr_to_scan)
+		return lru_count;
+
+	while (sc->nr_to_scan > 0) {
+		LIST_HEAD(batch);
+		unsigned long pages;
+
+		pages = ashmem_lru_isolate(&batch, sc->nr_to_scan);
+		if (!pages)
 			break;
+
+		ashmem_purge_batch(&batch);
+		sc->nr_to_scan -= pages;
 	}
-	mutex_unlock(&ashmem_mutex);
 
 	return lru_count;
 }
@@ -346,7 +496,7 @@ static int set_prot_mask(struct ashmem_area *asma, unsigned long prot)
 {
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	asma_lock(asma);
 
 	
 	if (unlikely((asma->prot_mask & prot) != prot)) {
@@ -361,7 +511,7 @@ static int set_prot_mask(struct ashmem_area *asma, unsigned long prot)
 	asma->prot_mask = prot;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	asma_unlock(asma);
 	return ret;
 }
 
@@ -369,7 +519,7 @@ static int set_name(struct ashmem_area *asma, void __user *name)
 {
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	asma_lock(asma);
 
 	
 	if (unlikely(asma->file)) {
@@ -383,7 +533,7 @@ static int set_name(struct ashmem_area *asma, void __user *name)
 	asma->name[ASHMEM_FULL_NAME_LEN-1] = '\0';
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	asma_unlock(asma);
 
 	return ret;
 }
@@ -392,7 +542,7 @@ static int get_name(struct ashmem_area *asma, void __user *name)
 {
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	asma_lock(asma);
 	if (asma->name[ASHMEM_NAME_PREFIX_LEN] != '\0') {
 		size_t len;
 
@@ -405,7 +555,7 @@ static int get_name(struct ashmem_area *asma, void __user *name)
 					  sizeof(ASHMEM_NAME_DEF))))
 			ret = -EFAULT;
 	}
-	mutex_unlock(&ashmem_mutex);
+	asma_unlock(asma);
 
 	return ret;
 }
@@ -523,7 +673,7 @@ static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
 	pgstart = pin.offset / PAGE_SIZE;
 	pgend = pgstart + (pin.len / PAGE_SIZE) - 1;
 
-	mutex_lock(&ashmem_mutex);
+	asma_lock(asma);
 
 	switch (cmd) {
 	case ASHMEM_PIN:
@@ -537,7 +687,7 @@ static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
 		break;
 	}
 
-	mutex_unlock(&ashmem_mutex);
+	asma_unlock(asma);
 
 	return ret;
 }
@@ -648,10 +798,12 @@ static long ashmem_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		break;
 	case ASHMEM_SET_SIZE:
 		ret = -EINVAL;
+		asma_lock(asma);
 		if (!asma->file) {
 			ret = 0;
 			asma->size = (size_t) arg;
 		}
+		asma_unlock(asma);
 		break;
 	case ASHMEM_GET_SIZE:
 		ret = asma->size;
@@ -757,6 +909,43 @@ static const struct file_operations ashmem_fops = {
 	.compat_ioctl = ashmem_ioctl,
 };
 
+static void ashmem_stat_show(struct seq_file *m, const char *name,
+			     struct ashmem_lock_stat *st)
+{
+	seq_printf(m, "%-6s count %ld total_ns %lld max_ns %llu\n", name,
+		   atomic_long_read(&st->count),
+		   (long long)atomic64_read(&st->total_ns),
+		   (unsigned long long)st->max_ns);
+}
+
+static int ashmem_stats_show(struct seq_file *m, void *unused)
+{
+	ashmem_stat_show(m, "area", &ashmem_area_stat);
+	ashmem_stat_show(m, "lru", &ashmem_lru_stat);
+	ashmem_stat_show(m, "purge", &ashmem_purge_stat);
+	seq_printf(m, "lru_pages %lu purged_ranges %ld purged_pages %ld "
+		   "contended %ld\n", lru_count,
+		   atomic_long_read(&ashmem_purged_ranges),
+		   atomic_long_read(&ashmem_purged_pages),
+		   atomic_long_read(&ashmem_purge_contended));
+	return 0;
+}
+
+static int ashmem_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ashmem_stats_show, inode->i_private);
+}
+
+static const struct file_operations ashmem_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = ashmem_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static struct dentry *ashmem_debugfs_stats;
+
 static struct miscdevice ashmem_misc = {
 	.minor = MISC_DYNAMIC_MINOR,
 	.name = "ashmem",
@@ -791,6 +980,10 @@ static int __init ashmem_init(void)
 
 	register_shrinker(&ashmem_shrinker);
 
+	ashmem_debugfs_stats = debugfs_create_file("ashmem_stats", S_IRUGO,
+						   NULL, NULL,
+						   &ashmem_stats_fops);
+
 	printk(KERN_INFO "ashmem: initialized\n");
 
 	return 0;
@@ -800,6 +993,7 @@ static void __exit ashmem_exit(void)
 {
 	int ret;
 
+	debugfs_remove(ashmem_debugfs_stats);
 	unregister_shrinker(&ashmem_shrinker);
 
 	ret = misc_deregister(&ashmem_misc);
@@ -19,11 +19,17 @@
 #include <linux/init.h>
 #include <linux/io.h>
 #include <linux/list.h>
+#include <linux/math64.h>
 #include <linux/memblock.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/notifier.h>
 #include <linux/persistent_ram.h>
 #include <linux/rslib.h>
+#include <linux/sched.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 
 struct persistent_ram_buffer {
 	uint32_t    sig;
@@ -36,6 +42,28 @@ struct persistent_ram_buffer {
 
 static __devinitdata LIST_HEAD(persistent_ram_list);
 
+/*
+ * Parity is normally brought up to date by a deferrable work item every
+ * ecc_delay_ms and on panic, rather than by every write; 0 encodes on
+ * every write. Writes go through a write-combining mapping unless
+ * buffered is cleared, in which case the buffer is strongly ordered.
+ */
+static int persistent_ram_ecc_delay_ms = 100;
+module_param_named(ecc_delay_ms, persistent_ram_ecc_delay_ms, int,
+		   S_IRUGO | S_IWUSR);
+
+static bool persistent_ram_buffered = true;
+module_param_named(buffered, persistent_ram_buffered, bool, S_IRUGO);
+
+#define PRZ_ECC_HEADER_DIRTY	0
+
+static LIST_HEAD(persistent_ram_ecc_zones);
+static DEFINE_MUTEX(persistent_ram_ecc_lock);
+
+static void persistent_ram_ecc_work_fn(struct work_struct *work);
+static DECLARE_DEFERRED_WORK(persistent_ram_ecc_work,
+			     persistent_ram_ecc_work_fn);
+
 static inline size_t buffer_size(struct persistent_ram_zone *prz)
 {
 	return atomic_read(&prz->buffer->size);
@@ -102,43 +130,116 @@ static int persistent_ram_decode_rs8(struct persistent_ram_zone *prz,
 				NULL, 0, NULL, 0, NULL);
 }
 
-static void notrace persistent_ram_update_ecc(struct persistent_ram_zone *prz,
-	unsigned int start, unsigned int count)
+static void notrace persistent_ram_encode_block(struct persistent_ram_zone *prz,
+	int blk)
 {
-	struct persistent_ram_buffer *buffer = prz->buffer;
-	uint8_t *buffer_end = buffer->data + prz->buffer_size;
-	uint8_t *block;
-	uint8_t *par;
-	int ecc_block_size = prz->ecc_block_size;
-	int ecc_size = prz->ecc_size;
+	uint8_t *block = prz->buffer->data + blk * prz->ecc_block_size;
+	uint8_t *par = prz->par_buffer + blk * prz->ecc_size;
 	int size = prz->ecc_block_size;
 
+	if (block + size > prz->buffer->data + prz->buffer_size)
+		size = prz->buffer->data + prz->buffer_size - block;
+	persistent_ram_encode_rs8(prz, block, size, par);
+}
+
+static void notrace persistent_ram_update_ecc(struct persistent_ram_zone *prz,
+	unsigned int start, unsigned int count, bool sync)
+{
+	int blk, last;
+
 	if (!prz->ecc)
 		return;
 
-	block = buffer->data + (start & ~(ecc_block_size - 1));
-	par = prz->par_buffer + (start / ecc_block_size) * prz->ecc_size;
+	blk = start / prz->ecc_block_size;
+	last = (start + count - 1) / prz->ecc_block_size;
 
-	do {
-		if (block + ecc_block_size > buffer_end)
-			size = buffer_end - block;
-		persistent_ram_encode_rs8(prz, block, size, par);
-		block += ecc_block_size;
-		par += ecc_size;
-	} while (block < buffer->data + start + count);
+	if (sync) {
+		for (; blk <= last; blk++)
+			persistent_ram_encode_block(prz, blk);
+		return;
+	}
+
+	/* data before the dirty bit, see persistent_ram_flush_ecc() */
+	smp_wmb();
+	for (; blk <= last; blk++)
+		set_bit(blk, prz->ecc_dirty);
 }
 
-static void persistent_ram_update_header_ecc(struct persistent_ram_zone *prz)
+static void persistent_ram_update_header_ecc(struct persistent_ram_zone *prz,
+	bool sync)
 {
 	struct persistent_ram_buffer *buffer = prz->buffer;
 
 	if (!prz->ecc)
 		return;
 
+	if (!sync) {
+		smp_wmb();
+		set_bit(PRZ_ECC_HEADER_DIRTY, &prz->ecc_flags);
+		return;
+	}
+
 	persistent_ram_encode_rs8(prz, (uint8_t *)buffer, sizeof(*buffer),
 				  prz->par_header);
 }
 
+/* Encode every block written since the last flush */
+void persistent_ram_flush_ecc(struct persistent_ram_zone *prz)
+{
+	int blk = 0;
+
+	if (!prz->ecc)
+		return;
+
+	while ((blk = find_next_bit(prz->ecc_dirty, prz->ecc_blocks, blk)) <
+	       prz->ecc_blocks) {
+		if (test_and_clear_bit(blk, prz->ecc_dirty)) {
+			prz->ecc_busy_block = blk;
+			persistent_ram_encode_block(prz, blk);
+			prz->ecc_busy_block = -1;
+		}
+		blk++;
+	}
+
+	if (test_and_clear_bit(PRZ_ECC_HEADER_DIRTY, &prz->ecc_flags))
+		persistent_ram_update_header_ecc(prz, true);
+}
+
+static void persistent_ram_ecc_work_fn(struct work_struct *work)
+{
+	struct persistent_ram_zone *prz;
+	int delay = persistent_ram_ecc_delay_ms;
+
+	mutex_lock(&persistent_ram_ecc_lock);
+	list_for_each_entry(prz, &persistent_ram_ecc_zones, node)
+		persistent_ram_flush_ecc(prz);
+	mutex_unlock(&persistent_ram_ecc_lock);
+
+	schedule_delayed_work(&persistent_ram_ecc_work,
+			      msecs_to_jiffies(delay > 0 ? delay : 1000));
+}
+
+static int persistent_ram_ecc_panic(struct notifier_block *nb,
+	unsigned long event, void *unused)
+{
+	struct persistent_ram_zone *prz;
+
+	/* the other cpus are stopped, the worker may have been on this one */
+	list_for_each_entry(prz, &persistent_ram_ecc_zones, node) {
+		if (prz->ecc_busy_block >= 0)
+			persistent_ram_encode_block(prz, prz->ecc_busy_block);
+		persistent_ram_flush_ecc(prz);
+	}
+	mb();
+
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block persistent_ram_ecc_panic_nb = {
+	.notifier_call	= persistent_ram_ecc_panic,
+	.priority	= INT_MIN,
+};
+
 static void persistent_ram_ecc_old(struct persistent_ram_zone *prz)
 {
 	struct persistent_ram_buffer *buffer = prz->buffer;
@@ -198,10 +299,18 @@ static int persistent_ram_init_ecc(struct persistent_ram_zone *prz,
 	prz->par_buffer = buffer->data + prz->buffer_size;
 	prz->par_header = prz->par_buffer + ecc_blocks * prz->ecc_size;
 
+	prz->ecc_blocks = ecc_blocks;
+	prz->ecc_busy_block = -1;
+	prz->ecc_dirty = kzalloc(BITS_TO_LONGS(ecc_blocks) * sizeof(long),
+				 GFP_KERNEL);
+	if (!prz->ecc_dirty)
+		return -ENOMEM;
+
 	prz->rs_decoder = init_rs(prz->ecc_symsize, prz->ecc_poly, 0, 1,
 				  prz->ecc_size);
 	if (prz->rs_decoder == NULL) {
 		pr_info("persistent_ram: init_rs failed\n");
+		kfree(prz->ecc_dirty);
 		return -EINVAL;
 	}
 
@@ -237,11 +346,11 @@ ssize_t persistent_ram_ecc_string(struct persistent_ram_zone *prz,
 }
 
 static void notrace persistent_ram_update(struct persistent_ram_zone *prz,
-	const void *s, unsigned int start, unsigned int count)
+	const void *s, unsigned int start, unsigned int count, bool sync)
 {
 	struct persistent_ram_buffer *buffer = prz->buffer;
 	memcpy(buffer->data + start, s, count);
-	persistent_ram_update_ecc(prz, start, count);
+	persistent_ram_update_ecc(prz, start, count, sync);
 }
 
 static void __devinit
@@ -266,8 +375,8 @@ persistent_ram_save_old(struct persistent_ram_zone *prz)
 	memcpy(prz->old_log + size - start, &buffer->data[0], start);
 }
 
-int notrace persistent_ram_write(struct persistent_ram_zone *prz,
-	const void *s, unsigned int count)
+static int notrace __persistent_ram_write(struct persistent_ram_zone *prz,
+	const void *s, unsigned int count, bool sync)
 {
 	int rem;
 	int c = count;
@@ -284,18 +393,76 @@ int notrace persistent_ram_write(struct persistent_ram_zone *prz,
 
 	rem = prz->buffer_size - start;
 	if (unlikely(rem < c)) {
-		persistent_ram_update(prz, s, start, rem);
+		persistent_ram_update(prz, s, start, rem, sync);
 		s += rem;
 		c -= rem;
 		start = 0;
 	}
-	persistent_ram_update(prz, s, start, c);
+	persistent_ram_update(prz, s, start, c, sync);
 
-	persistent_ram_update_header_ecc(prz);
+	persistent_ram_update_header_ecc(prz, sync);
 
 	return count;
 }
 
+int notrace persistent_ram_write(struct persistent_ram_zone *prz,
+	const void *s, unsigned int count)
+{
+	return __persistent_ram_write(prz, s, count,
+				      persistent_ram_ecc_delay_ms <= 0);
+}
+
+/*
+ * Average cost in ns of writing @line @iters times with encoding on every
+ * write, with deferred encoding and without ECC, into ns[0..2]. The
+ * caller keeps other writers out (e.g. holds the console lock); the
+ * zone's contents are restored afterwards.
+ */
+int persistent_ram_bench(struct persistent_ram_zone *prz, const char *line,
+	size_t len, unsigned int iters, u64 *ns)
+{
+	struct persistent_ram_buffer *buffer = prz->buffer;
+	size_t start = buffer_start(prz);
+	size_t size = buffer_size(prz);
+	bool ecc = prz->ecc;
+	unsigned int i;
+	int mode;
+	void *save;
+	u64 t0;
+
+	if (!iters)
+		return -EINVAL;
+
+	persistent_ram_flush_ecc(prz);
+
+	save = vmalloc(prz->buffer_size);
+	if (!save)
+		return -ENOMEM;
+	memcpy(save, buffer->data, prz->buffer_size);
+
+	for (mode = 0; mode < 3; mode++) {
+		prz->ecc = ecc && mode < 2;
+		t0 = sched_clock();
+		for (i = 0; i < iters; i++)
+			__persistent_ram_write(prz, line, len, mode == 0);
+		ns[mode] = div_u64(sched_clock() - t0, iters);
+	}
+	prz->ecc = ecc;
+
+	memcpy(buffer->data, save, prz->buffer_size);
+	atomic_set(&buffer->start, start);
+	atomic_set(&buffer->size, size);
+	vfree(save);
+
+	if (ecc) {
+		bitmap_fill(prz->ecc_dirty, prz->ecc_blocks);
+		set_bit(PRZ_ECC_HEADER_DIRTY, &prz->ecc_flags);
+		persistent_ram_flush_ecc(prz);
+	}
+
+	return 0;
+}
+
 size_t persistent_ram_old_size(struct persistent_ram_zone *prz)
 {
 	return prz->old_log_size;
@@ -325,7 +492,10 @@ static int persistent_ram_buffer_map(phys_addr_t start, phys_addr_t size,
 	page_start = start - offset_in_page(start);
 	page_count = DIV_ROUND_UP(size + offset_in_page(start), PAGE_SIZE);
 
-	prot = pgprot_noncached(PAGE_KERNEL);
+	if (persistent_ram_buffered)
+		prot = pgprot_writecombine(PAGE_KERNEL);
+	else
+		prot = pgprot_noncached(PAGE_KERNEL);
 
 	pages = kmalloc(sizeof(struct page *) * page_count, GFP_KERNEL);
 	if (!pages) {
@@ -422,6 +592,18 @@ struct persistent_ram_zone *__persistent_ram_init(struct device *dev, bool ecc)
 	atomic_set(&prz->buffer->start, 0);
 	atomic_set(&prz->buffer->size, 0);
 
+	if (prz->ecc) {
+		mutex_lock(&persistent_ram_ecc_lock);
+		if (list_empty(&persistent_ram_ecc_zones)) {
+			atomic_notifier_chain_register(&panic_notifier_list,
+					&persistent_ram_ecc_panic_nb);
+			schedule_delayed_work(&persistent_ram_ecc_work,
+				msecs_to_jiffies(persistent_ram_ecc_delay_ms));
+		}
+		list_add_tail(&prz->node, &persistent_ram_ecc_zones);
+		mutex_unlock(&persistent_ram_ecc_lock);
+	}
+
 	return prz;
 err:
 	kfree(prz);
@@ -19,15 +19,73 @@
 #include <linux/workqueue.h>
 #include <linux/cpu.h>
 #include <linux/cpufreq.h>
-#include <linux/msm_tsens.h>
+#include <linux/cpumask.h>
+#include <linux/jiffies.h>
+#include <linux/math64.h>
 #include <linux/msm_thermal.h>
 #include <mach/cpufreq.h>
 #include <mach/perflock.h>
 
 static int enabled;
 static struct msm_thermal_data msm_thermal_info;
-static uint32_t limited_max_freq = MSM_CPUFREQ_NO_LIMIT;
+static uint32_t cpu_max_freq[NR_CPUS] = {
+	[0 ... NR_CPUS - 1] = MSM_CPUFREQ_NO_LIMIT
+};
+static uint32_t table_min_freq, table_max_freq;
 static struct delayed_work check_temp_work;
+static cpumask_t thermal_offlined;
+
+/*
+ * Controller state.  Temperatures are in milli-degrees C, the slope in
+ * mC/s and the frequency reduction in kHz below the table maximum.
+ */
+static long cur_temp, prev_temp, temp_slope, reduction;
+static s64 integral;
+static unsigned long last_poll;
+static bool emergency;
+
+module_param(cur_temp, long, 0444);
+module_param_named(cur_slope, temp_slope, long, 0444);
+module_param(reduction, long, 0444);
+
+/* gains in kHz per C, kHz per C*s and kHz per C/s */
+static int k_p = 100000;
+static int k_i = 20000;
+static int k_d = 50000;
+module_param(k_p, int, 0644);
+module_param(k_i, int, 0644);
+module_param(k_d, int, 0644);
+
+/* apply limit_freq early if the slope reaches limit_temp within this */
+static int predict_ms = 2000;
+module_param(predict_ms, int, 0644);
+
+module_param_named(target_temp, msm_thermal_info.target_temp, uint, 0644);
+module_param_named(core_offline_temp, msm_thermal_info.core_offline_temp,
+		   uint, 0644);
+
+/*
+ * Simulated sensor: a first order model heated in proportion to the
+ * frequency caps of the online cores and cooled towards sim_ambient.
+ * Lets the controller be exercised without hot hardware.
+ */
+static int sim_enabled;
+static int sim_temp = 30000;
+static int sim_ambient = 30000;
+static int sim_heat = 4000;	/* mC/s with all cores unthrottled */
+static int sim_cool = 50;	/* per mille of (temp - ambient) per s */
+module_param(sim_enabled, int, 0644);
+module_param(sim_temp, int, 0644);
+module_param(sim_ambient, int, 0644);
+module_param(sim_heat, int, 0644);
+module_param(sim_cool, int, 0644);
+
+static uint32_t cpu_cap(int cpu)
+{
+	if (cpu_max_freq[cpu] == MSM_CPUFREQ_NO_LIMIT)
+		return table_max_freq;
+	return cpu_max_freq[cpu];
+}
 
 static int update_cpu_max_freq(int cpu, uint32_t max_freq)
 {
@@ -37,57 +95,243 @@ static int update_cpu_max_freq(int cpu, uint32_t max_freq)
 	if (ret)
 		return ret;
 
+	cpu_max_freq[cpu] = max_freq;
+
 	ret = cpufreq_update_policy(cpu);
 	if (ret)
 		return ret;
 
-	limited_max_freq = max_freq;
 	if (max_freq != MSM_CPUFREQ_NO_LIMIT)
-		pr_info("msm_thermal: Limiting cpu%d max frequency to %d\n",
+		pr_debug("msm_thermal: Limiting cpu%d max frequency to %d\n",
 				cpu, max_freq);
 	else
-		pr_info("msm_thermal: Max frequency reset for cpu%d\n", cpu);
+		pr_debug("msm_thermal: Max frequency reset for cpu%d\n", cpu);
 
 	return ret;
 }
 
-static void check_temp(struct work_struct *work)
+static void freq_table_limits(struct cpufreq_frequency_table *table)
+{
+	int i;
+
+	table_min_freq = UINT_MAX;
+	table_max_freq = 0;
+	for (i = 0; table[i].frequency != CPUFREQ_TABLE_END; i++) {
+		if (table[i].frequency == CPUFREQ_ENTRY_INVALID)
+			continue;
+		table_min_freq = min(table_min_freq, table[i].frequency);
+		table_max_freq = max(table_max_freq, table[i].frequency);
+	}
+}
+
+/* Highest table frequency not above @cap */
+static uint32_t freq_floor(struct cpufreq_frequency_table *table, long cap)
+{
+	uint32_t freq = table_min_freq;
+	int i;
+
+	for (i = 0; table[i].frequency != CPUFREQ_TABLE_END; i++) {
+		if (table[i].frequency == CPUFREQ_ENTRY_INVALID)
+			continue;
+		if ((long)table[i].frequency <= cap &&
+		    table[i].frequency > freq)
+			freq = table[i].frequency;
+	}
+	return freq;
+}
+
+static void sim_read_temp(long *temp, unsigned int interval_ms)
+{
+	/* signed, or the cooling term goes unsigned below ambient on ILP32 */
+	long dt_ms = interval_ms;
+	long load = 0;
+	int cpu;
+
+	for_each_online_cpu(cpu)
+		load += div_u64((u64)cpu_cap(cpu) * 1000, table_max_freq);
+	load /= num_possible_cpus();
+
+	sim_temp += (long)sim_heat * load / 1000 * dt_ms / 1000;
+	sim_temp -= (long)(sim_temp - sim_ambient) * sim_cool / 1000 *
+			dt_ms / 1000;
+	*temp = sim_temp;
+}
+
+static int read_hottest(long *temp)
 {
 	struct tsens_device tsens_dev;
-	unsigned long temp = 0;
-	uint32_t max_freq = limited_max_freq;
-	int cpu = 0;
-	int ret = 0;
+	uint32_t mask;
+	unsigned long t;
+	int i, ret = -ENODEV;
 
-	tsens_dev.sensor_num = msm_thermal_info.sensor_id;
-	ret = tsens_get_temp(&tsens_dev, &temp);
-	if (ret) {
-		pr_debug("msm_thermal: Unable to read TSENS sensor %d\n",
-				tsens_dev.sensor_num);
-		goto reschedule;
-	} else
-		pr_debug("msm_thermal: TSENS sensor %d (%ld C)\n",
-				tsens_dev.sensor_num, temp);
-	if (temp >= msm_thermal_info.limit_temp) {
-		max_freq = msm_thermal_info.limit_freq;
-#ifdef CONFIG_PERFLOCK_BOOT_LOCK
-		release_boot_lock();
-#endif
+	mask = msm_thermal_info.sensor_mask | BIT(msm_thermal_info.sensor_id);
+	*temp = LONG_MIN;
+	for (i = 0; i < TSENS_MAX_SENSORS; i++) {
+		if (!(mask & BIT(i)))
+			continue;
+		tsens_dev.sensor_num = i;
+		if (tsens_get_temp(&tsens_dev, &t)) {
+			pr_debug("msm_thermal: Unable to read TSENS sensor %d\n",
+					i);
+			continue;
+		}
+		*temp = max(*temp, (long)t * 1000);
+		ret = 0;
 	}
-	else if (temp <
-		msm_thermal_info.limit_temp - msm_thermal_info.temp_hysteresis)
-		max_freq = MSM_CPUFREQ_NO_LIMIT;
+	return ret;
+}
 
-	if (max_freq == limited_max_freq)
-		goto reschedule;
+static long target_mc(void)
+{
+	if (msm_thermal_info.target_temp)
+		return msm_thermal_info.target_temp * 1000;
+	return (msm_thermal_info.limit_temp -
+		msm_thermal_info.temp_hysteresis / 2) * 1000;
+}
+
+/*
+ * Spread the reduction over the cores so that higher numbered cores,
+ * which are also the first to be offlined, take the larger share.
+ */
+static void apply_caps(struct cpufreq_frequency_table *table)
+{
+	int n = num_possible_cpus();
+	uint32_t freq;
+	long cap;
+	int cpu;
 
-	
 	for_each_possible_cpu(cpu) {
-		ret = update_cpu_max_freq(cpu, max_freq);
-		if (ret)
+		cap = table_max_freq - reduction * 2 * (cpu + 1) / (n + 1);
+		if (emergency && cap > (long)msm_thermal_info.limit_freq)
+			cap = msm_thermal_info.limit_freq;
+
+		freq = freq_floor(table, cap);
+		if (freq == table_max_freq)
+			freq = MSM_CPUFREQ_NO_LIMIT;
+		if (freq == cpu_max_freq[cpu])
+			continue;
+
+		if (update_cpu_max_freq(cpu, freq))
 			pr_debug("Unable to limit cpu%d max freq to %d\n",
-					cpu, max_freq);
+					cpu, freq);
+	}
+}
+
+#ifdef CONFIG_HOTPLUG_CPU
+static void do_core_control(long temp)
+{
+	long offline_mc = msm_thermal_info.core_offline_temp * 1000;
+	long hyst_mc = msm_thermal_info.temp_hysteresis * 1000;
+	int cpu;
+
+	if (!offline_mc)
+		return;
+
+	if (temp >= offline_mc && temp_slope >= 0) {
+		for (cpu = num_possible_cpus() - 1; cpu > 0; cpu--) {
+			if (!cpu_online(cpu))
+				continue;
+			if (cpu_down(cpu)) {
+				pr_err("msm_thermal: Unable to offline cpu%d\n",
+						cpu);
+				break;
+			}
+			cpumask_set_cpu(cpu, &thermal_offlined);
+			pr_info("msm_thermal: Offlined cpu%d at %ld mC\n",
+					cpu, temp);
+			break;
+		}
+	} else if (temp < offline_mc - hyst_mc &&
+		   !cpumask_empty(&thermal_offlined)) {
+		cpu = cpumask_first(&thermal_offlined);
+		cpumask_clear_cpu(cpu, &thermal_offlined);
+		if (cpu_up(cpu))
+			pr_err("msm_thermal: Unable to online cpu%d\n", cpu);
+		else
+			pr_info("msm_thermal: Onlined cpu%d at %ld mC\n",
+					cpu, temp);
+	}
+}
+
+static void release_offlined_cores(void)
+{
+	int cpu;
+
+	for_each_cpu(cpu, &thermal_offlined) {
+		if (cpu_up(cpu))
+			pr_err("msm_thermal: Unable to online cpu%d\n", cpu);
+	}
+	cpumask_clear(&thermal_offlined);
+}
+#else
+static void do_core_control(long temp) {}
+static void release_offlined_cores(void) {}
+#endif
+
+static void reset_controller(void)
+{
+	integral = 0;
+	reduction = 0;
+	temp_slope = 0;
+	emergency = false;
+	last_poll = 0;
+}
+
+static void check_temp(struct work_struct *work)
+{
+	struct cpufreq_frequency_table *table;
+	long limit_mc = msm_thermal_info.limit_temp * 1000;
+	long hyst_mc = msm_thermal_info.temp_hysteresis * 1000;
+	long range, err, temp = 0;
+	unsigned int dt_ms;
+	s64 out;
+
+	table = cpufreq_frequency_get_table(0);
+	if (!table)
+		goto reschedule;
+	if (!table_max_freq)
+		freq_table_limits(table);
+	range = table_max_freq - table_min_freq;
+
+	dt_ms = last_poll ? jiffies_to_msecs(jiffies - last_poll) : 0;
+	last_poll = jiffies;
+
+	if (sim_enabled)
+		sim_read_temp(&temp, dt_ms ?: msm_thermal_info.poll_ms);
+	else if (read_hottest(&temp))
+		goto reschedule;
+
+	pr_debug("msm_thermal: hottest sensor %ld mC\n", temp);
+
+	if (dt_ms) {
+		long inst = (temp - prev_temp) * 1000 / (long)dt_ms;
+
+		temp_slope = (3 * temp_slope + inst) / 4;
 	}
+	prev_temp = cur_temp = temp;
+
+	/* hard limit, entered early when the slope predicts a crossing */
+	if (temp >= limit_mc || (temp_slope > 0 &&
+	    temp + temp_slope * predict_ms / 1000 >= limit_mc)) {
+#ifdef CONFIG_PERFLOCK_BOOT_LOCK
+		if (!emergency)
+			release_boot_lock();
+#endif
+		emergency = true;
+	} else if (temp < limit_mc - hyst_mc)
+		emergency = false;
+
+	err = temp - target_mc();
+	integral += div_s64((s64)k_i * err * (dt_ms ?: msm_thermal_info.poll_ms),
+			    1000000);
+	integral = clamp_t(s64, integral, 0, range);
+
+	out = div_s64((s64)k_p * err, 1000) + integral +
+		div_s64((s64)k_d * temp_slope, 1000);
+	reduction = clamp_t(s64, out, 0, range);
+
+	apply_caps(table);
+	do_core_control(temp);
 
 reschedule:
 	if (enabled)
@@ -107,6 +351,8 @@ static void disable_msm_thermal(void)
 	for_each_possible_cpu(cpu) {
 		update_cpu_max_freq(cpu, MSM_CPUFREQ_NO_LIMIT);
 	}
+	release_offlined_cores();
+	reset_controller();
 }
 
 static int set_enabled(const char *val, const struct kernel_param *kp)
@@ -116,8 +362,8 @@ static int set_enabled(const char *val, const struct kernel_param *kp)
 	ret = param_set_bool(val, kp);
 	if (!enabled)
 		disable_msm_thermal();
-	else
-		pr_info("msm_thermal: no action for enabled = %d\n", enabled);
+	else if (msm_thermal_info.poll_ms)
+		schedule_delayed_work(&check_temp_work, 0);
 
 	pr_info("msm_thermal: enabled = %d\n", enabled);
 
@@ -138,6 +384,7 @@ int __init msm_thermal_init(struct msm_thermal_data *pdata)
 
 	BUG_ON(!pdata);
 	BUG_ON(pdata->sensor_id >= TSENS_MAX_SENSORS);
+	BUG_ON(pdata->sensor_mask >> TSENS_MAX_SENSORS);
 	memcpy(&msm_thermal_info, pdata, sizeof(struct msm_thermal_data));
 
 	enabled = 1;
@@ -20,6 +20,7 @@
 
 #include <linux/blkdev.h>
 #include <linux/pagemap.h>
+#include <linux/aio.h>
 #include <linux/export.h>
 #include <asm/unaligned.h>
 
@@ -875,6 +876,219 @@ ffs_epfile_read(struct file *file, char __user *buf, size_t len, loff_t *ptr)
 	return ffs_epfile_io(file, buf, len, 1);
 }
 
+/*
+ * Asynchronous I/O.  Unlike read(2)/write(2), which share the single
+ * ep->req under epfile->mutex, every kiocb gets a usb_request of its
+ * own so userspace can keep as many transfers queued as it likes with
+ * io_submit(2); completions are reported through the aio ring (and the
+ * iocb's eventfd, if it asked for one).
+ */
+
+struct ffs_io_data {
+	struct kiocb			*kiocb;
+	struct usb_ep			*ep;
+	struct usb_request		*req;
+	char				*buf;
+
+	/* read: where to copy the data to once it arrives */
+	const struct iovec		*iov;
+	unsigned long			nr_segs;
+
+	/* usb_request completion and a pending cancel each hold one */
+	atomic_t			users;
+	int				status;
+	unsigned			actual;
+};
+
+static void ffs_aio_dtor(struct kiocb *kiocb)
+{
+	struct ffs_io_data *io_data = kiocb->private;
+
+	kiocb->private = NULL;
+	kfree(io_data->buf);
+	kfree(io_data);
+}
+
+static void ffs_aio_put(struct ffs_io_data *io_data)
+{
+	struct kiocb *kiocb = io_data->kiocb;
+
+	if (!atomic_dec_and_test(&io_data->users))
+		return;
+
+	usb_ep_free_request(io_data->ep, io_data->req);
+
+	if (io_data->iov && likely(io_data->actual))
+		/* ffs_aio_read_retry() copies it out in the right mm */
+		kick_iocb(kiocb);
+	else
+		aio_complete(kiocb, io_data->actual ?: io_data->status,
+			     io_data->status);
+}
+
+static void ffs_aio_complete(struct usb_ep *_ep, struct usb_request *req)
+{
+	struct ffs_io_data *io_data = req->context;
+
+	ENTER();
+
+	io_data->status = req->status;
+	io_data->actual = req->actual;
+	ffs_aio_put(io_data);
+}
+
+static int ffs_aio_cancel(struct kiocb *kiocb, struct io_event *e)
+{
+	struct ffs_io_data *io_data = kiocb->private;
+	int value = -EINVAL;
+
+	ENTER();
+
+	/* the request may not be freed under us while we dequeue it */
+	if (io_data && atomic_inc_not_zero(&io_data->users)) {
+		value = usb_ep_dequeue(io_data->ep, io_data->req);
+		ffs_aio_put(io_data);
+	}
+
+	aio_put_req(kiocb);
+	return value;
+}
+
+static ssize_t ffs_aio_read_retry(struct kiocb *kiocb)
+{
+	struct ffs_io_data *io_data = kiocb->private;
+	size_t total = io_data->actual;
+	char *from = io_data->buf;
+	ssize_t ret = 0;
+	unsigned long i;
+
+	for (i = 0; i < io_data->nr_segs && total; ++i) {
+		size_t this = min(io_data->iov[i].iov_len, total);
+
+		if (unlikely(copy_to_user(io_data->iov[i].iov_base,
+					  from, this))) {
+			if (!ret)
+				ret = -EFAULT;
+			break;
+		}
+		total -= this;
+		from  += this;
+		ret   += this;
+	}
+
+	return ret;
+}
+
+static ssize_t ffs_aio_submit(struct kiocb *kiocb, const struct iovec *iov,
+			      unsigned long nr_segs, int read)
+{
+	struct file *file = kiocb->ki_filp;
+	struct ffs_epfile *epfile = file->private_data;
+	struct ffs_io_data *io_data;
+	struct usb_request *req;
+	struct ffs_ep *ep;
+	size_t len = kiocb->ki_left;
+	unsigned long i;
+	ssize_t ret;
+
+	if (WARN_ON(epfile->ffs->state != FFS_ACTIVE))
+		return -ENODEV;
+
+	io_data = kzalloc(sizeof *io_data, GFP_KERNEL);
+	if (unlikely(!io_data))
+		return -ENOMEM;
+
+	io_data->buf = kmalloc(len, GFP_KERNEL);
+	if (unlikely(!io_data->buf)) {
+		kfree(io_data);
+		return -ENOMEM;
+	}
+
+	/* from now on the kiocb owns io_data */
+	io_data->kiocb = kiocb;
+	kiocb->private = io_data;
+	kiocb->ki_dtor = ffs_aio_dtor;
+
+	if (read) {
+		io_data->iov = iov;
+		io_data->nr_segs = nr_segs;
+	} else {
+		size_t off = 0;
+
+		for (i = 0; i < nr_segs; ++i) {
+			if (unlikely(copy_from_user(io_data->buf + off,
+						    iov[i].iov_base,
+						    iov[i].iov_len)))
+				return -EFAULT;
+			off += iov[i].iov_len;
+		}
+	}
+
+	/* Wait for endpoint to be enabled */
+	ep = epfile->ep;
+	if (!ep) {
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		if (wait_event_interruptible(epfile->wait, (ep = epfile->ep)))
+			return -EINTR;
+	}
+
+	spin_lock_irq(&epfile->ffs->eps_lock);
+
+	if (unlikely(epfile->ep != ep || !ep->ep)) {
+		ret = -ENODEV;
+	} else if (unlikely(!read != !epfile->in)) {
+		/* no halting from here, that's what read(2)/write(2) are for */
+		ret = -EINVAL;
+	} else if (unlikely(!(req = usb_ep_alloc_request(ep->ep,
+							 GFP_ATOMIC)))) {
+		ret = -ENOMEM;
+	} else {
+		req->buf      = io_data->buf;
+		req->length   = len;
+		req->complete = ffs_aio_complete;
+		req->context  = io_data;
+
+		io_data->ep  = ep->ep;
+		io_data->req = req;
+		atomic_set(&io_data->users, 1);
+
+		ret = usb_ep_queue(ep->ep, req, GFP_ATOMIC);
+		if (unlikely(ret)) {
+			atomic_set(&io_data->users, 0);
+			usb_ep_free_request(ep->ep, req);
+		} else {
+			kiocb->ki_cancel = ffs_aio_cancel;
+			if (read)
+				kiocb->ki_retry = ffs_aio_read_retry;
+		}
+	}
+
+	spin_unlock_irq(&epfile->ffs->eps_lock);
+
+	if (unlikely(ret))
+		return ret;
+	return read ? -EIOCBRETRY : -EIOCBQUEUED;
+}
+
+static ssize_t ffs_epfile_aio_write(struct kiocb *kiocb,
+				    const struct iovec *iov,
+				    unsigned long nr_segs, loff_t pos)
+{
+	ENTER();
+
+	return ffs_aio_submit(kiocb, iov, nr_segs, 0);
+}
+
+static ssize_t ffs_epfile_aio_read(struct kiocb *kiocb,
+				   const struct iovec *iov,
+				   unsigned long nr_segs, loff_t pos)
+{
+	ENTER();
+
+	return ffs_aio_submit(kiocb, iov, nr_segs, 1);
+}
+
 static int
 ffs_epfile_open(struct inode *inode, struct file *file)
 {
@@ -948,6 +1162,8 @@ static const struct file_operations ffs_epfile_operations = {
 	.open =		ffs_epfile_open,
 	.write =	ffs_epfile_write,
 	.read =		ffs_epfile_read,
+	.aio_write =	ffs_epfile_aio_write,
+	.aio_read =	ffs_epfile_aio_read,
 	.release =	ffs_epfile_release,
 	.unlocked_ioctl =	ffs_epfile_ioctl,
 };
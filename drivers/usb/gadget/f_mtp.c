@@ -25,6 +25,8 @@
 #include <linux/wait.h>
 #include <linux/err.h>
 #include <linux/interrupt.h>
+#include <linux/debugfs.h>
+#include <linux/ktime.h>
 
 #include <linux/types.h>
 #include <linux/file.h>
@@ -37,6 +39,7 @@
 #include <linux/usb/f_mtp.h>
 
 #define MTP_BULK_BUFFER_SIZE       16384
+#define MTP_BULK_BUFFER_SIZE_MAX   (1024 * 1024)
 #define INTR_BUFFER_SIZE           28
 
 /* String IDs */
@@ -50,10 +53,23 @@
 #define STATE_ERROR                 4   /* error from completion routine */
 
 /* number of tx and rx requests to allocate */
-#define TX_REQ_MAX 4
-#define RX_REQ_MAX 2
+#define TX_REQ_MAX 16
+#define RX_REQ_MAX 16
 #define INTR_REQ_MAX 5
 
+/*
+ * Bulk request depth and size, latched at bind. If the larger buffers
+ * cannot be allocated we fall back to MTP_BULK_BUFFER_SIZE.
+ */
+static unsigned int mtp_tx_reqs = 8;
+module_param(mtp_tx_reqs, uint, S_IRUGO | S_IWUSR);
+static unsigned int mtp_rx_reqs = 4;
+module_param(mtp_rx_reqs, uint, S_IRUGO | S_IWUSR);
+static unsigned int mtp_tx_req_len = 65536;
+module_param(mtp_tx_req_len, uint, S_IRUGO | S_IWUSR);
+static unsigned int mtp_rx_req_len = 65536;
+module_param(mtp_rx_req_len, uint, S_IRUGO | S_IWUSR);
+
 /* ID for Microsoft MTP OS String */
 #define MTP_OS_STRING_ID   0xEE
 
@@ -92,8 +108,14 @@ struct mtp_dev {
 	wait_queue_head_t write_wq;
 	wait_queue_head_t intr_wq;
 	struct usb_request *rx_req[RX_REQ_MAX];
+	/* completed rx requests since the last reset */
 	int rx_done;
 
+	unsigned tx_reqs;
+	unsigned rx_reqs;
+	unsigned tx_req_len;
+	unsigned rx_req_len;
+
 	/* for processing MTP_SEND_FILE, MTP_RECEIVE_FILE and
 	 * MTP_SEND_FILE_WITH_HEADER ioctls on a work queue
 	 */
@@ -107,6 +129,16 @@ struct mtp_dev {
 	uint16_t xfer_command;
 	uint32_t xfer_transaction_id;
 	int xfer_result;
+
+	/* file transfer statistics, see usb_mtp/status in debugfs */
+	unsigned tx_files;
+	unsigned rx_files;
+	u64 tx_bytes;
+	u64 rx_bytes;
+	s64 tx_ns;
+	s64 rx_ns;
+	s64 vfs_read_ns;
+	s64 vfs_write_ns;
 };
 
 static struct usb_interface_descriptor mtp_interface_desc = {
@@ -361,7 +393,7 @@ static void mtp_complete_out(struct usb_ep *ep, struct usb_request *req)
 {
 	struct mtp_dev *dev = _mtp_dev;
 
-	dev->rx_done = 1;
+	dev->rx_done++;
 	if (req->status != 0)
 		dev->state = STATE_ERROR;
 
@@ -380,6 +412,29 @@ static void mtp_complete_intr(struct usb_ep *ep, struct usb_request *req)
 	wake_up(&dev->intr_wq);
 }
 
+static void mtp_free_requests(struct mtp_dev *dev)
+{
+	struct usb_request *req;
+	int i;
+
+	while ((req = mtp_req_get(dev, &dev->tx_idle)))
+		mtp_request_free(req, dev->ep_in);
+	for (i = 0; i < RX_REQ_MAX; i++) {
+		mtp_request_free(dev->rx_req[i], dev->ep_out);
+		dev->rx_req[i] = NULL;
+	}
+	while ((req = mtp_req_get(dev, &dev->intr_idle)))
+		mtp_request_free(req, dev->ep_intr);
+}
+
+static unsigned mtp_bulk_len(unsigned len)
+{
+	len = clamp_t(unsigned, len, MTP_BULK_BUFFER_SIZE,
+		      MTP_BULK_BUFFER_SIZE_MAX);
+	/* keep OUT requests a multiple of the high speed packet size */
+	return ALIGN(len, 512);
+}
+
 static int mtp_create_bulk_endpoints(struct mtp_dev *dev,
 				struct usb_endpoint_descriptor *in_desc,
 				struct usb_endpoint_descriptor *out_desc,
@@ -419,16 +474,22 @@ static int mtp_create_bulk_endpoints(struct mtp_dev *dev,
 	ep->driver_data = dev;		/* claim the endpoint */
 	dev->ep_intr = ep;
 
+	dev->tx_reqs = clamp_t(unsigned, mtp_tx_reqs, 1, TX_REQ_MAX);
+	dev->rx_reqs = clamp_t(unsigned, mtp_rx_reqs, 2, RX_REQ_MAX);
+	dev->tx_req_len = mtp_bulk_len(mtp_tx_req_len);
+	dev->rx_req_len = mtp_bulk_len(mtp_rx_req_len);
+
+retry:
 	/* now allocate requests for our endpoints */
-	for (i = 0; i < TX_REQ_MAX; i++) {
-		req = mtp_request_new(dev->ep_in, MTP_BULK_BUFFER_SIZE);
+	for (i = 0; i < dev->tx_reqs; i++) {
+		req = mtp_request_new(dev->ep_in, dev->tx_req_len);
 		if (!req)
 			goto fail;
 		req->complete = mtp_complete_in;
 		mtp_req_put(dev, &dev->tx_idle, req);
 	}
-	for (i = 0; i < RX_REQ_MAX; i++) {
-		req = mtp_request_new(dev->ep_out, MTP_BULK_BUFFER_SIZE);
+	for (i = 0; i < dev->rx_reqs; i++) {
+		req = mtp_request_new(dev->ep_out, dev->rx_req_len);
 		if (!req)
 			goto fail;
 		req->complete = mtp_complete_out;
@@ -442,9 +503,18 @@ static int mtp_create_bulk_endpoints(struct mtp_dev *dev,
 		mtp_req_put(dev, &dev->intr_idle, req);
 	}
 
+	DBG(cdev, "%u x %u tx, %u x %u rx requests\n", dev->tx_reqs,
+		dev->tx_req_len, dev->rx_reqs, dev->rx_req_len);
 	return 0;
 
 fail:
+	mtp_free_requests(dev);
+	if (dev->tx_req_len > MTP_BULK_BUFFER_SIZE ||
+	    dev->rx_req_len > MTP_BULK_BUFFER_SIZE) {
+		dev->tx_req_len = MTP_BULK_BUFFER_SIZE;
+		dev->rx_req_len = MTP_BULK_BUFFER_SIZE;
+		goto retry;
+	}
 	printk(KERN_ERR "mtp_bind() could not allocate requests\n");
 	return -1;
 }
@@ -460,7 +530,7 @@ static ssize_t mtp_read(struct file *fp, char __user *buf,
 
 	DBG(cdev, "mtp_read(%d)\n", count);
 
-	if (count > MTP_BULK_BUFFER_SIZE)
+	if (count > dev->rx_req_len)
 		return -EINVAL;
 
 	/* we will block until we're online */
@@ -589,8 +659,8 @@ static ssize_t mtp_write(struct file *fp, const char __user *buf,
 			break;
 		}
 
-		if (count > MTP_BULK_BUFFER_SIZE)
-			xfer = MTP_BULK_BUFFER_SIZE;
+		if (count > dev->tx_req_len)
+			xfer = dev->tx_req_len;
 		else
 			xfer = count;
 		if (xfer && copy_from_user(req->buf, buf, xfer)) {
@@ -641,6 +711,7 @@ static void send_file_work(struct work_struct *data)
 	int xfer, ret, hdr_size;
 	int r = 0;
 	int sendZLP = 0;
+	ktime_t start, t;
 
 	/* read our parameters */
 	smp_rmb();
@@ -649,6 +720,7 @@ static void send_file_work(struct work_struct *data)
 	count = dev->xfer_file_length;
 
 	DBG(cdev, "send_file_work(%lld %lld)\n", offset, count);
+	start = ktime_get();
 
 	if (dev->xfer_send_header) {
 		hdr_size = sizeof(struct mtp_data_header);
@@ -682,8 +754,8 @@ static void send_file_work(struct work_struct *data)
 			break;
 		}
 
-		if (count > MTP_BULK_BUFFER_SIZE)
-			xfer = MTP_BULK_BUFFER_SIZE;
+		if (count > dev->tx_req_len)
+			xfer = dev->tx_req_len;
 		else
 			xfer = count;
 
@@ -697,8 +769,10 @@ static void send_file_work(struct work_struct *data)
 					__cpu_to_le32(dev->xfer_transaction_id);
 		}
 
+		t = ktime_get();
 		ret = vfs_read(filp, req->buf + hdr_size, xfer - hdr_size,
 								&offset);
+		dev->vfs_read_ns += ktime_to_ns(ktime_sub(ktime_get(), t));
 		if (ret < 0) {
 			r = ret;
 			break;
@@ -717,6 +791,7 @@ static void send_file_work(struct work_struct *data)
 		}
 
 		count -= xfer;
+		dev->tx_bytes += xfer;
 
 		/* zero this so we don't try to free it on error exit */
 		req = 0;
@@ -725,6 +800,8 @@ static void send_file_work(struct work_struct *data)
 	if (req)
 		mtp_req_put(dev, &dev->tx_idle, req);
 
+	dev->tx_files++;
+	dev->tx_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
 	DBG(cdev, "send_file_work returning %d\n", r);
 	/* write the result */
 	dev->xfer_result = r;
@@ -737,12 +814,14 @@ static void receive_file_work(struct work_struct *data)
 	struct mtp_dev *dev = container_of(data, struct mtp_dev,
 						receive_file_work);
 	struct usb_composite_dev *cdev = dev->cdev;
-	struct usb_request *read_req = NULL, *write_req = NULL;
+	struct usb_request *req;
 	struct file *filp;
 	loff_t offset;
-	int64_t count;
-	int ret, cur_buf = 0;
+	int64_t count, to_queue;
+	int ret, head = 0, tail = 0, depth;
 	int r = 0;
+	int state;
+	ktime_t start, t;
 
 	/* read our parameters */
 	smp_rmb();
@@ -751,68 +830,108 @@ static void receive_file_work(struct work_struct *data)
 	count = dev->xfer_file_length;
 
 	DBG(cdev, "receive_file_work(%lld)\n", count);
+	start = ktime_get();
+
+	/*
+	 * Keep up to rx_reqs reads queued and write each completed one to
+	 * the file while the others are still in flight. Requests on one
+	 * endpoint complete in order, so rx_req[] is used as a ring with
+	 * [head, tail) queued. Transfers of unknown length end with a short
+	 * packet; only one read may be outstanding for those so that we
+	 * never swallow the start of the next command.
+	 */
+	depth = (count == 0xFFFFFFFF) ? 1 : dev->rx_reqs;
+	to_queue = count;
+	dev->rx_done = 0;
 
-	while (count > 0 || write_req) {
-		if (count > 0) {
-			/* queue a request */
-			read_req = dev->rx_req[cur_buf];
-			cur_buf = (cur_buf + 1) % RX_REQ_MAX;
-
-			read_req->length = (count > MTP_BULK_BUFFER_SIZE
-					? MTP_BULK_BUFFER_SIZE : count);
-			dev->rx_done = 0;
-			ret = usb_ep_queue(dev->ep_out, read_req, GFP_KERNEL);
+	while (count > 0) {
+		while (to_queue > 0 && tail - head < depth) {
+			req = dev->rx_req[tail % dev->rx_reqs];
+			req->length = (to_queue > dev->rx_req_len
+					? dev->rx_req_len : to_queue);
+			ret = usb_ep_queue(dev->ep_out, req, GFP_KERNEL);
 			if (ret < 0) {
 				r = -EIO;
 				if (dev->state != STATE_OFFLINE)
 					dev->state = STATE_ERROR;
-				break;
+				goto out;
 			}
+			/* if xfer_file_length is 0xFFFFFFFF, then we read
+			 * until we get a zero length packet
+			 */
+			if (to_queue != 0xFFFFFFFF)
+				to_queue -= req->length;
+			tail++;
 		}
 
-		if (write_req) {
-			DBG(cdev, "rx %p %d\n", write_req, write_req->actual);
-			ret = vfs_write(filp, write_req->buf, write_req->actual,
-				&offset);
-			DBG(cdev, "vfs_write %d\n", ret);
-			if (ret != write_req->actual) {
-				r = -EIO;
-				if (dev->state != STATE_OFFLINE)
-					dev->state = STATE_ERROR;
-				break;
-			}
-			write_req = NULL;
+		/* wait for the oldest read to complete */
+		req = dev->rx_req[head % dev->rx_reqs];
+		wait_event_interruptible(dev->read_wq,
+			dev->rx_done != head || dev->state != STATE_BUSY);
+		if (dev->state == STATE_CANCELED) {
+			r = -ECANCELED;
+			goto out;
 		}
-
-		if (read_req) {
-			/* wait for our last read to complete */
-			ret = wait_event_interruptible(dev->read_wq,
-				dev->rx_done || dev->state != STATE_BUSY);
-			if (dev->state == STATE_CANCELED) {
-				r = -ECANCELED;
-				if (!dev->rx_done)
-					usb_ep_dequeue(dev->ep_out, read_req);
-				break;
-			}
-			/* if xfer_file_length is 0xFFFFFFFF, then we read until
-			 * we get a zero length packet
+		if (dev->rx_done == head || req->status) {
+			r = -EIO;
+			goto out;
+		}
+		head++;
+
+		if (count != 0xFFFFFFFF)
+			count -= req->actual;
+		if (req->actual < req->length) {
+			/*
+			 * short packet is used to signal EOF for
+			 * sizes > 4 gig
 			 */
-			if (count != 0xFFFFFFFF)
-				count -= read_req->actual;
-			if (read_req->actual < read_req->length) {
-				/*
-				 * short packet is used to signal EOF for
-				 * sizes > 4 gig
-				 */
-				DBG(cdev, "got short packet\n");
-				count = 0;
-			}
+			DBG(cdev, "got short packet\n");
+			count = 0;
+		}
+
+		DBG(cdev, "rx %p %d\n", req, req->actual);
+		t = ktime_get();
+		ret = vfs_write(filp, req->buf, req->actual, &offset);
+		dev->vfs_write_ns += ktime_to_ns(ktime_sub(ktime_get(), t));
+		DBG(cdev, "vfs_write %d\n", ret);
+		if (ret != req->actual) {
+			r = -EIO;
+			if (dev->state != STATE_OFFLINE)
+				dev->state = STATE_ERROR;
+			goto out;
+		}
+		dev->rx_bytes += ret;
+	}
 
-			write_req = read_req;
-			read_req = NULL;
+out:
+	/*
+	 * Take back any reads still queued.  They complete with an error
+	 * status, possibly after usb_ep_dequeue() returns, and
+	 * mtp_complete_out() then flags STATE_ERROR; wait for all of them
+	 * and put back the state we left the loop with.
+	 */
+	if (tail != head) {
+		int queued = tail;
+
+		spin_lock_irq(&dev->lock);
+		state = dev->state;
+		spin_unlock_irq(&dev->lock);
+
+		while (tail != head) {
+			tail--;
+			usb_ep_dequeue(dev->ep_out,
+				       dev->rx_req[tail % dev->rx_reqs]);
 		}
+		wait_event(dev->read_wq, dev->rx_done == queued);
+
+		spin_lock_irq(&dev->lock);
+		if (dev->state != STATE_OFFLINE)
+			dev->state = state;
+		spin_unlock_irq(&dev->lock);
 	}
 
+	dev->rx_files++;
+	dev->rx_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
 	DBG(cdev, "receive_file_work returning %d\n", r);
 	/* write the result */
 	dev->xfer_result = r;
@@ -1123,15 +1242,8 @@ static void
 mtp_function_unbind(struct usb_configuration *c, struct usb_function *f)
 {
 	struct mtp_dev	*dev = func_to_mtp(f);
-	struct usb_request *req;
-	int i;
 
-	while ((req = mtp_req_get(dev, &dev->tx_idle)))
-		mtp_request_free(req, dev->ep_in);
-	for (i = 0; i < RX_REQ_MAX; i++)
-		mtp_request_free(dev->rx_req[i], dev->ep_out);
-	while ((req = mtp_req_get(dev, &dev->intr_idle)))
-		mtp_request_free(req, dev->ep_intr);
+	mtp_free_requests(dev);
 	dev->state = STATE_OFFLINE;
 }
 
@@ -1238,6 +1350,86 @@ static int mtp_bind_config(struct usb_configuration *c, bool ptp_config)
 	return usb_add_function(c, &dev->function);
 }
 
+#ifdef CONFIG_DEBUG_FS
+static struct dentry *mtp_dent;
+
+/* bytes per microsecond, i.e. MB/s */
+static unsigned mtp_rate(u64 bytes, s64 ns)
+{
+	return ns > 0 ? div64_u64(bytes * 1000, ns) : 0;
+}
+
+static ssize_t mtp_debugfs_read_status(struct file *file, char __user *ubuf,
+				       size_t count, loff_t *ppos)
+{
+	struct mtp_dev *dev = _mtp_dev;
+	char *buf;
+	int ret;
+
+	buf = kzalloc(PAGE_SIZE, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	ret = scnprintf(buf, PAGE_SIZE,
+		"tx requests: %u x %u\n"
+		"rx requests: %u x %u\n"
+		"tx files: %u bytes: %llu time: %lld us (%u MB/s)\n"
+		"rx files: %u bytes: %llu time: %lld us (%u MB/s)\n"
+		"vfs_read: %lld us\n"
+		"vfs_write: %lld us\n",
+		dev->tx_reqs, dev->tx_req_len,
+		dev->rx_reqs, dev->rx_req_len,
+		dev->tx_files, dev->tx_bytes, div_s64(dev->tx_ns, 1000),
+		mtp_rate(dev->tx_bytes, dev->tx_ns),
+		dev->rx_files, dev->rx_bytes, div_s64(dev->rx_ns, 1000),
+		mtp_rate(dev->rx_bytes, dev->rx_ns),
+		div_s64(dev->vfs_read_ns, 1000),
+		div_s64(dev->vfs_write_ns, 1000));
+
+	ret = simple_read_from_buffer(ubuf, count, ppos, buf, ret);
+	kfree(buf);
+	return ret;
+}
+
+/* any write clears the transfer statistics */
+static ssize_t mtp_debugfs_reset_status(struct file *file,
+					const char __user *ubuf,
+					size_t count, loff_t *ppos)
+{
+	struct mtp_dev *dev = _mtp_dev;
+
+	dev->tx_files = dev->rx_files = 0;
+	dev->tx_bytes = dev->rx_bytes = 0;
+	dev->tx_ns = dev->rx_ns = 0;
+	dev->vfs_read_ns = dev->vfs_write_ns = 0;
+	return count;
+}
+
+static const struct file_operations mtp_debugfs_status_ops = {
+	.read = mtp_debugfs_read_status,
+	.write = mtp_debugfs_reset_status,
+};
+
+static void mtp_debugfs_init(void)
+{
+	mtp_dent = debugfs_create_dir("usb_mtp", 0);
+	if (IS_ERR_OR_NULL(mtp_dent))
+		return;
+
+	debugfs_create_file("status", 0644, mtp_dent, 0,
+			    &mtp_debugfs_status_ops);
+}
+
+static void mtp_debugfs_remove(void)
+{
+	debugfs_remove_recursive(mtp_dent);
+	mtp_dent = NULL;
+}
+#else
+static inline void mtp_debugfs_init(void) { }
+static inline void mtp_debugfs_remove(void) { }
+#endif
+
 static int mtp_setup(void)
 {
 	struct mtp_dev *dev;
@@ -1255,6 +1447,8 @@ static int mtp_setup(void)
 	atomic_set(&dev->ioctl_excl, 0);
 	INIT_LIST_HEAD(&dev->tx_idle);
 	INIT_LIST_HEAD(&dev->intr_idle);
+	dev->rx_req_len = MTP_BULK_BUFFER_SIZE;
+	dev->tx_req_len = MTP_BULK_BUFFER_SIZE;
 
 	dev->wq = create_singlethread_workqueue("f_mtp");
 	if (!dev->wq) {
@@ -1270,6 +1464,7 @@ static int mtp_setup(void)
 	if (ret)
 		goto err2;
 
+	mtp_debugfs_init();
 	return 0;
 
 err2:
@@ -1288,6 +1483,7 @@ static void mtp_cleanup(void)
 	if (!dev)
 		return;
 
+	mtp_debugfs_remove();
 	misc_deregister(&mtp_device);
 	destroy_workqueue(dev->wq);
 	_mtp_dev = NULL;
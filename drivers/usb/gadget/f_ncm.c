@@ -19,6 +19,8 @@
 #include <linux/device.h>
 #include <linux/etherdevice.h>
 #include <linux/crc32.h>
+#include <linux/hrtimer.h>
+#include <linux/interrupt.h>
 
 #include <linux/usb/cdc.h>
 
@@ -59,6 +61,15 @@ struct f_ncm {
 	struct ndp_parser_opts		*parser_opts;
 	bool				is_crc;
 
+	/* NTB being filled for the IN direction, see ncm_wrap_ntb() */
+	struct sk_buff			*skb_tx_data;
+	struct sk_buff			*skb_tx_ndp;
+	u16				ndp_dgram_count;
+	bool				timer_force_tx;
+	bool				timer_stopping;
+	struct tasklet_struct		tx_tasklet;
+	struct hrtimer			task_timer;
+
 	/*
 	 * for notification, it is accessed from both
 	 * callback and ethernet open/close
@@ -83,20 +94,18 @@ static inline unsigned ncm_bitrate(struct usb_gadget *g)
 /*-------------------------------------------------------------------------*/
 
 /*
- * We cannot group frames so use just the minimal size which ok to put
- * one max-size ethernet frame.
- * If the host can group frames, allow it to do that, 16K is selected,
- * because it's used by default by the current linux host driver
+ * Frames are grouped in both directions, 16K is selected because it's
+ * used by default by the current linux host driver.
  */
-#define NTB_DEFAULT_IN_SIZE	USB_CDC_NCM_NTB_MIN_IN_SIZE
+#define NTB_DEFAULT_IN_SIZE	16384
 #define NTB_OUT_SIZE		16384
 
 /*
- * skbs of size less than that will not be aligned
- * to NCM's dwNtbInMaxSize to save bus bandwidth
+ * A partly filled IN NTB is sent after TX_TIMEOUT_NSECS without new
+ * frames; TX_MAX_NUM_DPE bounds the datagrams in one NTB.
  */
-
-#define	MAX_TX_NONFIXED		(512 * 3)
+#define TX_TIMEOUT_NSECS	300000
+#define TX_MAX_NUM_DPE		32
 
 #define FORMATS_SUPPORTED	(USB_CDC_NCM_NTB16_SUPPORTED |	\
 				 USB_CDC_NCM_NTB32_SUPPORTED)
@@ -770,6 +779,20 @@ invalid:
 }
 
 
+/* drop a partly filled NTB */
+static void ncm_free_tx_ntb(struct f_ncm *ncm)
+{
+	if (ncm->skb_tx_data) {
+		dev_kfree_skb_any(ncm->skb_tx_data);
+		ncm->skb_tx_data = NULL;
+	}
+	if (ncm->skb_tx_ndp) {
+		dev_kfree_skb_any(ncm->skb_tx_ndp);
+		ncm->skb_tx_ndp = NULL;
+	}
+	ncm->ndp_dgram_count = 0;
+}
+
 static int ncm_set_alt(struct usb_function *f, unsigned intf, unsigned alt)
 {
 	struct f_ncm		*ncm = func_to_ncm(f);
@@ -800,7 +823,10 @@ static int ncm_set_alt(struct usb_function *f, unsigned intf, unsigned alt)
 
 		if (ncm->port.in_ep->driver_data) {
 			DBG(cdev, "reset ncm\n");
+			ncm->timer_stopping = true;
+			hrtimer_try_to_cancel(&ncm->task_timer);
 			gether_disconnect(&ncm->port);
+			ncm_free_tx_ntb(ncm);
 			ncm_reset_values(ncm);
 		}
 
@@ -832,6 +858,7 @@ static int ncm_set_alt(struct usb_function *f, unsigned intf, unsigned alt)
 				gadget_is_musbhdrc(cdev->gadget)
 				);
 			ncm->port.cdc_filter = DEFAULT_FILTER;
+			ncm->timer_stopping = false;
 			DBG(cdev, "activate ncm\n");
 			net = gether_connect(&ncm->port);
 			if (IS_ERR(net))
@@ -862,91 +889,162 @@ static int ncm_get_alt(struct usb_function *f, unsigned intf)
 	return ncm->port.in_ep->driver_data ? 1 : 0;
 }
 
+/* append the NDP to the datagrams and return the finished NTB */
+static struct sk_buff *ncm_package_ntb(struct f_ncm *ncm)
+{
+	struct ndp_parser_opts *opts = ncm->parser_opts;
+	struct sk_buff	*skb = ncm->skb_tx_data;
+	int		ndp_align = ntb_parameters.wNdpInAlignment;
+	int		dgram_idx_len = 2 * 2 * opts->dgram_item_len;
+	unsigned	ndp_pad, ndp_index;
+	__le16		*tmp;
+
+	hrtimer_try_to_cancel(&ncm->task_timer);
+
+	ndp_pad = ALIGN(skb->len, ndp_align) - skb->len;
+	ndp_index = skb->len + ndp_pad;
+
+	/* (d)wBlockLength and (d)wFpIndex, right after wSequence */
+	tmp = (void *)skb->data + 8;
+	put_ncm(&tmp, opts->block_length,
+		ndp_index + ncm->skb_tx_ndp->len + dgram_idx_len);
+	put_ncm(&tmp, opts->fp_index, ndp_index);
+
+	/* NDP wLength, counting the zero datagram entry */
+	tmp = (void *)ncm->skb_tx_ndp->data + 4;
+	put_unaligned_le16(opts->ndp_size +
+			   ncm->ndp_dgram_count * dgram_idx_len, tmp);
+
+	memset(skb_put(skb, ndp_pad), 0, ndp_pad);
+	memcpy(skb_put(skb, ncm->skb_tx_ndp->len), ncm->skb_tx_ndp->data,
+	       ncm->skb_tx_ndp->len);
+	memset(skb_put(skb, dgram_idx_len), 0, dgram_idx_len);
+
+	ncm->skb_tx_data = NULL;
+	ncm_free_tx_ntb(ncm);
+	return skb;
+}
+
+/*
+ * Datagrams are gathered into one NTB of up to fixed_in_len bytes with
+ * the NDP at its end. NULL is returned while the NTB fills up; it goes
+ * out when the next datagram doesn't fit, or from ncm_tx_tasklet() once
+ * TX_TIMEOUT_NSECS pass without traffic.
+ */
 static struct sk_buff *ncm_wrap_ntb(struct gether *port,
 				    struct sk_buff *skb)
 {
 	struct f_ncm	*ncm = func_to_ncm(&port->func);
-	struct sk_buff	*skb2;
-	int		ncb_len = 0;
+	struct sk_buff	*skb2 = NULL;
 	__le16		*tmp;
 	int		div = ntb_parameters.wNdpInDivisor;
 	int		rem = ntb_parameters.wNdpInPayloadRemainder;
-	int		pad;
 	int		ndp_align = ntb_parameters.wNdpInAlignment;
-	int		ndp_pad;
+	int		dgram_idx_len;
+	unsigned	ncb_len, pad, dgram_len;
 	unsigned	max_size = ncm->port.fixed_in_len;
 	struct ndp_parser_opts *opts = ncm->parser_opts;
 	unsigned	crc_len = ncm->is_crc ? sizeof(uint32_t) : 0;
 
-	ncb_len += opts->nth_size;
-	ndp_pad = ALIGN(ncb_len, ndp_align) - ncb_len;
-	ncb_len += ndp_pad;
-	ncb_len += opts->ndp_size;
-	ncb_len += 2 * 2 * opts->dgram_item_len; /* Datagram entry */
-	ncb_len += 2 * 2 * opts->dgram_item_len; /* Zero datagram entry */
-	pad = ALIGN(ncb_len, div) + rem - ncb_len;
-	ncb_len += pad;
-
-	if (ncb_len + skb->len + crc_len > max_size) {
-		dev_kfree_skb_any(skb);
+	if (!skb) {
+		if (ncm->skb_tx_data && ncm->timer_force_tx)
+			return ncm_package_ntb(ncm);
 		return NULL;
 	}
 
-	skb2 = skb_copy_expand(skb, ncb_len,
-			       max_size - skb->len - ncb_len - crc_len,
-			       GFP_ATOMIC);
-	dev_kfree_skb_any(skb);
-	if (!skb2)
-		return NULL;
+	dgram_idx_len = 2 * 2 * opts->dgram_item_len;
+	dgram_len = skb->len + crc_len;
 
-	skb = skb2;
+	/* it has to fit an NTB of its own */
+	if (opts->nth_size + div + rem + dgram_len + ndp_align +
+	    opts->ndp_size + 2 * dgram_idx_len > max_size) {
+		dev_kfree_skb_any(skb);
+		return NULL;
+	}
 
-	tmp = (void *) skb_push(skb, ncb_len);
-	memset(tmp, 0, ncb_len);
+	if (ncm->skb_tx_data &&
+	    (ncm->ndp_dgram_count > TX_MAX_NUM_DPE ||
+	     ncm->skb_tx_data->len + div + rem + dgram_len + ndp_align +
+	     ncm->skb_tx_ndp->len + 2 * dgram_idx_len > max_size))
+		skb2 = ncm_package_ntb(ncm);
+
+	if (!ncm->skb_tx_data) {
+		ncm->skb_tx_data = alloc_skb(max_size, GFP_ATOMIC);
+		ncm->skb_tx_ndp = alloc_skb(opts->ndp_size +
+					    dgram_idx_len * TX_MAX_NUM_DPE,
+					    GFP_ATOMIC);
+		if (!ncm->skb_tx_data || !ncm->skb_tx_ndp) {
+			ncm_free_tx_ntb(ncm);
+			dev_kfree_skb_any(skb);
+			return skb2;
+		}
 
-	put_unaligned_le32(opts->nth_sign, tmp); /* dwSignature */
-	tmp += 2;
-	/* wHeaderLength */
-	put_unaligned_le16(opts->nth_size, tmp++);
-	tmp++; /* skip wSequence */
-	put_ncm(&tmp, opts->block_length, skb->len); /* (d)wBlockLength */
-	/* (d)wFpIndex */
-	/* the first pointer is right after the NTH + align */
-	put_ncm(&tmp, opts->fp_index, opts->nth_size + ndp_pad);
+		/* NTH, block length and NDP index are set when it's sent */
+		tmp = (void *)skb_put(ncm->skb_tx_data, opts->nth_size);
+		memset(tmp, 0, opts->nth_size);
+		put_unaligned_le32(opts->nth_sign, tmp); /* dwSignature */
+		tmp += 2;
+		/* wHeaderLength */
+		put_unaligned_le16(opts->nth_size, tmp++);
 
-	tmp = (void *)tmp + ndp_pad;
+		tmp = (void *)skb_put(ncm->skb_tx_ndp, opts->ndp_size);
+		memset(tmp, 0, opts->ndp_size);
+		put_unaligned_le32(opts->ndp_sign, tmp); /* dwSignature */
 
-	/* NDP */
-	put_unaligned_le32(opts->ndp_sign, tmp); /* dwSignature */
-	tmp += 2;
-	/* wLength */
-	put_unaligned_le16(ncb_len - opts->nth_size - pad, tmp++);
+		/* the zero datagram entry */
+		ncm->ndp_dgram_count = 1;
+	}
 
-	tmp += opts->reserved1;
-	tmp += opts->next_fp_index; /* skip reserved (d)wNextFpIndex */
-	tmp += opts->reserved2;
+	ncb_len = ncm->skb_tx_data->len;
+	pad = ALIGN(ncb_len, div) + rem - ncb_len;
+	memset(skb_put(ncm->skb_tx_data, pad), 0, pad);
+	ncb_len += pad;
 
+	memcpy(skb_put(ncm->skb_tx_data, skb->len), skb->data, skb->len);
 	if (ncm->is_crc) {
 		uint32_t crc;
 
-		crc = ~crc32_le(~0,
-				skb->data + ncb_len,
-				skb->len - ncb_len);
-		put_unaligned_le32(crc, skb->data + skb->len);
-		skb_put(skb, crc_len);
+		crc = ~crc32_le(~0, skb->data, skb->len);
+		put_unaligned_le32(crc, skb_put(ncm->skb_tx_data, crc_len));
 	}
+	dev_kfree_skb_any(skb);
 
-	/* (d)wDatagramIndex[0] */
+	tmp = (void *)skb_put(ncm->skb_tx_ndp, dgram_idx_len);
+	/* (d)wDatagramIndex */
 	put_ncm(&tmp, opts->dgram_item_len, ncb_len);
-	/* (d)wDatagramLength[0] */
-	put_ncm(&tmp, opts->dgram_item_len, skb->len - ncb_len);
-	/* (d)wDatagramIndex[1] and  (d)wDatagramLength[1] already zeroed */
+	/* (d)wDatagramLength */
+	put_ncm(&tmp, opts->dgram_item_len, dgram_len);
+	ncm->ndp_dgram_count++;
 
-	if (skb->len > MAX_TX_NONFIXED)
-		memset(skb_put(skb, max_size - skb->len),
-		       0, max_size - skb->len);
+	hrtimer_start(&ncm->task_timer, ktime_set(0, TX_TIMEOUT_NSECS),
+		      HRTIMER_MODE_REL);
 
-	return skb;
+	return skb2;
+}
+
+static void ncm_tx_tasklet(unsigned long data)
+{
+	struct f_ncm	*ncm = (void *)data;
+
+	if (ncm->timer_stopping || !ncm->skb_tx_data)
+		return;
+
+	ncm->timer_force_tx = true;
+	/* no free request, try again on the next tick */
+	if (gether_flush(&ncm->port) == -EBUSY)
+		hrtimer_start(&ncm->task_timer,
+			      ktime_set(0, TX_TIMEOUT_NSECS),
+			      HRTIMER_MODE_REL);
+	ncm->timer_force_tx = false;
+}
+
+static enum hrtimer_restart ncm_tx_timeout(struct hrtimer *timer)
+{
+	struct f_ncm	*ncm = container_of(timer, struct f_ncm, task_timer);
+
+	if (!ncm->timer_stopping)
+		tasklet_schedule(&ncm->tx_tasklet);
+	return HRTIMER_NORESTART;
 }
 
 static int ncm_unwrap_ntb(struct gether *port,
@@ -1090,8 +1188,12 @@ static void ncm_disable(struct usb_function *f)
 
 	DBG(cdev, "ncm deactivated\n");
 
+	ncm->timer_stopping = true;
+	hrtimer_try_to_cancel(&ncm->task_timer);
+
 	if (ncm->port.in_ep->driver_data)
 		gether_disconnect(&ncm->port);
+	ncm_free_tx_ntb(ncm);
 
 	if (ncm->notify->driver_data) {
 		usb_ep_disable(ncm->notify);
@@ -1276,6 +1378,11 @@ ncm_unbind(struct usb_configuration *c, struct usb_function *f)
 
 	DBG(c->cdev, "ncm unbind\n");
 
+	ncm->timer_stopping = true;
+	hrtimer_cancel(&ncm->task_timer);
+	tasklet_kill(&ncm->tx_tasklet);
+	ncm_free_tx_ntb(ncm);
+
 	if (gadget_is_dualspeed(c->cdev->gadget))
 		usb_free_descriptors(f->hs_descriptors);
 	usb_free_descriptors(f->descriptors);
@@ -1368,6 +1475,12 @@ int __init ncm_bind_config(struct usb_configuration *c, u8 ethaddr[ETH_ALEN])
 
 	ncm->port.wrap = ncm_wrap_ntb;
 	ncm->port.unwrap = ncm_unwrap_ntb;
+	ncm->port.supports_multi_frame = true;
+
+	ncm->timer_stopping = true;
+	hrtimer_init(&ncm->task_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	ncm->task_timer.function = ncm_tx_timeout;
+	tasklet_init(&ncm->tx_tasklet, ncm_tx_tasklet, (unsigned long)ncm);
 
 	status = usb_add_function(c, &ncm->port.func);
 	if (status) {
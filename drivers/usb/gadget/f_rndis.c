@@ -80,6 +80,15 @@ struct f_rndis {
 	atomic_t			notify_count;
 };
 
+/*
+ * Number of packets the host may aggregate into one OUT transfer. The
+ * receive buffers are sized for this many full frames.
+ */
+static unsigned int rndis_ul_max_pkt_per_xfer = TX_SKB_HOLD_THRESHOLD;
+module_param(rndis_ul_max_pkt_per_xfer, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(rndis_ul_max_pkt_per_xfer,
+	"max packets per host to device transfer");
+
 static inline struct f_rndis *func_to_rndis(struct usb_function *f)
 {
 	return container_of(f, struct f_rndis, port.func);
@@ -784,6 +793,11 @@ rndis_bind(struct usb_configuration *c, struct usb_function *f)
 	rndis_set_param_medium(rndis->config, NDIS_MEDIUM_802_3, 0);
 	rndis_set_host_mac(rndis->config, rndis->ethaddr);
 
+	rndis_ul_max_pkt_per_xfer = clamp_t(unsigned, rndis_ul_max_pkt_per_xfer,
+					    1, 16);
+	rndis_set_max_pkt_xfer(rndis->config, rndis_ul_max_pkt_per_xfer);
+	rndis->port.ul_max_pkts_per_xfer = rndis_ul_max_pkt_per_xfer;
+
 	if (rndis->manufacturer && rndis->vendorID &&
 			rndis_set_param_vendor(rndis->config, rndis->vendorID,
 					       rndis->manufacturer))
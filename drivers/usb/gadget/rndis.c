@@ -585,8 +585,8 @@ static int rndis_init_response(int configNr, rndis_init_msg_type *buf)
 	resp->MinorVersion = cpu_to_le32(RNDIS_MINOR_VERSION);
 	resp->DeviceFlags = cpu_to_le32(RNDIS_DF_CONNECTIONLESS);
 	resp->Medium = cpu_to_le32(RNDIS_MEDIUM_802_3);
-	resp->MaxPacketsPerTransfer = cpu_to_le32(TX_SKB_HOLD_THRESHOLD);
-	resp->MaxTransferSize = cpu_to_le32(TX_SKB_HOLD_THRESHOLD *
+	resp->MaxPacketsPerTransfer = cpu_to_le32(params->max_pkt_per_xfer);
+	resp->MaxTransferSize = cpu_to_le32(params->max_pkt_per_xfer *
 		(params->dev->mtu
 		+ sizeof(struct ethhdr)
 		+ sizeof(struct rndis_packet_msg_type)
@@ -902,6 +902,7 @@ int rndis_register(void (*resp_avail)(void *v), void *v)
 			rndis_per_dev_params[i].used = 1;
 			rndis_per_dev_params[i].resp_avail = resp_avail;
 			rndis_per_dev_params[i].v = v;
+			rndis_per_dev_params[i].max_pkt_per_xfer = 1;
 			pr_debug("%s: configNr = %d\n", __func__, i);
 			return i;
 		}
@@ -955,6 +956,17 @@ int rndis_set_param_medium(u8 configNr, u32 medium, u32 speed)
 	return 0;
 }
 
+/* how many packets the host may send us in one OUT transfer */
+void rndis_set_max_pkt_xfer(u8 configNr, u8 max_pkt_per_xfer)
+{
+	pr_debug("%s: %u\n", __func__, max_pkt_per_xfer);
+	if (configNr >= RNDIS_MAX_CONFIGS)
+		return;
+
+	rndis_per_dev_params[configNr].max_pkt_per_xfer =
+		max_pkt_per_xfer ? max_pkt_per_xfer : 1;
+}
+
 void rndis_add_hdr(struct sk_buff *skb)
 {
 	struct rndis_packet_msg_type *header;
@@ -1023,30 +1035,72 @@ static rndis_resp_t *rndis_add_response(int configNr, u32 length)
 	return r;
 }
 
+/*
+ * The host may pack up to max_pkt_per_xfer packet messages into one
+ * transfer. All but the last are split off as clones sharing the
+ * receive buffer, so de-aggregation never copies payload.
+ */
 int rndis_rm_hdr(struct gether *port,
 			struct sk_buff *skb,
 			struct sk_buff_head *list)
 {
-	/* tmp points to a struct rndis_packet_msg_type */
-	__le32 *tmp = (void *)skb->data;
+	struct sk_buff *skb2;
+	u32 msg_len, data_offset, data_len;
+	__le32 *tmp;
 
-	/* MessageType, MessageLength */
-	if (cpu_to_le32(REMOTE_NDIS_PACKET_MSG)
-			!= get_unaligned(tmp++)) {
-		dev_kfree_skb_any(skb);
-		return -EINVAL;
-	}
-	tmp++;
+	while (skb->len) {
+		/* some hosts send an extra byte to avoid a zlp */
+		if (skb->len == 1)
+			break;
 
-	/* DataOffset, DataLength */
-	if (!skb_pull(skb, get_unaligned_le32(tmp++) + 8)) {
-		dev_kfree_skb_any(skb);
-		return -EOVERFLOW;
+		if (skb->len < sizeof(struct rndis_packet_msg_type))
+			goto bad;
+
+		/* tmp points to a struct rndis_packet_msg_type */
+		tmp = (void *)skb->data;
+
+		/* MessageType, MessageLength */
+		if (cpu_to_le32(REMOTE_NDIS_PACKET_MSG)
+				!= get_unaligned(tmp++))
+			goto bad;
+		msg_len = get_unaligned_le32(tmp++);
+
+		/* DataOffset, DataLength */
+		data_offset = get_unaligned_le32(tmp++);
+		data_len = get_unaligned_le32(tmp++);
+		if (msg_len > skb->len || msg_len < 8 ||
+		    data_offset > msg_len - 8 ||
+		    data_len > msg_len - 8 - data_offset) {
+			dev_kfree_skb_any(skb);
+			return -EOVERFLOW;
+		}
+
+		if (msg_len + 1 >= skb->len) {
+			/* last (or only) packet in this transfer */
+			skb_pull(skb, data_offset + 8);
+			skb_trim(skb, data_len);
+			skb_queue_tail(list, skb);
+			return 0;
+		}
+
+		skb2 = skb_clone(skb, GFP_ATOMIC);
+		if (!skb2) {
+			dev_kfree_skb_any(skb);
+			return -ENOMEM;
+		}
+		skb_pull(skb2, data_offset + 8);
+		skb_trim(skb2, data_len);
+		skb_queue_tail(list, skb2);
+
+		skb_pull(skb, msg_len);
 	}
-	skb_trim(skb, get_unaligned_le32(tmp++));
 
-	skb_queue_tail(list, skb);
+	dev_kfree_skb_any(skb);
 	return 0;
+
+bad:
+	dev_kfree_skb_any(skb);
+	return -EINVAL;
 }
 
 #ifdef CONFIG_USB_GADGET_DEBUG_FILES
@@ -19,6 +19,7 @@
 #include <linux/ctype.h>
 #include <linux/etherdevice.h>
 #include <linux/ethtool.h>
+#include <linux/scatterlist.h>
 
 #include "u_ether.h"
 
@@ -66,6 +67,8 @@ struct eth_dev {
 	int			no_tx_req_used;
 	int			tx_skb_hold_count;
 	u32			tx_req_bufsize;
+	/* multi packet requests chain the skbs instead of copying them */
+	bool			tx_sg;
 
 	struct sk_buff_head	rx_frames;
 
@@ -89,6 +92,13 @@ struct eth_dev {
 
 #define RX_EXTRA	20	/* bytes guarding against rx overflows */
 
+/* per request state for scatter-gather multi packet transfers */
+struct eth_tx_sg {
+	struct sk_buff_head	skbs;
+	struct scatterlist	sg[TX_SKB_HOLD_THRESHOLD + 1];
+	u8			pad;
+};
+
 #define DEFAULT_QLEN	2	/* double buffering by default */
 
 #ifdef CONFIG_USB_GADGET_DUALSPEED
@@ -236,6 +246,9 @@ rx_submit(struct eth_dev *dev, struct usb_request *req, gfp_t gfp_flags)
 	 */
 	size += sizeof(struct ethhdr) + dev->net->mtu + RX_EXTRA;
 	size += dev->port_usb->header_len;
+	/* room for every frame the host may aggregate */
+	if (dev->port_usb->ul_max_pkts_per_xfer)
+		size *= dev->port_usb->ul_max_pkts_per_xfer;
 	size += out->maxpacket - 1;
 	size -= size % out->maxpacket;
 
@@ -473,6 +486,29 @@ static void eth_work(struct work_struct *work)
 		DBG(dev, "work done, flags = 0x%lx\n", dev->todo);
 }
 
+static void eth_tx_sg_release(struct usb_request *req)
+{
+	struct eth_tx_sg	*ctx = req->context;
+	struct sk_buff		*skb;
+
+	if (!ctx)
+		return;
+	while ((skb = __skb_dequeue(&ctx->skbs)))
+		dev_kfree_skb_any(skb);
+	req->num_sgs = 0;
+}
+
+/* terminate the chain, adding the one byte pad used instead of a zlp */
+static void eth_tx_sg_end(struct usb_request *req, bool pad)
+{
+	struct eth_tx_sg	*ctx = req->context;
+
+	if (pad)
+		sg_set_buf(&ctx->sg[req->num_sgs++], &ctx->pad, 1);
+	sg_mark_end(&ctx->sg[req->num_sgs - 1]);
+	req->sg = ctx->sg;
+}
+
 static void tx_complete(struct usb_ep *ep, struct usb_request *req)
 {
 	struct sk_buff	*skb = req->context;
@@ -505,6 +541,8 @@ static void tx_complete(struct usb_ep *ep, struct usb_request *req)
 	if (dev->port_usb->multi_pkt_xfer) {
 		dev->no_tx_req_used--;
 		req->length = 0;
+		if (dev->tx_sg)
+			eth_tx_sg_release(req);
 		in = dev->port_usb->in_ep;
 
 		if (!list_empty(&dev->tx_reqs)) {
@@ -535,6 +573,9 @@ static void tx_complete(struct usb_ep *ep, struct usb_request *req)
 					length++;
 				}
 
+				if (new_req->num_sgs)
+					eth_tx_sg_end(new_req,
+						      length > new_req->length);
 				new_req->length = length;
 				retval = usb_ep_queue(in, new_req, GFP_ATOMIC);
 				switch (retval) {
@@ -573,6 +614,7 @@ static void alloc_tx_buffer(struct eth_dev *dev)
 {
 	struct list_head	*act;
 	struct usb_request	*req;
+	struct eth_tx_sg	*ctx;
 
 	dev->tx_req_bufsize = (TX_SKB_HOLD_THRESHOLD *
 				(dev->net->mtu
@@ -581,11 +623,23 @@ static void alloc_tx_buffer(struct eth_dev *dev)
 				+ 44
 				+ 22));
 
+	/* controllers that take a scatterlist send the skbs in place */
+	dev->tx_sg = dev->gadget->sg_supported;
+
 	list_for_each(act, &dev->tx_reqs) {
 		req = container_of(act, struct usb_request, list);
-		if (!req->buf)
+		if (dev->tx_sg) {
+			if (req->context)
+				continue;
+			ctx = kzalloc(sizeof(*ctx), GFP_ATOMIC);
+			if (ctx)
+				skb_queue_head_init(&ctx->skbs);
+			req->context = ctx;
+			req->num_sgs = 0;
+		} else if (!req->buf) {
 			req->buf = kmalloc(dev->tx_req_bufsize,
 						GFP_ATOMIC);
+		}
 	}
 }
 
@@ -593,7 +647,7 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 					struct net_device *net)
 {
 	struct eth_dev		*dev = netdev_priv(net);
-	int			length = skb->len;
+	int			length;
 	int			retval;
 	struct usb_request	*req = NULL;
 	unsigned long		flags;
@@ -611,7 +665,8 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 	spin_unlock_irqrestore(&dev->lock, flags);
 
 	if (!in) {
-		dev_kfree_skb_any(skb);
+		if (skb)
+			dev_kfree_skb_any(skb);
 		return NETDEV_TX_OK;
 	}
 
@@ -619,8 +674,8 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 	if (dev->port_usb->multi_pkt_xfer && !dev->tx_req_bufsize)
 		alloc_tx_buffer(dev);
 
-	/* apply outgoing CDC or RNDIS filters */
-	if (!is_promisc(cdc_filter)) {
+	/* apply outgoing CDC or RNDIS filters; a NULL skb is a flush */
+	if (skb && !is_promisc(cdc_filter)) {
 		u8		*dest = skb->data;
 
 		if (is_multicast_ether_addr(dest)) {
@@ -671,8 +726,13 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 		if (dev->port_usb)
 			skb = dev->wrap(dev->port_usb, skb);
 		spin_unlock_irqrestore(&dev->lock, flags);
-		if (!skb)
+		if (!skb) {
+			/* aggregating framing may hold the frame for later */
+			if (dev->port_usb &&
+			    dev->port_usb->supports_multi_frame)
+				goto multiframe;
 			goto drop;
+		}
 	}
 
 	spin_lock_irqsave(&dev->req_lock, flags);
@@ -680,10 +740,25 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 	spin_unlock_irqrestore(&dev->req_lock, flags);
 
 	if (dev->port_usb->multi_pkt_xfer) {
-		memcpy(req->buf + req->length, skb->data, skb->len);
 		req->length = req->length + skb->len;
 		length = req->length;
-		dev_kfree_skb_any(skb);
+		if (dev->tx_sg) {
+			struct eth_tx_sg *ctx = req->context;
+
+			if (!ctx) {
+				dev_kfree_skb_any(skb);
+				goto drop;
+			}
+			if (!req->num_sgs)
+				sg_init_table(ctx->sg, ARRAY_SIZE(ctx->sg));
+			sg_set_buf(&ctx->sg[req->num_sgs++], skb->data,
+				   skb->len);
+			__skb_queue_tail(&ctx->skbs, skb);
+		} else {
+			memcpy(req->buf + length - skb->len, skb->data,
+			       skb->len);
+			dev_kfree_skb_any(skb);
+		}
 
 		spin_lock_irqsave(&dev->req_lock, flags);
 		if (dev->tx_skb_hold_count < TX_SKB_HOLD_THRESHOLD) {
@@ -725,6 +800,8 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 		length++;
 	}
 
+	if (req->num_sgs)
+		eth_tx_sg_end(req, length > req->length);
 	req->length = length;
 
 	/* throttle highspeed IRQ rate back slightly */
@@ -755,6 +832,7 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 			dev_kfree_skb_any(skb);
 drop:
 		dev->net->stats.tx_dropped++;
+multiframe:
 		spin_lock_irqsave(&dev->req_lock, flags);
 		if (list_empty(&dev->tx_reqs))
 			netif_start_queue(net);
@@ -1068,6 +1146,7 @@ struct net_device *gether_connect(struct gether *link)
 		dev->tx_skb_hold_count = 0;
 		dev->no_tx_req_used = 0;
 		dev->tx_req_bufsize = 0;
+		dev->tx_sg = false;
 		dev->port_usb = link;
 		link->ioport = dev;
 		if (netif_running(dev->net)) {
@@ -1134,8 +1213,13 @@ void gether_disconnect(struct gether *link)
 		list_del(&req->list);
 
 		spin_unlock(&dev->req_lock);
-		if (link->multi_pkt_xfer)
+		if (link->multi_pkt_xfer) {
 			kfree(req->buf);
+			if (dev->tx_sg) {
+				eth_tx_sg_release(req);
+				kfree(req->context);
+			}
+		}
 		usb_ep_free_request(link->in_ep, req);
 		spin_lock(&dev->req_lock);
 	}
@@ -1175,6 +1259,31 @@ void gether_disconnect(struct gether *link)
 	spin_unlock(&dev->lock);
 }
 
+/**
+ * gether_flush - transmit frames held back by an aggregating wrap()
+ * @link: the USB link, on which gether_connect() was called
+ * Context: process or softirq context
+ *
+ * Framing that packs several frames into one transfer (NCM) returns
+ * NULL from wrap() while a block fills up, and calls this, typically
+ * from a timer, so that a partly filled block goes out. Returns -EBUSY
+ * if no request was free; the caller should try again later.
+ */
+int gether_flush(struct gether *link)
+{
+	struct eth_dev		*dev = link->ioport;
+	netdev_tx_t		ret;
+
+	if (!dev || !link->supports_multi_frame)
+		return -ENOTCONN;
+
+	netif_tx_lock_bh(dev->net);
+	ret = eth_start_xmit(NULL, dev->net);
+	netif_tx_unlock_bh(dev->net);
+
+	return ret == NETDEV_TX_BUSY ? -EBUSY : 0;
+}
+
 static int __init gether_init(void)
 {
 	uether_wq  = create_singlethread_workqueue("uether");
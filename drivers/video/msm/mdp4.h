@@ -401,6 +401,11 @@ struct mdp4_statistic {
 	ulong dsi_mdp_start;
 	ulong dsi_clk_on;
 	ulong dsi_clk_off;
+	ulong dsi_frame_full;
+	ulong dsi_frame_partial;
+	ulong dsi_bytes_last;
+	u64 dsi_bytes_total;
+	u64 dsi_bytes_saved;
 	ulong intr_dsi;
 	ulong intr_dsi_mdp;
 	ulong intr_dsi_cmd;
@@ -420,6 +425,7 @@ struct mdp4_statistic {
 	ulong overlay_unset[MDP4_MIXER_MAX];
 	ulong overlay_play[MDP4_MIXER_MAX];
 	ulong overlay_commit[MDP4_MIXER_MAX];
+	ulong atomic_commit;
 	ulong pipe[OVERLAY_PIPE_MAX];
 	ulong wait4vsync0;
 	ulong wait4vsync1;
@@ -616,6 +622,8 @@ int mdp4_overlay_unset_mixer(int mixer);
 int mdp4_overlay_play_wait(struct fb_info *info,
 	struct msmfb_overlay_data *req);
 int mdp4_overlay_play(struct fb_info *info, struct msmfb_overlay_data *req);
+int mdp4_overlay_atomic(struct fb_info *info, struct mdp_atomic_layer *layers,
+			int cnt, int test_only);
 struct mdp4_overlay_pipe *mdp4_overlay_pipe_alloc(int ptype, int mixer);
 void mdp4_overlay_dma_commit(int mixer);
 void mdp4_overlay_vsync_commit(struct mdp4_overlay_pipe *pipe);
@@ -3511,11 +3511,13 @@ int mdp4_overlay_get(struct fb_info *info, struct mdp_overlay *req)
 	return 0;
 }
 
+static int mdp4_overlay_set_locked(struct msm_fb_data_type *mfd,
+				   struct mdp_overlay *req);
+
 int mdp4_overlay_set(struct fb_info *info, struct mdp_overlay *req)
 {
 	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
-	int ret, mixer;
-	struct mdp4_overlay_pipe *pipe;
+	int ret;
 
 	if (mfd == NULL) {
 		pr_err("%s: mfd == NULL, -ENODEV\n", __func__);
@@ -3534,12 +3536,25 @@ int mdp4_overlay_set(struct fb_info *info, struct mdp_overlay *req)
 		return -EINTR;
 	}
 
+	ret = mdp4_overlay_set_locked(mfd, req);
+
+	mutex_unlock(&mfd->dma->ov_mutex);
+
+	return ret;
+}
+
+/* called with ov_mutex held */
+static int mdp4_overlay_set_locked(struct msm_fb_data_type *mfd,
+				   struct mdp_overlay *req)
+{
+	int ret, mixer;
+	struct mdp4_overlay_pipe *pipe;
+
 	mixer = mfd->panel_info.pdest;	/* DISPLAY_1 or DISPLAY_2 */
 
 	ret = mdp4_calc_req_blt(mfd, req);
 
 	if (ret < 0) {
-		mutex_unlock(&mfd->dma->ov_mutex);
 		pr_err("%s: blt mode is required! ret=%d\n", __func__, ret);
 		return ret;
 	}
@@ -3547,7 +3562,6 @@ int mdp4_overlay_set(struct fb_info *info, struct mdp_overlay *req)
 	ret = mdp4_overlay_req2pipe(req, mixer, &pipe, mfd);
 
 	if (ret < 0) {
-		mutex_unlock(&mfd->dma->ov_mutex);
 		pr_err("%s: mdp4_overlay_req2pipe, ret=%d\n", __func__, ret);
 		return ret;
 	}
@@ -3588,8 +3602,6 @@ int mdp4_overlay_set(struct fb_info *info, struct mdp_overlay *req)
 
 	mdp4_overlay_mdp_pipe_req(pipe, mfd);
 
-	mutex_unlock(&mfd->dma->ov_mutex);
-
 	return 0;
 }
 
@@ -3614,6 +3626,9 @@ int mdp4_overlay_unset_mixer(int mixer)
 	return cnt;
 }
 
+static void mdp4_overlay_unset_locked(struct msm_fb_data_type *mfd,
+				      struct mdp4_overlay_pipe *pipe);
+
 int mdp4_overlay_unset(struct fb_info *info, int ndx)
 {
 	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
@@ -3632,10 +3647,20 @@ int mdp4_overlay_unset(struct fb_info *info, int ndx)
 		return -ENODEV;
 	}
 
+	mdp4_overlay_unset_locked(mfd, pipe);
+
+	mutex_unlock(&mfd->dma->ov_mutex);
+
+	return 0;
+}
+
+/* called with ov_mutex held */
+static void mdp4_overlay_unset_locked(struct msm_fb_data_type *mfd,
+				      struct mdp4_overlay_pipe *pipe)
+{
 	if (pipe->pipe_type == OVERLAY_TYPE_BF) {
 		mdp4_overlay_borderfill_stage_down(pipe);
-		mutex_unlock(&mfd->dma->ov_mutex);
-		return 0;
+		return;
 	}
 
 	if (pipe->mixer_num == MDP4_MIXER2)
@@ -3673,10 +3698,6 @@ int mdp4_overlay_unset(struct fb_info *info, int ndx)
 	if (pipe->flags & MDP_SECURE_OVERLAY_SESSION)
 		mfd->sec_active = FALSE;
 	mdp4_overlay_pipe_free(pipe, 0);
-
-	mutex_unlock(&mfd->dma->ov_mutex);
-
-	return 0;
 }
 
 int mdp4_overlay_wait4vsync(struct fb_info *info)
@@ -3795,17 +3816,15 @@ void mdp4_overlay_vsync_commit(struct mdp4_overlay_pipe *pipe)
 	mdp4_mixer_stage_up(pipe, 0);
 }
 
+static int mdp4_overlay_play_locked(struct fb_info *info,
+				    struct mdp4_overlay_pipe *pipe,
+				    struct msmfb_overlay_data *req);
+
 int mdp4_overlay_play(struct fb_info *info, struct msmfb_overlay_data *req)
 {
 	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
-	struct msmfb_data *img;
 	struct mdp4_overlay_pipe *pipe;
-	ulong start, addr;
-	ulong len = 0;
-	struct ion_handle *srcp0_ihdl = NULL;
-	struct ion_handle *srcp1_ihdl = NULL, *srcp2_ihdl = NULL;
-	uint32_t overlay_version = 0;
-	int ret = 0;
+	int ret;
 
 	if (mfd == NULL)
 		return -ENODEV;
@@ -3823,6 +3842,25 @@ int mdp4_overlay_play(struct fb_info *info, struct msmfb_overlay_data *req)
 	}
 
 	mutex_lock(&mfd->dma->ov_mutex);
+	ret = mdp4_overlay_play_locked(info, pipe, req);
+	mutex_unlock(&mfd->dma->ov_mutex);
+
+	return ret;
+}
+
+/* called with ov_mutex held */
+static int mdp4_overlay_play_locked(struct fb_info *info,
+				    struct mdp4_overlay_pipe *pipe,
+				    struct msmfb_overlay_data *req)
+{
+	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
+	struct msmfb_data *img;
+	ulong start, addr;
+	ulong len = 0;
+	struct ion_handle *srcp0_ihdl = NULL;
+	struct ion_handle *srcp1_ihdl = NULL, *srcp2_ihdl = NULL;
+	uint32_t overlay_version = 0;
+	int ret = 0;
 
 	img = &req->data;
 	get_img(img, info, pipe, 0, &start, &len, &pipe->srcp0_file,
@@ -3957,6 +3995,125 @@ int mdp4_overlay_play(struct fb_info *info, struct msmfb_overlay_data *req)
 	}
 
 end:
+	return ret;
+}
+
+static int mdp4_overlay_atomic_check(struct msm_fb_data_type *mfd,
+				     struct mdp_atomic_layer *layers, int cnt)
+{
+	struct mdp_overlay *req;
+	u32 zmask = 0;
+	int i;
+
+	for (i = 0; i < cnt; i++) {
+		req = &layers[i].overlay;
+
+		if (layers[i].flags & MDP_ATOMIC_LAYER_UNSET) {
+			if (!mdp4_overlay_ndx2pipe(req->id))
+				return -ENODEV;
+			continue;
+		}
+
+		if (req->id != MSMFB_NEW_REQUEST &&
+		    !mdp4_overlay_ndx2pipe(req->id))
+			return -ENODEV;
+
+		if (layers[i].flags & MDP_ATOMIC_LAYER_PLAY_ONLY) {
+			if (req->id == MSMFB_NEW_REQUEST)
+				return -EINVAL;
+			continue;
+		}
+
+		if (req->src.format == MDP_FB_FORMAT)
+			req->src.format = mfd->fb_imgType;
+
+		/* one pipe per stage */
+		if (req->z_order > 3 || (zmask & BIT(req->z_order))) {
+			mdp4_stat.err_zorder++;
+			return -ERANGE;
+		}
+		zmask |= BIT(req->z_order);
+
+		if (req->src_rect.w < 2 || req->src_rect.h < 2 ||
+		    req->dst_rect.w < 2 || req->dst_rect.h < 2 ||
+		    req->src_rect.x + req->src_rect.w > req->src.width ||
+		    req->src_rect.y + req->src_rect.h > req->src.height) {
+			mdp4_stat.err_size++;
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Configure and queue every layer of a frame under a single ov_mutex hold.
+ * All layers are checked first, so a bad request is refused before any
+ * pipe is touched; the registers are then programmed once by the
+ * following overlay commit.  Pipe ids are returned in the layers.
+ */
+int mdp4_overlay_atomic(struct fb_info *info, struct mdp_atomic_layer *layers,
+			int cnt, int test_only)
+{
+	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
+	struct mdp4_overlay_pipe *pipe;
+	struct mdp_atomic_layer *layer;
+	int i, ret;
+
+	if (mfd == NULL)
+		return -ENODEV;
+
+	if (info->node != 0 || mfd->cont_splash_done)	/* primary */
+		if (!mfd->panel_power_on)		/* suspended */
+			return -EPERM;
+
+	if (mutex_lock_interruptible(&mfd->dma->ov_mutex))
+		return -EINTR;
+
+	ret = mdp4_overlay_atomic_check(mfd, layers, cnt);
+	if (ret || test_only)
+		goto out;
+
+	for (i = 0; i < cnt; i++) {
+		layer = &layers[i];
+		if (!(layer->flags & MDP_ATOMIC_LAYER_UNSET))
+			continue;
+		pipe = mdp4_overlay_ndx2pipe(layer->overlay.id);
+		if (pipe)
+			mdp4_overlay_unset_locked(mfd, pipe);
+	}
+
+	for (i = 0; i < cnt; i++) {
+		layer = &layers[i];
+		if (layer->flags & MDP_ATOMIC_LAYER_UNSET)
+			continue;
+
+		if (!(layer->flags & MDP_ATOMIC_LAYER_PLAY_ONLY)) {
+			ret = mdp4_overlay_set_locked(mfd, &layer->overlay);
+			if (ret)
+				goto out;
+		}
+
+		pipe = mdp4_overlay_ndx2pipe(layer->overlay.id);
+		if (pipe == NULL) {
+			mdp4_stat.err_play++;
+			ret = -ENODEV;
+			goto out;
+		}
+
+		if (pipe->pipe_type == OVERLAY_TYPE_BF) {
+			mdp4_overlay_borderfill_stage_up(pipe);
+			mdp4_mixer_stage_commit(pipe->mixer_num);
+			continue;
+		}
+
+		layer->data.id = layer->overlay.id;
+		ret = mdp4_overlay_play_locked(info, pipe, &layer->data);
+		if (ret)
+			goto out;
+	}
+	mdp4_stat.atomic_commit++;
+out:
 	mutex_unlock(&mfd->dma->ov_mutex);
 
 	return ret;
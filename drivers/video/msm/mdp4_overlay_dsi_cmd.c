@@ -75,6 +75,7 @@ static struct vsycn_ctrl {
 	u32 last_vsync_ms;
 	struct work_struct clk_work;
 	wait_queue_head_t wait_queue;
+	struct mdp_rect roi;	/* panel window, w == 0: full frame */
 } vsync_ctrl_db[MAX_CONTROLLER];
 
 static void vsync_irq_enable(int intr, int term)
@@ -129,6 +130,7 @@ static void mdp4_dsi_cmd_blt_dmap_update(struct mdp4_overlay_pipe *pipe)
 {
 	uint32 off, addr;
 	int bpp;
+	struct mdp_rect *roi = &vsync_ctrl_db[0].roi;
 
 	if (pipe->ov_blt_addr == 0)
 		return;
@@ -143,6 +145,15 @@ static void mdp4_dsi_cmd_blt_dmap_update(struct mdp4_overlay_pipe *pipe)
 		off = pipe->src_height * pipe->src_width * bpp;
 	addr = pipe->dma_blt_addr + off;
 
+	if (roi->w && roi->h) {
+		/* fetch the dirty region only */
+		addr += (roi->y * pipe->src_width + roi->x) * bpp;
+		MDP_OUTP(MDP_BASE + 0x90004, (roi->h << 16 | roi->w));
+	} else {
+		MDP_OUTP(MDP_BASE + 0x90004,
+			(pipe->src_height << 16 | pipe->src_width));
+	}
+
 	/* dmap */
 	MDP_OUTP(MDP_BASE + 0x90008, addr);
 }
@@ -269,6 +280,82 @@ static void mdp4_dsi_cmd_pipe_clean(struct vsync_update *vp)
 static void mdp4_dsi_cmd_blt_ov_update(struct mdp4_overlay_pipe *pipe);
 static int mdp4_dsi_cmd_clk_check(struct vsycn_ctrl *vctrl);
 
+/*
+ * mdp4_dsi_cmd_roi_update:
+ * move the panel window to the dirty region of this commit.
+ * dma_p can only crop its fetch when it reads the blt buffer,
+ * direct out always sends the full frame.
+ */
+static void mdp4_dsi_cmd_roi_update(struct vsycn_ctrl *vctrl,
+				    struct mdp4_overlay_pipe *pipe)
+{
+	struct msm_fb_data_type *mfd = vctrl->mfd;
+	struct mdp_rect roi;
+	unsigned long flags;
+	u32 full, area, bpp;
+	int need_wait = 0;
+
+	roi = mfd->roi;
+	full = pipe->src_width * pipe->src_height;
+	if (!mfd->panel_info.mipi.partial_update || !pipe->ov_blt_addr ||
+	    pipe->is_3d || !roi.w || !roi.h ||
+	    roi.x + roi.w > pipe->src_width ||
+	    roi.y + roi.h > pipe->src_height) {
+		roi.x = 0;
+		roi.y = 0;
+		roi.w = pipe->src_width;
+		roi.h = pipe->src_height;
+	}
+
+	area = roi.w * roi.h;
+	bpp = mfd->panel_info.bpp / 8;
+	mdp4_stat.dsi_bytes_last = area * bpp;
+	mdp4_stat.dsi_bytes_total += area * bpp;
+	if (area < full) {
+		mdp4_stat.dsi_frame_partial++;
+		mdp4_stat.dsi_bytes_saved += (full - area) * bpp;
+	} else {
+		mdp4_stat.dsi_frame_full++;
+	}
+
+	if (vctrl->roi.w == 0 && area == full)
+		return;		/* panel already takes the full frame */
+	if (!memcmp(&roi, &vctrl->roi, sizeof(roi)))
+		return;
+
+	/* do not move the window under a frame still in flight */
+	spin_lock_irqsave(&vctrl->spin_lock, flags);
+	if (vctrl->ov_koff != vctrl->ov_done) {
+		INIT_COMPLETION(vctrl->ov_comp);
+		need_wait = 1;
+	}
+	spin_unlock_irqrestore(&vctrl->spin_lock, flags);
+	if (need_wait)
+		mdp4_dsi_cmd_wait4ov(0);
+
+	need_wait = 0;
+	spin_lock_irqsave(&vctrl->spin_lock, flags);
+	if (vctrl->dmap_koff != vctrl->dmap_done) {
+		INIT_COMPLETION(vctrl->dmap_comp);
+		need_wait = 1;
+	}
+	spin_unlock_irqrestore(&vctrl->spin_lock, flags);
+	if (need_wait)
+		mdp4_dsi_cmd_wait4dmap(0);
+
+	pr_debug("%s: roi=%d,%d %dx%d\n", __func__,
+		roi.x, roi.y, roi.w, roi.h);
+
+	mipi_dsi_cmd_roi_set(mfd, &roi);
+
+	spin_lock_irqsave(&vctrl->spin_lock, flags);
+	if (area == full)
+		memset(&vctrl->roi, 0, sizeof(vctrl->roi));
+	else
+		vctrl->roi = roi;
+	spin_unlock_irqrestore(&vctrl->spin_lock, flags);
+}
+
 int mdp4_dsi_cmd_pipe_commit(int cndx, int wait, u32 *release_busy)
 {
 	int  i, undx;
@@ -370,6 +457,8 @@ int mdp4_dsi_cmd_pipe_commit(int cndx, int wait, u32 *release_busy)
 		vctrl->blt_change = 0;
 	}
 
+	mdp4_dsi_cmd_roi_update(vctrl, pipe);
+
 	pipe = vp->plist;
 	for (i = 0; i < OVERLAY_PIPE_MAX; i++, pipe++) {
 		if (pipe->pipe_used) {
@@ -1075,6 +1164,8 @@ int mdp4_dsi_cmd_on(struct platform_device *pdev)
 	vctrl->mfd = mfd;
 	vctrl->dev = mfd->fbi->dev;
 	vctrl->vsync_enabled = 0;
+	/* panel comes out of reset with the full window */
+	memset(&vctrl->roi, 0, sizeof(vctrl->roi));
 
 	mdp_clk_ctrl(1);
 	mdp4_overlay_update_dsi_cmd(mfd);
@@ -1259,6 +1350,9 @@ void mdp4_dsi_cmd_overlay(struct msm_fb_data_type *mfd)
 		mdp4_dsi_cmd_pipe_queue(0, pipe);
 	}
 
+	/* pan display has no dirty region */
+	memset(&mfd->roi, 0, sizeof(mfd->roi));
+
 	mdp4_overlay_mdp_perf_upd(mfd, 1);
 	mdp4_dsi_cmd_pipe_commit(cndx, 1, NULL);
 	mdp4_overlay_mdp_perf_upd(mfd, 0);
@@ -368,9 +368,24 @@ static ssize_t mdp_stat_read(
 
 	bp += len;
 	dlen -= len;
-	len = snprintf(bp, dlen, "clk_off: %08lu\n\n",
+	len = snprintf(bp, dlen, "clk_off: %08lu\n",
 					mdp4_stat.dsi_clk_off);
 
+	bp += len;
+	dlen -= len;
+	len = snprintf(bp, dlen, "frame_full: %08lu\tframe_partial: %08lu\n",
+			mdp4_stat.dsi_frame_full, mdp4_stat.dsi_frame_partial);
+
+	bp += len;
+	dlen -= len;
+	len = snprintf(bp, dlen, "bytes_last: %08lu\tbytes_total: %llu\t",
+			mdp4_stat.dsi_bytes_last, mdp4_stat.dsi_bytes_total);
+
+	bp += len;
+	dlen -= len;
+	len = snprintf(bp, dlen, "bytes_saved: %llu\n\n",
+					mdp4_stat.dsi_bytes_saved);
+
 	bp += len;
 	dlen -= len;
 	len = snprintf(bp, dlen, "kickoff:\n");
@@ -442,6 +457,11 @@ static ssize_t mdp_stat_read(
 	bp += len;
 	dlen -= len;
 
+	len = snprintf(bp, dlen, "atomic_commit: %08lu\n\n",
+					mdp4_stat.atomic_commit);
+	bp += len;
+	dlen -= len;
+
 	len = snprintf(bp, dlen, "frame_push:\n");
 	bp += len;
 	dlen -= len;
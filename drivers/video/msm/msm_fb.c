@@ -2296,8 +2296,40 @@ static int msm_fb_pan_idle(struct msm_fb_data_type *mfd)
 	}
 	return ret;
 }
-static int msm_fb_pan_display_ex(struct fb_info *info,
-		struct mdp_display_commit *disp_commit)
+/*
+ * Grow the dirty region of the commits not yet picked up by the commit
+ * thread.  A commit without a region dirties the whole panel.
+ */
+static void msm_fb_roi_merge(struct msm_fb_data_type *mfd,
+			     struct msm_fb_backup_type *fb_backup,
+			     struct mdp_rect *roi)
+{
+	struct mdp_rect *cur = &fb_backup->roi;
+	u32 x1, y1;
+
+	if (roi == NULL || roi->w == 0 || roi->h == 0) {
+		cur->x = 0;
+		cur->y = 0;
+		cur->w = mfd->panel_info.xres;
+		cur->h = mfd->panel_info.yres;
+		return;
+	}
+
+	if (cur->w == 0 || cur->h == 0) {
+		*cur = *roi;
+		return;
+	}
+
+	x1 = max(cur->x + cur->w, roi->x + roi->w);
+	y1 = max(cur->y + cur->h, roi->y + roi->h);
+	cur->x = min(cur->x, roi->x);
+	cur->y = min(cur->y, roi->y);
+	cur->w = x1 - cur->x;
+	cur->h = y1 - cur->y;
+}
+
+static int msm_fb_pan_display_roi(struct fb_info *info,
+		struct mdp_display_commit *disp_commit, struct mdp_rect *roi)
 {
 	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
 	struct msm_fb_backup_type *fb_backup;
@@ -2356,6 +2388,7 @@ static int msm_fb_pan_display_ex(struct fb_info *info,
 	memcpy(&fb_backup->info, info, sizeof(struct fb_info));
 	memcpy(&fb_backup->disp_commit, disp_commit,
 		sizeof(struct mdp_display_commit));
+	msm_fb_roi_merge(mfd, fb_backup, roi);
 	mfd->is_committing = 1;
 	INIT_COMPLETION(mfd->commit_comp);
 	atomic_inc(&mfd->commit_cnt);
@@ -2367,6 +2400,12 @@ static int msm_fb_pan_display_ex(struct fb_info *info,
 	return ret;
 }
 
+static int msm_fb_pan_display_ex(struct fb_info *info,
+		struct mdp_display_commit *disp_commit)
+{
+	return msm_fb_pan_display_roi(info, disp_commit, NULL);
+}
+
 static void bl_workqueue_handler(struct work_struct *work)
 {
 	struct msm_fb_data_type *mfd = container_of(to_delayed_work(work),
@@ -2556,6 +2595,11 @@ static int msm_fb_commit_thread(void *data)
 				if (fb_backup->disp_commit.flags &
 						MDP_DISPLAY_COMMIT_OVERLAY) {
 					overlay_commit = true;
+					mutex_lock(&mfd->sync_mutex);
+					mfd->roi = fb_backup->roi;
+					memset(&fb_backup->roi, 0,
+						sizeof(fb_backup->roi));
+					mutex_unlock(&mfd->sync_mutex);
 					mdp4_overlay_commit(info);
 				} else {
 					var = &fb_backup->disp_commit.var;
@@ -3711,22 +3755,10 @@ static int msmfb_overlay_play_wait(struct fb_info *info, unsigned long *argp)
 	return ret;
 }
 
-static int msmfb_overlay_play(struct fb_info *info, unsigned long *argp)
+/* Turn the panel on if needed and kick the update notifier */
+static int msmfb_overlay_play_prepare(struct fb_info *info,
+				      struct msm_fb_data_type *mfd)
 {
-	int	ret;
-	struct msmfb_overlay_data req;
-	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
-
-	if (mfd->overlay_play_enable == 0)	/* nothing to do */
-		return 0;
-
-	ret = copy_from_user(&req, argp, sizeof(req));
-	if (ret) {
-		printk(KERN_ERR "%s:msmfb_overlay_play ioctl failed \n",
-			__func__);
-		return ret;
-	}
-
 	if (info->node == 0 && !(mfd->cont_splash_done)) { /* primary */
 		mdp_set_dma_pan_info(info, NULL, TRUE);
 		if (msm_fb_blank_sub(FB_BLANK_UNBLANK, info, mfd->op_enable)) {
@@ -3747,6 +3779,29 @@ static int msmfb_overlay_play(struct fb_info *info, unsigned long *argp)
 	add_timer(&mfd->msmfb_no_update_notify_timer);
 	mutex_unlock(&msm_fb_notify_update_sem);
 
+	return 0;
+}
+
+static int msmfb_overlay_play(struct fb_info *info, unsigned long *argp)
+{
+	int	ret;
+	struct msmfb_overlay_data req;
+	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
+
+	if (mfd->overlay_play_enable == 0)	/* nothing to do */
+		return 0;
+
+	ret = copy_from_user(&req, argp, sizeof(req));
+	if (ret) {
+		printk(KERN_ERR "%s:msmfb_overlay_play ioctl failed \n",
+			__func__);
+		return ret;
+	}
+
+	ret = msmfb_overlay_play_prepare(info, mfd);
+	if (ret)
+		return ret;
+
 	ret = mdp4_overlay_play(info, &req);
 
 	if (info->node == 0 && (mfd->cont_splash_done)) /* primary */
@@ -4125,36 +4180,37 @@ static int msmfb_handle_pp_ioctl(struct msm_fb_data_type *mfd,
 	return ret;
 }
 
-static int msmfb_handle_buf_sync_ioctl(struct msm_fb_data_type *mfd,
-						struct mdp_buf_sync *buf_sync)
+struct msmfb_buf_sync_out {
+	int rel_fd;
+	int retire_fd;
+	struct sync_fence *rel_fence;
+	struct sync_fence *retire_fence;
+};
+
+/*
+ * Take the acquire fences and create the release and retire fences of
+ * the next commit.  The fds are reserved but not installed yet, so the
+ * caller can still back out with msmfb_buf_sync_abort().
+ */
+static int msmfb_buf_sync_prepare(struct msm_fb_data_type *mfd, u32 flags,
+				  int *acq_fen_fd, u32 acq_fen_fd_cnt,
+				  struct msmfb_buf_sync_out *out)
 {
 	int i, ret = 0;
 	u32 threshold;
-	int acq_fen_fd[MDP_MAX_FENCE_FD];
 	struct sync_fence *fence;
 	struct sync_pt *release_sync_pt;
 	struct sync_pt *retire_sync_pt;
-	struct sync_fence *release_fence;
-	struct sync_fence *retire_fence;
-	int release_fen_fd;
-	int retire_fen_fd;
 
-	if ((buf_sync->acq_fen_fd_cnt > MDP_MAX_FENCE_FD) ||
+	if ((acq_fen_fd_cnt > MDP_MAX_FENCE_FD) ||
 		(mfd->timeline == NULL))
 		return -EINVAL;
 
 	if ((!mfd->op_enable) || (!mfd->panel_power_on))
 		return -EPERM;
 
-	if (buf_sync->acq_fen_fd_cnt)
-		ret = copy_from_user(acq_fen_fd, buf_sync->acq_fen_fd,
-				buf_sync->acq_fen_fd_cnt * sizeof(int));
-	if (ret) {
-		pr_err("%s:copy_from_user failed", __func__);
-		return ret;
-	}
 	mutex_lock(&mfd->sync_mutex);
-	for (i = 0; i < buf_sync->acq_fen_fd_cnt; i++) {
+	for (i = 0; i < acq_fen_fd_cnt; i++) {
 		fence = sync_fence_fdget(acq_fen_fd[i]);
 		if (fence == NULL) {
 			pr_info("%s: null fence! i=%d fd=%d\n", __func__, i,
@@ -4167,7 +4223,7 @@ static int msmfb_handle_buf_sync_ioctl(struct msm_fb_data_type *mfd,
 	mfd->acq_fen_cnt = i;
 	if (ret)
 		goto buf_sync_err_1;
-	if (buf_sync->flags & MDP_BUF_SYNC_FLAG_WAIT) {
+	if (flags & MDP_BUF_SYNC_FLAG_WAIT) {
 		msm_fb_wait_for_fence(mfd);
 	}
 	if ((mfd->panel.type == WRITEBACK_PANEL) ||
@@ -4176,15 +4232,15 @@ static int msmfb_handle_buf_sync_ioctl(struct msm_fb_data_type *mfd,
 	else
 		threshold = 2;
 
-	release_fen_fd = get_unused_fd_flags(0);
-	if (release_fen_fd < 0) {
+	out->rel_fd = get_unused_fd_flags(0);
+	if (out->rel_fd < 0) {
 		pr_err("%s: get_unused_fd_flags failed", __func__);
 		ret  = -EIO;
 		goto buf_sync_err_1;
 	}
 
-	retire_fen_fd = get_unused_fd_flags(0);
-	if (retire_fen_fd < 0) {
+	out->retire_fd = get_unused_fd_flags(0);
+	if (out->retire_fd < 0) {
 		pr_err("%s: get_unused_fd_flags failed", __func__);
 		ret  = -EIO;
 		goto buf_sync_err_2;
@@ -4193,43 +4249,90 @@ static int msmfb_handle_buf_sync_ioctl(struct msm_fb_data_type *mfd,
 	release_sync_pt = sw_sync_pt_create(mfd->timeline,
 			mfd->timeline_value + threshold +
 			atomic_read(&mfd->commit_cnt));
-	release_fence = sync_fence_create("mdp-fence",
+	out->rel_fence = sync_fence_create("mdp-fence",
 			release_sync_pt);
-	sync_fence_install(release_fence, release_fen_fd);
 	retire_sync_pt = sw_sync_pt_create(mfd->timeline,
 			mfd->timeline_value + threshold +
 			atomic_read(&mfd->commit_cnt) + 1);
-	retire_fence = sync_fence_create("mdp-retire-fence",
+	out->retire_fence = sync_fence_create("mdp-retire-fence",
 			retire_sync_pt);
-	sync_fence_install(retire_fence, retire_fen_fd);
+
+	mutex_unlock(&mfd->sync_mutex);
+	return ret;
+buf_sync_err_2:
+	put_unused_fd(out->rel_fd);
+buf_sync_err_1:
+	for (i = 0; i < mfd->acq_fen_cnt; i++)
+		sync_fence_put(mfd->acq_fen[i]);
+	mfd->acq_fen_cnt = 0;
+	mutex_unlock(&mfd->sync_mutex);
+	return ret;
+}
+
+static void msmfb_buf_sync_install(struct msmfb_buf_sync_out *out)
+{
+	sync_fence_install(out->rel_fence, out->rel_fd);
+	sync_fence_install(out->retire_fence, out->retire_fd);
+}
+
+static void msmfb_buf_sync_abort(struct msm_fb_data_type *mfd,
+				 struct msmfb_buf_sync_out *out)
+{
+	int i;
+
+	sync_fence_put(out->rel_fence);
+	sync_fence_put(out->retire_fence);
+	put_unused_fd(out->retire_fd);
+	put_unused_fd(out->rel_fd);
+
+	mutex_lock(&mfd->sync_mutex);
+	for (i = 0; i < mfd->acq_fen_cnt; i++)
+		sync_fence_put(mfd->acq_fen[i]);
+	mfd->acq_fen_cnt = 0;
+	mutex_unlock(&mfd->sync_mutex);
+}
+
+static int msmfb_handle_buf_sync_ioctl(struct msm_fb_data_type *mfd,
+						struct mdp_buf_sync *buf_sync)
+{
+	int ret = 0;
+	int acq_fen_fd[MDP_MAX_FENCE_FD];
+	struct msmfb_buf_sync_out out;
+
+	if (buf_sync->acq_fen_fd_cnt > MDP_MAX_FENCE_FD)
+		return -EINVAL;
+
+	if (buf_sync->acq_fen_fd_cnt)
+		ret = copy_from_user(acq_fen_fd, buf_sync->acq_fen_fd,
+				buf_sync->acq_fen_fd_cnt * sizeof(int));
+	if (ret) {
+		pr_err("%s:copy_from_user failed", __func__);
+		return ret;
+	}
+
+	ret = msmfb_buf_sync_prepare(mfd, buf_sync->flags, acq_fen_fd,
+				     buf_sync->acq_fen_fd_cnt, &out);
+	if (ret)
+		return ret;
 
 	ret = copy_to_user(buf_sync->rel_fen_fd,
-		&release_fen_fd, sizeof(int));
+		&out.rel_fd, sizeof(int));
 	if (ret) {
 		pr_err("%s:copy_to_user failed", __func__);
-		goto buf_sync_err_3;
+		goto buf_sync_err;
 	}
 
 	ret = copy_to_user(buf_sync->retire_fen_fd,
-		&retire_fen_fd, sizeof(int));
+		&out.retire_fd, sizeof(int));
 	if (ret) {
 		pr_err("%s:copy_to_user failed", __func__);
-		goto buf_sync_err_3;
+		goto buf_sync_err;
 	}
 
-	mutex_unlock(&mfd->sync_mutex);
+	msmfb_buf_sync_install(&out);
 	return ret;
-buf_sync_err_3:
-	sync_fence_put(release_fence);
-	sync_fence_put(retire_fence);
-	put_unused_fd(retire_fen_fd);
-buf_sync_err_2:
-	put_unused_fd(release_fen_fd);
-buf_sync_err_1:
-	for (i = 0; i < mfd->acq_fen_cnt; i++)
-		sync_fence_put(mfd->acq_fen[i]);
-	mfd->acq_fen_cnt = 0;
-	mutex_unlock(&mfd->sync_mutex);
+buf_sync_err:
+	msmfb_buf_sync_abort(mfd, &out);
 	return ret;
 }
 
@@ -4250,6 +4353,117 @@ static int msmfb_display_commit(struct fb_info *info,
 	return ret;
 }
 
+#ifdef CONFIG_FB_MSM_OVERLAY
+/*
+ * MSMFB_ATOMIC_COMMIT: the OVERLAY_SET/OVERLAY_PLAY sequence of every
+ * layer, MSMFB_BUFFER_SYNC and MSMFB_DISPLAY_COMMIT in one call.
+ */
+static int msmfb_atomic_commit(struct fb_info *info, void __user *argp)
+{
+	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
+	struct mdp_atomic_commit commit;
+	struct mdp_atomic_layer *layers;
+	struct mdp_display_commit disp_commit;
+	struct msmfb_buf_sync_out out;
+	int acq_fen_fd[MDP_ATOMIC_MAX_LAYERS];
+	u32 acq_cnt = 0;
+	int i, ret, test_only;
+
+	if (copy_from_user(&commit, argp, sizeof(commit)))
+		return -EFAULT;
+
+	if (!commit.layer_cnt || commit.layer_cnt > MDP_ATOMIC_MAX_LAYERS)
+		return -EINVAL;
+
+	layers = kcalloc(commit.layer_cnt, sizeof(*layers), GFP_KERNEL);
+	if (!layers)
+		return -ENOMEM;
+
+	if (copy_from_user(layers, commit.layers,
+			   commit.layer_cnt * sizeof(*layers))) {
+		ret = -EFAULT;
+		goto atomic_exit;
+	}
+
+	test_only = commit.flags & MDP_ATOMIC_COMMIT_TEST_ONLY;
+	if (commit.flags & MDP_ATOMIC_COMMIT_ROI) {
+		if (!commit.roi.w || !commit.roi.h ||
+		    commit.roi.x + commit.roi.w > mfd->panel_info.xres ||
+		    commit.roi.y + commit.roi.h > mfd->panel_info.yres ||
+		    commit.roi.x + commit.roi.w < commit.roi.x ||
+		    commit.roi.y + commit.roi.h < commit.roi.y) {
+			ret = -EINVAL;
+			goto atomic_exit;
+		}
+	}
+	commit.rel_fen_fd = -1;
+	commit.retire_fen_fd = -1;
+
+	if (!test_only) {
+		if (mfd->overlay_play_enable == 0) {	/* nothing to do */
+			ret = 0;
+			goto atomic_copy;
+		}
+		ret = msmfb_overlay_play_prepare(info, mfd);
+		if (ret)
+			goto atomic_exit;
+	}
+
+	ret = mdp4_overlay_atomic(info, layers, commit.layer_cnt, test_only);
+	if (ret)
+		goto atomic_exit;
+
+	/* hand the allocated pipe ids back */
+	if (copy_to_user(commit.layers, layers,
+			 commit.layer_cnt * sizeof(*layers))) {
+		ret = -EFAULT;
+		goto atomic_exit;
+	}
+
+	if (test_only)
+		goto atomic_exit;
+
+	if (info->node == 0 && (mfd->cont_splash_done)) /* primary */
+		mdp_free_splash_buffer(mfd);
+
+	for (i = 0; i < commit.layer_cnt; i++) {
+		if (layers[i].flags & MDP_ATOMIC_LAYER_UNSET)
+			continue;
+		if (layers[i].acq_fen_fd >= 0)
+			acq_fen_fd[acq_cnt++] = layers[i].acq_fen_fd;
+	}
+
+	ret = msmfb_buf_sync_prepare(mfd, 0, acq_fen_fd, acq_cnt, &out);
+	if (ret)
+		goto atomic_exit;
+
+	commit.rel_fen_fd = out.rel_fd;
+	commit.retire_fen_fd = out.retire_fd;
+	if (copy_to_user(argp, &commit, sizeof(commit))) {
+		msmfb_buf_sync_abort(mfd, &out);
+		ret = -EFAULT;
+		goto atomic_exit;
+	}
+	msmfb_buf_sync_install(&out);
+
+	memset(&disp_commit, 0, sizeof(disp_commit));
+	disp_commit.flags = MDP_DISPLAY_COMMIT_OVERLAY;
+	disp_commit.wait_for_finish =
+		!!(commit.flags & MDP_ATOMIC_COMMIT_WAIT);
+	disp_commit.var = info->var;
+	ret = msm_fb_pan_display_roi(info, &disp_commit,
+			(commit.flags & MDP_ATOMIC_COMMIT_ROI) ? &commit.roi : NULL);
+	goto atomic_exit;
+
+atomic_copy:
+	if (copy_to_user(argp, &commit, sizeof(commit)))
+		ret = -EFAULT;
+atomic_exit:
+	kfree(layers);
+	return ret;
+}
+#endif
+
 static int msmfb_get_metadata(struct msm_fb_data_type *mfd,
 				struct msmfb_metadata *metadata_ptr)
 {
@@ -4592,6 +4806,12 @@ static int msm_fb_ioctl(struct fb_info *info, unsigned int cmd,
 		ret = msmfb_display_commit(info, argp);
 		break;
 
+#ifdef CONFIG_FB_MSM_OVERLAY
+	case MSMFB_ATOMIC_COMMIT:
+		ret = msmfb_atomic_commit(info, argp);
+		break;
+#endif
+
 	case MSMFB_METADATA_GET:
 		ret = copy_from_user(&mdp_metadata, argp, sizeof(mdp_metadata));
 		if (ret)
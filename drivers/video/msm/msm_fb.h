@@ -205,6 +205,7 @@ struct msm_fb_data_type {
 	struct mutex queue_mutex;
 	struct completion commit_comp;
 	u32 is_committing;
+	struct mdp_rect roi;	/* dirty region of the frame in commit */
 	atomic_t commit_cnt;
 	struct task_struct *commit_thread;
 	wait_queue_head_t commit_queue;
@@ -228,6 +229,7 @@ struct msm_fb_data_type {
 struct msm_fb_backup_type {
 	struct fb_info info;
 	struct mdp_display_commit disp_commit;
+	struct mdp_rect roi;	/* w == 0: nothing pending */
 };
 
 struct dentry *msm_fb_get_debugfs_root(void);
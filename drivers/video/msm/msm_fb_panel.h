@@ -145,6 +145,12 @@ struct mipi_panel_info {
 	char no_max_pkt_size;
 	/* Clock required during LP commands */
 	char force_clk_lane_hs;
+	/*
+	 * panel takes column/page address windows (partial update).
+	 * Opt-in per command-mode panel; none in this tree sets it yet,
+	 * the dlx panels are video mode.
+	 */
+	char partial_update;
 };
 
 enum lvds_mode {
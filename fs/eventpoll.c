@@ -34,13 +34,19 @@
 #include <linux/mutex.h>
 #include <linux/anon_inodes.h>
 #include <linux/freezer.h>
+#include <linux/wakelock.h>
 #include <asm/uaccess.h>
 #include <asm/io.h>
 #include <asm/mman.h>
 #include <linux/atomic.h>
 
 
-#define EP_PRIVATE_BITS (EPOLLONESHOT | EPOLLET)
+#define EP_PRIVATE_BITS (EPOLLWAKEUP | EPOLLONESHOT | EPOLLET | EPOLLEXCLUSIVE)
+
+#define EPOLLINOUT_BITS (POLLIN | POLLOUT)
+
+#define EPOLLEXCLUSIVE_OK_BITS (EPOLLINOUT_BITS | POLLERR | POLLHUP | \
+				EPOLLWAKEUP | EPOLLET | EPOLLEXCLUSIVE)
 
 #define EP_MAX_NESTS 4
 
@@ -90,6 +96,9 @@ struct epitem {
 	
 	struct list_head fllink;
 
+	/* held while the item is ready, for EPOLLWAKEUP */
+	struct wake_lock *wl;
+
 	
 	struct epoll_event event;
 };
@@ -114,6 +123,9 @@ struct eventpoll {
 
 	struct epitem *ovflist;
 
+	/* covers EPOLLWAKEUP items while ep_scan_ready_list() has them */
+	struct wake_lock *wl;
+
 	
 	struct user_struct *user;
 
@@ -232,6 +244,80 @@ static inline int ep_op_has_event(int op)
 	return op != EPOLL_CTL_DEL;
 }
 
+#ifdef CONFIG_HAS_WAKELOCK
+static struct wake_lock *ep_wake_lock_create(const char *name)
+{
+	struct wake_lock *wl;
+	char *wl_name;
+
+	wl = kzalloc(sizeof(*wl), GFP_KERNEL);
+	wl_name = kstrdup(name, GFP_KERNEL);
+	if (!wl || !wl_name) {
+		kfree(wl);
+		kfree(wl_name);
+		return NULL;
+	}
+	wake_lock_init(wl, WAKE_LOCK_SUSPEND, wl_name);
+
+	return wl;
+}
+
+static void ep_wake_lock_destroy(struct wake_lock *wl)
+{
+	if (!wl)
+		return;
+	if (wake_lock_active(wl))
+		wake_unlock(wl);
+	wake_lock_destroy(wl);
+	kfree(wl->name);
+	kfree(wl);
+}
+
+/*
+ * wake_lock()/wake_unlock() take the global wakelock list lock and may
+ * kick the suspend worker, so only call them when the state changes.
+ */
+static inline void ep_pm_stay_awake(struct wake_lock *wl)
+{
+	if (wl && !wake_lock_active(wl))
+		wake_lock(wl);
+}
+
+static inline void ep_pm_relax(struct wake_lock *wl)
+{
+	if (wl && wake_lock_active(wl))
+		wake_unlock(wl);
+}
+
+static inline int ep_pm_active(struct wake_lock *wl)
+{
+	return wl && wake_lock_active(wl);
+}
+
+static inline void ep_take_care_of_epollwakeup(struct epoll_event *epev)
+{
+	if ((epev->events & EPOLLWAKEUP) && !capable(CAP_BLOCK_SUSPEND))
+		epev->events &= ~EPOLLWAKEUP;
+}
+#else
+static inline struct wake_lock *ep_wake_lock_create(const char *name)
+{
+	return NULL;
+}
+static inline void ep_wake_lock_destroy(struct wake_lock *wl) {}
+static inline void ep_pm_stay_awake(struct wake_lock *wl) {}
+static inline void ep_pm_relax(struct wake_lock *wl) {}
+static inline int ep_pm_active(struct wake_lock *wl)
+{
+	return 0;
+}
+
+static inline void ep_take_care_of_epollwakeup(struct epoll_event *epev)
+{
+	epev->events &= ~EPOLLWAKEUP;
+}
+#endif
+
 static void ep_nested_calls_init(struct nested_calls *ncalls)
 {
 	INIT_LIST_HEAD(&ncalls->tasks_call_list);
@@ -366,12 +452,15 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 	spin_lock_irqsave(&ep->lock, flags);
 	for (nepi = ep->ovflist; (epi = nepi) != NULL;
 	     nepi = epi->next, epi->next = EP_UNACTIVE_PTR) {
-		if (!ep_is_linked(&epi->rdllink))
+		if (!ep_is_linked(&epi->rdllink)) {
 			list_add_tail(&epi->rdllink, &ep->rdllist);
+			ep_pm_stay_awake(epi->wl);
+		}
 	}
 	ep->ovflist = EP_UNACTIVE_PTR;
 
 	list_splice(&txlist, &ep->rdllist);
+	ep_pm_relax(ep->wl);
 
 	if (!list_empty(&ep->rdllist)) {
 		if (waitqueue_active(&ep->wq))
@@ -410,6 +499,8 @@ static int ep_remove(struct eventpoll *ep, struct epitem *epi)
 		list_del_init(&epi->rdllink);
 	spin_unlock_irqrestore(&ep->lock, flags);
 
+	ep_wake_lock_destroy(epi->wl);
+
 	
 	kmem_cache_free(epi_cache, epi);
 
@@ -443,6 +534,7 @@ static void ep_free(struct eventpoll *ep)
 	mutex_unlock(&epmutex);
 	mutex_destroy(&ep->mtx);
 	free_uid(ep->user);
+	ep_wake_lock_destroy(ep->wl);
 	kfree(ep);
 }
 
@@ -578,7 +670,7 @@ static struct epitem *ep_find(struct eventpoll *ep, struct file *file, int fd)
 
 static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *key)
 {
-	int pwake = 0;
+	int pwake = 0, ewake = 0;
 	unsigned long flags;
 	struct epitem *epi = ep_item_from_wait(wait);
 	struct eventpoll *ep = epi->ep;
@@ -600,16 +692,43 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 		if (epi->next == EP_UNACTIVE_PTR) {
 			epi->next = ep->ovflist;
 			ep->ovflist = epi;
+			/* epi->wl may be released by the scan at any time */
+			if (epi->wl)
+				ep_pm_stay_awake(ep->wl);
 		}
 		goto out_unlock;
 	}
 
 	
-	if (!ep_is_linked(&epi->rdllink))
+	if (!ep_is_linked(&epi->rdllink)) {
 		list_add_tail(&epi->rdllink, &ep->rdllist);
+		ep_pm_stay_awake(epi->wl);
+	}
 
-	if (waitqueue_active(&ep->wq))
+	if (waitqueue_active(&ep->wq)) {
+		/*
+		 * An EPOLLEXCLUSIVE item only consumes the wakeup if it
+		 * woke a waiter interested in the event, otherwise the
+		 * next exclusive entry on the target's queue gets it.
+		 */
+		if ((epi->event.events & EPOLLEXCLUSIVE) &&
+		    !((unsigned long)key & POLLFREE)) {
+			switch ((unsigned long)key & EPOLLINOUT_BITS) {
+			case POLLIN:
+				if (epi->event.events & POLLIN)
+					ewake = 1;
+				break;
+			case POLLOUT:
+				if (epi->event.events & POLLOUT)
+					ewake = 1;
+				break;
+			case 0:
+				ewake = 1;
+				break;
+			}
+		}
 		wake_up_locked(&ep->wq);
+	}
 	if (waitqueue_active(&ep->poll_wait))
 		pwake++;
 
@@ -620,7 +739,10 @@ out_unlock:
 	if (pwake)
 		ep_poll_safewake(&ep->poll_wait);
 
-	return 1;
+	if (!(epi->event.events & EPOLLEXCLUSIVE))
+		ewake = 1;
+
+	return ewake;
 }
 
 static void ep_ptable_queue_proc(struct file *file, wait_queue_head_t *whead,
@@ -633,7 +755,10 @@ static void ep_ptable_queue_proc(struct file *file, wait_queue_head_t *whead,
 		init_waitqueue_func_entry(&pwq->wait, ep_poll_callback);
 		pwq->whead = whead;
 		pwq->base = epi;
-		add_wait_queue(whead, &pwq->wait);
+		if (epi->event.events & EPOLLEXCLUSIVE)
+			add_wait_queue_exclusive(whead, &pwq->wait);
+		else
+			add_wait_queue(whead, &pwq->wait);
 		list_add_tail(&pwq->llink, &epi->pwqlist);
 		epi->nwait++;
 	} else {
@@ -642,6 +767,42 @@ static void ep_ptable_queue_proc(struct file *file, wait_queue_head_t *whead,
 	}
 }
 
+static int ep_create_wakeup_source(struct epitem *epi)
+{
+	struct eventpoll *ep = epi->ep;
+	struct wake_lock *wl;
+
+	if (!ep->wl) {
+		ep->wl = ep_wake_lock_create("eventpoll");
+		if (!ep->wl)
+			return -ENOMEM;
+	}
+
+	wl = ep_wake_lock_create(epi->ffd.file->f_path.dentry->d_name.name);
+	if (!wl)
+		return -ENOMEM;
+
+	/* ep_poll_callback() looks at epi->wl under ep->lock */
+	spin_lock_irq(&ep->lock);
+	epi->wl = wl;
+	spin_unlock_irq(&ep->lock);
+
+	return 0;
+}
+
+static void ep_destroy_wakeup_source(struct epitem *epi)
+{
+	struct eventpoll *ep = epi->ep;
+	struct wake_lock *wl;
+
+	spin_lock_irq(&ep->lock);
+	wl = epi->wl;
+	epi->wl = NULL;
+	spin_unlock_irq(&ep->lock);
+
+	ep_wake_lock_destroy(wl);
+}
+
 static void ep_rbtree_insert(struct eventpoll *ep, struct epitem *epi)
 {
 	int kcmp;
@@ -759,6 +920,12 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 	epi->event = *event;
 	epi->nwait = 0;
 	epi->next = EP_UNACTIVE_PTR;
+	epi->wl = NULL;
+	if (epi->event.events & EPOLLWAKEUP) {
+		error = ep_create_wakeup_source(epi);
+		if (error)
+			goto error_create_wakeup_source;
+	}
 
 	
 	epq.epi = epi;
@@ -789,6 +956,7 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 	
 	if ((revents & event->events) && !ep_is_linked(&epi->rdllink)) {
 		list_add_tail(&epi->rdllink, &ep->rdllist);
+		ep_pm_stay_awake(epi->wl);
 
 		
 		if (waitqueue_active(&ep->wq))
@@ -823,6 +991,9 @@ error_unregister:
 		list_del_init(&epi->rdllink);
 	spin_unlock_irqrestore(&ep->lock, flags);
 
+	ep_wake_lock_destroy(epi->wl);
+
+error_create_wakeup_source:
 	kmem_cache_free(epi_cache, epi);
 
 	return error;
@@ -844,6 +1015,12 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_even
 	epi->event.events = event->events; /* need barrier below */
 	pt._key = event->events;
 	epi->event.data = event->data; 
+	if (epi->event.events & EPOLLWAKEUP) {
+		if (!epi->wl)
+			ep_create_wakeup_source(epi);
+	} else if (epi->wl) {
+		ep_destroy_wakeup_source(epi);
+	}
 
 	/*
 	 * The following barrier has two effects:
@@ -875,6 +1052,7 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_even
 		spin_lock_irq(&ep->lock);
 		if (!ep_is_linked(&epi->rdllink)) {
 			list_add_tail(&epi->rdllink, &ep->rdllist);
+			ep_pm_stay_awake(epi->wl);
 
 			
 			if (waitqueue_active(&ep->wq))
@@ -908,6 +1086,13 @@ static int ep_send_events_proc(struct eventpoll *ep, struct list_head *head,
 	     !list_empty(head) && eventcnt < esed->maxevents;) {
 		epi = list_first_entry(head, struct epitem, rdllink);
 
+		/*
+		 * Take ep->wl before dropping epi->wl so that suspend cannot
+		 * sneak in between here and re-arming epi->wl below.
+		 */
+		if (ep_pm_active(epi->wl))
+			ep_pm_stay_awake(ep->wl);
+		ep_pm_relax(epi->wl);
 		list_del_init(&epi->rdllink);
 
 		pt._key = epi->event.events;
@@ -918,6 +1103,7 @@ static int ep_send_events_proc(struct eventpoll *ep, struct list_head *head,
 			if (__put_user(revents, &uevent->events) ||
 			    __put_user(epi->event.data, &uevent->data)) {
 				list_add(&epi->rdllink, head);
+				ep_pm_stay_awake(epi->wl);
 				return eventcnt ? eventcnt : -EFAULT;
 			}
 			eventcnt++;
@@ -926,6 +1112,7 @@ static int ep_send_events_proc(struct eventpoll *ep, struct list_head *head,
 				epi->event.events &= EP_PRIVATE_BITS;
 			else if (!(epi->event.events & EPOLLET)) {
 				list_add_tail(&epi->rdllink, &ep->rdllist);
+				ep_pm_stay_awake(epi->wl);
 			}
 		}
 	}
@@ -1138,6 +1325,9 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 	    copy_from_user(&epds, event, sizeof(struct epoll_event)))
 		goto error_return;
 
+	if (ep_op_has_event(op))
+		ep_take_care_of_epollwakeup(&epds);
+
 	
 	error = -EBADF;
 	file = fget(epfd);
@@ -1158,6 +1348,18 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 	if (file == tfile || !is_file_epoll(file))
 		goto error_tgt_fput;
 
+	/*
+	 * EPOLLEXCLUSIVE is only allowed on add, not on nested epoll
+	 * files and only with the event bits whose wakeups it can route.
+	 */
+	if (ep_op_has_event(op) && (epds.events & EPOLLEXCLUSIVE)) {
+		if (op == EPOLL_CTL_MOD)
+			goto error_tgt_fput;
+		if (is_file_epoll(tfile) ||
+		    (epds.events & ~EPOLLEXCLUSIVE_OK_BITS))
+			goto error_tgt_fput;
+	}
+
 	ep = file->private_data;
 
 	if (op == EPOLL_CTL_ADD || op == EPOLL_CTL_DEL) {
@@ -1197,8 +1399,10 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 		break;
 	case EPOLL_CTL_MOD:
 		if (epi) {
-			epds.events |= POLLERR | POLLHUP;
-			error = ep_modify(ep, epi, &epds);
+			if (!(epi->event.events & EPOLLEXCLUSIVE)) {
+				epds.events |= POLLERR | POLLHUP;
+				error = ep_modify(ep, epi, &epds);
+			}
 		} else
 			error = -ENOENT;
 		break;
@@ -20,6 +20,7 @@
 #define DEINIT_TYPE			16
 #define USER_SPACE_DATA_TYPE		32
 #define DCI_DATA_TYPE			64
+#define DIAG_MMAP_DATA_TYPE		4096
 
 #define USERMODE_DIAGFWD		2048
 #define USERMODE_DIAGFWD_LEGACY		64
@@ -48,6 +49,24 @@
 #define DIAG_IOCTL_REMOTE_DEV		32
 #define DIAG_IOCTL_NONBLOCKING_TIMEOUT 64
 
+/*
+ * Memory device mode delivery ring. The logging process may mmap the
+ * diag device; the first page holds the header below and the ring data
+ * follows it. Each record is a 32-bit length followed by the data,
+ * padded to 4 bytes. A length of DIAG_MMAP_WRAP means the rest of the
+ * ring is unused and the next record starts at offset 0. The kernel
+ * advances head, the logger advances tail; read() reports
+ * DIAG_MMAP_DATA_TYPE when new records are available.
+ */
+#define DIAG_MMAP_WRAP			0xFFFFFFFF
+
+struct diag_mmap_ring_hdr {
+	unsigned int size;
+	unsigned int head;
+	unsigned int tail;
+	unsigned int dropped;
+};
+
 #define APQ8060_TOOLS_ID	4062
 #define AO8960_TOOLS_ID		4064
 #define APQ8064_TOOLS_ID	4072
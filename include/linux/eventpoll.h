@@ -23,6 +23,10 @@
 #define EPOLL_CTL_DEL 2
 #define EPOLL_CTL_MOD 3
 
+#define EPOLLEXCLUSIVE (1 << 28)
+
+#define EPOLLWAKEUP (1 << 29)
+
 #define EPOLLONESHOT (1 << 30)
 
 #define EPOLLET (1 << 31)
@@ -110,6 +110,19 @@ static inline void exit_pi_state_list(struct task_struct *curr)
 {
 }
 #endif
+
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+extern int futex_private_hash_size;
+extern void futex_hash_allocate(struct mm_struct *mm);
+extern void futex_hash_free(struct mm_struct *mm);
+#else
+static inline void futex_hash_allocate(struct mm_struct *mm)
+{
+}
+static inline void futex_hash_free(struct mm_struct *mm)
+{
+}
+#endif
 #endif 
 
 #define FUTEX_OP_SET		0	
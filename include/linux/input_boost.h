@@ -0,0 +1,58 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef __LINUX_INPUT_BOOST_H
+#define __LINUX_INPUT_BOOST_H
+
+#include <linux/notifier.h>
+#include <linux/ktime.h>
+
+enum input_boost_class {
+	INPUT_BOOST_TOUCH,	/* finger down */
+	INPUT_BOOST_FLING,	/* fast release, scrolling expected */
+	INPUT_BOOST_KEY,
+	INPUT_BOOST_NR,
+};
+
+/* notifier actions */
+#define INPUT_BOOST_START	1	/* @class started */
+#define INPUT_BOOST_END		2	/* @class expired */
+
+/*
+ * Passed to the notifier chain.  The resource fields are the aggregate of
+ * every class still active, so a consumer only has to apply them; all
+ * zero means no boost is left.
+ */
+struct input_boost_event {
+	enum input_boost_class	class;
+	unsigned int		cpu_freq;	/* kHz */
+	unsigned int		min_cpus;
+	bool			gpu;
+	bool			bus;
+	ktime_t			input_time;
+};
+
+#ifdef CONFIG_CPU_FREQ
+extern int input_boost_register_notifier(struct notifier_block *nb);
+extern int input_boost_unregister_notifier(struct notifier_block *nb);
+#else
+static inline int input_boost_register_notifier(struct notifier_block *nb)
+{
+	return 0;
+}
+
+static inline int input_boost_unregister_notifier(struct notifier_block *nb)
+{
+	return 0;
+}
+#endif
+
+#endif
@@ -370,6 +370,10 @@ struct mm_struct {
 #ifdef CONFIG_CPUMASK_OFFSTACK
 	struct cpumask cpumask_allocation;
 #endif
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+	struct futex_hash_bucket *futex_hash;	/* PROCESS_PRIVATE futexes */
+	unsigned int futex_hash_mask;
+#endif
 };
 
 static inline void mm_init_cpumask(struct mm_struct *mm)
@@ -76,6 +76,8 @@
 #define MSMFB_WRITEBACK_SET_MIRRORING_HINT _IOW(MSMFB_IOCTL_MAGIC, 165, \
 						unsigned int)
 #define MSMFB_METADATA_GET  _IOW(MSMFB_IOCTL_MAGIC, 166, struct msmfb_metadata)
+#define MSMFB_ATOMIC_COMMIT _IOWR(MSMFB_IOCTL_MAGIC, 167, \
+						struct mdp_atomic_commit)
 
 #define FB_TYPE_3D_PANEL 0x10101010
 #define MDP_IMGTYPE2_START 0x10000
@@ -585,6 +587,37 @@ struct mdp_display_commit {
 	struct fb_var_screeninfo var;
 };
 
+#define MDP_ATOMIC_MAX_LAYERS		MDP_MAX_FENCE_FD
+
+/* mdp_atomic_layer flags */
+#define MDP_ATOMIC_LAYER_UNSET		0x00000001	/* release overlay.id */
+#define MDP_ATOMIC_LAYER_PLAY_ONLY	0x00000002	/* config unchanged */
+
+struct mdp_atomic_layer {
+	uint32_t flags;
+	struct mdp_overlay overlay;	/* id returned for MSMFB_NEW_REQUEST */
+	struct msmfb_overlay_data data;	/* data.id is taken from overlay.id */
+	int acq_fen_fd;			/* -1 if the buffer is ready */
+};
+
+/* mdp_atomic_commit flags */
+#define MDP_ATOMIC_COMMIT_TEST_ONLY	0x00000001
+#define MDP_ATOMIC_COMMIT_WAIT		0x00000002	/* wait for kickoff */
+#define MDP_ATOMIC_COMMIT_ROI		0x00000004	/* only roi changed */
+
+/*
+ * Set, play and commit a whole frame in one call.  Returns release and
+ * retire fences like MSMFB_BUFFER_SYNC.
+ */
+struct mdp_atomic_commit {
+	uint32_t flags;
+	uint32_t layer_cnt;
+	struct mdp_atomic_layer *layers;
+	int rel_fen_fd;
+	int retire_fen_fd;
+	struct mdp_rect roi;		/* dirty region, panel coordinates */
+};
+
 struct mdp_page_protection {
 	uint32_t page_protection;
 };
@@ -20,6 +20,10 @@ struct msm_thermal_data {
 	uint32_t limit_temp;
 	uint32_t temp_hysteresis;
 	uint32_t limit_freq;
+	/* optional, 0 selects the default */
+	uint32_t sensor_mask;		/* extra TSENS sensors, hottest wins */
+	uint32_t target_temp;		/* PID set point, C */
+	uint32_t core_offline_temp;	/* offline cores above this, C */
 };
 
 #ifdef CONFIG_THERMAL_MONITOR
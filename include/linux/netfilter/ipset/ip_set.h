@@ -108,6 +108,10 @@ enum {
 	IPSET_ATTR_CIDR2,
 	IPSET_ATTR_IP2_TO,
 	IPSET_ATTR_IFACE,
+	/* The slots after IFACE are allocated upstream (BYTES, PACKETS,
+	 * COMMENT, SKBMARK, ...), keep local attributes clear of them */
+	IPSET_ATTR_UID = 40,
+	IPSET_ATTR_UID_TO,	/* 41 */
 	__IPSET_ATTR_ADT_MAX,
 };
 #define IPSET_ATTR_ADT_MAX	(__IPSET_ATTR_ADT_MAX - 1)
@@ -227,6 +231,9 @@ enum ip_set_feature {
 	 * this settype must be dumped last */
 	IPSET_DUMP_LAST_FLAG = 7,
 	IPSET_DUMP_LAST = (1 << IPSET_DUMP_LAST_FLAG),
+	/* Local features take the top bits, away from upstream's */
+	IPSET_TYPE_UID_FLAG = 15,
+	IPSET_TYPE_UID = (1 << IPSET_TYPE_UID_FLAG),
 };
 
 struct ip_set;
@@ -291,7 +298,7 @@ struct ip_set_type {
 	/* Protocol version */
 	u8 protocol;
 	/* Set features to control swapping */
-	u8 features;
+	u16 features;
 	/* Set type dimension */
 	u8 dimension;
 	/*
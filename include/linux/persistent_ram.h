@@ -59,6 +59,10 @@ struct persistent_ram_zone {
 	int ecc_size;
 	int ecc_symsize;
 	int ecc_poly;
+	int ecc_blocks;
+	unsigned long *ecc_dirty;	/* blocks with stale parity */
+	unsigned long ecc_flags;
+	int ecc_busy_block;		/* being encoded by the worker */
 
 	char *old_log;
 	size_t old_log_size;
@@ -77,6 +81,9 @@ int persistent_ram_write(struct persistent_ram_zone *prz, const void *s,
 size_t persistent_ram_old_size(struct persistent_ram_zone *prz);
 void *persistent_ram_old(struct persistent_ram_zone *prz);
 void persistent_ram_free_old(struct persistent_ram_zone *prz);
+void persistent_ram_flush_ecc(struct persistent_ram_zone *prz);
+int persistent_ram_bench(struct persistent_ram_zone *prz, const char *line,
+	size_t len, unsigned int iters, u64 *ns);
 ssize_t persistent_ram_ecc_string(struct persistent_ram_zone *prz,
 	char *str, size_t len);
 
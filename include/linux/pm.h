@@ -197,6 +197,8 @@ struct dev_pm_info {
 	struct completion	completion;
 	struct wakeup_source	*wakeup;
 	bool			wakeup_path:1;
+	s64			suspend_ns;	/* callbacks, last transition */
+	s64			resume_ns;
 #else
 	unsigned int		should_wakeup:1;
 #endif
@@ -39,6 +39,8 @@ struct seq_file;
  *			  1 if b will signal before a
  *			  0 if a and b will signal at the same time
  *			 -1 if a will signabl before b
+ *			  pts are signaled in this order, so a pt must not
+ *			  signal before the pts comparing earlier than it
  * @free_pt:		called before sync_pt is freed
  * @release_obj:	called before sync_timeline is freed
  * @print_obj:		deprecated
@@ -126,6 +128,7 @@ struct sync_timeline {
  * @status:		1: signaled, 0:active, <0: error
  * @timestamp:		time which sync_pt status transitioned from active to
  *			  singaled or error.
+ * @cached:		allocated from the sync_pt slab cache
  */
 struct sync_pt {
 	struct sync_timeline		*parent;
@@ -141,6 +144,8 @@ struct sync_pt {
 	int			status;
 
 	ktime_t			timestamp;
+
+	bool			cached;
 };
 
 /**
@@ -273,7 +278,9 @@ struct sync_fence *sync_fence_create(const char *name, struct sync_pt *pt);
  * @b:		fence b
  *
  * Creates a new fence which contains copies of all the sync_pts in both
- * @a and @b.  @a and @b remain valid, independent fences.
+ * @a and @b.  @a and @b remain valid, independent fences.  If either
+ * fence has already signaled, or @a == @b, no new fence is created and
+ * the other one is returned with an extra reference.
  */
 struct sync_fence *sync_fence_merge(const char *name,
 				    struct sync_fence *a, struct sync_fence *b);
@@ -0,0 +1,39 @@
+#ifndef _LINUX_TRACE_MMAP_H
+#define _LINUX_TRACE_MMAP_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/*
+ * Layout of an mmapped per_cpu/cpuN/trace_pipe_raw: this meta page,
+ * then nr_subbufs pages of ring buffer in sub-buffer id order.  Each
+ * sub-buffer starts with the ring buffer page header (u64 time stamp,
+ * long commit) followed by the events.
+ *
+ * Only the reader sub-buffer belongs to userspace.
+ * TRACE_MMAP_IOCTL_GET_READER gives the previous one back to the
+ * writer and hands out the events in [reader.read, reader.commit) of
+ * the new one.
+ */
+struct trace_buffer_meta {
+	__u32	meta_page_size;
+	__u32	meta_struct_len;
+	__u32	subbuf_size;
+	__u32	nr_subbufs;
+
+	struct {
+		__u64	lost_events;
+		__u32	id;
+		__u32	read;
+		__u32	commit;
+		__u32	__pad;
+	} reader;
+
+	__u64	entries;	/* events written */
+	__u64	overrun;	/* events lost to overwrite */
+	__u64	read;		/* events consumed */
+};
+
+#define TRACE_MMAP_IOCTL_GET_READER	_IO('R', 0x20)
+
+#endif /* _LINUX_TRACE_MMAP_H */
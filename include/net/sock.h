@@ -143,6 +143,7 @@ struct sock_common {
 };
 
 struct cg_proto;
+struct sock_tag;
 /**
   *	struct sock - network layer representation of sockets
   *	@__sk_common: shared layout with inet_timewait_sock
@@ -206,6 +207,7 @@ struct cg_proto;
   *	@sk_security: used by security modules
   *	@sk_mark: generic packet mark
   *	@sk_classid: this socket's cgroup classid
+  *	@sk_qtaguid_tag: xt_qtaguid accounting tag, if the socket is tagged
   *	@sk_cgrp: this socket's cgroup-specific proto data
   *	@sk_write_pending: a write to stream socket waits to start
   *	@sk_state_change: callback to indicate change in the state of the sock
@@ -311,6 +313,9 @@ struct sock {
 #endif
 	__u32			sk_mark;
 	u32			sk_classid;
+#if IS_ENABLED(CONFIG_NETFILTER_XT_MATCH_QTAGUID)
+	struct sock_tag __rcu	*sk_qtaguid_tag;
+#endif
 	struct cg_proto		*sk_cgrp;
 	void			(*sk_state_change)(struct sock *sk);
 	void			(*sk_data_ready)(struct sock *sk, int bytes);
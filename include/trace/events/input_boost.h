@@ -0,0 +1,50 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM input_boost
+
+#if !defined(_TRACE_INPUT_BOOST_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_INPUT_BOOST_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(input_boost,
+	TP_PROTO(unsigned int class, unsigned int freq, unsigned int min_cpus,
+		 s64 latency_us),
+	TP_ARGS(class, freq, min_cpus, latency_us),
+
+	TP_STRUCT__entry(
+	    __field(unsigned int, class)
+	    __field(unsigned int, freq)
+	    __field(unsigned int, min_cpus)
+	    __field(s64, latency_us)
+	),
+
+	TP_fast_assign(
+	    __entry->class = class;
+	    __entry->freq = freq;
+	    __entry->min_cpus = min_cpus;
+	    __entry->latency_us = latency_us;
+	),
+
+	TP_printk("class=%u freq=%u min_cpus=%u latency=%lldus",
+	      __entry->class, __entry->freq, __entry->min_cpus,
+	      __entry->latency_us)
+);
+
+TRACE_EVENT(input_boost_end,
+	TP_PROTO(unsigned int class),
+	TP_ARGS(class),
+
+	TP_STRUCT__entry(
+	    __field(unsigned int, class)
+	),
+
+	TP_fast_assign(
+	    __entry->class = class;
+	),
+
+	TP_printk("class=%u", __entry->class)
+);
+
+#endif 
+
+#include <trace/define_trace.h>
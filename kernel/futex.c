@@ -62,6 +62,8 @@
 #include <linux/ptrace.h>
 #include <linux/freezer.h>
 #include <linux/hugetlb.h>
+#include <linux/bootmem.h>
+#include <linux/log2.h>
 
 #include <asm/futex.h>
 
@@ -69,7 +71,12 @@
 
 int __read_mostly futex_cmpxchg_enabled;
 
-#define FUTEX_HASHBITS (CONFIG_BASE_SMALL ? 4 : 8)
+/*
+ * The global hash is sized at boot: one bucket per 64KB of memory, capped
+ * at FUTEX_BUCKETS_PER_CPU buckets for every possible cpu.
+ */
+#define FUTEX_HASH_SCALE	16
+#define FUTEX_BUCKETS_PER_CPU	(CONFIG_BASE_SMALL ? 16 : 256)
 
 /*
  * Futex flags used to encode options to functions and preserve them across
@@ -143,14 +150,59 @@ static const struct futex_q futex_q_init = {
 /*
  * Hash buckets are shared by all the futex_keys that hash to the same
  * location.  Each key may have multiple futex_q structures, one for each task
- * waiting on a futex.
+ * waiting on a futex.  Buckets are cacheline aligned so that waiters on
+ * neighbouring buckets do not bounce each other's lock.
  */
 struct futex_hash_bucket {
 	spinlock_t lock;
 	struct plist_head chain;
-};
+} ____cacheline_aligned_in_smp;
+
+static struct futex_hash_bucket *futex_queues;
+static unsigned int futex_hash_mask __read_mostly;
+
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+/*
+ * Number of buckets in the per-mm hash used for PROCESS_PRIVATE futexes,
+ * 0 keeps every futex in the global hash.
+ */
+int futex_private_hash_size __read_mostly = 16;
+
+/*
+ * Called when the first thread of @mm is created.  With a single user no
+ * task of @mm can be queued on a futex, so private keys can be moved to
+ * their own table without rehashing anything.  Once installed the table
+ * stays until the mm is freed.
+ */
+void futex_hash_allocate(struct mm_struct *mm)
+{
+	struct futex_hash_bucket *queues;
+	unsigned int i, size;
+
+	if (futex_private_hash_size <= 0 || mm->futex_hash ||
+	    atomic_read(&mm->mm_users) != 1)
+		return;
 
-static struct futex_hash_bucket futex_queues[1<<FUTEX_HASHBITS];
+	size = roundup_pow_of_two(futex_private_hash_size);
+	queues = kmalloc(size * sizeof(*queues), GFP_KERNEL);
+	if (!queues)
+		return;		/* keep using the global hash */
+
+	for (i = 0; i < size; i++) {
+		plist_head_init(&queues[i].chain);
+		spin_lock_init(&queues[i].lock);
+	}
+
+	mm->futex_hash_mask = size - 1;
+	mm->futex_hash = queues;
+}
+
+void futex_hash_free(struct mm_struct *mm)
+{
+	kfree(mm->futex_hash);
+	mm->futex_hash = NULL;
+}
+#endif
 
 /*
  * We hash on the keys returned from get_futex_key (see below).
@@ -160,7 +212,16 @@ static struct futex_hash_bucket *hash_futex(union futex_key *key)
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
-	return &futex_queues[hash & ((1 << FUTEX_HASHBITS)-1)];
+
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+	if (!(key->both.offset & (FUT_OFF_INODE | FUT_OFF_MMSHARED))) {
+		struct mm_struct *mm = key->private.mm;
+
+		if (mm->futex_hash)
+			return &mm->futex_hash[hash & mm->futex_hash_mask];
+	}
+#endif
+	return &futex_queues[hash & futex_hash_mask];
 }
 
 /*
@@ -2789,6 +2850,7 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 
 static int __init futex_init(void)
 {
+	unsigned long limit;
 	u32 curval;
 	int i;
 
@@ -2805,7 +2867,12 @@ static int __init futex_init(void)
 	if (cmpxchg_futex_value_locked(&curval, NULL, 0, 0) == -EFAULT)
 		futex_cmpxchg_enabled = 1;
 
-	for (i = 0; i < ARRAY_SIZE(futex_queues); i++) {
+	limit = roundup_pow_of_two(FUTEX_BUCKETS_PER_CPU * num_possible_cpus());
+	futex_queues = alloc_large_system_hash("futex", sizeof(*futex_queues),
+					       0, FUTEX_HASH_SCALE, 0, NULL,
+					       &futex_hash_mask, limit);
+
+	for (i = 0; i <= futex_hash_mask; i++) {
 		plist_head_init(&futex_queues[i].chain);
 		spin_lock_init(&futex_queues[i].lock);
 	}
@@ -41,6 +41,8 @@
 #include <linux/cpu.h>
 #include <linux/notifier.h>
 #include <linux/rculist.h>
+#include <linux/kthread.h>
+#include <linux/percpu.h>
 
 #include <asm/uaccess.h>
 
@@ -108,6 +110,18 @@ EXPORT_SYMBOL(console_set_on_cmdline);
 
 static int console_may_schedule;
 
+#define PRINTK_BUF_SIZE		512
+
+#define PRINTK_PENDING_WAKEUP	0x01
+#define PRINTK_PENDING_SCHED	0x02
+#define PRINTK_PENDING_OUTPUT	0x04
+
+static DEFINE_PER_CPU(int, printk_pending);
+static DEFINE_PER_CPU(char [PRINTK_BUF_SIZE], printk_sched_buf);
+
+/* console output thread, see vprintk_stage() */
+static struct task_struct *printk_kthread_task;
+
 #ifdef CONFIG_PRINTK
 
 static char __log_buf[__LOG_BUF_LEN];
@@ -116,6 +130,13 @@ static int log_buf_len = __LOG_BUF_LEN;
 static unsigned logged_chars; 
 static int saved_console_loglevel = -1;
 
+static void log_merge_staged(void);
+static bool log_staged_pending(void);
+
+/* chars overwritten in log_buf before any console printed them */
+static unsigned long console_dropped;
+module_param(console_dropped, ulong, S_IRUGO);
+
 #ifdef CONFIG_KEXEC
 void log_buf_kexec_setup(void)
 {
@@ -261,6 +282,7 @@ int log_buf_copy(char *dest, int idx, int len)
 		took_lock = true;
 	}
 
+	log_merge_staged();
 	max = log_buf_get_len();
 	if (idx < 0 || idx >= max) {
 		ret = -1;
@@ -385,6 +407,7 @@ int do_syslog(int type, char __user *buf, int len, bool from_file)
 		if (count > log_buf_len)
 			count = log_buf_len;
 		raw_spin_lock_irq(&logbuf_lock);
+		log_merge_staged();
 		if (count > logged_chars)
 			count = logged_chars;
 		if (do_clear)
@@ -448,7 +471,10 @@ int do_syslog(int type, char __user *buf, int len, bool from_file)
 		break;
 	
 	case SYSLOG_ACTION_SIZE_UNREAD:
+		raw_spin_lock_irq(&logbuf_lock);
+		log_merge_staged();
 		error = log_end - log_start;
+		raw_spin_unlock_irq(&logbuf_lock);
 		break;
 	
 	case SYSLOG_ACTION_SIZE_BUFFER:
@@ -623,8 +649,10 @@ static void emit_log_char(char c)
 	log_end++;
 	if (log_end - log_start > log_buf_len)
 		log_start = log_end - log_buf_len;
-	if (log_end - con_start > log_buf_len)
+	if (log_end - con_start > log_buf_len) {
 		con_start = log_end - log_buf_len;
+		console_dropped++;
+	}
 	if (logged_chars < log_buf_len)
 		logged_chars++;
 }
@@ -755,47 +783,20 @@ static inline void printk_delay(void)
 	}
 }
 
-asmlinkage int vprintk(const char *fmt, va_list args)
+/*
+ * Emit one formatted printk into log_buf, adding the level, time, cpu
+ * and pid prefixes at the start of each line. Called with logbuf_lock
+ * held; returns the number of prefix chars added.
+ */
+static int log_store(const char *text, unsigned int cpu, pid_t pid,
+		     unsigned long long ts)
 {
 	int printed_len = 0;
 	int current_log_level = default_message_loglevel;
-	unsigned long flags;
-	int this_cpu;
-	char *p;
+	const char *p = text;
 	size_t plen;
 	char special;
 
-	boot_delay_msec();
-	printk_delay();
-
-	
-	local_irq_save(flags);
-	this_cpu = smp_processor_id();
-
-	if (unlikely(printk_cpu == this_cpu)) {
-		if (!oops_in_progress && !lockdep_recursing(current)) {
-			recursion_bug = 1;
-			goto out_restore_irqs;
-		}
-		zap_locks();
-	}
-
-	lockdep_off();
-	raw_spin_lock(&logbuf_lock);
-	printk_cpu = this_cpu;
-
-	if (recursion_bug) {
-		recursion_bug = 0;
-		strcpy(printk_buf, recursion_bug_msg);
-		printed_len = strlen(recursion_bug_msg);
-	}
-	
-	printed_len += vscnprintf(printk_buf + printed_len,
-				  sizeof(printk_buf) - printed_len, fmt, args);
-
-
-	p = printk_buf;
-
 	
 	plen = log_prefix(p, &current_log_level, &special);
 	if (plen) {
@@ -824,7 +825,7 @@ asmlinkage int vprintk(const char *fmt, va_list args)
 				int i;
 
 				for (i = 0; i < plen; i++)
-					emit_log_char(printk_buf[i]);
+					emit_log_char(text[i]);
 				printed_len += plen;
 			} else {
 				
@@ -838,10 +839,9 @@ asmlinkage int vprintk(const char *fmt, va_list args)
 				
 				char tbuf[50], *tp;
 				unsigned tlen;
-				unsigned long long t;
+				unsigned long long t = ts;
 				unsigned long nanosec_rem;
 
-				t = cpu_clock(printk_cpu);
 				nanosec_rem = do_div(t, 1000000000);
 				tlen = sprintf(tbuf, "[%5lu.%06lu] ",
 						(unsigned long) t,
@@ -857,7 +857,7 @@ asmlinkage int vprintk(const char *fmt, va_list args)
                    char tbuf[10], *tp;
                    unsigned tlen;
 
-                   tlen = sprintf(tbuf, "c%u ", printk_cpu);
+                   tlen = sprintf(tbuf, "c%u ", cpu);
 
                    for (tp = tbuf; tp < tbuf + tlen; tp++)
                            emit_log_char(*tp);
@@ -869,7 +869,7 @@ asmlinkage int vprintk(const char *fmt, va_list args)
                    char tbuf[10], *tp;
                    unsigned tlen;
 
-                   tlen = sprintf(tbuf, "%6u ", current->pid);
+                   tlen = sprintf(tbuf, "%6u ", pid);
 
                    for (tp = tbuf; tp < tbuf + tlen; tp++)
                            emit_log_char(*tp);
@@ -885,7 +885,242 @@ asmlinkage int vprintk(const char *fmt, va_list args)
 			new_text_line = 1;
 	}
 
-	if (console_trylock_for_printk(this_cpu))
+	return printed_len;
+}
+
+/*
+ * Once the "printk" kthread runs, printk() on a running system only
+ * formats the message into a per-cpu staging ring, with interrupts off
+ * and without taking logbuf_lock or console_sem. The kthread merges the
+ * rings into log_buf in timestamp order and feeds the consoles; anybody
+ * reading log_buf merges them first. Oopses, panics, shutdown and early
+ * boot (emergency mode) keep the old synchronous path, as does a
+ * printk finding its staging ring full; that is bounded by log_buf.
+ */
+#define PRINTK_STAGE_SIZE	8192	/* power of two */
+#define PRINTK_LINE_MAX		1024
+
+struct printk_stage_hdr {
+	unsigned long long	ts;
+	pid_t			pid;
+	unsigned int		len;
+};
+
+struct printk_stage {
+	unsigned int		head;	/* only advanced by the owning cpu */
+	unsigned int		tail;	/* only advanced under logbuf_lock */
+	int			busy;
+	char			buf[PRINTK_STAGE_SIZE];
+	char			line[PRINTK_LINE_MAX];
+};
+
+static DEFINE_PER_CPU(struct printk_stage, printk_stage);
+
+static bool printk_console_kthread = 1;
+module_param_named(console_kthread, printk_console_kthread, bool,
+		   S_IRUGO | S_IWUSR);
+
+static DEFINE_PER_CPU(unsigned long, printk_staged);
+static DEFINE_PER_CPU(unsigned long, printk_stage_overflow);
+
+static int param_get_percpu_ulong(char *buffer, const struct kernel_param *kp)
+{
+	unsigned long __percpu *cnt = (unsigned long __percpu *)kp->arg;
+	unsigned long sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		sum += *per_cpu_ptr(cnt, cpu);
+	return sprintf(buffer, "%lu", sum);
+}
+
+static struct kernel_param_ops printk_percpu_ulong_ops = {
+	.get = param_get_percpu_ulong,
+};
+module_param_cb(staged, &printk_percpu_ulong_ops, &printk_staged, S_IRUGO);
+module_param_cb(stage_overflow, &printk_percpu_ulong_ops,
+		&printk_stage_overflow, S_IRUGO);
+
+static inline bool printk_emergency(void)
+{
+	return oops_in_progress || system_state != SYSTEM_RUNNING ||
+	       !printk_console_kthread || !printk_kthread_task;
+}
+
+static void stage_copy_in(struct printk_stage *st, unsigned int pos,
+			  const void *src, unsigned int len)
+{
+	unsigned int off = pos & (PRINTK_STAGE_SIZE - 1);
+	unsigned int n = min(len, PRINTK_STAGE_SIZE - off);
+
+	memcpy(st->buf + off, src, n);
+	memcpy(st->buf, src + n, len - n);
+}
+
+static void stage_copy_out(struct printk_stage *st, unsigned int pos,
+			   void *dst, unsigned int len)
+{
+	unsigned int off = pos & (PRINTK_STAGE_SIZE - 1);
+	unsigned int n = min(len, PRINTK_STAGE_SIZE - off);
+
+	memcpy(dst, st->buf + off, n);
+	memcpy(dst + n, st->buf, len - n);
+}
+
+/*
+ * Stage a message on this cpu, interrupts off. Returns -1 if the caller
+ * has to take the synchronous path instead.
+ */
+static int vprintk_stage(unsigned int cpu, const char *fmt, va_list args)
+{
+	struct printk_stage *st = &per_cpu(printk_stage, cpu);
+	struct printk_stage_hdr hdr;
+	unsigned int need;
+
+	/* printk from within printk on this cpu */
+	if (st->busy)
+		return -1;
+	st->busy = 1;
+
+	hdr.ts = cpu_clock(cpu);
+	hdr.pid = current->pid;
+	hdr.len = vscnprintf(st->line, sizeof(st->line), fmt, args);
+
+	need = sizeof(hdr) + hdr.len;
+	if (need > PRINTK_STAGE_SIZE - (st->head - ACCESS_ONCE(st->tail))) {
+		__this_cpu_inc(printk_stage_overflow);
+		st->busy = 0;
+		return -1;
+	}
+
+	stage_copy_in(st, st->head, &hdr, sizeof(hdr));
+	stage_copy_in(st, st->head + sizeof(hdr), st->line, hdr.len);
+	smp_wmb();
+	st->head += need;
+	__this_cpu_inc(printk_staged);
+
+	st->busy = 0;
+	return hdr.len;
+}
+
+static bool log_staged_pending(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct printk_stage *st = &per_cpu(printk_stage, cpu);
+
+		if (ACCESS_ONCE(st->head) != st->tail)
+			return true;
+	}
+	return false;
+}
+
+/* Move staged messages into log_buf, oldest first. logbuf_lock held. */
+static void log_merge_staged(void)
+{
+	struct printk_stage_hdr hdr, best_hdr;
+	struct printk_stage *st, *best;
+	int cpu, best_cpu;
+
+	for (;;) {
+		best = NULL;
+		best_cpu = 0;
+		for_each_possible_cpu(cpu) {
+			st = &per_cpu(printk_stage, cpu);
+			if (ACCESS_ONCE(st->head) == st->tail)
+				continue;
+			smp_rmb();
+			stage_copy_out(st, st->tail, &hdr, sizeof(hdr));
+			if (!best || hdr.ts < best_hdr.ts) {
+				best = st;
+				best_cpu = cpu;
+				best_hdr = hdr;
+			}
+		}
+		if (!best)
+			break;
+
+		stage_copy_out(best, best->tail + sizeof(best_hdr), printk_buf,
+			       best_hdr.len);
+		printk_buf[best_hdr.len] = '\0';
+		log_store(printk_buf, best_cpu, best_hdr.pid, best_hdr.ts);
+
+		/* done reading before the owner may reuse the space */
+		smp_mb();
+		best->tail += sizeof(best_hdr) + best_hdr.len;
+	}
+}
+
+static void printk_kick_kthread(unsigned long flags)
+{
+	/* with interrupts off the caller may hold a runqueue lock */
+	if (!irqs_disabled_flags(flags))
+		wake_up_process(printk_kthread_task);
+	else
+		__this_cpu_or(printk_pending, PRINTK_PENDING_OUTPUT);
+}
+
+asmlinkage int vprintk(const char *fmt, va_list args)
+{
+	int printed_len = 0;
+	unsigned long flags;
+	int this_cpu;
+	bool emergency;
+	va_list args2;
+
+	boot_delay_msec();
+	printk_delay();
+
+	
+	local_irq_save(flags);
+	this_cpu = smp_processor_id();
+
+	emergency = printk_emergency();
+	if (!emergency) {
+		va_copy(args2, args);
+		printed_len = vprintk_stage(this_cpu, fmt, args2);
+		va_end(args2);
+		if (printed_len >= 0) {
+			printk_kick_kthread(flags);
+			goto out_restore_irqs;
+		}
+		printed_len = 0;
+	}
+
+	if (unlikely(printk_cpu == this_cpu)) {
+		if (!oops_in_progress && !lockdep_recursing(current)) {
+			recursion_bug = 1;
+			goto out_restore_irqs;
+		}
+		zap_locks();
+	}
+
+	lockdep_off();
+	raw_spin_lock(&logbuf_lock);
+	printk_cpu = this_cpu;
+
+	/* keep whatever was staged ahead of this one */
+	log_merge_staged();
+
+	if (recursion_bug) {
+		recursion_bug = 0;
+		strcpy(printk_buf, recursion_bug_msg);
+		printed_len = strlen(recursion_bug_msg);
+	}
+	
+	printed_len += vscnprintf(printk_buf + printed_len,
+				  sizeof(printk_buf) - printed_len, fmt, args);
+
+	printed_len += log_store(printk_buf, printk_cpu, current->pid,
+				 cpu_clock(printk_cpu));
+
+	if (!emergency) {
+		/* staging ring full: leave the consoles to the kthread */
+		printk_cpu = UINT_MAX;
+		raw_spin_unlock(&logbuf_lock);
+		printk_kick_kthread(flags);
+	} else if (console_trylock_for_printk(this_cpu))
 		console_unlock();
 
 	lockdep_on();
@@ -903,6 +1138,15 @@ static void call_console_drivers(unsigned start, unsigned end)
 {
 }
 
+static inline void log_merge_staged(void)
+{
+}
+
+static inline bool log_staged_pending(void)
+{
+	return false;
+}
+
 #endif
 
 static int __add_preferred_console(char *name, int idx, char *options,
@@ -1101,14 +1345,6 @@ int is_console_locked(void)
 	return console_locked;
 }
 
-#define PRINTK_BUF_SIZE		512
-
-#define PRINTK_PENDING_WAKEUP	0x01
-#define PRINTK_PENDING_SCHED	0x02
-
-static DEFINE_PER_CPU(int, printk_pending);
-static DEFINE_PER_CPU(char [PRINTK_BUF_SIZE], printk_sched_buf);
-
 void printk_tick(void)
 {
 	if (__this_cpu_read(printk_pending)) {
@@ -1119,6 +1355,8 @@ void printk_tick(void)
 		}
 		if (pending & PRINTK_PENDING_WAKEUP)
 			wake_up_interruptible(&log_wait);
+		if (pending & PRINTK_PENDING_OUTPUT)
+			wake_up_process(printk_kthread_task);
 	}
 }
 
@@ -1151,6 +1389,7 @@ void console_unlock(void)
 again:
 	for ( ; ; ) {
 		raw_spin_lock_irqsave(&logbuf_lock, flags);
+		log_merge_staged();
 		wake_klogd |= log_start - log_end;
 		if (con_start == log_end)
 			break;			
@@ -1174,7 +1413,7 @@ again:
 	up(&console_sem);
 
 	raw_spin_lock(&logbuf_lock);
-	if (con_start != log_end)
+	if (con_start != log_end || log_staged_pending())
 		retry = 1;
 	else
 		retry = 0;
@@ -1403,6 +1642,31 @@ int unregister_console(struct console *console)
 }
 EXPORT_SYMBOL(unregister_console);
 
+#ifdef CONFIG_PRINTK
+static int printk_kthread_fn(void *unused)
+{
+	while (!kthread_should_stop()) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!log_staged_pending() &&
+		    (con_start == log_end || console_suspended))
+			schedule();
+		__set_current_state(TASK_RUNNING);
+
+		if (console_suspended) {
+			/* resume_console() prints it */
+			raw_spin_lock_irq(&logbuf_lock);
+			log_merge_staged();
+			raw_spin_unlock_irq(&logbuf_lock);
+			continue;
+		}
+
+		console_lock();
+		console_unlock();
+	}
+	return 0;
+}
+#endif
+
 static int __init printk_late_init(void)
 {
 	struct console *con;
@@ -1415,6 +1679,14 @@ static int __init printk_late_init(void)
 		}
 	}
 	hotcpu_notifier(console_cpu_notify, 0);
+
+#ifdef CONFIG_PRINTK
+	printk_kthread_task = kthread_run(printk_kthread_fn, NULL, "printk");
+	if (IS_ERR(printk_kthread_task)) {
+		pr_err("printk: console thread failed, output stays synchronous\n");
+		printk_kthread_task = NULL;
+	}
+#endif
 	return 0;
 }
 late_initcall(printk_late_init);
@@ -1519,6 +1791,7 @@ void kmsg_dump(enum kmsg_dump_reason reason)
 		return;
 
 	raw_spin_lock_irqsave(&logbuf_lock, flags);
+	log_merge_staged();
 	end = log_end & LOG_BUF_MASK;
 	chars = logged_chars;
 	raw_spin_unlock_irqrestore(&logbuf_lock, flags);
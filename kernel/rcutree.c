@@ -1245,9 +1245,13 @@ static void invoke_rcu_core(void)
 	raise_softirq(RCU_SOFTIRQ);
 }
 
+/*
+ * @local queues the callback on this CPU's own list even if it is a
+ * no-CBs CPU; the rcuo kthreads use it to wait for their grace periods.
+ */
 static void
 __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
-	   struct rcu_state *rsp, bool lazy)
+	   struct rcu_state *rsp, bool lazy, bool local)
 {
 	unsigned long flags;
 	struct rcu_data *rdp;
@@ -1262,6 +1266,11 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
 	local_irq_save(flags);
 	rdp = this_cpu_ptr(rsp->rda);
 
+	if (!local && __call_rcu_nocb(rdp, head, lazy)) {
+		local_irq_restore(flags);
+		return;
+	}
+
 	
 	*rdp->nxttail[RCU_NEXT_TAIL] = head;
 	rdp->nxttail[RCU_NEXT_TAIL] = &head->next;
@@ -1310,13 +1319,13 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
 
 void call_rcu_sched(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_sched_state, 0);
+	__call_rcu(head, func, &rcu_sched_state, 0, 0);
 }
 EXPORT_SYMBOL_GPL(call_rcu_sched);
 
 void call_rcu_bh(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_bh_state, 0);
+	__call_rcu(head, func, &rcu_bh_state, 0, 0);
 }
 EXPORT_SYMBOL_GPL(call_rcu_bh);
 
@@ -1492,6 +1501,7 @@ static void rcu_barrier_func(void *type)
 			      void (*func)(struct rcu_head *head));
 
 	atomic_inc(&rcu_barrier_cpu_count);
+	rcu_nocb_barrier_note(cpu);
 	call_rcu_func = type;
 	call_rcu_func(head, rcu_barrier_callback);
 }
@@ -1506,6 +1516,7 @@ static void _rcu_barrier(struct rcu_state *rsp,
 	init_completion(&rcu_barrier_completion);
 	atomic_set(&rcu_barrier_cpu_count, 1);
 	on_each_cpu(rcu_barrier_func, (void *)call_rcu_func, 1);
+	rcu_nocb_barrier(rsp);
 	if (atomic_dec_and_test(&rcu_barrier_cpu_count))
 		complete(&rcu_barrier_completion);
 	wait_for_completion(&rcu_barrier_completion);
@@ -1545,6 +1556,7 @@ rcu_boot_init_percpu_data(int cpu, struct rcu_state *rsp)
 	WARN_ON_ONCE(atomic_read(&rdp->dynticks->dynticks) != 1);
 	rdp->cpu = cpu;
 	rdp->rsp = rsp;
+	rcu_boot_init_nocb_percpu_data(rdp);
 	raw_spin_unlock_irqrestore(&rnp->lock, flags);
 }
 
@@ -249,6 +249,26 @@ struct rcu_data {
 	unsigned long n_rp_need_fqs;
 	unsigned long n_rp_need_nothing;
 
+#ifdef CONFIG_RCU_NOCB_CPU
+	
+	struct rcu_head *nocb_head;
+	struct rcu_head **nocb_tail;
+	atomic_long_t nocb_q_count;
+	atomic_long_t nocb_q_count_lazy;
+	long nocb_p_count;
+	long nocb_p_count_lazy;
+	u64 nocb_enq_time;
+	wait_queue_head_t nocb_wq;
+	struct task_struct *nocb_kthread;
+
+	
+	unsigned long n_nocb_wakes;
+	unsigned long n_nocb_batches;
+	unsigned long n_nocbs_invoked;
+	u64 nocb_lat_total;
+	u64 nocb_lat_max;
+#endif
+
 	int cpu;
 	struct rcu_state *rsp;
 };
@@ -408,5 +428,10 @@ static void print_cpu_stall_info(struct rcu_state *rsp, int cpu);
 static void print_cpu_stall_info_end(void);
 static void zero_cpu_stall_ticks(struct rcu_data *rdp);
 static void increment_cpu_stall_ticks(void);
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp);
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    bool lazy);
+static void rcu_nocb_barrier_note(int cpu);
+static void rcu_nocb_barrier(struct rcu_state *rsp);
 
 #endif 
@@ -505,14 +505,14 @@ static void rcu_preempt_do_callbacks(void)
 
 void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_preempt_state, 0);
+	__call_rcu(head, func, &rcu_preempt_state, 0, 0);
 }
 EXPORT_SYMBOL_GPL(call_rcu);
 
 void kfree_call_rcu(struct rcu_head *head,
 		    void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_preempt_state, 1);
+	__call_rcu(head, func, &rcu_preempt_state, 1, 0);
 }
 EXPORT_SYMBOL_GPL(kfree_call_rcu);
 
@@ -773,7 +773,7 @@ static void rcu_preempt_process_callbacks(void)
 void kfree_call_rcu(struct rcu_head *head,
 		    void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_sched_state, 1);
+	__call_rcu(head, func, &rcu_sched_state, 1, 0);
 }
 EXPORT_SYMBOL_GPL(kfree_call_rcu);
 
@@ -1610,3 +1610,258 @@ static void increment_cpu_stall_ticks(void)
 }
 
 #endif 
+
+#ifdef CONFIG_RCU_NOCB_CPU
+
+/*
+ * No-CBs CPUs: callbacks queued on the CPUs in rcu_nocbs= are handed to
+ * a per-CPU, per-flavor "rcuo" kthread instead of being invoked from
+ * RCU_SOFTIRQ.  The kthreads are not bound, so the scheduler is free to
+ * run them on whatever CPU is awake, and a no-CBs CPU with nothing else
+ * to do can stay in dyntick-idle.  The CPU itself still takes part in
+ * grace periods as usual.
+ */
+static cpumask_var_t rcu_nocb_mask;
+static bool have_rcu_nocb_mask;
+static struct cpumask rcu_nocb_barrier_done;
+
+static int __init rcu_nocb_setup(char *str)
+{
+	alloc_bootmem_cpumask_var(&rcu_nocb_mask);
+	have_rcu_nocb_mask = true;
+	cpulist_parse(str, rcu_nocb_mask);
+	return 1;
+}
+__setup("rcu_nocbs=", rcu_nocb_setup);
+
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+	rdp->nocb_tail = &rdp->nocb_head;
+	init_waitqueue_head(&rdp->nocb_wq);
+}
+
+/*
+ * Queue @rhp for the rcuo kthread if this is a no-CBs CPU whose kthread
+ * is running.  Called with irqs disabled; the tail is advanced with
+ * xchg() so that remote enqueues from rcu_nocb_barrier() are safe too.
+ */
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    bool lazy)
+{
+	struct rcu_head **old_rhpp;
+	struct task_struct *t = ACCESS_ONCE(rdp->nocb_kthread);
+
+	if (!t)
+		return false;
+
+	atomic_long_inc(&rdp->nocb_q_count);
+	if (lazy)
+		atomic_long_inc(&rdp->nocb_q_count_lazy);
+	old_rhpp = xchg(&rdp->nocb_tail, &rhp->next);
+	if (old_rhpp == &rdp->nocb_head) {
+		rdp->nocb_enq_time = local_clock();
+		smp_wmb(); /* nocb_enq_time before the list is visible. */
+	}
+	ACCESS_ONCE(*old_rhpp) = rhp;
+
+	if (__is_kfree_rcu_offset((unsigned long)rhp->func))
+		trace_rcu_kfree_callback(rdp->rsp->name, rhp,
+					 (unsigned long)rhp->func,
+					 atomic_long_read(&rdp->nocb_q_count_lazy),
+					 atomic_long_read(&rdp->nocb_q_count));
+	else
+		trace_rcu_callback(rdp->rsp->name, rhp,
+				   atomic_long_read(&rdp->nocb_q_count_lazy),
+				   atomic_long_read(&rdp->nocb_q_count));
+
+	/* The kthread only sleeps when the list is empty. */
+	if (old_rhpp == &rdp->nocb_head) {
+		rdp->n_nocb_wakes++;
+		wake_up(&rdp->nocb_wq);
+	}
+	return true;
+}
+
+struct rcu_nocb_gp {
+	struct rcu_head head;
+	struct completion done;
+};
+
+static void rcu_nocb_gp_done(struct rcu_head *head)
+{
+	complete(&container_of(head, struct rcu_nocb_gp, head)->done);
+}
+
+/*
+ * Wait for a grace period of @rsp.  The callback must not go through
+ * __call_rcu_nocb(), or an rcuo kthread running on a no-CBs CPU would
+ * end up waiting on its own queue.
+ */
+static void rcu_nocb_wait_gp(struct rcu_state *rsp)
+{
+	struct rcu_nocb_gp gp;
+
+	init_rcu_head_on_stack(&gp.head);
+	init_completion(&gp.done);
+	__call_rcu(&gp.head, rcu_nocb_gp_done, rsp, 0, 1);
+	wait_for_completion(&gp.done);
+	destroy_rcu_head_on_stack(&gp.head);
+}
+
+static int rcu_nocb_kthread(void *arg)
+{
+	struct rcu_data *rdp = arg;
+	struct rcu_head *list, *next, **tail;
+	long c, cl;
+	u64 enq_time, lat;
+
+	for (;;) {
+		wait_event_interruptible(rdp->nocb_wq,
+					 ACCESS_ONCE(rdp->nocb_head));
+		list = ACCESS_ONCE(rdp->nocb_head);
+		if (!list)
+			continue;
+		smp_rmb(); /* List before nocb_enq_time. */
+		enq_time = rdp->nocb_enq_time;
+
+		/* Take the whole list, later CBs start a new one. */
+		ACCESS_ONCE(rdp->nocb_head) = NULL;
+		tail = xchg(&rdp->nocb_tail, &rdp->nocb_head);
+		c = atomic_long_xchg(&rdp->nocb_q_count, 0);
+		cl = atomic_long_xchg(&rdp->nocb_q_count_lazy, 0);
+		ACCESS_ONCE(rdp->nocb_p_count) += c;
+		ACCESS_ONCE(rdp->nocb_p_count_lazy) += cl;
+
+		rcu_nocb_wait_gp(rdp->rsp);
+
+		lat = local_clock() - enq_time;
+		trace_rcu_batch_start(rdp->rsp->name, cl, c, -1);
+		c = cl = 0;
+		while (list) {
+			next = list->next;
+			/* An enqueuer may not have linked its CB in yet. */
+			while (next == NULL && &list->next != tail) {
+				schedule_timeout_interruptible(1);
+				next = list->next;
+			}
+			debug_rcu_head_unqueue(list);
+			local_bh_disable();
+			if (__rcu_reclaim(rdp->rsp->name, list))
+				cl++;
+			c++;
+			local_bh_enable();
+			list = next;
+		}
+		trace_rcu_batch_end(rdp->rsp->name, c, !!list, 0, 0, 1);
+
+		ACCESS_ONCE(rdp->nocb_p_count) -= c;
+		ACCESS_ONCE(rdp->nocb_p_count_lazy) -= cl;
+		rdp->n_nocbs_invoked += c;
+		rdp->n_nocb_batches++;
+		rdp->nocb_lat_total += lat;
+		if (lat > rdp->nocb_lat_max)
+			rdp->nocb_lat_max = lat;
+	}
+	return 0;
+}
+
+static void __init rcu_spawn_nocb_kthreads(struct rcu_state *rsp, char abbr)
+{
+	int cpu;
+	struct rcu_data *rdp;
+	struct task_struct *t;
+
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		rdp = per_cpu_ptr(rsp->rda, cpu);
+		t = kthread_run(rcu_nocb_kthread, rdp, "rcuo%c/%d", abbr, cpu);
+		if (IS_ERR(t)) {
+			printk(KERN_ERR "RCU: no rcuo%c kthread for CPU %d, "
+			       "callbacks stay in softirq\n", abbr, cpu);
+			continue;
+		}
+		ACCESS_ONCE(rdp->nocb_kthread) = t;
+	}
+}
+
+static int __init rcu_nocb_init(void)
+{
+	char buf[64];
+
+	if (!have_rcu_nocb_mask)
+		return 0;
+
+	cpumask_and(rcu_nocb_mask, cpu_possible_mask, rcu_nocb_mask);
+	if (cpumask_empty(rcu_nocb_mask))
+		return 0;
+	cpulist_scnprintf(buf, sizeof(buf), rcu_nocb_mask);
+	printk(KERN_INFO "\tOffload RCU callbacks from CPUs: %s.\n", buf);
+
+#ifdef CONFIG_TREE_PREEMPT_RCU
+	rcu_spawn_nocb_kthreads(&rcu_preempt_state, 'p');
+#endif
+	rcu_spawn_nocb_kthreads(&rcu_sched_state, 's');
+	rcu_spawn_nocb_kthreads(&rcu_bh_state, 'b');
+	return 0;
+}
+early_initcall(rcu_nocb_init);
+
+static void rcu_nocb_barrier_note(int cpu)
+{
+	if (have_rcu_nocb_mask && cpumask_test_cpu(cpu, rcu_nocb_mask))
+		cpumask_set_cpu(cpu, &rcu_nocb_barrier_done);
+}
+
+/*
+ * rcu_barrier() only IPIs online CPUs, but the rcuo kthread of an
+ * offline no-CBs CPU may still hold callbacks.  Queue the barrier
+ * callback directly on every no-CBs CPU that rcu_barrier_func() did
+ * not run on.  Called with rcu_barrier_mutex held.
+ */
+static void rcu_nocb_barrier(struct rcu_state *rsp)
+{
+	int cpu;
+	unsigned long flags;
+	struct rcu_data *rdp;
+	struct rcu_head *head;
+
+	if (!have_rcu_nocb_mask)
+		return;
+
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		if (cpumask_test_cpu(cpu, &rcu_nocb_barrier_done))
+			continue;
+		rdp = per_cpu_ptr(rsp->rda, cpu);
+		head = &per_cpu(rcu_barrier_head, cpu);
+		debug_rcu_head_queue(head);
+		head->func = rcu_barrier_callback;
+		head->next = NULL;
+		atomic_inc(&rcu_barrier_cpu_count);
+		local_irq_save(flags);
+		if (!__call_rcu_nocb(rdp, head, 0))
+			atomic_dec(&rcu_barrier_cpu_count);
+		local_irq_restore(flags);
+	}
+	cpumask_clear(&rcu_nocb_barrier_done);
+}
+
+#else /* #ifdef CONFIG_RCU_NOCB_CPU */
+
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+}
+
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    bool lazy)
+{
+	return false;
+}
+
+static void rcu_nocb_barrier_note(int cpu)
+{
+}
+
+static void rcu_nocb_barrier(struct rcu_state *rsp)
+{
+}
+
+#endif /* #else #ifdef CONFIG_RCU_NOCB_CPU */
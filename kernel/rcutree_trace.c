@@ -443,6 +443,91 @@ static const struct file_operations rcutorture_fops = {
 	.release = single_release,
 };
 
+#ifdef CONFIG_RCU_NOCB_CPU
+
+static void print_one_rcu_nocb(struct seq_file *m, struct rcu_data *rdp)
+{
+	u64 avg = 0, max = rdp->nocb_lat_max;
+
+	if (rdp->n_nocb_batches) {
+		avg = rdp->nocb_lat_total;
+		do_div(avg, rdp->n_nocb_batches);
+	}
+	do_div(avg, NSEC_PER_USEC);
+	do_div(max, NSEC_PER_USEC);
+	seq_printf(m, "%3d%c q=%ld/%ld p=%ld/%ld w=%lu b=%lu ci=%lu "
+		   "lat=%llu/%llu\n",
+		   rdp->cpu,
+		   cpu_is_offline(rdp->cpu) ? '!' : ' ',
+		   atomic_long_read(&rdp->nocb_q_count_lazy),
+		   atomic_long_read(&rdp->nocb_q_count),
+		   ACCESS_ONCE(rdp->nocb_p_count_lazy),
+		   ACCESS_ONCE(rdp->nocb_p_count),
+		   rdp->n_nocb_wakes,
+		   rdp->n_nocb_batches,
+		   rdp->n_nocbs_invoked,
+		   (unsigned long long)avg,
+		   (unsigned long long)max);
+}
+
+static void print_rcu_nocbs(struct seq_file *m, struct rcu_state *rsp)
+{
+	int cpu;
+	struct rcu_data *rdp;
+
+	for_each_possible_cpu(cpu) {
+		rdp = per_cpu_ptr(rsp->rda, cpu);
+		if (rdp->nocb_kthread)
+			print_one_rcu_nocb(m, rdp);
+	}
+}
+
+static int show_rcu_nocb(struct seq_file *m, void *unused)
+{
+#ifdef CONFIG_TREE_PREEMPT_RCU
+	seq_puts(m, "rcu_preempt:\n");
+	print_rcu_nocbs(m, &rcu_preempt_state);
+#endif /* #ifdef CONFIG_TREE_PREEMPT_RCU */
+	seq_puts(m, "rcu_sched:\n");
+	print_rcu_nocbs(m, &rcu_sched_state);
+	seq_puts(m, "rcu_bh:\n");
+	print_rcu_nocbs(m, &rcu_bh_state);
+	return 0;
+}
+
+static int rcu_nocb_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, show_rcu_nocb, NULL);
+}
+
+static const struct file_operations rcu_nocb_fops = {
+	.owner = THIS_MODULE,
+	.open = rcu_nocb_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/*
+ * Create the rcunocb debugfs entry: per no-CBs CPU, queued and in-flight
+ * callbacks (lazy/total), kthread wakeups, batches, callbacks invoked,
+ * and average/max enqueue-to-invoke latency in microseconds.
+ */
+static int rcu_nocb_trace_create_file(struct dentry *rcudir)
+{
+	return !debugfs_create_file("rcunocb", 0444, rcudir, NULL,
+				    &rcu_nocb_fops);
+}
+
+#else /* #ifdef CONFIG_RCU_NOCB_CPU */
+
+static int rcu_nocb_trace_create_file(struct dentry *rcudir)
+{
+	return 0;
+}
+
+#endif /* #else #ifdef CONFIG_RCU_NOCB_CPU */
+
 static struct dentry *rcudir;
 
 static int __init rcutree_trace_init(void)
@@ -466,6 +551,9 @@ static int __init rcutree_trace_init(void)
 	if (rcu_boost_trace_create_file(rcudir))
 		goto free_out;
 
+	if (rcu_nocb_trace_create_file(rcudir))
+		goto free_out;
+
 	retval = debugfs_create_file("rcugp", 0444, rcudir, NULL, &rcugp_fops);
 	if (!retval)
 		goto free_out;
@@ -69,6 +69,9 @@
 #ifdef CONFIG_LOCKUP_DETECTOR
 #include <linux/nmi.h>
 #endif
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+#include <linux/futex.h>
+#endif
 
 
 #if defined(CONFIG_SYSCTL)
@@ -110,6 +113,9 @@ static int one_hundred = 100;
 #ifdef CONFIG_PRINTK
 static int ten_thousand = 10000;
 #endif
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+static int futex_private_hash_max = 4096;
+#endif
 
 static unsigned long dirty_bytes_min = 2 * PAGE_SIZE;
 
@@ -828,6 +834,17 @@ static struct ctl_table kern_table[] = {
 		.proc_handler	= proc_dointvec,
 	},
 #endif
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+	{
+		.procname	= "futex_private_hash_size",
+		.data		= &futex_private_hash_size,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &zero,
+		.extra2		= &futex_private_hash_max,
+	},
+#endif
 #if defined(CONFIG_S390) && defined(CONFIG_SMP)
 	{
 		.procname	= "spin_retry",
@@ -5,6 +5,7 @@
  */
 #include <linux/ring_buffer.h>
 #include <linux/trace_clock.h>
+#include <linux/trace_mmap.h>
 #include <linux/spinlock.h>
 #include <linux/debugfs.h>
 #include <linux/uaccess.h>
@@ -19,6 +20,7 @@
 #include <linux/list.h>
 #include <linux/cpu.h>
 #include <linux/fs.h>
+#include <linux/mm.h>
 
 #include <asm/local.h>
 #include "trace.h"
@@ -210,6 +212,7 @@ struct buffer_page {
 	unsigned	 read;		
 	local_t		 entries;	
 	unsigned long	 real_end;	
+	unsigned	 id;		/* sub-buffer id while mapped */
 	struct buffer_data_page *page;	
 };
 
@@ -299,6 +302,12 @@ struct ring_buffer_per_cpu {
 	unsigned long			read_bytes;
 	u64				write_stamp;
 	u64				read_stamp;
+	/* userspace mapping, protected by buffer->mutex */
+	unsigned			mapped;
+	/* open iterators, protected by reader_lock */
+	unsigned			nr_iters;
+	struct trace_buffer_meta	*meta_page;
+	unsigned long			*subbuf_ids;
 };
 
 struct ring_buffer {
@@ -956,6 +965,16 @@ int ring_buffer_resize(struct ring_buffer *buffer, unsigned long size)
 	mutex_lock(&buffer->mutex);
 	get_online_cpus();
 
+	/* the mapped sub-buffer ids cover a fixed set of pages */
+	for_each_buffer_cpu(buffer, cpu) {
+		if (buffer->buffers[cpu]->mapped) {
+			put_online_cpus();
+			mutex_unlock(&buffer->mutex);
+			atomic_dec(&buffer->record_disabled);
+			return -EBUSY;
+		}
+	}
+
 	nr_pages = DIV_ROUND_UP(size, BUF_PAGE_SIZE);
 
 	if (size < buffer_size) {
@@ -2489,10 +2508,13 @@ ring_buffer_peek(struct ring_buffer *buffer, int cpu, u64 *ts,
 
 	dolock = rb_ok_to_lock();
  again:
+	event = NULL;
 	local_irq_save(flags);
 	if (dolock)
 		raw_spin_lock(&cpu_buffer->reader_lock);
-	event = rb_buffer_peek(cpu_buffer, ts, lost_events);
+	/* peeking would swap the reader page behind the mapping */
+	if (!cpu_buffer->mapped)
+		event = rb_buffer_peek(cpu_buffer, ts, lost_events);
 	if (event && event->type_len == RINGBUF_TYPE_PADDING)
 		rb_advance_reader(cpu_buffer);
 	if (dolock)
@@ -2535,7 +2557,7 @@ ring_buffer_consume(struct ring_buffer *buffer, int cpu, u64 *ts,
 	dolock = rb_ok_to_lock();
 
  again:
-	
+	event = NULL;
 	preempt_disable();
 
 	if (!cpumask_test_cpu(cpu, buffer->cpumask))
@@ -2546,7 +2568,9 @@ ring_buffer_consume(struct ring_buffer *buffer, int cpu, u64 *ts,
 	if (dolock)
 		raw_spin_lock(&cpu_buffer->reader_lock);
 
-	event = rb_buffer_peek(cpu_buffer, ts, lost_events);
+	/* a mapped buffer is consumed through the reader sub-buffer */
+	if (!cpu_buffer->mapped)
+		event = rb_buffer_peek(cpu_buffer, ts, lost_events);
 	if (event) {
 		cpu_buffer->lost_events = 0;
 		rb_advance_reader(cpu_buffer);
@@ -2571,6 +2595,7 @@ ring_buffer_read_prepare(struct ring_buffer *buffer, int cpu)
 {
 	struct ring_buffer_per_cpu *cpu_buffer;
 	struct ring_buffer_iter *iter;
+	unsigned long flags;
 
 	if (!cpumask_test_cpu(cpu, buffer->cpumask))
 		return NULL;
@@ -2581,6 +2606,16 @@ ring_buffer_read_prepare(struct ring_buffer *buffer, int cpu)
 
 	cpu_buffer = buffer->buffers[cpu];
 
+	/* a mapped buffer is only read through its reader sub-buffer */
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	if (cpu_buffer->mapped) {
+		raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+		kfree(iter);
+		return NULL;
+	}
+	cpu_buffer->nr_iters++;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
 	iter->cpu_buffer = cpu_buffer;
 
 	atomic_inc(&cpu_buffer->record_disabled);
@@ -2619,6 +2654,11 @@ void
 ring_buffer_read_finish(struct ring_buffer_iter *iter)
 {
 	struct ring_buffer_per_cpu *cpu_buffer = iter->cpu_buffer;
+	unsigned long flags;
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	cpu_buffer->nr_iters--;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
 
 	atomic_dec(&cpu_buffer->record_disabled);
 	kfree(iter);
@@ -2748,7 +2788,7 @@ int ring_buffer_empty(struct ring_buffer *buffer)
 		local_irq_save(flags);
 		if (dolock)
 			raw_spin_lock(&cpu_buffer->reader_lock);
-		ret = rb_per_cpu_empty(cpu_buffer);
+		ret = cpu_buffer->mapped || rb_per_cpu_empty(cpu_buffer);
 		if (dolock)
 			raw_spin_unlock(&cpu_buffer->reader_lock);
 		local_irq_restore(flags);
@@ -2777,7 +2817,8 @@ int ring_buffer_empty_cpu(struct ring_buffer *buffer, int cpu)
 	local_irq_save(flags);
 	if (dolock)
 		raw_spin_lock(&cpu_buffer->reader_lock);
-	ret = rb_per_cpu_empty(cpu_buffer);
+	/* nothing is left for peek/consume readers while mapped */
+	ret = cpu_buffer->mapped || rb_per_cpu_empty(cpu_buffer);
 	if (dolock)
 		raw_spin_unlock(&cpu_buffer->reader_lock);
 	local_irq_restore(flags);
@@ -2802,6 +2843,10 @@ int ring_buffer_swap_cpu(struct ring_buffer *buffer_a,
 	if (buffer_a->pages != buffer_b->pages)
 		goto out;
 
+	ret = -EBUSY;
+	if (cpu_buffer_a->mapped || cpu_buffer_b->mapped)
+		goto out;
+
 	ret = -EAGAIN;
 
 	if (ring_buffer_flags != RB_BUFFERS_ON)
@@ -2903,6 +2948,10 @@ int ring_buffer_read_page(struct ring_buffer *buffer,
 
 	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
 
+	/* swapping pages out would break the sub-buffer ids */
+	if (cpu_buffer->mapped)
+		goto out_unlock;
+
 	reader = rb_get_reader_page(cpu_buffer);
 	if (!reader)
 		goto out_unlock;
@@ -3005,6 +3054,246 @@ int ring_buffer_read_page(struct ring_buffer *buffer,
 }
 EXPORT_SYMBOL_GPL(ring_buffer_read_page);
 
+static void rb_update_meta_page(struct ring_buffer_per_cpu *cpu_buffer)
+{
+	struct trace_buffer_meta *meta = cpu_buffer->meta_page;
+
+	meta->entries = local_read(&cpu_buffer->entries);
+	meta->overrun = local_read(&cpu_buffer->overrun);
+	meta->read = cpu_buffer->read;
+}
+
+/* call with reader_lock held */
+static void rb_setup_ids_meta_page(struct ring_buffer_per_cpu *cpu_buffer)
+{
+	struct trace_buffer_meta *meta = cpu_buffer->meta_page;
+	struct buffer_page *bpage = cpu_buffer->reader_page;
+	struct list_head *p = cpu_buffer->pages;
+	unsigned id = 0;
+
+	bpage->id = id;
+	cpu_buffer->subbuf_ids[id++] = (unsigned long)bpage->page;
+
+	do {
+		bpage = list_entry(p, struct buffer_page, list);
+		bpage->id = id;
+		cpu_buffer->subbuf_ids[id++] = (unsigned long)bpage->page;
+		p = rb_list_head(p->next);
+	} while (p != cpu_buffer->pages);
+
+	meta->meta_page_size = PAGE_SIZE;
+	meta->meta_struct_len = sizeof(*meta);
+	meta->subbuf_size = PAGE_SIZE;
+	meta->nr_subbufs = id;
+	meta->reader.id = cpu_buffer->reader_page->id;
+	meta->reader.read = cpu_buffer->reader_page->read;
+	meta->reader.commit = cpu_buffer->reader_page->read;
+	rb_update_meta_page(cpu_buffer);
+}
+
+/**
+ * ring_buffer_map - prepare a cpu buffer to be mapped to userspace
+ * @buffer: the buffer
+ * @cpu: the cpu buffer
+ *
+ * Mappings nest.  While a cpu buffer is mapped it cannot be resized
+ * or swapped and it is only consumed via ring_buffer_map_get_reader():
+ * peek and consume see it as empty and no iterators can be started.
+ * Returns -EBUSY if an iterator is already open on it.
+ */
+int ring_buffer_map(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct trace_buffer_meta *meta;
+	unsigned long *ids;
+	unsigned long flags;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&buffer->mutex);
+	if (cpu_buffer->mapped) {
+		cpu_buffer->mapped++;
+		mutex_unlock(&buffer->mutex);
+		return 0;
+	}
+
+	meta = (void *)get_zeroed_page(GFP_KERNEL);
+	ids = kcalloc(buffer->pages + 1, sizeof(*ids), GFP_KERNEL);
+	if (!meta || !ids) {
+		free_page((unsigned long)meta);
+		kfree(ids);
+		mutex_unlock(&buffer->mutex);
+		return -ENOMEM;
+	}
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	if (cpu_buffer->nr_iters) {
+		raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+		free_page((unsigned long)meta);
+		kfree(ids);
+		mutex_unlock(&buffer->mutex);
+		return -EBUSY;
+	}
+	cpu_buffer->meta_page = meta;
+	cpu_buffer->subbuf_ids = ids;
+	rb_setup_ids_meta_page(cpu_buffer);
+	cpu_buffer->mapped = 1;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	mutex_unlock(&buffer->mutex);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map);
+
+int ring_buffer_unmap(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct trace_buffer_meta *meta = NULL;
+	unsigned long *ids = NULL;
+	unsigned long flags;
+	int ret = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&buffer->mutex);
+	if (!cpu_buffer->mapped) {
+		ret = -ENODEV;
+		goto out;
+	}
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	if (!--cpu_buffer->mapped) {
+		meta = cpu_buffer->meta_page;
+		ids = cpu_buffer->subbuf_ids;
+		cpu_buffer->meta_page = NULL;
+		cpu_buffer->subbuf_ids = NULL;
+	}
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	free_page((unsigned long)meta);
+	kfree(ids);
+out:
+	mutex_unlock(&buffer->mutex);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_unmap);
+
+/**
+ * ring_buffer_map_pages - insert the meta page and sub-buffers into a vma
+ * @buffer: the buffer
+ * @cpu: the mapped cpu buffer
+ * @vma: the vma, starting at offset 0
+ */
+int ring_buffer_map_pages(struct ring_buffer *buffer, int cpu,
+			  struct vm_area_struct *vma)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	unsigned long addr = vma->vm_start;
+	unsigned long nr = vma_pages(vma);
+	unsigned i;
+	int ret;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&buffer->mutex);
+	ret = -ENODEV;
+	if (!cpu_buffer->mapped)
+		goto out;
+
+	ret = -EINVAL;
+	if (vma->vm_pgoff || nr > cpu_buffer->meta_page->nr_subbufs + 1)
+		goto out;
+
+	ret = vm_insert_page(vma, addr, virt_to_page(cpu_buffer->meta_page));
+	for (i = 0; !ret && i < nr - 1; i++) {
+		addr += PAGE_SIZE;
+		ret = vm_insert_page(vma, addr,
+			virt_to_page((void *)cpu_buffer->subbuf_ids[i]));
+	}
+out:
+	mutex_unlock(&buffer->mutex);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_pages);
+
+/**
+ * ring_buffer_map_get_reader - hand the next reader sub-buffer out
+ * @buffer: the buffer
+ * @cpu: the mapped cpu buffer
+ * @page: if not NULL, set to the kernel address of the reader sub-buffer
+ *
+ * The previous reader sub-buffer goes back to the writer, so the
+ * caller must be done with it.  The events handed out are accounted
+ * as read; the meta page tells where they are.
+ */
+int ring_buffer_map_get_reader(struct ring_buffer *buffer, int cpu,
+			       void **page)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct trace_buffer_meta *meta;
+	struct buffer_page *reader;
+	unsigned long flags;
+	unsigned commit;
+	int ret = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	if (!cpu_buffer->mapped) {
+		ret = -ENODEV;
+		goto out;
+	}
+
+	meta = cpu_buffer->meta_page;
+	reader = rb_get_reader_page(cpu_buffer);
+	if (reader) {
+		meta->reader.id = reader->id;
+		meta->reader.read = reader->read;
+		meta->reader.lost_events = cpu_buffer->lost_events;
+		cpu_buffer->lost_events = 0;
+
+		/* the writer may still be on this page, stop at a snapshot */
+		commit = rb_page_size(reader);
+		while (reader->read < commit)
+			rb_advance_reader(cpu_buffer);
+		meta->reader.commit = reader->read;
+	} else {
+		reader = cpu_buffer->reader_page;
+		meta->reader.read = reader->read;
+		meta->reader.commit = reader->read;
+	}
+	rb_update_meta_page(cpu_buffer);
+
+	if (page)
+		*page = reader->page;
+out:
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_get_reader);
+
+struct trace_buffer_meta *ring_buffer_map_meta(struct ring_buffer *buffer,
+					       int cpu)
+{
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return NULL;
+
+	return buffer->buffers[cpu]->meta_page;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_meta);
+
 #ifdef CONFIG_HOTPLUG_CPU
 static int rb_cpu_notify(struct notifier_block *self,
 			 unsigned long action, void *hcpu)
@@ -4,10 +4,12 @@
  * Copyright (C) 2009 Steven Rostedt <srostedt@redhat.com>
  */
 #include <linux/ring_buffer.h>
+#include <linux/trace_mmap.h>
 #include <linux/completion.h>
 #include <linux/kthread.h>
 #include <linux/module.h>
 #include <linux/time.h>
+#include <linux/ktime.h>
 #include <asm/local.h>
 
 struct rb_page {
@@ -31,6 +33,8 @@ static struct ring_buffer *buffer;
 static struct task_struct *producer;
 static struct task_struct *consumer;
 static unsigned long read;
+/* time the consumer spent reading, in nanosecs */
+static u64 read_ns;
 
 static int disable_reader;
 module_param(disable_reader, uint, 0644);
@@ -58,7 +62,20 @@ MODULE_PARM_DESC(producer_fifo, "fifo prio for producer");
 module_param(consumer_fifo, uint, 0644);
 MODULE_PARM_DESC(consumer_fifo, "fifo prio for consumer");
 
-static int read_events;
+enum read_mode {
+	READ_EVENTS,
+	READ_PAGES,
+	READ_MAPPED,
+	READ_MODES,
+};
+
+static const char *read_mode_names[READ_MODES] = {
+	[READ_EVENTS]	= "events",
+	[READ_PAGES]	= "pages",
+	[READ_MAPPED]	= "mapped pages",
+};
+
+static int read_mode = READ_MODES - 1;
 
 static int kill_test;
 
@@ -95,76 +112,81 @@ static enum event_status read_event(int cpu)
 	return EVENT_FOUND;
 }
 
-static enum event_status read_page(int cpu)
+static void read_rpage(struct rb_page *rpage, int start,
+		       unsigned long commit, int cpu)
 {
 	struct ring_buffer_event *event;
-	struct rb_page *rpage;
-	unsigned long commit;
-	void *bpage;
 	int *entry;
-	int ret;
 	int inc;
 	int i;
 
-	bpage = ring_buffer_alloc_read_page(buffer, cpu);
-	if (!bpage)
-		return EVENT_DROPPED;
+	for (i = start; i < commit && !kill_test; i += inc) {
 
-	ret = ring_buffer_read_page(buffer, &bpage, PAGE_SIZE, cpu, 1);
-	if (ret >= 0) {
-		rpage = bpage;
-		/* The commit may have missed event flags set, clear them */
-		commit = local_read(&rpage->commit) & 0xfffff;
-		for (i = 0; i < commit && !kill_test; i += inc) {
+		if (i >= (PAGE_SIZE - offsetof(struct rb_page, data))) {
+			KILL_TEST();
+			break;
+		}
 
-			if (i >= (PAGE_SIZE - offsetof(struct rb_page, data))) {
+		inc = -1;
+		event = (void *)&rpage->data[i];
+		switch (event->type_len) {
+		case RINGBUF_TYPE_PADDING:
+			/* failed writes may be discarded events */
+			if (!event->time_delta)
+				KILL_TEST();
+			inc = event->array[0] + 4;
+			break;
+		case RINGBUF_TYPE_TIME_EXTEND:
+			inc = 8;
+			break;
+		case 0:
+			entry = ring_buffer_event_data(event);
+			if (*entry != cpu) {
 				KILL_TEST();
 				break;
 			}
-
-			inc = -1;
-			event = (void *)&rpage->data[i];
-			switch (event->type_len) {
-			case RINGBUF_TYPE_PADDING:
-				/* failed writes may be discarded events */
-				if (!event->time_delta)
-					KILL_TEST();
-				inc = event->array[0] + 4;
-				break;
-			case RINGBUF_TYPE_TIME_EXTEND:
-				inc = 8;
-				break;
-			case 0:
-				entry = ring_buffer_event_data(event);
-				if (*entry != cpu) {
-					KILL_TEST();
-					break;
-				}
-				read++;
-				if (!event->array[0]) {
-					KILL_TEST();
-					break;
-				}
-				inc = event->array[0] + 4;
+			read++;
+			if (!event->array[0]) {
+				KILL_TEST();
 				break;
-			default:
-				entry = ring_buffer_event_data(event);
-				if (*entry != cpu) {
-					KILL_TEST();
-					break;
-				}
-				read++;
-				inc = ((event->type_len + 1) * 4);
 			}
-			if (kill_test)
-				break;
-
-			if (inc <= 0) {
+			inc = event->array[0] + 4;
+			break;
+		default:
+			entry = ring_buffer_event_data(event);
+			if (*entry != cpu) {
 				KILL_TEST();
 				break;
 			}
+			read++;
+			inc = ((event->type_len + 1) * 4);
+		}
+		if (kill_test)
+			break;
+
+		if (inc <= 0) {
+			KILL_TEST();
+			break;
 		}
 	}
+}
+
+static enum event_status read_page(int cpu)
+{
+	struct rb_page *rpage;
+	void *bpage;
+	int ret;
+
+	bpage = ring_buffer_alloc_read_page(buffer, cpu);
+	if (!bpage)
+		return EVENT_DROPPED;
+
+	ret = ring_buffer_read_page(buffer, &bpage, PAGE_SIZE, cpu, 1);
+	if (ret >= 0) {
+		rpage = bpage;
+		/* The commit may have missed event flags set, clear them */
+		read_rpage(rpage, 0, local_read(&rpage->commit) & 0xfffff, cpu);
+	}
 	ring_buffer_free_read_page(buffer, bpage);
 
 	if (ret < 0)
@@ -172,26 +194,57 @@ static enum event_status read_page(int cpu)
 	return EVENT_FOUND;
 }
 
+/* Read the reader sub-buffer in place, as an mmap reader would */
+static enum event_status read_mapped(int cpu)
+{
+	struct trace_buffer_meta *meta;
+	void *bpage;
+
+	if (ring_buffer_map_get_reader(buffer, cpu, &bpage))
+		return EVENT_DROPPED;
+
+	meta = ring_buffer_map_meta(buffer, cpu);
+	if (meta->reader.read == meta->reader.commit)
+		return EVENT_DROPPED;
+
+	read_rpage(bpage, meta->reader.read, meta->reader.commit, cpu);
+	return EVENT_FOUND;
+}
+
 static void ring_buffer_consumer(void)
 {
-	/* toggle between reading pages and events */
-	read_events ^= 1;
+	int cpu;
+
+	/* cycle between reading events, pages and mapped pages */
+	if (++read_mode == READ_MODES)
+		read_mode = READ_EVENTS;
+
+	if (read_mode == READ_MAPPED) {
+		for_each_online_cpu(cpu) {
+			if (ring_buffer_map(buffer, cpu)) {
+				KILL_TEST();
+				break;
+			}
+		}
+	}
 
 	read = 0;
+	read_ns = 0;
 	while (!reader_finish && !kill_test) {
+		ktime_t start = ktime_get();
 		int found;
 
 		do {
-			int cpu;
-
 			found = 0;
 			for_each_online_cpu(cpu) {
 				enum event_status stat;
 
-				if (read_events)
+				if (read_mode == READ_EVENTS)
 					stat = read_event(cpu);
-				else
+				else if (read_mode == READ_PAGES)
 					stat = read_page(cpu);
+				else
+					stat = read_mapped(cpu);
 
 				if (kill_test)
 					break;
@@ -200,6 +253,8 @@ static void ring_buffer_consumer(void)
 			}
 		} while (found && !kill_test);
 
+		read_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+
 		set_current_state(TASK_INTERRUPTIBLE);
 		if (reader_finish)
 			break;
@@ -207,6 +262,12 @@ static void ring_buffer_consumer(void)
 		schedule();
 		__set_current_state(TASK_RUNNING);
 	}
+
+	if (read_mode == READ_MAPPED) {
+		for_each_online_cpu(cpu)
+			ring_buffer_unmap(buffer, cpu);
+	}
+
 	reader_finish = 0;
 	complete(&read_done);
 }
@@ -317,12 +378,20 @@ static void ring_buffer_producer(void)
 		trace_printk("Read:     (reader disabled)\n");
 	else
 		trace_printk("Read:     %ld  (by %s)\n", read,
-			read_events ? "events" : "pages");
+			read_mode_names[read_mode]);
 	trace_printk("Entries:  %lld\n", entries);
 	trace_printk("Total:    %lld\n", entries + overruns + read);
 	trace_printk("Missed:   %ld\n", missed);
 	trace_printk("Hit:      %ld\n", hit);
 
+	if (!disable_reader && read) {
+		/* consumer overhead, comparable across the read modes */
+		do_div(read_ns, read);
+		trace_printk("%lld ns per entry read (by %s)\n",
+			     (unsigned long long)read_ns,
+			     read_mode_names[read_mode]);
+	}
+
 	/* Convert time from usecs to millisecs */
 	do_div(time, USEC_PER_MSEC);
 	if (time)
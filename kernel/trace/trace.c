@@ -12,6 +12,7 @@
  *  Copyright (C) 2004 William Lee Irwin III
  */
 #include <linux/ring_buffer.h>
+#include <linux/trace_mmap.h>
 #include <generated/utsrelease.h>
 #include <linux/stacktrace.h>
 #include <linux/writeback.h>
@@ -2805,6 +2806,18 @@ static int tracing_set_tracer(const char *buf)
 	if (t == current_trace)
 		goto out;
 
+	/* max buffer swaps would pull pages out from under a mapping */
+	if (t->use_max_tr) {
+		int cpu;
+
+		for_each_tracing_cpu(cpu) {
+			if (ring_buffer_map_meta(global_trace.buffer, cpu)) {
+				ret = -EBUSY;
+				goto out;
+			}
+		}
+	}
+
 	trace_branch_disable();
 
 	current_trace->enabled = false;
@@ -3835,11 +3848,85 @@ out:
 	return ret;
 }
 
+static long tracing_buffers_ioctl(struct file *file, unsigned int cmd,
+				  unsigned long arg)
+{
+	struct ftrace_buffer_info *info = file->private_data;
+	int ret;
+
+	if (cmd != TRACE_MMAP_IOCTL_GET_READER)
+		return -ENOTTY;
+
+	trace_access_lock(info->cpu);
+	ret = ring_buffer_map_get_reader(info->tr->buffer, info->cpu, NULL);
+	trace_access_unlock(info->cpu);
+
+	return ret;
+}
+
+static void tracing_buffers_mmap_open(struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+
+	WARN_ON(ring_buffer_map(info->tr->buffer, info->cpu));
+}
+
+static void tracing_buffers_mmap_close(struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+
+	WARN_ON(ring_buffer_unmap(info->tr->buffer, info->cpu));
+}
+
+static const struct vm_operations_struct tracing_buffers_vmops = {
+	.open		= tracing_buffers_mmap_open,
+	.close		= tracing_buffers_mmap_close,
+};
+
+/*
+ * Map the meta page followed by the cpu buffer's sub-buffers read-only.
+ * Tracers that swap in the max buffer would pull the pages out from
+ * under the mapping, so they are refused.
+ */
+static int tracing_buffers_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = filp->private_data;
+	int ret;
+
+	if (info->cpu == TRACE_PIPE_ALL_CPU)
+		return -EINVAL;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	mutex_lock(&trace_types_lock);
+	if (current_trace && current_trace->use_max_tr) {
+		mutex_unlock(&trace_types_lock);
+		return -EBUSY;
+	}
+
+	vma->vm_flags &= ~VM_MAYWRITE;
+	vma->vm_flags |= VM_RESERVED | VM_DONTEXPAND;
+	vma->vm_ops = &tracing_buffers_vmops;
+
+	ret = ring_buffer_map(info->tr->buffer, info->cpu);
+	if (!ret) {
+		ret = ring_buffer_map_pages(info->tr->buffer, info->cpu, vma);
+		if (ret)
+			ring_buffer_unmap(info->tr->buffer, info->cpu);
+	}
+	mutex_unlock(&trace_types_lock);
+
+	return ret;
+}
+
 static const struct file_operations tracing_buffers_fops = {
 	.open		= tracing_buffers_open,
 	.read		= tracing_buffers_read,
 	.release	= tracing_buffers_release,
 	.splice_read	= tracing_buffers_splice_read,
+	.unlocked_ioctl	= tracing_buffers_ioctl,
+	.mmap		= tracing_buffers_mmap,
 	.llseek		= no_llseek,
 };
 
@@ -1264,6 +1264,9 @@ struct sock *sk_clone_lock(const struct sock *sk, const gfp_t priority)
 				af_family_clock_key_strings[newsk->sk_family]);
 
 		newsk->sk_dst_cache	= NULL;
+#if IS_ENABLED(CONFIG_NETFILTER_XT_MATCH_QTAGUID)
+		RCU_INIT_POINTER(newsk->sk_qtaguid_tag, NULL);
+#endif
 		newsk->sk_wmem_queued	= 0;
 		newsk->sk_forward_alloc = 0;
 		newsk->sk_send_head	= NULL;
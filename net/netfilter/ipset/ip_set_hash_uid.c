@@ -0,0 +1,330 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/* Kernel module implementing an IP set type: the hash:uid type
+ *
+ * The elements are the owner uids of local sockets, so that a single
+ * "-m set --match-set <set> src" rule can replace a chain of per-uid
+ * "-m owner --uid-owner" rules. Like the owner match, it only sees
+ * packets which carry a local socket (OUTPUT and POSTROUTING).
+ *
+ * The stock ipset(8) tool does not know this type, so userspace talks
+ * to it over NFNL_SUBSYS_IPSET directly. Every message carries
+ * IPSET_ATTR_PROTOCOL and IPSET_ATTR_SETNAME, all u32 payloads are in
+ * network order with NLA_F_NET_BYTEORDER set:
+ *
+ *   IPSET_CMD_CREATE: IPSET_ATTR_TYPENAME "hash:uid", IPSET_ATTR_REVISION
+ *     0, IPSET_ATTR_FAMILY NFPROTO_IPV4 or NFPROTO_IPV6, and a nested
+ *     IPSET_ATTR_DATA with optional HASHSIZE, MAXELEM and TIMEOUT.
+ *   IPSET_CMD_ADD/DEL/TEST: a nested IPSET_ATTR_DATA with IPSET_ATTR_UID,
+ *     plus optional IPSET_ATTR_UID_TO (ADD/DEL only, inclusive range)
+ *     and IPSET_ATTR_TIMEOUT.
+ *
+ * IPSET_CMD_LIST returns a nested IPSET_ATTR_ADT with one IPSET_ATTR_DATA
+ * per element: IPSET_ATTR_UID and, for sets with timeout, the remaining
+ * IPSET_ATTR_TIMEOUT.
+ */
+
+#include <linux/jhash.h>
+#include <linux/module.h>
+#include <linux/skbuff.h>
+#include <linux/errno.h>
+#include <linux/file.h>
+#include <linux/random.h>
+#include <net/netlink.h>
+#include <net/sock.h>
+
+#include <linux/netfilter.h>
+#include <linux/netfilter/ipset/ip_set.h>
+#include <linux/netfilter/ipset/ip_set_timeout.h>
+#include <linux/netfilter/ipset/ip_set_hash.h>
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("hash:uid type of IP sets");
+MODULE_ALIAS("ip_set_hash:uid");
+
+/* Type specific function prefix */
+#define TYPE		hash_uid
+
+static bool
+hash_uid_same_set(const struct ip_set *a, const struct ip_set *b);
+
+#define hash_uid4_same_set	hash_uid_same_set
+
+/* The type variant functions: the key is family independent,
+ * so a single variant serves both inet and inet6 sets. */
+
+/* Member elements without timeout */
+struct hash_uid4_elem {
+	u32 uid;
+};
+
+/* Member elements with timeout support */
+struct hash_uid4_telem {
+	u32 uid;
+	unsigned long timeout;
+};
+
+static inline bool
+hash_uid4_data_equal(const struct hash_uid4_elem *e1,
+		     const struct hash_uid4_elem *e2,
+		     u32 *multi)
+{
+	return e1->uid == e2->uid;
+}
+
+static inline bool
+hash_uid4_data_isnull(const struct hash_uid4_elem *elem)
+{
+	/* uid 0 is a valid member, nothing marks an empty slot */
+	return false;
+}
+
+static inline void
+hash_uid4_data_copy(struct hash_uid4_elem *dst,
+		    const struct hash_uid4_elem *src)
+{
+	dst->uid = src->uid;
+}
+
+static inline void
+hash_uid4_data_zero_out(struct hash_uid4_elem *elem)
+{
+	elem->uid = 0;
+}
+
+static inline bool
+hash_uid4_data_list(struct sk_buff *skb, const struct hash_uid4_elem *data)
+{
+	NLA_PUT_NET32(skb, IPSET_ATTR_UID, htonl(data->uid));
+	return 0;
+
+nla_put_failure:
+	return 1;
+}
+
+static bool
+hash_uid4_data_tlist(struct sk_buff *skb, const struct hash_uid4_elem *data)
+{
+	const struct hash_uid4_telem *tdata =
+		(const struct hash_uid4_telem *)data;
+
+	NLA_PUT_NET32(skb, IPSET_ATTR_UID, htonl(tdata->uid));
+	NLA_PUT_NET32(skb, IPSET_ATTR_TIMEOUT,
+		      htonl(ip_set_timeout_get(tdata->timeout)));
+
+	return 0;
+
+nla_put_failure:
+	return 1;
+}
+
+#define PF		4
+#define HOST_MASK	32
+#include <linux/netfilter/ipset/ip_set_ahash.h>
+
+static inline void
+hash_uid4_data_next(struct ip_set_hash *h, const struct hash_uid4_elem *d)
+{
+	h->next.uid = d->uid;
+}
+
+/* Same socket to file walk as xt_owner */
+static bool
+hash_uid_sk_uid(const struct sk_buff *skb, u32 *uid)
+{
+	const struct sock *sk = skb->sk;
+	const struct file *filp;
+
+	if (sk == NULL || sk->sk_socket == NULL)
+		return false;
+	filp = sk->sk_socket->file;
+	if (filp == NULL)
+		return false;
+	*uid = filp->f_cred->fsuid;
+	return true;
+}
+
+static int
+hash_uid4_kadt(struct ip_set *set, const struct sk_buff *skb,
+	       const struct xt_action_param *par,
+	       enum ipset_adt adt, const struct ip_set_adt_opt *opt)
+{
+	const struct ip_set_hash *h = set->data;
+	ipset_adtfn adtfn = set->variant->adt[adt];
+	struct hash_uid4_elem data;
+
+	if (!hash_uid_sk_uid(skb, &data.uid))
+		return -EINVAL;
+
+	return adtfn(set, &data, opt_timeout(opt, h), opt->cmdflags);
+}
+
+static int
+hash_uid4_uadt(struct ip_set *set, struct nlattr *tb[],
+	       enum ipset_adt adt, u32 *lineno, u32 flags, bool retried)
+{
+	const struct ip_set_hash *h = set->data;
+	ipset_adtfn adtfn = set->variant->adt[adt];
+	struct hash_uid4_elem data = { };
+	u32 uid, uid_to, timeout = h->timeout;
+	int ret = 0;
+
+	if (unlikely(!ip_set_attr_netorder(tb, IPSET_ATTR_UID) ||
+		     !ip_set_optattr_netorder(tb, IPSET_ATTR_UID_TO) ||
+		     !ip_set_optattr_netorder(tb, IPSET_ATTR_TIMEOUT)))
+		return -IPSET_ERR_PROTOCOL;
+
+	if (tb[IPSET_ATTR_LINENO])
+		*lineno = nla_get_u32(tb[IPSET_ATTR_LINENO]);
+
+	uid = ip_set_get_h32(tb[IPSET_ATTR_UID]);
+
+	if (tb[IPSET_ATTR_TIMEOUT]) {
+		if (!with_timeout(h->timeout))
+			return -IPSET_ERR_TIMEOUT;
+		timeout = ip_set_timeout_uget(tb[IPSET_ATTR_TIMEOUT]);
+	}
+
+	if (adt == IPSET_TEST || !tb[IPSET_ATTR_UID_TO]) {
+		data.uid = uid;
+		ret = adtfn(set, &data, timeout, flags);
+		return ip_set_eexist(ret, flags) ? 0 : ret;
+	}
+
+	uid_to = ip_set_get_h32(tb[IPSET_ATTR_UID_TO]);
+	if (uid > uid_to)
+		swap(uid, uid_to);
+
+	if (retried)
+		uid = h->next.uid;
+	for (; uid <= uid_to; uid++) {
+		data.uid = uid;
+		ret = adtfn(set, &data, timeout, flags);
+
+		if (ret && !ip_set_eexist(ret, flags))
+			return ret;
+		else
+			ret = 0;
+		/* Don't wrap around at UINT_MAX */
+		if (uid == uid_to)
+			break;
+	}
+	return ret;
+}
+
+static bool
+hash_uid_same_set(const struct ip_set *a, const struct ip_set *b)
+{
+	const struct ip_set_hash *x = a->data;
+	const struct ip_set_hash *y = b->data;
+
+	/* Resizing changes htable_bits, so we ignore it */
+	return x->maxelem == y->maxelem &&
+	       x->timeout == y->timeout;
+}
+
+/* Create hash:uid type of sets */
+
+static int
+hash_uid_create(struct ip_set *set, struct nlattr *tb[], u32 flags)
+{
+	u32 hashsize = IPSET_DEFAULT_HASHSIZE, maxelem = IPSET_DEFAULT_MAXELEM;
+	u8 hbits;
+	size_t hsize;
+	struct ip_set_hash *h;
+
+	if (unlikely(!ip_set_optattr_netorder(tb, IPSET_ATTR_HASHSIZE) ||
+		     !ip_set_optattr_netorder(tb, IPSET_ATTR_MAXELEM) ||
+		     !ip_set_optattr_netorder(tb, IPSET_ATTR_TIMEOUT)))
+		return -IPSET_ERR_PROTOCOL;
+
+	if (tb[IPSET_ATTR_HASHSIZE]) {
+		hashsize = ip_set_get_h32(tb[IPSET_ATTR_HASHSIZE]);
+		if (hashsize < IPSET_MIMINAL_HASHSIZE)
+			hashsize = IPSET_MIMINAL_HASHSIZE;
+	}
+
+	if (tb[IPSET_ATTR_MAXELEM])
+		maxelem = ip_set_get_h32(tb[IPSET_ATTR_MAXELEM]);
+
+	h = kzalloc(sizeof(*h), GFP_KERNEL);
+	if (!h)
+		return -ENOMEM;
+
+	h->maxelem = maxelem;
+	get_random_bytes(&h->initval, sizeof(h->initval));
+	h->timeout = IPSET_NO_TIMEOUT;
+
+	hbits = htable_bits(hashsize);
+	hsize = htable_size(hbits);
+	if (hsize == 0) {
+		kfree(h);
+		return -ENOMEM;
+	}
+	h->table = ip_set_alloc(hsize);
+	if (!h->table) {
+		kfree(h);
+		return -ENOMEM;
+	}
+	h->table->htable_bits = hbits;
+
+	set->data = h;
+
+	if (tb[IPSET_ATTR_TIMEOUT]) {
+		h->timeout = ip_set_timeout_uget(tb[IPSET_ATTR_TIMEOUT]);
+		set->variant = &hash_uid4_tvariant;
+		hash_uid4_gc_init(set);
+	} else {
+		set->variant = &hash_uid4_variant;
+	}
+
+	pr_debug("create %s hashsize %u (%u) maxelem %u: %p(%p)\n",
+		 set->name, jhash_size(h->table->htable_bits),
+		 h->table->htable_bits, h->maxelem, set->data, h->table);
+
+	return 0;
+}
+
+static struct ip_set_type hash_uid_type __read_mostly = {
+	.name		= "hash:uid",
+	.protocol	= IPSET_PROTOCOL,
+	.features	= IPSET_TYPE_UID,
+	.dimension	= IPSET_DIM_ONE,
+	.family		= NFPROTO_UNSPEC,
+	.revision_min	= 0,
+	.revision_max	= 0,
+	.create		= hash_uid_create,
+	.create_policy	= {
+		[IPSET_ATTR_HASHSIZE]	= { .type = NLA_U32 },
+		[IPSET_ATTR_MAXELEM]	= { .type = NLA_U32 },
+		[IPSET_ATTR_PROBES]	= { .type = NLA_U8 },
+		[IPSET_ATTR_RESIZE]	= { .type = NLA_U8  },
+		[IPSET_ATTR_TIMEOUT]	= { .type = NLA_U32 },
+	},
+	.adt_policy	= {
+		[IPSET_ATTR_UID]	= { .type = NLA_U32 },
+		[IPSET_ATTR_UID_TO]	= { .type = NLA_U32 },
+		[IPSET_ATTR_TIMEOUT]	= { .type = NLA_U32 },
+		[IPSET_ATTR_LINENO]	= { .type = NLA_U32 },
+	},
+	.me		= THIS_MODULE,
+};
+
+static int __init
+hash_uid_init(void)
+{
+	return ip_set_type_register(&hash_uid_type);
+}
+
+static void __exit
+hash_uid_fini(void)
+{
+	ip_set_type_unregister(&hash_uid_type);
+}
+
+module_init(hash_uid_init);
+module_exit(hash_uid_fini);
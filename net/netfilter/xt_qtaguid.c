@@ -282,10 +282,25 @@ static void sock_tag_tree_erase(struct rb_root *st_to_free_tree)
 			 get_uid_from_tag(st_entry->tag));
 		rb_erase(&st_entry->sock_node, st_to_free_tree);
 		sockfd_put(st_entry->socket);
-		kfree(st_entry);
+		kfree_rcu(st_entry, rcu);
 	}
 }
 
+/*
+ * Must be called with sock_tag_list_lock held, at the time the entry
+ * leaves sock_tag_tree, so that a new tag on the same socket can't be
+ * clobbered by a late unpublish.
+ */
+static void sock_tag_publish(struct sock_tag *st_entry)
+{
+	rcu_assign_pointer(st_entry->sk->sk_qtaguid_tag, st_entry);
+}
+
+static void sock_tag_unpublish(struct sock_tag *st_entry)
+{
+	RCU_INIT_POINTER(st_entry->sk->sk_qtaguid_tag, NULL);
+}
+
 static struct proc_qtu_data *proc_qtu_data_tree_search(struct rb_root *root,
 						       const pid_t pid)
 {
@@ -595,6 +610,9 @@ static int get_active_counter_set(tag_t tag)
 	return active_set;
 }
 
+/*
+ * Caller must hold either iface_stat_list_lock or rcu_read_lock().
+ */
 static struct iface_stat *get_iface_entry(const char *ifname)
 {
 	struct iface_stat *iface_entry;
@@ -606,7 +624,7 @@ static struct iface_stat *get_iface_entry(const char *ifname)
 	}
 
 	
-	list_for_each_entry(iface_entry, &iface_stat_list, list) {
+	list_for_each_entry_rcu(iface_entry, &iface_stat_list, list) {
 		if (!strcmp(ifname, iface_entry->ifname))
 			goto done;
 	}
@@ -633,9 +651,10 @@ static int pp_iface_stat_line(bool header, char *outp,
 			       "tx_other_bytes tx_other_packets\n"
 			);
 	} else {
-		struct data_counters *cnts;
+		struct data_counters totals;
+		struct data_counters *cnts = &totals;
 		int cnt_set = 0;   /* We only use one set for the device */
-		cnts = &iface_entry->totals_via_skb;
+		dc_fold_pcpu(cnts, iface_entry->totals_via_skb);
 		len = snprintf(
 			outp, char_count,
 			"%s "
@@ -823,7 +842,15 @@ static struct iface_stat *iface_alloc(struct net_device *net_dev)
 		kfree(new_iface);
 		return NULL;
 	}
-	spin_lock_init(&new_iface->tag_stat_list_lock);
+	new_iface->totals_via_skb = dc_alloc_pcpu(GFP_ATOMIC);
+	if (new_iface->totals_via_skb == NULL) {
+		pr_err("qtaguid: iface_stat: create(%s): "
+		       "counters alloc failed\n", net_dev->name);
+		kfree(new_iface->ifname);
+		kfree(new_iface);
+		return NULL;
+	}
+	rwlock_init(&new_iface->tag_stat_list_lock);
 	new_iface->tag_stat_tree = RB_ROOT;
 	_iface_stat_set_active(new_iface, net_dev, true);
 
@@ -832,6 +859,7 @@ static struct iface_stat *iface_alloc(struct net_device *net_dev)
 		pr_err("qtaguid: iface_stat: create(%s): "
 		       "work alloc failed\n", new_iface->ifname);
 		_iface_stat_set_active(new_iface, net_dev, false);
+		kfree(new_iface->totals_via_skb);
 		kfree(new_iface->ifname);
 		kfree(new_iface);
 		return NULL;
@@ -839,7 +867,8 @@ static struct iface_stat *iface_alloc(struct net_device *net_dev)
 	isw->iface_entry = new_iface;
 	INIT_WORK(&isw->iface_work, iface_create_proc_worker);
 	schedule_work(&isw->iface_work);
-	list_add(&new_iface->list, &iface_stat_list);
+	/* iface_stat entries are never freed, rcu only guards the list walk */
+	list_add_rcu(&new_iface->list, &iface_stat_list);
 	return new_iface;
 }
 
@@ -1015,16 +1044,22 @@ static struct sock_tag *get_sock_stat_nl(const struct sock *sk)
 	return sock_tag_tree_search(&sock_tag_tree, sk);
 }
 
-static struct sock_tag *get_sock_stat(const struct sock *sk)
+/*
+ * Packet path lookup: uses the tag attached to the socket instead of
+ * searching sock_tag_tree under sock_tag_list_lock.
+ * Caller must hold rcu_read_lock().
+ */
+static bool get_sock_tag_rcu(const struct sock *sk, tag_t *tag)
 {
 	struct sock_tag *sock_tag_entry;
-	MT_DEBUG("qtaguid: get_sock_stat(sk=%p)\n", sk);
+	MT_DEBUG("qtaguid: get_sock_tag_rcu(sk=%p)\n", sk);
 	if (!sk)
-		return NULL;
-	spin_lock_bh(&sock_tag_list_lock);
-	sock_tag_entry = get_sock_stat_nl(sk);
-	spin_unlock_bh(&sock_tag_list_lock);
-	return sock_tag_entry;
+		return false;
+	sock_tag_entry = rcu_dereference(sk->sk_qtaguid_tag);
+	if (!sock_tag_entry)
+		return false;
+	*tag = sock_tag_read(sock_tag_entry);
+	return true;
 }
 
 static int ipx_proto(const struct sk_buff *skb,
@@ -1048,10 +1083,18 @@ static int ipx_proto(const struct sk_buff *skb,
 	return tproto;
 }
 
+/*
+ * Must be called with bh disabled, which the x_tables core does for us
+ * on the match path.
+ */
 static void
-data_counters_update(struct data_counters *dc, int set,
+data_counters_update(struct data_counters_pcpu *pcpu, int set,
 		     enum ifs_tx_rx direction, int proto, int bytes)
 {
+	struct data_counters_pcpu *slot = &pcpu[smp_processor_id()];
+	struct data_counters *dc = &slot->dc;
+
+	u64_stats_update_begin(&slot->syncp);
 	switch (proto) {
 	case IPPROTO_TCP:
 		dc_add_byte_packets(dc, set, direction, IFS_TCP, bytes, 1);
@@ -1065,6 +1108,7 @@ data_counters_update(struct data_counters *dc, int set,
 				    1);
 		break;
 	}
+	u64_stats_update_end(&slot->syncp);
 }
 
 static void iface_stat_update(struct net_device *net_dev, bool stash_only)
@@ -1155,33 +1199,33 @@ static void iface_stat_update_from_skb(const struct sk_buff *skb,
 			 par->family, proto);
 	}
 
-	spin_lock_bh(&iface_stat_list_lock);
+	rcu_read_lock();
 	entry = get_iface_entry(el_dev->name);
 	if (entry == NULL) {
 		IF_DEBUG("qtaguid: iface_stat: %s(%s): not tracked\n",
 			 __func__, el_dev->name);
-		spin_unlock_bh(&iface_stat_list_lock);
+		rcu_read_unlock();
 		return;
 	}
 
 	IF_DEBUG("qtaguid: %s(%s): entry=%p\n", __func__,
 		 el_dev->name, entry);
 
-	data_counters_update(&entry->totals_via_skb, 0, direction, proto,
+	data_counters_update(entry->totals_via_skb, 0, direction, proto,
 			     bytes);
-	spin_unlock_bh(&iface_stat_list_lock);
+	rcu_read_unlock();
 }
 
 static void tag_stat_update(struct tag_stat *tag_entry,
 			enum ifs_tx_rx direction, int proto, int bytes)
 {
 	int active_set;
-	active_set = get_active_counter_set(tag_entry->tn.tag);
+	active_set = ACCESS_ONCE(tag_entry->active_set);
 	MT_DEBUG("qtaguid: tag_stat_update(tag=0x%llx (uid=%u) set=%d "
 		 "dir=%d proto=%d bytes=%d)\n",
 		 tag_entry->tn.tag, get_uid_from_tag(tag_entry->tn.tag),
 		 active_set, direction, proto, bytes);
-	data_counters_update(&tag_entry->counters, active_set, direction,
+	data_counters_update(tag_entry->counters, active_set, direction,
 			     proto, bytes);
 	if (tag_entry->parent_counters)
 		data_counters_update(tag_entry->parent_counters, active_set,
@@ -1200,7 +1244,15 @@ static struct tag_stat *create_if_tag_stat(struct iface_stat *iface_entry,
 		pr_err("qtaguid: iface_stat: tag stat alloc failed\n");
 		goto done;
 	}
+	new_tag_stat_entry->counters = dc_alloc_pcpu(GFP_ATOMIC);
+	if (!new_tag_stat_entry->counters) {
+		pr_err("qtaguid: iface_stat: tag stat counters alloc failed\n");
+		kfree(new_tag_stat_entry);
+		new_tag_stat_entry = NULL;
+		goto done;
+	}
 	new_tag_stat_entry->tn.tag = tag;
+	new_tag_stat_entry->active_set = get_active_counter_set(tag);
 	tag_stat_tree_insert(new_tag_stat_entry, &iface_entry->tag_stat_tree);
 done:
 	return new_tag_stat_entry;
@@ -1213,8 +1265,7 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 	struct tag_stat *tag_stat_entry;
 	tag_t tag, acct_tag;
 	tag_t uid_tag;
-	struct data_counters *uid_tag_counters;
-	struct sock_tag *sock_tag_entry;
+	struct data_counters_pcpu *uid_tag_counters;
 	struct iface_stat *iface_entry;
 	struct tag_stat *new_tag_stat = NULL;
 	MT_DEBUG("qtaguid: if_tag_stat_update(ifname=%s "
@@ -1222,20 +1273,19 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 		 ifname, uid, sk, direction, proto, bytes);
 
 
+	rcu_read_lock();
 	iface_entry = get_iface_entry(ifname);
 	if (!iface_entry) {
 		pr_err_ratelimited("qtaguid: iface_stat: stat_update() "
 				   "%s not found\n", ifname);
-		return;
+		goto out_rcu;
 	}
 	
 
 	MT_DEBUG("qtaguid: iface_stat: stat_update() dev=%s entry=%p\n",
 		 ifname, iface_entry);
 
-	sock_tag_entry = get_sock_stat(sk);
-	if (sock_tag_entry) {
-		tag = sock_tag_entry->tag;
+	if (get_sock_tag_rcu(sk, &tag)) {
 		acct_tag = get_atag_from_tag(tag);
 		uid_tag = get_utag_from_tag(tag);
 	} else {
@@ -1247,14 +1297,23 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 		 " looking for tag=0x%llx (uid=%u) in ife=%p\n",
 		 tag, get_uid_from_tag(tag), iface_entry);
 	
-	spin_lock_bh(&iface_entry->tag_stat_list_lock);
+	read_lock_bh(&iface_entry->tag_stat_list_lock);
+	tag_stat_entry = tag_stat_tree_search(&iface_entry->tag_stat_tree,
+					      tag);
+	if (tag_stat_entry) {
+		tag_stat_update(tag_stat_entry, direction, proto, bytes);
+		read_unlock_bh(&iface_entry->tag_stat_list_lock);
+		goto out_rcu;
+	}
+	read_unlock_bh(&iface_entry->tag_stat_list_lock);
 
+	write_lock_bh(&iface_entry->tag_stat_list_lock);
+	/* Somebody else might have added it while we were unlocked */
 	tag_stat_entry = tag_stat_tree_search(&iface_entry->tag_stat_tree,
 					      tag);
 	if (tag_stat_entry) {
 		tag_stat_update(tag_stat_entry, direction, proto, bytes);
-		spin_unlock_bh(&iface_entry->tag_stat_list_lock);
-		return;
+		goto unlock;
 	}
 
 	
@@ -1265,9 +1324,9 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 		new_tag_stat = create_if_tag_stat(iface_entry, uid_tag);
 		if (!new_tag_stat)
 			goto unlock;
-		uid_tag_counters = &new_tag_stat->counters;
+		uid_tag_counters = new_tag_stat->counters;
 	} else {
-		uid_tag_counters = &tag_stat_entry->counters;
+		uid_tag_counters = tag_stat_entry->counters;
 	}
 
 	if (acct_tag) {
@@ -1281,7 +1340,9 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 	}
 	tag_stat_update(new_tag_stat, direction, proto, bytes);
 unlock:
-	spin_unlock_bh(&iface_entry->tag_stat_list_lock);
+	write_unlock_bh(&iface_entry->tag_stat_list_lock);
+out_rcu:
+	rcu_read_unlock();
 }
 
 static int iface_netdev_event_handler(struct notifier_block *nb,
@@ -1844,6 +1905,7 @@ static int ctrl_cmd_delete(const char *input)
 
 		if (!acct_tag || st_entry->tag == tag) {
 			rb_erase(&st_entry->sock_node, &sock_tag_tree);
+			sock_tag_unpublish(st_entry);
 			
 			sock_tag_tree_insert(st_entry, &st_to_free_tree);
 			tr_entry = lookup_tag_ref(st_entry->tag, NULL);
@@ -1875,7 +1937,7 @@ static int ctrl_cmd_delete(const char *input)
 
 	spin_lock_bh(&iface_stat_list_lock);
 	list_for_each_entry(iface_entry, &iface_stat_list, list) {
-		spin_lock_bh(&iface_entry->tag_stat_list_lock);
+		write_lock_bh(&iface_entry->tag_stat_list_lock);
 		node = rb_first(&iface_entry->tag_stat_tree);
 		while (node) {
 			ts_entry = rb_entry(node, struct tag_stat, tn.node);
@@ -1896,10 +1958,11 @@ static int ctrl_cmd_delete(const char *input)
 					 entry_uid);
 				rb_erase(&ts_entry->tn.node,
 					 &iface_entry->tag_stat_tree);
+				kfree(ts_entry->counters);
 				kfree(ts_entry);
 			}
 		}
-		spin_unlock_bh(&iface_entry->tag_stat_list_lock);
+		write_unlock_bh(&iface_entry->tag_stat_list_lock);
 	}
 	spin_unlock_bh(&iface_stat_list_lock);
 
@@ -1936,6 +1999,9 @@ static int ctrl_cmd_counter_set(const char *input)
 	tag_t tag;
 	int res, argc;
 	struct tag_counter_set *tcs;
+	struct iface_stat *iface_entry;
+	struct rb_node *node;
+	struct tag_stat *ts_entry;
 	int counter_set;
 
 	argc = sscanf(input, "%c %d %u", &cmd, &counter_set, &uid);
@@ -1981,6 +2047,21 @@ static int ctrl_cmd_counter_set(const char *input)
 	}
 	tcs->active_set = counter_set;
 	spin_unlock_bh(&tag_counter_set_list_lock);
+
+	/* Refresh the copies the packet path uses instead of the tcs tree */
+	spin_lock_bh(&iface_stat_list_lock);
+	list_for_each_entry(iface_entry, &iface_stat_list, list) {
+		write_lock_bh(&iface_entry->tag_stat_list_lock);
+		for (node = rb_first(&iface_entry->tag_stat_tree);
+		     node;
+		     node = rb_next(node)) {
+			ts_entry = rb_entry(node, struct tag_stat, tn.node);
+			if (get_uid_from_tag(ts_entry->tn.tag) == uid)
+				ts_entry->active_set = counter_set;
+		}
+		write_unlock_bh(&iface_entry->tag_stat_list_lock);
+	}
+	spin_unlock_bh(&iface_stat_list_lock);
 	atomic64_inc(&qtu_events.counter_set_changes);
 	res = 0;
 
@@ -2068,7 +2149,9 @@ static int ctrl_cmd_tag(const char *input)
 		BUG_ON(IS_ERR_OR_NULL(prev_tag_ref_entry));
 		BUG_ON(prev_tag_ref_entry->num_sock_tags <= 0);
 		prev_tag_ref_entry->num_sock_tags--;
+		write_seqcount_begin(&sock_tag_entry->tag_seq);
 		sock_tag_entry->tag = full_tag;
+		write_seqcount_end(&sock_tag_entry->tag_seq);
 	} else {
 		CT_DEBUG("qtaguid: ctrl_tag(%s): newtag for sk=%p\n",
 			 input, el_socket->sk);
@@ -2087,6 +2170,7 @@ static int ctrl_cmd_tag(const char *input)
 		sock_tag_entry->pid = current->tgid;
 		sock_tag_entry->tag = combine_atag_with_uid(acct_tag,
 							    uid);
+		seqcount_init(&sock_tag_entry->tag_seq);
 		spin_lock_bh(&uid_tag_data_tree_lock);
 		pqd_entry = proc_qtu_data_tree_search(
 			&proc_qtu_data_tree, current->tgid);
@@ -2103,6 +2187,7 @@ static int ctrl_cmd_tag(const char *input)
 		spin_unlock_bh(&uid_tag_data_tree_lock);
 
 		sock_tag_tree_insert(sock_tag_entry, &sock_tag_tree);
+		sock_tag_publish(sock_tag_entry);
 		atomic64_inc(&qtu_events.sockets_tagged);
 	}
 	spin_unlock_bh(&sock_tag_list_lock);
@@ -2165,6 +2250,7 @@ static int ctrl_cmd_untag(const char *input)
 		goto err_put;
 	}
 	rb_erase(&sock_tag_entry->sock_node, &sock_tag_tree);
+	sock_tag_unpublish(sock_tag_entry);
 
 	tag_ref_entry = lookup_tag_ref(sock_tag_entry->tag, &utd_entry);
 	BUG_ON(!tag_ref_entry);
@@ -2188,7 +2274,7 @@ static int ctrl_cmd_untag(const char *input)
 		 atomic_long_read(&el_socket->file->f_count) - 1);
 	sockfd_put(el_socket);
 
-	kfree(sock_tag_entry);
+	kfree_rcu(sock_tag_entry, rcu);
 	atomic64_inc(&qtu_events.sockets_untagged);
 
 	return 0;
@@ -2275,7 +2361,8 @@ struct proc_print_info {
 static int pp_stats_line(struct proc_print_info *ppi, int cnt_set)
 {
 	int len;
-	struct data_counters *cnts;
+	struct data_counters totals;
+	struct data_counters *cnts = &totals;
 
 	if (!ppi->item_index) {
 		if (ppi->item_index++ < ppi->items_to_skip)
@@ -2307,7 +2394,7 @@ static int pp_stats_line(struct proc_print_info *ppi, int cnt_set)
 		}
 		if (ppi->item_index++ < ppi->items_to_skip)
 			return 0;
-		cnts = &ppi->ts_entry->counters;
+		dc_fold_pcpu(cnts, ppi->ts_entry->counters);
 		len = snprintf(
 			ppi->outp, ppi->char_count,
 			"%d %s 0x%llx %u %u "
@@ -2412,19 +2499,19 @@ static int qtaguid_stats_proc_read(char *page, char **num_items_returned,
 	spin_lock_bh(&iface_stat_list_lock);
 	list_for_each_entry(ppi.iface_entry, &iface_stat_list, list) {
 		struct rb_node *node;
-		spin_lock_bh(&ppi.iface_entry->tag_stat_list_lock);
+		read_lock_bh(&ppi.iface_entry->tag_stat_list_lock);
 		for (node = rb_first(&ppi.iface_entry->tag_stat_tree);
 		     node;
 		     node = rb_next(node)) {
 			ppi.ts_entry = rb_entry(node, struct tag_stat, tn.node);
 			if (!pp_sets(&ppi)) {
-				spin_unlock_bh(
+				read_unlock_bh(
 					&ppi.iface_entry->tag_stat_list_lock);
 				spin_unlock_bh(&iface_stat_list_lock);
 				return ppi.outp - page;
 			}
 		}
-		spin_unlock_bh(&ppi.iface_entry->tag_stat_list_lock);
+		read_unlock_bh(&ppi.iface_entry->tag_stat_list_lock);
 	}
 	spin_unlock_bh(&iface_stat_list_lock);
 
@@ -2545,6 +2632,7 @@ static int qtudev_release(struct inode *inode, struct file *file)
 		free_tag_ref_from_utd_entry(tr, utd_entry);
 
 		rb_erase(&st_entry->sock_node, &sock_tag_tree);
+		sock_tag_unpublish(st_entry);
 		list_del(&st_entry->list);
 		
 		sock_tag_tree_insert(st_entry, &st_to_free_tree);
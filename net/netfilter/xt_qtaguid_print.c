@@ -147,6 +147,7 @@ char *pp_tag_stat(struct tag_stat *ts)
 	char *tn_str;
 	char *counters_str;
 	char *parent_counters_str;
+	struct data_counters totals, parent_totals;
 	char *res;
 
 	if (!ts) {
@@ -155,8 +156,12 @@ char *pp_tag_stat(struct tag_stat *ts)
 		return res;
 	}
 	tn_str = pp_tag_node(&ts->tn);
-	counters_str = pp_data_counters(&ts->counters, true);
-	parent_counters_str = pp_data_counters(ts->parent_counters, false);
+	dc_fold_pcpu(&totals, ts->counters);
+	counters_str = pp_data_counters(&totals, true);
+	if (ts->parent_counters)
+		dc_fold_pcpu(&parent_totals, ts->parent_counters);
+	parent_counters_str = pp_data_counters(
+		ts->parent_counters ? &parent_totals : NULL, false);
 	res = kasprintf(GFP_ATOMIC,
 			"tag_stat@%p{%s, counters=%s, parent_counters=%s}",
 			ts, tn_str, counters_str, parent_counters_str);
@@ -173,7 +178,9 @@ char *pp_iface_stat(struct iface_stat *is)
 	if (!is) {
 		res = kasprintf(GFP_ATOMIC, "iface_stat@null{}");
 	} else {
-		struct data_counters *cnts = &is->totals_via_skb;
+		struct data_counters totals;
+		struct data_counters *cnts = &totals;
+		dc_fold_pcpu(cnts, is->totals_via_skb);
 		res = kasprintf(GFP_ATOMIC, "iface_stat@%p{"
 				"list=list_head{...}, "
 				"ifname=%s, "
@@ -509,14 +516,14 @@ void prdebug_iface_stat_list(int indent_level,
 		pr_debug("%*d: %s\n", indent_level*2, indent_level, str);
 		kfree(str);
 
-		spin_lock_bh(&iface_entry->tag_stat_list_lock);
+		read_lock_bh(&iface_entry->tag_stat_list_lock);
 		if (!RB_EMPTY_ROOT(&iface_entry->tag_stat_tree)) {
 			indent_level++;
 			prdebug_tag_stat_tree(indent_level,
 					      &iface_entry->tag_stat_tree);
 			indent_level--;
 		}
-		spin_unlock_bh(&iface_entry->tag_stat_list_lock);
+		read_unlock_bh(&iface_entry->tag_stat_list_lock);
 	}
 	indent_level--;
 	str = "}";
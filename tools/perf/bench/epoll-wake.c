@@ -0,0 +1,191 @@
+/*
+ *
+ * epoll-wake.c
+ *
+ * wake: Measure wakeups per event with several epoll instances
+ *
+ * Every thread has its own epoll instance watching the same eventfd.
+ * The main thread signals the eventfd once per loop and waits until
+ * one of the threads consumed the event.  Wakeups are counted as
+ * voluntary context switches of the waiters, since epoll_wait() goes
+ * back to sleep by itself when the event was already taken.  With
+ * --exclusive the fd is added with EPOLLEXCLUSIVE and only about one
+ * waiter should wake per event.
+ *
+ * Run it on the device: a host kernel has its own epoll, so its numbers
+ * say nothing about this tree.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE (1u << 28)
+#endif
+
+static int nthreads;
+static int loops = 10000;
+static bool exclusive;
+
+static int efd;
+static volatile int done;
+static volatile unsigned long consumed;
+
+struct waiter {
+	pthread_t thread;
+	int epfd;
+	unsigned long wakeups;
+	unsigned long missed;
+};
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nthreads,
+		    "Specify number of epoll waiters (default: online cpus)"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of events"),
+	OPT_BOOLEAN('x', "exclusive", &exclusive,
+		    "Add the fd with EPOLLEXCLUSIVE"),
+	OPT_END()
+};
+
+static const char * const bench_epoll_wake_usage[] = {
+	"perf bench epoll wake <options>",
+	NULL
+};
+
+static void *waiterfn(void *arg)
+{
+	struct waiter *w = arg;
+	struct epoll_event ev;
+	struct rusage start, stop;
+	u_int64_t val;
+
+	getrusage(RUSAGE_THREAD, &start);
+
+	while (!done) {
+		/* time out now and then to notice the end of the run */
+		if (epoll_wait(w->epfd, &ev, 1, 100) <= 0)
+			continue;
+		if (read(efd, &val, sizeof(val)) != sizeof(val)) {
+			w->missed++;
+			continue;
+		}
+		__sync_fetch_and_add(&consumed, val);
+	}
+
+	getrusage(RUSAGE_THREAD, &stop);
+	w->wakeups = stop.ru_nvcsw - start.ru_nvcsw;
+
+	return NULL;
+}
+
+int bench_epoll_wake(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long result_usec;
+	unsigned long wakeups = 0, missed = 0;
+	struct epoll_event ev;
+	struct waiter *waiter;
+	u_int64_t one = 1;
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_epoll_wake_usage, 0);
+	if (argc)
+		usage_with_options(bench_epoll_wake_usage, options);
+
+	if (nthreads <= 0)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (loops <= 0)
+		usage_with_options(bench_epoll_wake_usage, options);
+
+	efd = eventfd(0, EFD_NONBLOCK);
+	if (efd < 0)
+		die("eventfd");
+
+	waiter = calloc(nthreads, sizeof(*waiter));
+	if (!waiter)
+		die("calloc");
+
+	ev.events = EPOLLIN | (exclusive ? EPOLLEXCLUSIVE : 0);
+	ev.data.u64 = 0;
+	for (i = 0; i < nthreads; i++) {
+		waiter[i].epfd = epoll_create(1);
+		if (waiter[i].epfd < 0)
+			die("epoll_create");
+		if (epoll_ctl(waiter[i].epfd, EPOLL_CTL_ADD, efd, &ev))
+			die("epoll_ctl: %s", strerror(errno));
+		if (pthread_create(&waiter[i].thread, NULL, waiterfn,
+				   &waiter[i]))
+			die("pthread_create");
+	}
+
+	/* give the waiters time to block */
+	usleep(100000);
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < loops; i++) {
+		if (write(efd, &one, sizeof(one)) != sizeof(one))
+			die("write");
+		while (consumed <= (unsigned long)i)
+			;
+	}
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	result_usec = diff.tv_sec * 1000000ULL + diff.tv_usec;
+
+	done = 1;
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_join(waiter[i].thread, NULL))
+			die("pthread_join");
+		wakeups += waiter[i].wakeups;
+		missed += waiter[i].missed;
+		close(waiter[i].epfd);
+	}
+	close(efd);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d epoll waiters, %d events%s\n\n",
+		       nthreads, loops, exclusive ? ", EPOLLEXCLUSIVE" : "");
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lf usecs/event\n",
+		       (double)result_usec / (double)loops);
+		printf(" %14lf wakeups/event\n",
+		       (double)wakeups / (double)loops);
+		printf(" %14lu events already taken\n", missed);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lf\n", (double)wakeups / (double)loops);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(waiter);
+	return 0;
+}
@@ -0,0 +1,157 @@
+/*
+ *
+ * futex-hash.c
+ *
+ * hash: Stress the futex hash table
+ *
+ * Every thread loops over its own set of futexes doing FUTEX_WAIT with
+ * a value that never matches, so each call only hashes the key, takes
+ * and drops the bucket lock and returns -EWOULDBLOCK.  The result is
+ * the number of such operations per second.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+static int nthreads;
+static int nfutexes = 1024;
+static int runtime = 10;	/* seconds */
+static bool fshared;
+
+static volatile int done;
+static int futex_flag;
+
+struct worker {
+	pthread_t thread;
+	u_int32_t *futex;
+	unsigned long ops;
+};
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nthreads,
+		    "Specify number of threads (default: online cpus)"),
+	OPT_INTEGER('f', "futexes", &nfutexes,
+		    "Specify number of futexes per thread"),
+	OPT_INTEGER('r', "runtime", &runtime,
+		    "Specify runtime (in seconds)"),
+	OPT_BOOLEAN('s', "shared", &fshared,
+		    "Use shared futexes instead of private ones"),
+	OPT_END()
+};
+
+static const char * const bench_futex_hash_usage[] = {
+	"perf bench futex hash <options>",
+	NULL
+};
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long ops = 0;
+	int i;
+
+	while (!done) {
+		for (i = 0; i < nfutexes; i++, ops++) {
+			/* the value is 0, so this must fail right away */
+			if (futex_wait(&w->futex[i], 1234, futex_flag) != -1 ||
+			    errno != EAGAIN) {
+				fprintf(stderr, "futex_wait: unexpected result\n");
+				exit(1);
+			}
+		}
+	}
+
+	w->ops = ops;
+	return NULL;
+}
+
+int bench_futex_hash(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long total = 0;
+	struct worker *worker;
+	double secs;
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_hash_usage, 0);
+	if (argc)
+		usage_with_options(bench_futex_hash_usage, options);
+
+	if (nthreads <= 0)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nfutexes <= 0 || runtime <= 0)
+		usage_with_options(bench_futex_hash_usage, options);
+	if (!fshared)
+		futex_flag = FUTEX_PRIVATE_FLAG;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		die("calloc");
+
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < nthreads; i++) {
+		worker[i].futex = calloc(nfutexes, sizeof(u_int32_t));
+		if (!worker[i].futex)
+			die("calloc");
+		if (pthread_create(&worker[i].thread, NULL, workerfn,
+				   &worker[i]))
+			die("pthread_create");
+	}
+
+	sleep(runtime);
+	done = 1;
+
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_join(worker[i].thread, NULL))
+			die("pthread_join");
+		total += worker[i].ops;
+		free(worker[i].futex);
+	}
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	secs = diff.tv_sec + diff.tv_usec / 1000000.0;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d threads operating on %d %s futexes each\n\n",
+		       nthreads, nfutexes, fshared ? "shared" : "private");
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14.0lf ops/sec\n", total / secs);
+		printf(" %14.0lf ops/sec per thread\n",
+		       total / secs / nthreads);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.0lf\n", total / secs);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(worker);
+	return 0;
+}
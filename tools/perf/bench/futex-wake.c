@@ -0,0 +1,133 @@
+/*
+ *
+ * futex-wake.c
+ *
+ * wake: Wake up blocked futex waiters
+ *
+ * A number of threads block on a single futex, then the main thread
+ * wakes them (nwake at a time) and measures how long waking all of
+ * them takes.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+static int nthreads;
+static int nwakes = 1;
+static int loops = 10;
+static bool fshared;
+
+static u_int32_t futex1;
+static int futex_flag;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nthreads,
+		    "Specify number of waiters (default: online cpus)"),
+	OPT_INTEGER('w', "nwakes", &nwakes,
+		    "Specify number of waiters woken per call"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of loops"),
+	OPT_BOOLEAN('s', "shared", &fshared,
+		    "Use a shared futex instead of a private one"),
+	OPT_END()
+};
+
+static const char * const bench_futex_wake_usage[] = {
+	"perf bench futex wake <options>",
+	NULL
+};
+
+static void *waiterfn(void *arg __used)
+{
+	/* only a real wakeup returns 0, retry after signals */
+	while (futex_wait(&futex1, 0, futex_flag))
+		;
+	return NULL;
+}
+
+int bench_futex_wake(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long result_usec = 0;
+	pthread_t *waiter;
+	int i, j, ret, woken;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_wake_usage, 0);
+	if (argc)
+		usage_with_options(bench_futex_wake_usage, options);
+
+	if (nthreads <= 0)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nwakes <= 0 || loops <= 0)
+		usage_with_options(bench_futex_wake_usage, options);
+	if (!fshared)
+		futex_flag = FUTEX_PRIVATE_FLAG;
+
+	waiter = calloc(nthreads, sizeof(*waiter));
+	if (!waiter)
+		die("calloc");
+
+	for (j = 0; j < loops; j++) {
+		for (i = 0; i < nthreads; i++)
+			if (pthread_create(&waiter[i], NULL, waiterfn, NULL))
+				die("pthread_create");
+
+		/* give the waiters time to block */
+		usleep(100000);
+
+		woken = 0;
+		gettimeofday(&start, NULL);
+		while (woken < nthreads) {
+			ret = futex_wake(&futex1, nwakes, futex_flag);
+			if (ret < 0)
+				die("futex_wake");
+			woken += ret;
+		}
+		gettimeofday(&stop, NULL);
+		timersub(&stop, &start, &diff);
+		result_usec += diff.tv_sec * 1000000 + diff.tv_usec;
+
+		for (i = 0; i < nthreads; i++)
+			if (pthread_join(waiter[i], NULL))
+				die("pthread_join");
+	}
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Woke %d threads, %d per call, %d times\n\n",
+		       nthreads, nwakes, loops);
+
+		printf(" %14lf usecs to wake all waiters\n",
+		       (double)result_usec / (double)loops);
+		printf(" %14lf usecs per waiter\n",
+		       (double)result_usec / (double)loops / nthreads);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lf\n", (double)result_usec / (double)loops);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(waiter);
+	return 0;
+}
@@ -0,0 +1,31 @@
+/*
+ *
+ * futex.h
+ *
+ * Thin wrappers around the futex syscall for the futex benchmarks
+ *
+ */
+
+#ifndef _FUTEX_H
+#define _FUTEX_H
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <linux/futex.h>
+
+#define futex(uaddr, op, val, timeout, uaddr2, val3, opflags)		\
+	syscall(__NR_futex, uaddr, op | opflags, val, timeout, uaddr2, val3)
+
+static inline int
+futex_wait(u_int32_t *uaddr, u_int32_t val, int opflags)
+{
+	return futex(uaddr, FUTEX_WAIT, val, NULL, NULL, 0, opflags);
+}
+
+static inline int
+futex_wake(u_int32_t *uaddr, int nr_wake, int opflags)
+{
+	return futex(uaddr, FUTEX_WAKE, nr_wake, NULL, NULL, 0, opflags);
+}
+
+#endif /* _FUTEX_H */
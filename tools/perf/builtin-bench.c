@@ -13,6 +13,8 @@
  * Available subsystem list:
  *  sched ... scheduler and IPC mechanism
  *  mem   ... memory access performance
+ *  futex ... futex hash table and wakeup performance
+ *  epoll ... epoll wakeup behaviour
  *
  */
 
@@ -61,6 +63,29 @@ static struct bench_suite mem_suites[] = {
 	  NULL             }
 };
 
+static struct bench_suite futex_suites[] = {
+	{ "hash",
+	  "Benchmark for futex hash table",
+	  bench_futex_hash },
+	{ "wake",
+	  "Benchmark for futex wake calls",
+	  bench_futex_wake },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite epoll_suites[] = {
+	{ "wake",
+	  "Wakeups per event with several epoll waiters",
+	  bench_epoll_wake },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
 struct bench_subsys {
 	const char *name;
 	const char *summary;
@@ -74,6 +99,12 @@ static struct bench_subsys subsystems[] = {
 	{ "mem",
 	  "memory access performance",
 	  mem_suites },
+	{ "futex",
+	  "futex hash table and wakeup performance",
+	  futex_suites },
+	{ "epoll",
+	  "epoll wakeup behaviour",
+	  epoll_suites },
 	{ "all",		/* sentinel: easy for help */
 	  "test all subsystem (pseudo subsystem)",
 	  NULL },
@@ -0,0 +1,157 @@
+/*
+ * trace_pipe_mmap:
+ *
+ * While per_cpu/cpu0/trace_pipe_raw is mmapped, its events belong to the
+ * mapping.  trace_pipe and the trace iterator must neither hand them out
+ * nor spin on them, and they must still be there for the mapped reader.
+ *
+ * Needs root and debugfs mounted on /sys/kernel/debug.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <linux/trace_mmap.h>
+
+#define TRACING		"/sys/kernel/debug/tracing/"
+#define MARKER		"trace_pipe_mmap marker"
+#define TIMEOUT		10
+
+static int write_file(const char *name, const char *val)
+{
+	int fd, ret;
+
+	fd = open(name, O_WRONLY | O_TRUNC);
+	if (fd < 0)
+		return -1;
+	ret = write(fd, val, strlen(val));
+	close(fd);
+	return ret < 0 ? -1 : 0;
+}
+
+/* Read @name to EOF (or EAGAIN) and look for the marker */
+static int read_for_marker(const char *name, int flags)
+{
+	static char buf[65536];
+	int fd, found = 0;
+	ssize_t n;
+
+	fd = open(name, O_RDONLY | flags);
+	if (fd < 0) {
+		perror(name);
+		exit(2);
+	}
+	while ((n = read(fd, buf, sizeof(buf) - 1)) > 0) {
+		buf[n] = '\0';
+		if (strstr(buf, MARKER))
+			found = 1;
+	}
+	if (n < 0 && errno != EAGAIN) {
+		perror(name);
+		exit(2);
+	}
+	close(fd);
+	return found;
+}
+
+/* Run the read in a child so that a reader stuck in the kernel shows up */
+static int check_reader(const char *name, int flags)
+{
+	int status, i;
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		exit(2);
+	}
+	if (!pid)
+		exit(read_for_marker(name, flags));
+
+	for (i = 0; i < TIMEOUT * 10; i++) {
+		if (waitpid(pid, &status, WNOHANG) == pid) {
+			if (!WIFEXITED(status) || WEXITSTATUS(status) > 1) {
+				printf("FAIL: reading %s failed\n", name);
+				return 1;
+			}
+			if (WEXITSTATUS(status)) {
+				printf("FAIL: %s returned a mapped event\n",
+				       name);
+				return 1;
+			}
+			return 0;
+		}
+		usleep(100000);
+	}
+	printf("FAIL: %s did not return within %d seconds\n", name, TIMEOUT);
+	kill(pid, SIGKILL);
+	return 1;
+}
+
+int main(void)
+{
+	struct trace_buffer_meta *meta;
+	cpu_set_t cpus;
+	int fd, ret = 0;
+
+	if (access(TRACING "trace_marker", W_OK)) {
+		printf("trace_pipe_mmap: no tracing directory, skipped\n");
+		return 0;
+	}
+
+	CPU_ZERO(&cpus);
+	CPU_SET(0, &cpus);
+	if (sched_setaffinity(0, sizeof(cpus), &cpus)) {
+		perror("sched_setaffinity");
+		return 1;
+	}
+
+	write_file(TRACING "tracing_on", "0");
+	write_file(TRACING "trace", "");
+
+	fd = open(TRACING "per_cpu/cpu0/trace_pipe_raw", O_RDONLY);
+	if (fd < 0) {
+		perror("trace_pipe_raw");
+		return 1;
+	}
+	meta = mmap(NULL, getpagesize(), PROT_READ, MAP_SHARED, fd, 0);
+	if (meta == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	write_file(TRACING "tracing_on", "1");
+	if (write_file(TRACING "trace_marker", MARKER)) {
+		perror("trace_marker");
+		return 1;
+	}
+	write_file(TRACING "tracing_on", "0");
+
+	ret |= check_reader(TRACING "trace_pipe", O_NONBLOCK);
+	ret |= check_reader(TRACING "per_cpu/cpu0/trace_pipe", O_NONBLOCK);
+	ret |= check_reader(TRACING "per_cpu/cpu0/trace", 0);
+
+	if (ioctl(fd, TRACE_MMAP_IOCTL_GET_READER) < 0) {
+		perror("TRACE_MMAP_IOCTL_GET_READER");
+		return 1;
+	}
+	if (meta->reader.commit <= meta->reader.read) {
+		printf("FAIL: the marker did not reach the mapped reader\n");
+		ret = 1;
+	}
+
+	munmap(meta, getpagesize());
+	close(fd);
+
+	if (!ret)
+		printf("trace_pipe_mmap: PASS\n");
+	return ret;
+}